@@ -0,0 +1,29 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fixed-size bit sets stored as arrays of uint64_t words
+#define bitset_words(bits) \
+    (((bits) + 63) / 64)
+
+#define bitset_new(bits) \
+    ((uint64_t*) calloc(bitset_words(bits) + 1, sizeof(uint64_t)))
+
+#define bitset_set(set, index) \
+    ((set)[(index) / 64] |= (UINT64_C(1) << ((index) % 64)))
+
+#define bitset_clear(set, index) \
+    ((set)[(index) / 64] &= ~(UINT64_C(1) << ((index) % 64)))
+
+#define bitset_test(set, index) \
+    (((set)[(index) / 64] >> ((index) % 64)) & 1)
+
+#define bitset_copy(dest, src, words) \
+    memcpy((dest), (src), (words) * sizeof(uint64_t))
+
+// Iterates over every index set on <set>
+#define bitset_iterate(set, words, index) \
+    for (uint64_t _w = 0; _w < (words); _w++) \
+        for (uint64_t _bits = (set)[_w], index; _bits != 0 && ((index = _w * 64 + __builtin_ctzll(_bits)), 1); _bits &= _bits - 1)
@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "cfg.h"
+#include "bitset.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+/********************\
+ * Control-flow Graph *
+ \********************/
+int iloc_is_terminator(iloc_instruction_t *instruction) {
+    switch (instruction->instruction) {
+        case cbr:
+        case jump_i:
+        case jump:
+        case ret:
+        case tailcall:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+iloc_cfg_t iloc_cfg_build(iloc_program_t *program) {
+    iloc_cfg_t cfg;
+    nlist_init(iloc_block_t, cfg.blocks);
+    cfg.block_of = (uint64_t*) malloc((program->length+1) * sizeof(uint64_t));
+    if (cfg.block_of == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+
+    // Find the range of the labels, so they can be mapped with an array
+    int64_t label_min = INT64_MAX;
+    int64_t label_max = INT64_MIN;
+    for (uint64_t i = 0; i < program->length; i++) {
+        if (program->instructions[i].instruction == label) {
+            if (program->instructions[i].r1 < label_min) label_min = program->instructions[i].r1;
+            if (program->instructions[i].r1 > label_max) label_max = program->instructions[i].r1;
+        }
+    }
+    uint64_t label_range = label_min <= label_max ? (uint64_t) (label_max - label_min + 1) : 0;
+    int64_t *block_of_label = (int64_t*) malloc((label_range+1) * sizeof(int64_t));
+    if (block_of_label == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < label_range; i++) {
+        block_of_label[i] = -1;
+    }
+
+    // Leaders: the first instruction, every label and every instruction after a jump
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t *instruction = &program->instructions[i];
+        int leader = i == 0
+            || instruction->instruction == label
+            || iloc_is_terminator(&program->instructions[i-1]);
+        if (leader) {
+            iloc_block_t block;
+            block.start = i;
+            block.end = i;
+            nlist_init(uint64_t, block.successors);
+            nlist_init(uint64_t, block.predecessors);
+            nlist_insert(iloc_block_t, cfg.blocks, block);
+        }
+        iloc_block_t *current = &nlist_get_unsafe(cfg.blocks, cfg.blocks.length-1);
+        current->end = i+1;
+        cfg.block_of[i] = cfg.blocks.length-1;
+        if (instruction->instruction == label) {
+            block_of_label[instruction->r1 - label_min] = cfg.blocks.length-1;
+        }
+    }
+
+    // Edges
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+        iloc_instruction_t *last = &program->instructions[block->end-1];
+        int64_t targets[2];
+        uint64_t target_count = 0;
+        switch (last->instruction) {
+            case cbr:
+                targets[target_count++] = last->r2;
+                targets[target_count++] = last->r3;
+                break;
+            case jump_i:
+                targets[target_count++] = last->r1;
+                break;
+            case jump:
+            case ret:
+            case tailcall:
+                break;
+            default:
+                if (b+1 < cfg.blocks.length) {
+                    nlist_insert(uint64_t, block->successors, b+1);
+                }
+                break;
+        }
+        for (uint64_t t = 0; t < target_count; t++) {
+            int64_t target = targets[t] - label_min;
+            if (target < 0 || (uint64_t) target >= label_range || block_of_label[target] < 0) {
+                fprintf(stderr, "ERROR: Jump to an undefined label L%ld\n", targets[t]);
+                exit(EXIT_FAILURE);
+            }
+            // Both targets of a cbr may be the same block
+            if (t == 1 && targets[0] == targets[1]) {
+                continue;
+            }
+            nlist_insert(uint64_t, block->successors, block_of_label[target]);
+        }
+    }
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t successor = nlist_get_unsafe(block->successors, s);
+            nlist_insert(uint64_t, nlist_get_unsafe(cfg.blocks, successor).predecessors, b);
+        }
+    }
+
+    free(block_of_label);
+    return cfg;
+}
+
+void iloc_cfg_free(iloc_cfg_t *cfg) {
+    for (size_t b = 0; b < cfg->blocks.length; b++) {
+        nlist_free(nlist_get_unsafe(cfg->blocks, b).successors);
+        nlist_free(nlist_get_unsafe(cfg->blocks, b).predecessors);
+    }
+    nlist_free(cfg->blocks);
+    free(cfg->block_of);
+}
+
+uint64_t *iloc_cfg_loop_depth(iloc_cfg_t *cfg) {
+    uint64_t blocks = cfg->blocks.length;
+    int64_t *delta = (int64_t*) calloc(blocks+1, sizeof(int64_t));
+    uint64_t *depth = (uint64_t*) malloc((blocks+1) * sizeof(uint64_t));
+    if (delta == NULL || depth == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the loop depths (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < blocks; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t header = nlist_get_unsafe(block->successors, s);
+            if (header <= b) {
+                delta[header]++;
+                delta[b+1]--;
+            }
+        }
+    }
+    int64_t current = 0;
+    for (uint64_t b = 0; b < blocks; b++) {
+        current += delta[b];
+        depth[b] = current;
+    }
+    free(delta);
+    return depth;
+}
+
+void iloc_cfg_postorder(iloc_cfg_t *cfg, uint64_t block, int *visited, uint64_t *order, uint64_t *count) {
+    visited[block] = 1;
+    iloc_block_t *b = &nlist_get_unsafe(cfg->blocks, block);
+    for (size_t s = 0; s < b->successors.length; s++) {
+        uint64_t successor = nlist_get_unsafe(b->successors, s);
+        if (!visited[successor]) {
+            iloc_cfg_postorder(cfg, successor, visited, order, count);
+        }
+    }
+    order[(*count)++] = block;
+}
+
+/*
+ * Cooper, Harvey and Kennedy's iterative algorithm: the dominators of a block
+ * are the intersection of the ones of its predecessors, walking up the tree
+ * by postorder number
+ */
+int64_t *iloc_cfg_dominators(iloc_cfg_t *cfg) {
+    uint64_t blocks = cfg->blocks.length;
+    int64_t *idom = (int64_t*) malloc((blocks+1) * sizeof(int64_t));
+    int *visited = (int*) calloc(blocks+1, sizeof(int));
+    uint64_t *order = (uint64_t*) malloc((blocks+1) * sizeof(uint64_t));
+    uint64_t *number = (uint64_t*) malloc((blocks+1) * sizeof(uint64_t));
+    if (idom == NULL || visited == NULL || order == NULL || number == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the dominators (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-5);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < blocks; b++) {
+        idom[b] = -1;
+    }
+    if (blocks == 0) {
+        free(visited);
+        free(order);
+        free(number);
+        return idom;
+    }
+    uint64_t count = 0;
+    iloc_cfg_postorder(cfg, 0, visited, order, &count);
+    for (uint64_t i = 0; i < count; i++) {
+        number[order[i]] = i;
+    }
+    idom[0] = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t i = count-1; i-- > 0;) {
+            uint64_t b = order[i];
+            iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+            int64_t new_idom = -1;
+            for (size_t p = 0; p < block->predecessors.length; p++) {
+                int64_t other = nlist_get_unsafe(block->predecessors, p);
+                if (idom[other] < 0) {
+                    continue;
+                }
+                if (new_idom < 0) {
+                    new_idom = other;
+                    continue;
+                }
+                while (other != new_idom) {
+                    while (number[other] < number[new_idom]) {
+                        other = idom[other];
+                    }
+                    while (number[new_idom] < number[other]) {
+                        new_idom = idom[new_idom];
+                    }
+                }
+            }
+            if (idom[b] != new_idom) {
+                idom[b] = new_idom;
+                changed = 1;
+            }
+        }
+    }
+    free(visited);
+    free(order);
+    free(number);
+    return idom;
+}
+
+int iloc_cfg_dominates(int64_t *idom, uint64_t a, uint64_t b) {
+    if (idom[b] < 0) {
+        return 0;
+    }
+    while (b != a && b != 0) {
+        b = idom[b];
+    }
+    return b == a;
+}
+
+/********************\
+ * Register Numbering *
+ \********************/
+iloc_numbering_t iloc_numbering_build(iloc_program_t *program) {
+    iloc_numbering_t numbering;
+    int64_t *uses[3];
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t *instruction = &program->instructions[i];
+        uint64_t use_count = iloc_instruction_uses(instruction, uses);
+        for (uint64_t u = 0; u < use_count; u++) {
+            if (*uses[u] < min) min = *uses[u];
+            if (*uses[u] > max) max = *uses[u];
+        }
+        int64_t *def = iloc_instruction_def(instruction);
+        if (def != NULL) {
+            if (*def < min) min = *def;
+            if (*def > max) max = *def;
+        }
+    }
+    numbering.base = min <= max ? min : 0;
+    numbering.range = min <= max ? (uint64_t) (max - min + 1) : 0;
+    numbering.length = 0;
+    numbering.dense = (int64_t*) malloc((numbering.range+1) * sizeof(int64_t));
+    numbering.sparse = (int64_t*) malloc((numbering.range+1) * sizeof(int64_t));
+    if (numbering.dense == NULL || numbering.sparse == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < numbering.range; i++) {
+        numbering.dense[i] = -1;
+    }
+
+    // Registers are numbered in order of first appearance
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t *instruction = &program->instructions[i];
+        uint64_t use_count = iloc_instruction_uses(instruction, uses);
+        int64_t *def = iloc_instruction_def(instruction);
+        if (def != NULL) {
+            uses[use_count++] = def;
+        }
+        for (uint64_t u = 0; u < use_count; u++) {
+            int64_t *dense = &iloc_numbering_get(&numbering, *uses[u]);
+            if (*dense < 0) {
+                *dense = numbering.length;
+                numbering.sparse[numbering.length] = *uses[u];
+                numbering.length++;
+            }
+        }
+    }
+    return numbering;
+}
+
+void iloc_numbering_free(iloc_numbering_t *numbering) {
+    free(numbering->dense);
+    free(numbering->sparse);
+}
+
+/**********\
+ * Liveness *
+ \**********/
+iloc_liveness_t iloc_liveness_build(iloc_program_t *program, iloc_cfg_t *cfg, iloc_numbering_t *numbering) {
+    iloc_liveness_t liveness;
+    uint64_t blocks = cfg->blocks.length;
+    int64_t *uses[2];
+
+    // Find the registers that are read before being written in some block;
+    // all others die in the block that defines them and need no sets
+    liveness.index = (int64_t*) malloc((numbering->length+1) * sizeof(int64_t));
+    liveness.registers = (uint64_t*) malloc((numbering->length+1) * sizeof(uint64_t));
+    int64_t *defined_in = (int64_t*) malloc((numbering->length+1) * sizeof(int64_t));
+    if (liveness.index == NULL || liveness.registers == NULL || defined_in == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the liveness analysis (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    liveness.length = 0;
+    for (uint64_t v = 0; v < numbering->length; v++) {
+        liveness.index[v] = -1;
+        defined_in[v] = -1;
+    }
+    for (uint64_t b = 0; b < blocks; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        for (uint64_t i = block->start; i < block->end; i++) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            uint64_t use_count = iloc_instruction_uses(instruction, uses);
+            for (uint64_t u = 0; u < use_count; u++) {
+                int64_t reg = iloc_numbering_get(numbering, *uses[u]);
+                if (defined_in[reg] != (int64_t) b && liveness.index[reg] < 0) {
+                    liveness.index[reg] = liveness.length;
+                    liveness.registers[liveness.length] = reg;
+                    liveness.length++;
+                }
+            }
+            int64_t *def = iloc_instruction_def(instruction);
+            if (def != NULL) {
+                defined_in[iloc_numbering_get(numbering, *def)] = b;
+            }
+        }
+    }
+    free(defined_in);
+
+    uint64_t words = bitset_words(liveness.length);
+    liveness.words = words;
+    liveness.live_in = (uint64_t*) calloc(blocks * words + 1, sizeof(uint64_t));
+    liveness.live_out = (uint64_t*) calloc(blocks * words + 1, sizeof(uint64_t));
+    uint64_t *gen = (uint64_t*) calloc(blocks * words + 1, sizeof(uint64_t));
+    uint64_t *kill = (uint64_t*) calloc(blocks * words + 1, sizeof(uint64_t));
+    if (liveness.live_in == NULL || liveness.live_out == NULL || gen == NULL || kill == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+
+    // Upward-exposed uses and definitions of each block
+    for (uint64_t b = 0; b < blocks; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        uint64_t *block_gen = &gen[b * words];
+        uint64_t *block_kill = &kill[b * words];
+        for (uint64_t i = block->start; i < block->end; i++) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            uint64_t use_count = iloc_instruction_uses(instruction, uses);
+            for (uint64_t u = 0; u < use_count; u++) {
+                int64_t reg = liveness.index[iloc_numbering_get(numbering, *uses[u])];
+                if (reg >= 0 && !bitset_test(block_kill, reg)) {
+                    bitset_set(block_gen, reg);
+                }
+            }
+            int64_t *def = iloc_instruction_def(instruction);
+            if (def != NULL) {
+                int64_t reg = liveness.index[iloc_numbering_get(numbering, *def)];
+                if (reg >= 0) {
+                    bitset_set(block_kill, reg);
+                }
+            }
+        }
+    }
+
+    // Iterate backwards until a fixed point
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t b = blocks; b-- > 0;) {
+            iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+            uint64_t *out = &liveness.live_out[b * words];
+            uint64_t *in = &liveness.live_in[b * words];
+            for (size_t s = 0; s < block->successors.length; s++) {
+                uint64_t *successor_in = &liveness.live_in[nlist_get_unsafe(block->successors, s) * words];
+                for (uint64_t w = 0; w < words; w++) {
+                    out[w] |= successor_in[w];
+                }
+            }
+            for (uint64_t w = 0; w < words; w++) {
+                uint64_t new_in = gen[b * words + w] | (out[w] & ~kill[b * words + w]);
+                if (new_in != in[w]) {
+                    in[w] = new_in;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    free(gen);
+    free(kill);
+    return liveness;
+}
+
+void iloc_liveness_free(iloc_liveness_t *liveness) {
+    free(liveness->index);
+    free(liveness->registers);
+    free(liveness->live_in);
+    free(liveness->live_out);
+}
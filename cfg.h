@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/********************\
+* Control-flow Graph *
+\********************/
+/*
+ * This function splits the program into basic blocks and links them by the
+ * jumps and fall-throughs between them
+ */
+iloc_cfg_t iloc_cfg_build(iloc_program_t *program);
+
+/*
+ * This function frees the blocks of a control-flow graph
+ */
+void iloc_cfg_free(iloc_cfg_t *cfg);
+
+/*
+ * This function returns true if the instruction ends a basic block
+ */
+int iloc_is_terminator(iloc_instruction_t *instruction);
+
+/*
+ * This function returns the loop depth of each block: every back edge (a
+ * jump to an earlier block) encloses the blocks between its target and its
+ * source
+ */
+uint64_t *iloc_cfg_loop_depth(iloc_cfg_t *cfg);
+
+/*
+ * This function returns the immediate dominator of each block (the entry
+ * block dominates itself and unreachable blocks get -1)
+ */
+int64_t *iloc_cfg_dominators(iloc_cfg_t *cfg);
+
+/*
+ * This function returns true if every path from the entry to block <b>
+ * passes through block <a>
+ */
+int iloc_cfg_dominates(int64_t *idom, uint64_t a, uint64_t b);
+
+/********************\
+* Register Numbering *
+\********************/
+/*
+ * This function maps the virtual registers of the program to the dense range
+ * [0, length), so the analyses can index arrays instead of searching lists
+ */
+iloc_numbering_t iloc_numbering_build(iloc_program_t *program);
+
+/*
+ * This function returns the dense index of a virtual register
+ */
+#define iloc_numbering_get(numbering, id) ((numbering)->dense[(id) - (numbering)->base])
+
+void iloc_numbering_free(iloc_numbering_t *numbering);
+
+/**********\
+* Liveness *
+\**********/
+/*
+ * This function computes the registers live at the entry and exit of every
+ * block (indexed by their dense numbering)
+ */
+iloc_liveness_t iloc_liveness_build(iloc_program_t *program, iloc_cfg_t *cfg, iloc_numbering_t *numbering);
+
+void iloc_liveness_free(iloc_liveness_t *liveness);
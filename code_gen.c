@@ -9,15 +9,116 @@
 /**************\
  * Global state *
  \**************/
-uint64_t last_id = 1;
-scope_t *current_scope = NULL;
-scope_t *global_scope = NULL;
+// The compilation running on this thread (see compilation_activate)
+static _Thread_local compilation_t *compilation_active = NULL;
+// The namespace of the function compiled on this thread, if any
+static _Thread_local iloc_namespace_t *namespace_active = NULL;
+int optimization_level = 1;
+
+/*************\
+ * Compilation *
+ \*************/
+compilation_t *compilation_new() {
+    compilation_t *compilation = (compilation_t*) malloc(sizeof(compilation_t));
+    if (compilation == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for compilation_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    compilation->line = 1;
+    compilation->col = 1;
+    compilation->line_next = 1;
+    compilation->col_next = 1;
+    compilation->tree = NULL;
+    compilation->current_scope = NULL;
+    compilation->global_scope = NULL;
+    compilation->current_function = NULL;
+    compilation->module = NULL;
+    compilation->last_id = 1;
+    compilation->float_registers = NULL;
+    compilation->float_registers_capacity = 0;
+    return compilation;
+}
+
+void compilation_activate(compilation_t *compilation) {
+    compilation_active = compilation;
+}
+
+void compilation_free(compilation_t *compilation) {
+    if (compilation_active == compilation) {
+        compilation_active = NULL;
+    }
+    free(compilation->float_registers);
+    free(compilation);
+}
+
+void iloc_namespace_enter(iloc_namespace_t *namespace, compilation_t *compilation) {
+    namespace->compilation = compilation;
+    namespace->base = compilation->last_id;
+    namespace->last_id = compilation->last_id;
+    namespace->float_registers = NULL;
+    namespace->float_registers_capacity = 0;
+    namespace_active = namespace;
+}
+
+void iloc_namespace_leave(iloc_namespace_t *namespace) {
+    if (namespace_active == namespace) {
+        namespace_active = NULL;
+    }
+    free(namespace->float_registers);
+    namespace->float_registers = NULL;
+    namespace->float_registers_capacity = 0;
+}
 
 /******************************\
  * Intermediate Code Generation *
  \******************************/
+#define ILOC_INITIAL_CAPACITY 8
+
 uint64_t iloc_next_id() {
-    return last_id++;
+    if (namespace_active != NULL) {
+        return namespace_active->last_id++;
+    }
+    return compilation_active->last_id++;
+}
+
+/*
+ * Sets flags[index], growing the table if it is too small
+ */
+static void iloc_mark_float(uint8_t **flags, uint64_t *capacity, uint64_t index) {
+    if (index >= *capacity) {
+        uint64_t new_capacity = *capacity == 0 ? 64 : *capacity;
+        while (index >= new_capacity) {
+            new_capacity *= 2;
+        }
+        uint8_t *new_flags = (uint8_t*) realloc(*flags, new_capacity);
+        if (new_flags == NULL) {
+            fprintf(stderr, "ERROR: Failed to reallocate memory for uint8_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+            exit(EXIT_FAILURE);
+        }
+        memset(&new_flags[*capacity], 0, new_capacity - *capacity);
+        *flags = new_flags;
+        *capacity = new_capacity;
+    }
+    (*flags)[index] = 1;
+}
+
+uint64_t iloc_next_float_id() {
+    uint64_t id = iloc_next_id();
+    if (namespace_active != NULL) {
+        iloc_mark_float(&namespace_active->float_registers, &namespace_active->float_registers_capacity, id - namespace_active->base);
+    } else {
+        iloc_mark_float(&compilation_active->float_registers, &compilation_active->float_registers_capacity, id);
+    }
+    return id;
+}
+
+int iloc_is_float(uint64_t id) {
+    iloc_namespace_t *namespace = namespace_active;
+    if (namespace != NULL && id >= namespace->base) {
+        return id - namespace->base < namespace->float_registers_capacity && namespace->float_registers[id - namespace->base];
+    }
+    compilation_t *compilation = namespace != NULL ? namespace->compilation : compilation_active;
+    return id < compilation->float_registers_capacity && compilation->float_registers[id];
 }
 
 iloc_program_t *iloc_program_new() {
@@ -26,7 +127,7 @@ iloc_program_t *iloc_program_new() {
         fprintf(stderr, "Failed to allocate memory for iloc_program_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
         return NULL;
     }
-    iloc_instruction_t* iloc_instructions = (iloc_instruction_t*) malloc(0*sizeof(iloc_instruction_t));
+    iloc_instruction_t* iloc_instructions = (iloc_instruction_t*) malloc(ILOC_INITIAL_CAPACITY*sizeof(iloc_instruction_t));
     if (iloc_instructions == NULL) {
         free(iloc_program);
         fprintf(stderr, "Failed to allocate memory for iloc_instruction_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
@@ -34,6 +135,7 @@ iloc_program_t *iloc_program_new() {
     }
     iloc_program->instructions = iloc_instructions;
     iloc_program->length = 0;
+    iloc_program->capacity = ILOC_INITIAL_CAPACITY;
     return iloc_program;
 }
 
@@ -46,26 +148,38 @@ iloc_instruction_t iloc_instruction_new(iloc_instruction_type_t type, uint64_t r
     return instruction;
 }
 
-void iloc_program_push(iloc_program_t *program, iloc_instruction_t instruction) {
-    iloc_instruction_t *new_instructions = realloc(program->instructions, (program->length+1)*sizeof(iloc_instruction_t));
+/*
+ * Makes sure <program> can hold <length> instructions, growing it geometrically
+ */
+void iloc_program_reserve(iloc_program_t *program, uint64_t length) {
+    if (length <= program->capacity) {
+        return;
+    }
+    uint64_t new_capacity = program->capacity;
+    while (new_capacity < length) {
+        new_capacity = new_capacity * 2 + 1;
+    }
+    iloc_instruction_t *new_instructions = realloc(program->instructions, new_capacity*sizeof(iloc_instruction_t));
+    if (new_instructions == NULL) {
+        fprintf(stderr, "ERROR: Failed to reallocate memory for iloc_instruction_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
     program->instructions = new_instructions;
+    program->capacity = new_capacity;
+}
+
+void iloc_program_push(iloc_program_t *program, iloc_instruction_t instruction) {
+    iloc_program_reserve(program, program->length+1);
     program->instructions[program->length] = instruction;
     program->length++;
 }
 
 void iloc_push(iloc_program_t *program, iloc_instruction_type_t type, uint64_t r1, uint64_t r2, uint64_t r3) {
-    iloc_instruction_t *new_instructions = realloc(program->instructions, (program->length+1)*sizeof(iloc_instruction_t));
-    program->instructions = new_instructions;
-    program->instructions[program->length].instruction = type;
-    program->instructions[program->length].r1 = r1;
-    program->instructions[program->length].r2 = r2;
-    program->instructions[program->length].r3 = r3;
-    program->length++;
+    iloc_program_push(program, iloc_instruction_new(type, r1, r2, r3));
 }
 
 void iloc_program_append(iloc_program_t *dest, iloc_program_t *src) {
-    iloc_instruction_t *new_instructions = realloc(dest->instructions, (dest->length+src->length)*sizeof(iloc_instruction_t));
-    dest->instructions = new_instructions;
+    iloc_program_reserve(dest, dest->length+src->length);
     memcpy(&dest->instructions[dest->length], src->instructions, src->length * sizeof(iloc_instruction_t));
     dest->length += src->length;
 }
@@ -75,6 +189,264 @@ void iloc_program_free(iloc_program_t *program) {
     free(program);
 }
 
+uint64_t iloc_instruction_uses(iloc_instruction_t *instruction, int64_t **uses) {
+    switch (instruction->instruction) {
+        case add:
+        case sub:
+        case mult:
+        case _div:
+        case mod:
+        case cmp_lt:
+        case cmp_le:
+        case cmp_eq:
+        case cmp_ge:
+        case cmp_gt:
+        case cmp_ne:
+        case fadd:
+        case fsub:
+        case fmult:
+        case fdiv:
+        case fcmp_lt:
+        case fcmp_le:
+        case fcmp_eq:
+        case fcmp_ge:
+        case fcmp_gt:
+        case fcmp_ne:
+            uses[0] = &instruction->r1;
+            uses[1] = &instruction->r2;
+            return 2;
+        case store_ax:
+            uses[0] = &instruction->r1;
+            uses[1] = &instruction->r3;
+            return 2;
+        case rsub_i:
+        case i2i:
+        case store_ai_r:
+        case cbr:
+        case jump:
+        case push:
+        case ret:
+        case param:
+        case fstore_ai_r:
+        case f2f:
+        case i2f:
+        case f2i:
+        case fparam:
+            uses[0] = &instruction->r1;
+            return 1;
+        case load_ax:
+            uses[0] = &instruction->r2;
+            return 1;
+        case load_ai_r:
+        case load_i:
+        case fload_ai_r:
+        case fload_i:
+        case fgetparam:
+        case jump_i:
+        case label:
+        case pop:
+        case getparam:
+        case call:
+        case tailcall:
+            return 0;
+    }
+    return 0;
+}
+
+int64_t *iloc_instruction_def(iloc_instruction_t *instruction) {
+    switch (instruction->instruction) {
+        case add:
+        case sub:
+        case mult:
+        case _div:
+        case mod:
+        case rsub_i:
+        case load_ai_r:
+        case cmp_lt:
+        case cmp_le:
+        case cmp_eq:
+        case cmp_ge:
+        case cmp_gt:
+        case cmp_ne:
+        case call:
+        case fadd:
+        case fsub:
+        case fmult:
+        case fdiv:
+        case fload_ai_r:
+        case fcmp_lt:
+        case fcmp_le:
+        case fcmp_eq:
+        case fcmp_ge:
+        case fcmp_gt:
+        case fcmp_ne:
+        case load_ax:
+            return &instruction->r3;
+        case load_i:
+        case i2i:
+        case getparam:
+        case fload_i:
+        case f2f:
+        case i2f:
+        case f2i:
+        case fgetparam:
+            return &instruction->r2;
+        case pop:
+            return &instruction->r1;
+        case store_ai_r:
+        case cbr:
+        case jump_i:
+        case jump:
+        case label:
+        case push:
+        case ret:
+        case param:
+        case fstore_ai_r:
+        case fparam:
+        case tailcall:
+        case store_ax:
+            return NULL;
+    }
+    return NULL;
+}
+
+int64_t iloc_instruction_global(iloc_instruction_t *instruction, int *is_store) {
+    *is_store = 0;
+    switch (instruction->instruction) {
+        case load_ai_r:
+        case fload_ai_r:
+            return id_to_reg(instruction->r1) == rbss ? instruction->r2 : -1;
+        case load_ax:
+            return instruction->r1;
+        case store_ai_r:
+        case fstore_ai_r:
+            *is_store = 1;
+            return id_to_reg(instruction->r2) == rbss ? instruction->r3 : -1;
+        case store_ax:
+            *is_store = 1;
+            return instruction->r2;
+        default:
+            return -1;
+    }
+}
+
+iloc_function_t *iloc_function_new(char *name, type_t type, uint64_t function_label) {
+    iloc_function_t *function = (iloc_function_t*) malloc(sizeof(iloc_function_t));
+    if (function == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for iloc_function_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    function->name = strdup(name);
+    function->type = type;
+    function->function_label = function_label;
+    nlist_init(uint64_t, function->parameters);
+    function->code = iloc_program_new();
+    function->frame_size = 0;
+    function->callee_saved = 0;
+    function->frameless = 0;
+    function->shrink_wrapped = 0;
+    function->registers_saved = 0;
+    function->profiled = 0;
+    function->entry_count = 0;
+    nlist_init(iloc_block_count_t, function->block_counts);
+    return function;
+}
+
+void iloc_function_free(iloc_function_t *function) {
+    free(function->name);
+    nlist_free(function->parameters);
+    nlist_free(function->block_counts);
+    iloc_program_free(function->code);
+    free(function);
+}
+
+iloc_module_t *iloc_module_new() {
+    iloc_module_t *module = (iloc_module_t*) malloc(sizeof(iloc_module_t));
+    if (module == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for iloc_module_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    nlist_init(iloc_global_t, module->globals);
+    nlist_init(iloc_function_t*, module->functions);
+    nlist_init(double, module->constants);
+    nlist_init(uint8_t, module->data);
+    module->profile.file = NULL;
+    nlist_init(uint32_t, module->profile.description);
+    module->profile.file_data = 0;
+    module->profile.description_data = 0;
+    module->profile.counter_count = 0;
+    return module;
+}
+
+void iloc_module_free(iloc_module_t *module) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        iloc_function_free(nlist_get_unsafe(module->functions, i));
+    }
+    nlist_free(module->globals);
+    nlist_free(module->functions);
+    nlist_free(module->constants);
+    nlist_free(module->data);
+    nlist_free(module->profile.description);
+    free(module);
+}
+
+uint64_t iloc_module_constant(iloc_module_t *module, double value) {
+    for (size_t i = 0; i < module->constants.length; i++) {
+        if (memcmp(&nlist_get_unsafe(module->constants, i), &value, sizeof(double)) == 0) {
+            return i;
+        }
+    }
+    nlist_insert(double, module->constants, value);
+    return module->constants.length - 1;
+}
+
+iloc_global_t *iloc_module_find_global(iloc_module_t *module, uint64_t offset) {
+    for (size_t i = 0; i < module->globals.length; i++) {
+        if (nlist_get_unsafe(module->globals, i).offset == offset) {
+            return &nlist_get_unsafe(module->globals, i);
+        }
+    }
+    return NULL;
+}
+
+iloc_global_t *iloc_module_global_at(iloc_module_t *module, uint64_t offset) {
+    for (size_t i = 0; i < module->globals.length; i++) {
+        iloc_global_t *global = &nlist_get_unsafe(module->globals, i);
+        if (global->offset <= offset && offset < global->offset + global->size) {
+            return global;
+        }
+    }
+    return NULL;
+}
+
+uint64_t iloc_module_add_global(iloc_module_t *module, char *name, type_t type, uint64_t size) {
+    uint64_t offset = 0;
+    for (size_t i = 0; i < module->globals.length; i++) {
+        iloc_global_t *global = &nlist_get_unsafe(module->globals, i);
+        if (global->offset + global->size > offset) {
+            offset = global->offset + global->size;
+        }
+    }
+    iloc_global_t global;
+    global.name = name;
+    global.type = type;
+    global.offset = offset;
+    global.size = size;
+    global.alignment = sizeof_type(type);
+    global.local = 0;
+    nlist_insert(iloc_global_t, module->globals, global);
+    return offset;
+}
+
+iloc_function_t *iloc_module_find_function(iloc_module_t *module, uint64_t function_label) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        if (nlist_get_unsafe(module->functions, i)->function_label == function_label) {
+            return nlist_get_unsafe(module->functions, i);
+        }
+    }
+    return NULL;
+}
+
 iloc_register_t id_to_reg(uint64_t id) {
     switch (id) {
         case 0:
@@ -106,10 +478,91 @@ uint64_t reg_to_id(iloc_register_t reg) {
 void iloc_instruction_to_string(iloc_instruction_t *instruction) {
     switch (instruction->instruction) {
         case push:
-            fprintf(stdout, "push r%ld\n", instruction->r1); // r3 = r1 + r2
+            fprintf(stdout, "push r%ld\n", instruction->r1);
             break;
         case pop:
-            fprintf(stdout, "pop r%ld\n", instruction->r1); // r3 = r1 + r2
+            fprintf(stdout, "pop r%ld\n", instruction->r1);
+            break;
+        case mod:
+            fprintf(stdout, "mod r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3); // r3 = r1 % r2
+            break;
+        case ret:
+            fprintf(stdout, "ret r%ld\n", instruction->r1);
+            break;
+        case i2i:
+            fprintf(stdout, "i2i r%ld => r%ld\n", instruction->r1, instruction->r2); // r2 = r1
+            break;
+        case getparam:
+            fprintf(stdout, "getparam %ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case param:
+            fprintf(stdout, "param r%ld, %ld\n", instruction->r1, instruction->r2);
+            break;
+        case call:
+            fprintf(stdout, "call L%ld, %ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case tailcall:
+            fprintf(stdout, "tailcall L%ld, %ld\n", instruction->r1, instruction->r2);
+            break;
+        case load_ax:
+            fprintf(stdout, "loadAX %ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case store_ax:
+            fprintf(stdout, "storeAX r%ld => %ld, r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fadd:
+            fprintf(stdout, "fadd r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fsub:
+            fprintf(stdout, "fsub r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fmult:
+            fprintf(stdout, "fmult r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fdiv:
+            fprintf(stdout, "fdiv r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fload_i:
+            fprintf(stdout, "floadI %ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case fload_ai_r:
+            fprintf(stdout, "floadAI %ld, %ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fstore_ai_r:
+            fprintf(stdout, "fstoreAI r%ld => %ld, %ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case f2f:
+            fprintf(stdout, "f2f r%ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case i2f:
+            fprintf(stdout, "i2f r%ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case f2i:
+            fprintf(stdout, "f2i r%ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case fcmp_lt:
+            fprintf(stdout, "fcmp_LT r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fcmp_le:
+            fprintf(stdout, "fcmp_LE r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fcmp_eq:
+            fprintf(stdout, "fcmp_EQ r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fcmp_ge:
+            fprintf(stdout, "fcmp_GE r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fcmp_gt:
+            fprintf(stdout, "fcmp_GT r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fcmp_ne:
+            fprintf(stdout, "fcmp_NE r%ld, r%ld -> r%ld\n", instruction->r1, instruction->r2, instruction->r3);
+            break;
+        case fgetparam:
+            fprintf(stdout, "fgetparam %ld => r%ld\n", instruction->r1, instruction->r2);
+            break;
+        case fparam:
+            fprintf(stdout, "fparam r%ld, %ld\n", instruction->r1, instruction->r2);
             break;
         case add:
             fprintf(stdout, "add r%ld, r%ld => r%ld\n", instruction->r1, instruction->r2, instruction->r3); // r3 = r1 + r2
@@ -226,7 +679,10 @@ ast_t *ast_new(ast_label_t label) {
     ast->children = children;
     ast->lexeme = NULL;
     ast->type = type_undefined;
-    nlist_init(char*, ast->_program);
+    ast->code = iloc_program_new();
+    ast->value = 0;
+    ast->register_need = 1;
+    ast->has_call = 0;
     return ast;
 }
 
@@ -251,83 +707,71 @@ void ast_push(ast_t *parent, ast_t *child) {
 /********************\
  * Reduction Handlers *
  \********************/
-char *current_function;
-void reduce_push_scope() {
-    if (current_scope == NULL) {
-        current_scope = scope_new(current_scope, strdup("global_scope"));
-    } else if (current_scope->parent == NULL) {
-        current_scope = scope_new(current_scope, strdup(current_function));
+void reduce_push_scope(compilation_t *compilation) {
+    if (compilation->current_scope == NULL) {
+        compilation->current_scope = scope_new(compilation->current_scope, strdup("global_scope"));
+    } else if (compilation->current_scope->parent == NULL) {
+        compilation->current_scope = scope_new(compilation->current_scope, strdup(compilation->current_function));
     } else {
-        current_scope = scope_new(current_scope, strdup("inner_scope"));
+        compilation->current_scope = scope_new(compilation->current_scope, strdup("inner_scope"));
     }
-    if (current_scope->parent == NULL) {
-        global_scope = current_scope;
+    if (compilation->current_scope->parent == NULL) {
+        compilation->global_scope = compilation->current_scope;
+        compilation->module = iloc_module_new();
     }
 }
 
-void reduce_pop_scope() {
-    if (current_scope == global_scope) {
+void reduce_pop_scope(compilation_t *compilation) {
+    if (compilation->current_scope == compilation->global_scope) {
         return;
     }
-    print_scope(stderr, current_scope);
-    scope_t *temp_scope = current_scope;
-    current_scope = current_scope->parent;
+    print_scope(stderr, compilation->current_scope);
+    scope_t *temp_scope = compilation->current_scope;
+    compilation->current_scope = compilation->current_scope->parent;
     scope_free(temp_scope);
-    if (current_scope == NULL) {
-        global_scope = NULL;
+    if (compilation->current_scope == NULL) {
+        compilation->global_scope = NULL;
     }
 }
 
-char str_buffer[16*1024];
-#define asm_push(list, ...) sprintf(str_buffer, __VA_ARGS__); nlist_insert(char*, list, strdup(str_buffer))
-#define asm_append(list, other) for (size_t i = 0; i < other.length; i++) { nlist_insert(char*, list, strdup(other.items[i])); }
-
-ast_t *reduce_program(ast_t *global_list) {
-    name_entry_t *entry = scope_find(current_scope, "main");
+ast_t *reduce_program(compilation_t *compilation, ast_t *global_list) {
+    name_entry_t *entry = scope_find(compilation->current_scope, "main");
     if (global_list->value == 0) {
         fprintf(stderr, "ERRO: O programa compilado nao contem a funcao \"main\"\n");
         exit(ERR_ENTRY);
     }
 
     ast_t *program = ast_new(ast_program);
-    asm_push(program->_program, ".text\n");
+    ast_push(program, global_list);
 
-    list_iterate(global_scope->entries, i) {
-        if (list_get_as(global_scope->entries, i, name_entry_t)->nature != nat_identifier) {
+    list_iterate(compilation->global_scope->entries, i) {
+        name_entry_t *global = list_get_as(compilation->global_scope->entries, i, name_entry_t);
+        if (global->nature != nat_identifier) {
             continue;
         }
-        char *txt = list_get_as(global_scope->entries, i, name_entry_t)->lexeme->lex_ident_t.value;
-        // fprintf(stderr, "%s\n", txt);
-        asm_push(program->_program, ".globl %s\n", txt);
-        asm_push(program->_program, ".bss\n");
-        asm_push(program->_program, ".align 4\n");
-        asm_push(program->_program, ".type %s, @object\n", txt);
-        asm_push(program->_program, ".size %s, 4\n", txt);
-        asm_push(program->_program, "%s:\n", txt);
-        asm_push(program->_program, ".zero 4\n");
+        iloc_global_t iloc_global;
+        iloc_global.name = global->lexeme->lex_ident_t.value;
+        iloc_global.type = global->type;
+        iloc_global.offset = global->offset;
+        iloc_global.size = sizeof_type(global->type);
+        iloc_global.alignment = sizeof_type(global->type);
+        iloc_global.local = 0;
+        nlist_insert(iloc_global_t, compilation->module->globals, iloc_global);
     }
 
-    asm_push(program->_program, ".text\n");
-    asm_push(program->_program, ".globl main\n");
-    asm_push(program->_program, ".type main, @function\n");
-
-    asm_append(program->_program, global_list->_program);
-
-    asm_push(program->_program, ".section .note.GNU-stack,\"\",@progbits\n");
-
-
     return program;
 }
 
-ast_t *reduce_global_list_empty() {
+ast_t *reduce_global_list_empty(compilation_t *compilation) {
+    (void) compilation;
     return ast_new(ast_global_list);
 }
 
-ast_t *reduce_global_list_variable(ast_t *global_list, type_t type, list_t *names) {
+ast_t *reduce_global_list_variable(compilation_t *compilation, ast_t *global_list, type_t type, list_t *names) {
     // Iterates over names on the list and takes ownership of the items
     list_iterate(names, i) {
         lexeme_t *lexeme = list_get_as(names, i, lexeme_t);
-        int var_res = register_variable(current_scope, type, lexeme);
+        int var_res = register_variable(compilation->current_scope, type, lexeme);
         if (var_res != 0) {
             fprintf(stderr, "- Contexto: na declaracao de variavel global\n");
             fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", lexeme->lex_ident_t.line, lexeme->lex_ident_t.column);
@@ -349,43 +793,70 @@ ast_t *reduce_global_list_variable(ast_t *global_list, type_t type, list_t *name
     return global_list;
 }
 
-ast_t *reduce_global_list_function(ast_t *global_list, ast_t *function_header, ast_t *commands) {
+/*
+ * Converts the value to the float (cvtsi2sd) or integer (truncating) form,
+ * returning the register that holds it (the same one if it already is)
+ */
+uint64_t reduce_convert(iloc_program_t *code, uint64_t value, int to_float) {
+    if (iloc_is_float(value) == to_float) {
+        return value;
+    }
+    uint64_t converted = to_float ? iloc_next_float_id() : iloc_next_id();
+    iloc_push(code, to_float ? i2f : f2i, value, converted, 0);
+    return converted;
+}
+
+/*
+ * Returns a register holding 1 if the value is true and 0 otherwise (floats
+ * are true when different from zero)
+ */
+uint64_t reduce_truth(compilation_t *compilation, iloc_program_t *code, uint64_t value) {
+    if (!iloc_is_float(value)) {
+        return value;
+    }
+    uint64_t zero = iloc_next_float_id();
+    uint64_t truth = iloc_next_id();
+    iloc_push(code, fload_i, iloc_module_constant(compilation->module, 0.0), zero, 0);
+    iloc_push(code, fcmp_ne, value, zero, truth);
+    return truth;
+}
+
+ast_t *reduce_global_list_function(compilation_t *compilation, ast_t *global_list, ast_t *function_header, ast_t *commands) {
     ast_t *node = ast_new(ast_func_decl);
     node->type = function_header->type;
     ast_push(node, function_header);
     ast_push(node, commands);
     ast_push(global_list, node);
     // ILOC
-    name_entry_t *entry = scope_find(current_scope, function_header->lexeme->lex_ident_t.value);
-    asm_push(node->_program, "%s:\n", function_header->lexeme->lex_ident_t.value);
-    asm_push(node->_program, "endbr64\n");
-    asm_push(node->_program, "pushq %%rbp\n");
-    asm_push(node->_program, "movq %%rsp, %%rbp\n");
-
-    asm_push(node->_program, "movq $%lu, %%rax\n", current_scope->size);
-    asm_push(node->_program, "subq %%rax, %%rbp\n");
-
-    asm_append(node->_program, commands->_program);
-    asm_push(node->_program, "movl $1, %%eax\n");
-    asm_push(node->_program, "popq %%rbp\n");
-    asm_push(node->_program, "ret\n");
-
-    asm_append(global_list->_program, node->_program);
+    name_entry_t *entry = scope_find(compilation->current_scope, function_header->lexeme->lex_ident_t.value);
+    iloc_function_t *function = iloc_function_new(function_header->lexeme->lex_ident_t.value, function_header->type, entry->function_label);
+    for (uint64_t i = 0; i < function_header->length; i++) {
+        nlist_insert(uint64_t, function->parameters, function_header->children[i]->value);
+        uint64_t parameter = function_header->children[i]->value;
+        iloc_push(function->code, iloc_is_float(parameter) ? fgetparam : getparam, i, parameter, iloc_operand_register);
+    }
+    iloc_program_append(function->code, commands->code);
+    // Falling off the end of a function returns 1
+    uint64_t temp_val_1 = iloc_next_id();
+    iloc_push(function->code, load_i, 1, temp_val_1, 0);
+    temp_val_1 = reduce_convert(function->code, temp_val_1, function->type == type_float);
+    iloc_push(function->code, ret, temp_val_1, 0, 0);
+    nlist_insert(iloc_function_t*, compilation->module->functions, function);
 
     if (strcmp(function_header->lexeme->lex_ident_t.value, "main") == 0) {
         global_list->value = entry->function_label;
     }
 
-    reduce_pop_scope();
+    reduce_pop_scope(compilation);
 
     // Return
     return global_list;
 }
 
-ast_t *reduce_function_header(list_t *parameters, type_t type, lexeme_t *name) {
-    current_function = name->lex_ident_t.value;
-    reduce_push_scope();
-    int var_res = register_function(current_scope->parent, type, name);
+ast_t *reduce_function_header(compilation_t *compilation, list_t *parameters, type_t type, lexeme_t *name) {
+    compilation->current_function = name->lex_ident_t.value;
+    reduce_push_scope(compilation);
+    int var_res = register_function(compilation->current_scope->parent, type, name);
     if (var_res != 0) {
         fprintf(stderr, "- Contexto: na declaracao de funcao\n");
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", name->lex_ident_t.line, name->lex_ident_t.column);
@@ -402,7 +873,7 @@ ast_t *reduce_function_header(list_t *parameters, type_t type, lexeme_t *name) {
     header->lexeme = name;
     list_iterate(parameters, i) {
         ast_t *argument = list_get_as(parameters, i, ast_t);
-        int var_res = register_variable(current_scope, argument->type, argument->lexeme);
+        int var_res = register_variable(compilation->current_scope, argument->type, argument->lexeme);
         if (var_res != 0) {
             fprintf(stderr, "- Contexto: na declaracao de parametro da funcao \"%s\"\n", name->lex_ident_t.value);
             fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", argument->lexeme->lex_ident_t.line, argument->lexeme->lex_ident_t.column);
@@ -413,30 +884,35 @@ ast_t *reduce_function_header(list_t *parameters, type_t type, lexeme_t *name) {
             }
             exit(ERR_DECLARED);
         }
+        // The parameter lives in its own virtual register
+        argument->value = scope_find(compilation->current_scope, argument->lexeme->lex_ident_t.value)->virtual_register;
+        nlist_insert(type_t, scope_find(compilation->current_scope->parent, name->lex_ident_t.value)->parameter_types, argument->type);
         ast_push(header, argument);
     }
     list_free(parameters);
     return header;
 }
 
-ast_t *reduce_variable(type_t type, lexeme_t *name) {
+ast_t *reduce_variable(compilation_t *compilation, type_t type, lexeme_t *name) {
+    (void) compilation;
     ast_t *variable = ast_new(ast_var_decl);
     variable->type = type;
     variable->lexeme = name;
     return variable;
 }
 
-ast_t *reduce_command_empty() {
+ast_t *reduce_command_empty(compilation_t *compilation) {
+    (void) compilation;
     return ast_new(ast_command_list);
 }
 
-ast_t *reduce_command_variable(ast_t *commands, type_t type, list_t *names) {
+ast_t *reduce_command_variable(compilation_t *compilation, ast_t *commands, type_t type, list_t *names) {
     list_iterate(names, i) {
         lexeme_t *lexeme = list_get_as(names, i, lexeme_t);
-        int var_res = register_variable(current_scope, type, lexeme);
+        int var_res = register_variable(compilation->current_scope, type, lexeme);
         if (var_res != 0) {
-            fprintf(stderr, "- Contexto: dentro da funcao \"%s\"\n", 
-                    list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+            fprintf(stderr, "- Contexto: dentro da funcao \"%s\"\n",
+                    list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
             fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", lexeme->lex_ident_t.line, lexeme->lex_ident_t.column);
             if (var_res == 1) {
                 fprintf(stderr, "- Contexto: previamente declarado como variavel\n");
@@ -454,20 +930,20 @@ ast_t *reduce_command_variable(ast_t *commands, type_t type, list_t *names) {
     return commands;
 }
 
-ast_t *reduce_command_assignment(ast_t *commands, lexeme_t *name, ast_t *expr) {
-    name_entry_t *entry = scope_find(current_scope, name->lex_ident_t.value);
+ast_t *reduce_command_assignment(compilation_t *compilation, ast_t *commands, lexeme_t *name, ast_t *expr) {
+    name_entry_t *entry = scope_find(compilation->current_scope, name->lex_ident_t.value);
     if (entry == NULL) {
         fprintf(stderr, "ERRO: a variavel \"%s\" foi utilizada antes de ser declarada\n", name->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", name->lex_ident_t.line, name->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma atribuicao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_UNDECLARED);
     }
     if (entry->nature != nat_identifier) {
         fprintf(stderr, "ERRO: a funcao \"%s\" foi utilizada como variavel\n", name->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", name->lex_ident_t.line, name->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma atribuicao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_FUNCTION);
     }
     ast_t *assignment = ast_new(ast_assignment);
@@ -475,40 +951,63 @@ ast_t *reduce_command_assignment(ast_t *commands, lexeme_t *name, ast_t *expr) {
     ast_push(assignment, expr);
     ast_push(commands, assignment);
     // ILOC
-    asm_append(assignment->_program, expr->_program);
-    asm_push(assignment->_program, "// assignment (%s)\n", entry->lexeme->lex_ident_t.value);
+    iloc_program_append(assignment->code, expr->code);
+    int is_float = entry->type == type_float;
+    uint64_t value = reduce_convert(assignment->code, expr->value, is_float);
     switch (entry->base_register) {
         case rbss:
-            asm_push(assignment->_program, "movl %%eax, %s(%%rip)\n", entry->lexeme->lex_ident_t.value);
+            iloc_push(assignment->code, is_float ? fstore_ai_r : store_ai_r, value, reg_to_id(rbss), entry->offset);
             break;
         case rfp:
-            asm_push(assignment->_program, "movl %%eax, -%lu(%%rbp)\n", entry->offset);
+            iloc_push(assignment->code, is_float ? f2f : i2i, value, entry->virtual_register, 0);
             break;
         default:
             fprintf(stderr, "Register error #1\n");
             exit(EXIT_FAILURE);
             break;
     }
-    asm_append(commands->_program, assignment->_program);
+    iloc_program_append(commands->code, assignment->code);
     // Return
     return commands;
 }
 
-ast_t *reduce_command_call(ast_t *commands, lexeme_t *name, list_t *arguments) {
+/*
+ * Evaluates the arguments of the call (children of <node>) in order, then passes
+ * them and calls the function, whose result is left in a new temporary
+ */
+void reduce_call(ast_t *node, name_entry_t *entry) {
+    uint64_t arguments[node->length+1];
+    for (uint64_t i = 0; i < node->length; i++) {
+        iloc_program_append(node->code, node->children[i]->code);
+        arguments[i] = node->children[i]->value;
+        if (i < entry->parameter_types.length) {
+            arguments[i] = reduce_convert(node->code, arguments[i], nlist_get_unsafe(entry->parameter_types, i) == type_float);
+        }
+    }
+    // The arguments are moved to the ABI registers all at once, right before the call
+    for (uint64_t i = 0; i < node->length; i++) {
+        iloc_push(node->code, iloc_is_float(arguments[i]) ? fparam : param, arguments[i], i, iloc_operand_register);
+    }
+    node->value = entry->type == type_float ? iloc_next_float_id() : iloc_next_id();
+    node->has_call = 1;
+    iloc_push(node->code, call, entry->function_label, node->length, node->value);
+}
+
+ast_t *reduce_command_call(compilation_t *compilation, ast_t *commands, lexeme_t *name, list_t *arguments) {
     ast_t *call = ast_new(ast_call);
-    name_entry_t *entry = scope_find(current_scope, name->lex_ident_t.value);
+    name_entry_t *entry = scope_find(compilation->current_scope, name->lex_ident_t.value);
     if (entry == NULL) {
         fprintf(stderr, "ERRO: a funcao \"%s\" foi utilizada antes de ser declarada\n", name->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", name->lex_ident_t.line, name->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma chamada de funcao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_UNDECLARED);
     }
     if (entry->nature != nat_function) {
         fprintf(stderr, "ERRO: a variavel \"%s\" foi utilizada como funcao\n", name->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", name->lex_ident_t.line, name->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma chamada de funcao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_VARIABLE);
     }
     call->type = entry->type;
@@ -519,55 +1018,56 @@ ast_t *reduce_command_call(ast_t *commands, lexeme_t *name, list_t *arguments) {
     }
     list_free(arguments);
     ast_push(commands, call);
-    // TODO - Didio: write iloc code to handle calls
+    // ILOC
+    reduce_call(call, entry);
+    iloc_program_append(commands->code, call->code);
     return commands;
 }
 
-ast_t *reduce_command_return(ast_t *commands, ast_t *expr) {
+ast_t *reduce_command_return(compilation_t *compilation, ast_t *commands, ast_t *expr) {
     ast_t *return_ = ast_new(ast_return);
     return_->type = expr->type;
     ast_push(return_, expr);
     ast_push(commands, return_);
     // ILOC
-    asm_push(return_->_program, "// Return\n");
-    asm_append(return_->_program, expr->_program);
-    asm_push(return_->_program, "popq %%rbp\n");
-    asm_push(return_->_program, "ret\n");
-    asm_append(commands->_program, return_->_program);
+    iloc_program_append(return_->code, expr->code);
+    name_entry_t *function = scope_find(compilation->global_scope, compilation->current_function);
+    uint64_t value = reduce_convert(return_->code, expr->value, function->type == type_float);
+    iloc_push(return_->code, ret, value, 0, 0);
+    iloc_program_append(commands->code, return_->code);
     return commands;
 }
 
-ast_t *reduce_command_if_else(ast_t *commands, ast_t *cond, ast_t *then_block, ast_t *else_block) {
+ast_t *reduce_command_if_else(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *then_block, ast_t *else_block) {
     ast_t *if_ = ast_new(ast_if);
     if_->type = cond->type;
     ast_push(if_, cond);
     ast_push(if_, then_block);
     ast_push(if_, else_block);
     ast_push(commands, if_);
-    // Compute condition
+    // ILOC
+    uint64_t label_then = iloc_next_id();
     uint64_t label_else = iloc_next_id();
     uint64_t label_done = iloc_next_id();
 
-    asm_push(if_->_program, "// if (expr)\n");
-    asm_append(if_->_program, cond->_program);
-    asm_push(if_->_program, "// if (cmp)\n");
-    asm_push(if_->_program, "and %%eax, %%eax\n");
-    asm_push(if_->_program, "jz L%lu\n", label_else);
-    asm_push(if_->_program, "// if (then)\n");
-    asm_append(if_->_program, then_block->_program);
-    asm_push(if_->_program, "jmp L%lu\n", label_done);
-    asm_push(if_->_program, "// if (else)\n");
-    asm_push(if_->_program, "L%lu:\n", label_else);
-    asm_append(if_->_program, else_block->_program);
-    asm_push(if_->_program, "// if (done)\n");
-    asm_push(if_->_program, "L%lu:\n", label_done);
-
-    asm_append(commands->_program, if_->_program);
+    iloc_program_append(if_->code, cond->code);
+    iloc_push(if_->code, cbr, reduce_truth(compilation, if_->code, cond->value), label_then, label_else);
+    // Then
+    iloc_push(if_->code, label, label_then, 0, 0);
+    iloc_program_append(if_->code, then_block->code);
+    iloc_push(if_->code, jump_i, label_done, 0, 0);
+    // Else
+    iloc_push(if_->code, label, label_else, 0, 0);
+    iloc_program_append(if_->code, else_block->code);
+    // Done
+    iloc_push(if_->code, label, label_done, 0, 0);
+
+    iloc_program_append(commands->code, if_->code);
     // Return
     return commands;
 }
 
-ast_t *reduce_command_if(ast_t *commands, ast_t *cond, ast_t *then_block) {
+ast_t *reduce_command_if(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *then_block) {
     ast_t *if_ = ast_new(ast_if);
     if_->type = cond->type;
     ast_push(if_, cond);
@@ -575,24 +1075,23 @@ ast_t *reduce_command_if(ast_t *commands, ast_t *cond, ast_t *then_block) {
     ast_push(if_, NULL);
     ast_push(commands, if_);
     // ILOC
+    uint64_t label_then = iloc_next_id();
     uint64_t label_done = iloc_next_id();
 
-    asm_push(if_->_program, "// if (expr)\n");
-    asm_append(if_->_program, cond->_program);
-    asm_push(if_->_program, "// if (cmp)\n");
-    asm_push(if_->_program, "and %%eax, %%eax\n");
-    asm_push(if_->_program, "jz L%lu\n", label_done);
-    asm_push(if_->_program, "// if (then)\n");
-    asm_append(if_->_program, then_block->_program);
-    asm_push(if_->_program, "// if (done)\n");
-    asm_push(if_->_program, "L%lu:\n", label_done);
-
-    asm_append(commands->_program, if_->_program);
+    iloc_program_append(if_->code, cond->code);
+    iloc_push(if_->code, cbr, reduce_truth(compilation, if_->code, cond->value), label_then, label_done);
+    // Then
+    iloc_push(if_->code, label, label_then, 0, 0);
+    iloc_program_append(if_->code, then_block->code);
+    // Done
+    iloc_push(if_->code, label, label_done, 0, 0);
+
+    iloc_program_append(commands->code, if_->code);
     // Return
     return commands;
 }
 
-ast_t *reduce_command_while(ast_t *commands, ast_t *cond, ast_t *block) {
+ast_t *reduce_command_while(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *block) {
     ast_t *while_ = ast_new(ast_while);
     while_->type = cond->type;
     ast_push(while_, cond);
@@ -600,483 +1099,336 @@ ast_t *reduce_command_while(ast_t *commands, ast_t *cond, ast_t *block) {
     ast_push(commands, while_);
     // ILOC
     uint64_t label_start = iloc_next_id();
+    uint64_t label_block = iloc_next_id();
     uint64_t label_done = iloc_next_id();
 
-    asm_push(while_->_program, "// while (expr)\n");
-    asm_push(while_->_program, "L%lu:\n", label_start);
-    asm_append(while_->_program, cond->_program);
-    asm_push(while_->_program, "// while (cmp)\n");
-    asm_push(while_->_program, "and %%eax, %%eax\n");
-    asm_push(while_->_program, "jz L%lu\n", label_done);
-    asm_push(while_->_program, "// while (block)\n");
-    asm_append(while_->_program, block->_program);
-    asm_push(while_->_program, "jmp L%lu\n", label_start);
-    asm_push(while_->_program, "// while (done)\n");
-    asm_push(while_->_program, "L%lu:\n", label_done);
-
-    asm_append(commands->_program, while_->_program);
+    iloc_push(while_->code, label, label_start, 0, 0);
+    iloc_program_append(while_->code, cond->code);
+    iloc_push(while_->code, cbr, reduce_truth(compilation, while_->code, cond->value), label_block, label_done);
+    // Block
+    iloc_push(while_->code, label, label_block, 0, 0);
+    iloc_program_append(while_->code, block->code);
+    iloc_push(while_->code, jump_i, label_start, 0, 0);
+    // Done
+    iloc_push(while_->code, label, label_done, 0, 0);
+
+    iloc_program_append(commands->code, while_->code);
     // Return
     return commands;
 }
 
-ast_t *reduce_command_block(ast_t *commands, ast_t *block) {
+ast_t *reduce_command_block(compilation_t *compilation, ast_t *commands, ast_t *block) {
+    (void) compilation;
     ast_push(commands, block);
-    asm_push(commands->_program, "// block\n");
-    asm_append(commands->_program, block->_program);
+    iloc_program_append(commands->code, block->code);
     return commands;
 }
 
-ast_t *reduce_expr_or(ast_t *left, ast_t *right) {
+/*
+ * Evaluates both operands and combines them into a new temporary with <op>
+ *
+ * The operand that needs more registers is evaluated first (Sethi-Ullman), so
+ * only one temporary is held while the other runs. Operands that call
+ * functions keep the source order, since the call may change a global read
+ * by the other one.
+ */
+void reduce_expr_binary(ast_t *new_expr, iloc_instruction_type_t op, ast_t *left, ast_t *right) {
+    new_expr->has_call = left->has_call || right->has_call;
+    if (left->register_need == right->register_need) {
+        new_expr->register_need = left->register_need + 1;
+    } else {
+        new_expr->register_need = left->register_need > right->register_need ? left->register_need : right->register_need;
+    }
+    if (optimization_level >= 1 && !new_expr->has_call && right->register_need > left->register_need) {
+        iloc_program_append(new_expr->code, right->code);
+        iloc_program_append(new_expr->code, left->code);
+    } else {
+        iloc_program_append(new_expr->code, left->code);
+        iloc_program_append(new_expr->code, right->code);
+    }
+
+    // Arithmetic happens in the type of the expression, comparisons in the
+    // widest of their operands (mod is only defined for integers)
+    int is_float;
+    iloc_instruction_type_t float_op;
+    switch (op) {
+        case add:    float_op = fadd;    is_float = new_expr->type == type_float; break;
+        case sub:    float_op = fsub;    is_float = new_expr->type == type_float; break;
+        case mult:   float_op = fmult;   is_float = new_expr->type == type_float; break;
+        case _div:   float_op = fdiv;    is_float = new_expr->type == type_float; break;
+        case cmp_lt: float_op = fcmp_lt; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        case cmp_le: float_op = fcmp_le; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        case cmp_eq: float_op = fcmp_eq; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        case cmp_ge: float_op = fcmp_ge; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        case cmp_gt: float_op = fcmp_gt; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        case cmp_ne: float_op = fcmp_ne; is_float = iloc_is_float(left->value) || iloc_is_float(right->value); break;
+        default:     float_op = op;      is_float = 0; break;
+    }
+    uint64_t left_value = reduce_convert(new_expr->code, left->value, is_float);
+    uint64_t right_value = reduce_convert(new_expr->code, right->value, is_float);
+    int float_result = is_float && float_op != op && (op == add || op == sub || op == mult || op == _div);
+    new_expr->value = float_result ? iloc_next_float_id() : iloc_next_id();
+    iloc_push(new_expr->code, is_float ? float_op : op, left_value, right_value, new_expr->value);
+}
+
+ast_t *reduce_expr_or(compilation_t *compilation, ast_t *left, ast_t *right) {
     ast_t *new_expr = ast_new(ast_expr_or);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
+    // The operands are evaluated one after the other, neither is held
+    new_expr->register_need = left->register_need > right->register_need ? left->register_need : right->register_need;
+    new_expr->has_call = left->has_call || right->has_call;
     uint64_t label_right = iloc_next_id();
+    uint64_t label_true = iloc_next_id();
     uint64_t label_false = iloc_next_id();
     uint64_t label_done = iloc_next_id();
+    new_expr->value = iloc_next_id();
 
     // Left
-    asm_push(new_expr->_program, "// or (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "// or (cmp)\n");
-    asm_push(new_expr->_program, "and %%eax, %%eax\n");
-    asm_push(new_expr->_program, "jz L%lu\n", label_right);
-    // True
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
+    iloc_program_append(new_expr->code, left->code);
+    iloc_push(new_expr->code, cbr, reduce_truth(compilation, new_expr->code, left->value), label_true, label_right);
     // Right
-    asm_push(new_expr->_program, "L%lu:\n", label_right);
-    asm_push(new_expr->_program, "// or (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    asm_push(new_expr->_program, "// or (cmp)\n");
-    asm_push(new_expr->_program, "and %%eax, %%eax\n");
-    asm_push(new_expr->_program, "jz L%lu\n", label_false);
+    iloc_push(new_expr->code, label, label_right, 0, 0);
+    iloc_program_append(new_expr->code, right->code);
+    iloc_push(new_expr->code, cbr, reduce_truth(compilation, new_expr->code, right->value), label_true, label_false);
     // True
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
+    iloc_push(new_expr->code, label, label_true, 0, 0);
+    iloc_push(new_expr->code, load_i, 1, new_expr->value, 0);
+    iloc_push(new_expr->code, jump_i, label_done, 0, 0);
     // False
-    asm_push(new_expr->_program, "L%lu:\n", label_false);
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
+    iloc_push(new_expr->code, label, label_false, 0, 0);
+    iloc_push(new_expr->code, load_i, 0, new_expr->value, 0);
     // Done
-    asm_push(new_expr->_program, "// or (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
+    iloc_push(new_expr->code, label, label_done, 0, 0);
 
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_and(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_and(compilation_t *compilation, ast_t *left, ast_t *right) {
     ast_t *new_expr = ast_new(ast_expr_and);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
+    // The operands are evaluated one after the other, neither is held
+    new_expr->register_need = left->register_need > right->register_need ? left->register_need : right->register_need;
+    new_expr->has_call = left->has_call || right->has_call;
+    uint64_t label_right = iloc_next_id();
+    uint64_t label_true = iloc_next_id();
     uint64_t label_false = iloc_next_id();
     uint64_t label_done = iloc_next_id();
+    new_expr->value = iloc_next_id();
 
     // Left
-    asm_push(new_expr->_program, "// and (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "// and (cmp)\n");
-    asm_push(new_expr->_program, "and %%eax, %%eax\n");
-    asm_push(new_expr->_program, "jz L%lu\n", label_false);
+    iloc_program_append(new_expr->code, left->code);
+    iloc_push(new_expr->code, cbr, reduce_truth(compilation, new_expr->code, left->value), label_right, label_false);
     // Right
-    asm_push(new_expr->_program, "// and (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    asm_push(new_expr->_program, "// and (cmp)\n");
-    asm_push(new_expr->_program, "and %%eax, %%eax\n");
-    asm_push(new_expr->_program, "jz L%lu\n", label_false);
+    iloc_push(new_expr->code, label, label_right, 0, 0);
+    iloc_program_append(new_expr->code, right->code);
+    iloc_push(new_expr->code, cbr, reduce_truth(compilation, new_expr->code, right->value), label_true, label_false);
     // True
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
+    iloc_push(new_expr->code, label, label_true, 0, 0);
+    iloc_push(new_expr->code, load_i, 1, new_expr->value, 0);
+    iloc_push(new_expr->code, jump_i, label_done, 0, 0);
     // False
-    asm_push(new_expr->_program, "L%lu:\n", label_false);
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
+    iloc_push(new_expr->code, label, label_false, 0, 0);
+    iloc_push(new_expr->code, load_i, 0, new_expr->value, 0);
     // Done
-    asm_push(new_expr->_program, "// and (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
+    iloc_push(new_expr->code, label, label_done, 0, 0);
 
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_eq(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_eq(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_eq);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_false = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// eq (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// eq (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// eq (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%ebx, %%eax\n");
-    asm_push(new_expr->_program, "jne L%lu\n", label_false);
-    // True
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // False
-    asm_push(new_expr->_program, "L%lu:\n", label_false);
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// eq (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_eq, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_ne(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_ne(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_ne);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_true = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// ne (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// ne (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// ne (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%ebx, %%eax\n");
-    asm_push(new_expr->_program, "jne L%lu\n", label_true);
-    // False
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // True
-    asm_push(new_expr->_program, "L%lu:\n", label_true);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// ne (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_ne, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_lt(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_lt(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_lt);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_true = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// lt (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// lt (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// lt (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%eax, %%ebx\n");
-    asm_push(new_expr->_program, "jl L%lu\n", label_true);
-    // False
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // True
-    asm_push(new_expr->_program, "L%lu:\n", label_true);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// lt (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_lt, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_gt(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_gt(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_gt);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_true = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// gt (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// gt (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// gt (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%eax, %%ebx\n");
-    asm_push(new_expr->_program, "jg L%lu\n", label_true);
-    // False
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // True
-    asm_push(new_expr->_program, "L%lu:\n", label_true);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// gt (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_gt, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_le(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_le(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_le);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_true = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// le (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// le (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// le (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%eax, %%ebx\n");
-    asm_push(new_expr->_program, "jle L%lu\n", label_true);
-    // False
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // True
-    asm_push(new_expr->_program, "L%lu:\n", label_true);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// le (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_le, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_ge(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_ge(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_ge);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    uint64_t label_true = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    // Left
-    asm_push(new_expr->_program, "// ge (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// ge (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Compare
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// ge (cmp)\n");
-    asm_push(new_expr->_program, "cmp %%eax, %%ebx\n");
-    asm_push(new_expr->_program, "jge L%lu\n", label_true);
-    // False
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    // True
-    asm_push(new_expr->_program, "L%lu:\n", label_true);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    // Done
-    asm_push(new_expr->_program, "// ge (done)\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-
+    reduce_expr_binary(new_expr, cmp_ge, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_add(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_add(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_add);
     new_expr->type = type_infer(left->type, right->type);
-    uint64_t temp_val_1 = iloc_next_id();
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    // Left
-    asm_push(new_expr->_program, "// add (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// add (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Opperation
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// add (op)\n");
-    asm_push(new_expr->_program, "addl %%ebx, %%eax\n");
-
+    reduce_expr_binary(new_expr, add, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_sub(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_sub(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_sub);
     new_expr->type = type_infer(left->type, right->type);
-    uint64_t temp_val_1 = iloc_next_id();
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    // ILOC
-    // Left
-    asm_push(new_expr->_program, "// sub (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// sub (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Opperation
-    asm_push(new_expr->_program, "movl %%eax, %%ebx\n");
-    asm_push(new_expr->_program, "popq %%rax\n");
-    asm_push(new_expr->_program, "// sub (op)\n");
-    asm_push(new_expr->_program, "subl %%ebx, %%eax\n");
-
+    reduce_expr_binary(new_expr, sub, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_mul(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_mul(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_mul);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    // Left
-    asm_push(new_expr->_program, "// mul (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    // Right
-    asm_push(new_expr->_program, "// mul (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    // Opperation
-    asm_push(new_expr->_program, "popq %%rbx\n");
-    asm_push(new_expr->_program, "// mul (op)\n");
-    asm_push(new_expr->_program, "imull %%ebx, %%eax\n");
-
+    reduce_expr_binary(new_expr, mult, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_div(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_div(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_div);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    asm_push(new_expr->_program, "// div (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    asm_push(new_expr->_program, "// div (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    asm_push(new_expr->_program, "movl %%eax, %%ecx\n");
-    asm_push(new_expr->_program, "popq %%rax\n");
-    asm_push(new_expr->_program, "// div (op)\n");
-    asm_push(new_expr->_program, "cltd\n");
-    asm_push(new_expr->_program, "idivl %%ecx\n");
-
+    reduce_expr_binary(new_expr, _div, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_mod(ast_t *left, ast_t *right) {
+ast_t *reduce_expr_mod(compilation_t *compilation, ast_t *left, ast_t *right) {
+    (void) compilation;
     ast_t *new_expr = ast_new(ast_expr_mod);
     new_expr->type = type_infer(left->type, right->type);
     ast_push(new_expr, left);
     ast_push(new_expr, right);
     // ILOC
-    asm_push(new_expr->_program, "// mod (left)\n");
-    asm_append(new_expr->_program, left->_program);
-    asm_push(new_expr->_program, "pushq %%rax\n");
-    asm_push(new_expr->_program, "// mod (right)\n");
-    asm_append(new_expr->_program, right->_program);
-    asm_push(new_expr->_program, "movl %%eax, %%ecx\n");
-    asm_push(new_expr->_program, "popq %%rax\n");
-    asm_push(new_expr->_program, "// mod (op)\n");
-    asm_push(new_expr->_program, "cltd\n");
-    asm_push(new_expr->_program, "idivl %%ecx\n");
-    asm_push(new_expr->_program, "movl %%edx, %%eax\n");
-
+    reduce_expr_binary(new_expr, mod, left, right);
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_inv(ast_t *expr) {
+ast_t *reduce_expr_inv(compilation_t *compilation, ast_t *expr) {
     ast_t *new_expr = ast_new(ast_expr_inv);
     new_expr->type = expr->type;
     ast_push(new_expr, expr);
     // ILOC
-    asm_push(new_expr->_program, "// inv (expr)\n");
-    asm_append(new_expr->_program, expr->_program);
-    asm_push(new_expr->_program, "// inv (op)\n");
-    asm_push(new_expr->_program, "negl %%eax\n");
+    new_expr->register_need = expr->register_need;
+    new_expr->has_call = expr->has_call;
+    iloc_program_append(new_expr->code, expr->code);
+    if (iloc_is_float(expr->value)) {
+        uint64_t zero = iloc_next_float_id();
+        new_expr->value = iloc_next_float_id();
+        iloc_push(new_expr->code, fload_i, iloc_module_constant(compilation->module, 0.0), zero, 0);
+        iloc_push(new_expr->code, fsub, zero, expr->value, new_expr->value);
+    } else {
+        new_expr->value = iloc_next_id();
+        iloc_push(new_expr->code, rsub_i, expr->value, 0, new_expr->value);
+    }
 
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_not(ast_t *expr) {
+ast_t *reduce_expr_not(compilation_t *compilation, ast_t *expr) {
     ast_t *new_expr = ast_new(ast_expr_not);
     new_expr->type = expr->type;
     ast_push(new_expr, expr);
     // ILOC
-    uint64_t label_false = iloc_next_id();
-    uint64_t label_done = iloc_next_id();
-
-    asm_push(new_expr->_program, "// not (expr)\n");
-    asm_append(new_expr->_program, expr->_program);
-    asm_push(new_expr->_program, "// not (op)\n");
-    asm_push(new_expr->_program, "and %%eax, %%eax\n");
-    asm_push(new_expr->_program, "jz L%lu\n", label_false);
-    asm_push(new_expr->_program, "movl $1, %%eax\n");
-    asm_push(new_expr->_program, "jmp L%lu\n", label_done);
-    asm_push(new_expr->_program, "L%lu:\n", label_false);
-    asm_push(new_expr->_program, "movl $0, %%eax\n");
-    asm_push(new_expr->_program, "L%lu:\n", label_done);
-    asm_push(new_expr->_program, "// not (done)\n");
+    uint64_t temp_val_1 = iloc_next_id();
+    new_expr->value = iloc_next_id();
+    new_expr->register_need = expr->register_need > 2 ? expr->register_need : 2;
+    new_expr->has_call = expr->has_call;
+    iloc_program_append(new_expr->code, expr->code);
+    iloc_push(new_expr->code, load_i, 0, temp_val_1, 0);
+    iloc_push(new_expr->code, cmp_eq, reduce_truth(compilation, new_expr->code, expr->value), temp_val_1, new_expr->value);
 
     // Return
     return new_expr;
 }
 
-ast_t *reduce_expr_ident(lexeme_t *literal) {
+ast_t *reduce_expr_ident(compilation_t *compilation, lexeme_t *literal) {
     // Semantics
-    name_entry_t *entry = scope_find(current_scope, literal->lex_ident_t.value);
+    name_entry_t *entry = scope_find(compilation->current_scope, literal->lex_ident_t.value);
     if (entry == NULL) {
         fprintf(stderr, "ERRO: a variavel \"%s\" foi utilizada antes de ser declarada\n", literal->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", literal->lex_ident_t.line, literal->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma expressao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_UNDECLARED);
     }
     if (entry->nature != nat_identifier) {
         fprintf(stderr, "ERRO: a funcao \"%s\" foi utilizada como variavel\n", literal->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", literal->lex_ident_t.line, literal->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma expressao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_FUNCTION);
     }
     // AST
@@ -1084,13 +1436,19 @@ ast_t *reduce_expr_ident(lexeme_t *literal) {
     expr->type = entry->type;
     expr->lexeme = literal;
     // ILOC
-    asm_push(expr->_program, "// ident\n");
     switch (entry->base_register) {
         case rbss:
-            asm_push(expr->_program, "movl %s(%%rip), %%eax\n", entry->lexeme->lex_ident_t.value);
+            if (entry->type == type_float) {
+                expr->value = iloc_next_float_id();
+                iloc_push(expr->code, fload_ai_r, reg_to_id(rbss), entry->offset, expr->value);
+            } else {
+                expr->value = iloc_next_id();
+                iloc_push(expr->code, load_ai_r, reg_to_id(rbss), entry->offset, expr->value);
+            }
             break;
         case rfp:
-            asm_push(expr->_program, "movl -%lu(%%rbp), %%eax\n", entry->offset);
+            // Locals are never aliased, so the expression reads the variable's register directly
+            expr->value = entry->virtual_register;
             break;
         default:
             fprintf(stderr, "Register error #1\n");
@@ -1102,59 +1460,60 @@ ast_t *reduce_expr_ident(lexeme_t *literal) {
     return expr;
 }
 
-ast_t *reduce_expr_int(lexeme_t *literal) {
+ast_t *reduce_expr_int(compilation_t *compilation, lexeme_t *literal) {
+    (void) compilation;
     // Ast
     ast_t *expr = ast_new(ast_val_int);
     expr->type = type_int;
     expr->lexeme = literal;
     // ILOC
     expr->value = iloc_next_id();
-    asm_push(expr->_program, "// lit (int)\n");
-    asm_push(expr->_program, "movl $%ld, %%eax\n", literal->lex_int_t.value);
+    iloc_push(expr->code, load_i, literal->lex_int_t.value, expr->value, 0);
     // Return
     return expr;
 }
 
-ast_t *reduce_expr_float(lexeme_t *literal) {
+ast_t *reduce_expr_float(compilation_t *compilation, lexeme_t *literal) {
     // AST
     ast_t *expr = ast_new(ast_val_float);
     expr->type = type_float;
     expr->lexeme = literal;
     // ILOC
+    expr->value = iloc_next_float_id();
+    iloc_push(expr->code, fload_i, iloc_module_constant(compilation->module, literal->lex_float_t.value), expr->value, 0);
     // Return
     return expr;
 }
 
-ast_t *reduce_expr_bool(lexeme_t *literal) {
+ast_t *reduce_expr_bool(compilation_t *compilation, lexeme_t *literal) {
+    (void) compilation;
     // AST
     ast_t *expr = ast_new(ast_val_bool);
     expr->type = type_bool;
     expr->lexeme = literal;
     // ILOC
-    expr->value = iloc_next_id();
     uint64_t bool_val = literal->lex_bool_t.value == 0 ? 0 : 1;
     expr->value = iloc_next_id();
-    asm_push(expr->_program, "// lit (bool)\n");
-    asm_push(expr->_program, "movl $%lu, %%eax\n", bool_val);
+    iloc_push(expr->code, load_i, bool_val, expr->value, 0);
     // Return
     return expr;
 }
 
-ast_t *reduce_expr_call(lexeme_t *literal, list_t *arguments) {
+ast_t *reduce_expr_call(compilation_t *compilation, lexeme_t *literal, list_t *arguments) {
     ast_t *call = ast_new(ast_call);
-    name_entry_t *entry = scope_find(current_scope, literal->lex_ident_t.value);
+    name_entry_t *entry = scope_find(compilation->current_scope, literal->lex_ident_t.value);
     if (entry == NULL) {
         fprintf(stderr, "ERRO: a funcao \"%s\" foi utilizada antes de ser declarada\n", literal->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", literal->lex_ident_t.line, literal->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma expressao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_UNDECLARED);
     }
     if (entry->nature != nat_function) {
         fprintf(stderr, "ERRO: a variavel \"%s\" foi utilizada como funcao\n", literal->lex_ident_t.value);
         fprintf(stderr, "- Contexto: na linha %ld, coluna %ld\n", literal->lex_ident_t.line, literal->lex_ident_t.column);
         fprintf(stderr, "- Contexto: em uma expressao na funcao \"%s\"\n",
-                list_get_as(global_scope->entries, global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
+                list_get_as(compilation->global_scope->entries, compilation->global_scope->entries->length-1, name_entry_t)->lexeme->lex_ident_t.value);
         exit(ERR_VARIABLE);
     }
     call->type = entry->type;
@@ -1164,7 +1523,8 @@ ast_t *reduce_expr_call(lexeme_t *literal, list_t *arguments) {
         ast_push(call, node);
     }
     list_free(arguments);
-    // TODO - Didio: write iloc code to handle calls
+    // ILOC
+    reduce_call(call, entry);
     return call;
 }
 
@@ -1292,6 +1652,7 @@ int register_variable(scope_t *scope, type_t type, lexeme_t *lexeme) {
         name_entry->base_register = rbss;
     } else {
         name_entry->base_register = rfp;
+        name_entry->virtual_register = type == type_float ? iloc_next_float_id() : iloc_next_id();
     }
     scope->size += sizeof_type(type);
     list_push(scope->entries, name_entry);
@@ -1321,6 +1682,7 @@ int register_function(scope_t *scope, type_t type, lexeme_t *lexeme) {
     name_entry->column = lexeme->lex_ident_t.column;
     name_entry->offset = scope->size;
     name_entry->function_label = iloc_next_id();
+    nlist_init(type_t, name_entry->parameter_types);
     scope->size += sizeof_type(type);
     // Se for o escopo global, apenas adiciona o tamanho no total_size
     // Senao, adiciona o tamanho ao total_size de todos os escopos ate 
@@ -1366,219 +1728,3 @@ name_entry_t *scope_find(scope_t *scope, char *name) {
     }
     return NULL;
 }
-
-/*******************\
- *      ETAPA 6      *
- \*******************/
-typedef struct {
-    uint64_t register_id;
-    uint64_t start;
-    uint64_t end;
-} reg_alloc_entry_t;
-
-typedef nlist_definition(reg_alloc_entry_t) rae_list_t;
-
-typedef struct graph {
-    uint64_t register_id;
-    nlist_definition(struct graph*) next;
-} graph_node_t;
-
-typedef nlist_definition(graph_node_t) graph_t;
-
-void handle_instruction(rae_list_t *list, iloc_instruction_t *instruction, uint64_t index) {
-    // Handle r1
-    switch (instruction->instruction) {
-        case add:
-        case sub:
-        case mult:
-        case _div:
-        case rsub_i:
-        case store_ai_r:
-        case cmp_lt:
-        case cmp_le:
-        case cmp_eq:
-        case cmp_ge:
-        case cmp_gt:
-        case cmp_ne:
-        case cbr:
-        case push:
-        case pop:
-            // Has r1
-            {
-                reg_alloc_entry_t *found;
-                nlist_find(reg_alloc_entry_t, *list, item, item.register_id == instruction->r1, found);
-                if (found == NULL) {
-                    reg_alloc_entry_t new_item;
-                    new_item.register_id = instruction->r1;
-                    new_item.start = index;
-                    new_item.end = index;
-                    nlist_insert(reg_alloc_entry_t, *list, new_item);
-                } else {
-                    found->end = index;
-                }
-            }
-            break;
-
-        case load_i:
-        case jump_i:
-        case label:
-        case load_ai_r:
-            // Does not have r1
-            break;
-
-        default:
-            // Error
-            fprintf(stderr, "Instruction %d error #1\n", instruction->instruction);
-            exit(EXIT_FAILURE);
-            break;
-    }
-
-    // Handle r2
-    switch (instruction->instruction) {
-        case add:
-        case sub:
-        case mult:
-        case _div:
-        case load_i:
-        case cmp_lt:
-        case cmp_le:
-        case cmp_eq:
-        case cmp_ge:
-        case cmp_gt:
-        case cmp_ne:
-            // Has r2
-            {
-                reg_alloc_entry_t *found;
-                nlist_find(reg_alloc_entry_t, *list, item, item.register_id == instruction->r2, found);
-                if (found == NULL) {
-                    reg_alloc_entry_t new_item;
-                    new_item.register_id = instruction->r2;
-                    new_item.start = index;
-                    new_item.end = index;
-                    nlist_insert(reg_alloc_entry_t, *list, new_item);
-                } else {
-                    found->end = index;
-                }
-            }
-            break;
-
-        case cbr:
-        case jump_i:
-        case label:
-        case rsub_i:
-        case store_ai_r:
-        case load_ai_r:
-        case push:
-        case pop:
-            // Does not have r2
-            break;
-
-        default:
-            // Error
-            fprintf(stderr, "Instruction %d error #2\n", instruction->instruction);
-            exit(EXIT_FAILURE);
-            break;
-    }
-
-    // Handle r3
-    switch (instruction->instruction) {
-        case add:
-        case sub:
-        case mult:
-        case _div:
-        case rsub_i:
-        case load_ai_r:
-        case cmp_lt:
-        case cmp_le:
-        case cmp_eq:
-        case cmp_ge:
-        case cmp_gt:
-        case cmp_ne:
-            // Has r3
-            {
-                reg_alloc_entry_t *found;
-                nlist_find(reg_alloc_entry_t, *list, item, item.register_id == instruction->r3, found);
-                if (found == NULL) {
-                    reg_alloc_entry_t new_item;
-                    new_item.register_id = instruction->r3;
-                    new_item.start = index;
-                    new_item.end = index;
-                    nlist_insert(reg_alloc_entry_t, *list, new_item);
-                } else {
-                    found->end = index;
-                }
-            }
-            break;
-
-        case store_ai_r:
-        case load_i:
-        case cbr:
-        case jump_i:
-        case label:
-        case push:
-        case pop:
-            // Does not have r3
-            break;
-
-        default:
-            // Error
-            fprintf(stderr, "Instruction %d error #3\n", instruction->instruction);
-            exit(EXIT_FAILURE);
-            break;
-    }
-}
-
-void allocated_registers(iloc_program_t *program) {
-    iloc_program_t *new_program = iloc_program_new();
-    rae_list_t list;
-    nlist_init(reg_alloc_entry_t, list);
-
-    int64_t ebx = -1;
-    int64_t ecx = -1;
-    int64_t edx = -1;
-
-    reg_alloc_entry_t *found;
-    for (uint64_t i = 0; i < program->length; i++) {
-        handle_instruction(&list, &program->instructions[i], i);
-    }
-
-    for (size_t i = 0; i < list.length; i++) {
-        reg_alloc_entry_t rae = nlist_get_unsafe(list, i);
-        fprintf(stderr, "%lu [%lu..=%lu]\n", rae.register_id, rae.start, rae.end);
-    }
-
-    graph_t graph;
-    nlist_init(graph_node_t, graph);
-
-    for (size_t i = 0; i < list.length; i++) {
-        reg_alloc_entry_t entry = nlist_get_unsafe(list, i);
-
-        graph_node_t node;
-        nlist_init(graph_node_t*, node.next);
-        node.register_id = entry.register_id;
-        nlist_insert(graph_node_t, graph, node);
-
-        for (size_t j = 0; j < i; j++) {
-            reg_alloc_entry_t other = nlist_get_unsafe(list, j);
-
-            if ((entry.start <= other.start && other.start <= entry.end)
-                    || (other.start <= entry.start && entry.start <= other.end)) {
-                nlist_insert(graph_node_t*, nlist_get_unsafe(graph, i).next, &nlist_get_unsafe(graph, j));
-                nlist_insert(graph_node_t*, nlist_get_unsafe(graph, j).next, &nlist_get_unsafe(graph, i));
-            }
-        }
-    }
-
-    for (size_t i = 0; i < graph.length; i++) {
-        graph_node_t node = nlist_get_unsafe(graph, i);
-
-        fprintf(stdout, "%lu [ ", node.register_id);
-
-        for (size_t j = 0; j < node.next.length; j++) {
-            graph_node_t *next = nlist_get_unsafe(node.next, j);
-            fprintf(stdout, "%lu, ", next->register_id);
-        }
-
-        fprintf(stdout, "]\n");
-    }
-}
@@ -12,6 +12,45 @@
 #define ERR_FUNCTION   21 //2.3
 #define ERR_ENTRY       2
 
+/*************\
+* Compilation *
+\*************/
+/*
+ * This function creates the state of a new compilation
+ */
+compilation_t *compilation_new();
+
+/*
+ * This function makes the compilation the one the calling thread works on,
+ * whose counter iloc_next_id and iloc_next_float_id use
+ */
+void compilation_activate(compilation_t *compilation);
+
+/*
+ * This function parses <input> into the tree and module of the compilation
+ * (activating it) and returns the result of the parser. It is defined with
+ * the scanner, in scanner.l.
+ */
+int compilation_parse(compilation_t *compilation, FILE *input);
+
+/*
+ * This function frees the state of the compilation (but not its tree or module)
+ */
+void compilation_free(compilation_t *compilation);
+
+/*
+ * This function makes iloc_next_id and iloc_next_float_id of the calling
+ * thread take their ids from a new namespace, which starts after the ids of
+ * the compilation. The registers it creates must not leave the function, and
+ * it must not create labels, since their ids are repeated in other functions.
+ */
+void iloc_namespace_enter(iloc_namespace_t *namespace, compilation_t *compilation);
+
+/*
+ * This function frees the namespace and makes the calling thread leave it
+ */
+void iloc_namespace_leave(iloc_namespace_t *namespace);
+
 /******************************\
 * Intermediate Code Generation *
 \******************************/
@@ -20,6 +59,16 @@
  */
 uint64_t iloc_next_id();
 
+/*
+ * This function generates an unused id for a register that holds a float
+ */
+uint64_t iloc_next_float_id();
+
+/*
+ * This function returns true if the register was created by iloc_next_float_id
+ */
+int iloc_is_float(uint64_t id);
+
 /*
  * This function creates a new program structure
  */
@@ -35,6 +84,11 @@ iloc_instruction_t iloc_instruction_new(iloc_instruction_type_t type, uint64_t r
  */
 void iloc_program_push(iloc_program_t *program, iloc_instruction_t instruction);
 
+/*
+ * This function creates a new instruction and inserts it into the end of the program
+ */
+void iloc_push(iloc_program_t *program, iloc_instruction_type_t type, uint64_t r1, uint64_t r2, uint64_t r3);
+
 /*
  * This function inserts all the instructions from <src> into the end of <dest>
  */
@@ -55,6 +109,84 @@ void iloc_instruction_to_string(iloc_instruction_t *instruction);
  */
 void iloc_program_to_string(iloc_program_t *program);
 
+/*
+ * This function stores into <uses> pointers to the registers read by the 
+ * instruction and returns how many there are (at most 2)
+ */
+uint64_t iloc_instruction_uses(iloc_instruction_t *instruction, int64_t **uses);
+
+/*
+ * This function returns a pointer to the register written by the instruction,
+ * or NULL if it does not write any
+ */
+int64_t *iloc_instruction_def(iloc_instruction_t *instruction);
+
+/*
+ * This function returns the offset (relative to rbss) of the global variable
+ * read or written by the instruction, or -1 if it does not access one, and
+ * sets <is_store> if it is a write
+ */
+int64_t iloc_instruction_global(iloc_instruction_t *instruction, int *is_store);
+
+/*
+ * This function converts between the ids used on load/store instructions and 
+ * the special registers
+ */
+iloc_register_t id_to_reg(uint64_t id);
+uint64_t reg_to_id(iloc_register_t reg);
+
+/*
+ * This function creates a new, empty function
+ */
+iloc_function_t *iloc_function_new(char *name, type_t type, uint64_t function_label);
+
+/*
+ * This function frees the function and its code
+ */
+void iloc_function_free(iloc_function_t *function);
+
+/*
+ * This function creates a new, empty module
+ */
+iloc_module_t *iloc_module_new();
+
+/*
+ * This function frees the module and its functions (but not the names of its
+ * globals, which belong to the tree or to the pass that added them)
+ */
+void iloc_module_free(iloc_module_t *module);
+
+/*
+ * This function finds the global variable stored at <offset> from rbss
+ */
+iloc_global_t *iloc_module_find_global(iloc_module_t *module, uint64_t offset);
+
+/*
+ * This function returns the function of the module with the label (or NULL)
+ */
+iloc_function_t *iloc_module_find_function(iloc_module_t *module, uint64_t function_label);
+
+/*
+ * This function returns the global variable whose storage contains the offset
+ * (relative to rbss), or NULL if there is none
+ */
+iloc_global_t *iloc_module_global_at(iloc_module_t *module, uint64_t offset);
+
+/*
+ * This function reserves <size> bytes of rbss after every other global and
+ * returns the offset of the new global
+ */
+uint64_t iloc_module_add_global(iloc_module_t *module, char *name, type_t type, uint64_t size);
+
+/*
+ * This function returns the index of the float in the constant pool of the
+ * module, adding it if needed
+ */
+uint64_t iloc_module_constant(iloc_module_t *module, double value);
+
+// Set by the -O<n> option of the command line
+extern int optimization_level;
+
 /********************\
 * Syntactic Analysis *
 \********************/
@@ -65,43 +197,43 @@ void ast_push(ast_t *parent, ast_t *child);
 /********************\
 * Reduction Handlers *
 \********************/
-void reduce_push_scope();
-void reduce_pop_scope();
-ast_t *reduce_program(ast_t *global_list);
-ast_t *reduce_global_list_empty();
-ast_t *reduce_global_list_variable(ast_t *global_list, type_t type, list_t *names);
-ast_t *reduce_global_list_function(ast_t *global_list, ast_t *function_header, ast_t *commands);
-ast_t *reduce_function_header(list_t *parameters, type_t type, lexeme_t *name);
-ast_t *reduce_variable(type_t type, lexeme_t *name);
-ast_t *reduce_command_empty();
-ast_t *reduce_command_variable(ast_t *commands, type_t type, list_t *names);
-ast_t *reduce_command_assignment(ast_t *commands, lexeme_t *name, ast_t *expr);
-ast_t *reduce_command_call(ast_t *commands, lexeme_t *name, list_t *arguments);
-ast_t *reduce_command_return(ast_t *commands, ast_t *expr);
-ast_t *reduce_command_if_else(ast_t *commands, ast_t *cond, ast_t *then_block, ast_t *else_block);
-ast_t *reduce_command_if(ast_t *commands, ast_t *cond, ast_t *then_block);
-ast_t *reduce_command_while(ast_t *commands, ast_t *cond, ast_t *block);
-ast_t *reduce_command_block(ast_t *commands, ast_t *block);
-ast_t *reduce_expr_or(ast_t *left, ast_t *right);
-ast_t *reduce_expr_and(ast_t *left, ast_t *right);
-ast_t *reduce_expr_eq(ast_t *left, ast_t *right);
-ast_t *reduce_expr_ne(ast_t *left, ast_t *right);
-ast_t *reduce_expr_lt(ast_t *left, ast_t *right);
-ast_t *reduce_expr_gt(ast_t *left, ast_t *right);
-ast_t *reduce_expr_le(ast_t *left, ast_t *right);
-ast_t *reduce_expr_ge(ast_t *left, ast_t *right);
-ast_t *reduce_expr_add(ast_t *left, ast_t *right);
-ast_t *reduce_expr_sub(ast_t *left, ast_t *right);
-ast_t *reduce_expr_mul(ast_t *left, ast_t *right);
-ast_t *reduce_expr_div(ast_t *left, ast_t *right);
-ast_t *reduce_expr_mod(ast_t *left, ast_t *right);
-ast_t *reduce_expr_inv(ast_t *expr);
-ast_t *reduce_expr_not(ast_t *expr);
-ast_t *reduce_expr_ident(lexeme_t *literal);
-ast_t *reduce_expr_int(lexeme_t *literal);
-ast_t *reduce_expr_float(lexeme_t *literal);
-ast_t *reduce_expr_bool(lexeme_t *literal);
-ast_t *reduce_expr_call(lexeme_t *literal, list_t *arguments);
+void reduce_push_scope(compilation_t *compilation);
+void reduce_pop_scope(compilation_t *compilation);
+ast_t *reduce_program(compilation_t *compilation, ast_t *global_list);
+ast_t *reduce_global_list_empty(compilation_t *compilation);
+ast_t *reduce_global_list_variable(compilation_t *compilation, ast_t *global_list, type_t type, list_t *names);
+ast_t *reduce_global_list_function(compilation_t *compilation, ast_t *global_list, ast_t *function_header, ast_t *commands);
+ast_t *reduce_function_header(compilation_t *compilation, list_t *parameters, type_t type, lexeme_t *name);
+ast_t *reduce_variable(compilation_t *compilation, type_t type, lexeme_t *name);
+ast_t *reduce_command_empty(compilation_t *compilation);
+ast_t *reduce_command_variable(compilation_t *compilation, ast_t *commands, type_t type, list_t *names);
+ast_t *reduce_command_assignment(compilation_t *compilation, ast_t *commands, lexeme_t *name, ast_t *expr);
+ast_t *reduce_command_call(compilation_t *compilation, ast_t *commands, lexeme_t *name, list_t *arguments);
+ast_t *reduce_command_return(compilation_t *compilation, ast_t *commands, ast_t *expr);
+ast_t *reduce_command_if_else(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *then_block, ast_t *else_block);
+ast_t *reduce_command_if(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *then_block);
+ast_t *reduce_command_while(compilation_t *compilation, ast_t *commands, ast_t *cond, ast_t *block);
+ast_t *reduce_command_block(compilation_t *compilation, ast_t *commands, ast_t *block);
+ast_t *reduce_expr_or(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_and(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_eq(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_ne(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_lt(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_gt(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_le(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_ge(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_add(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_sub(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_mul(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_div(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_mod(compilation_t *compilation, ast_t *left, ast_t *right);
+ast_t *reduce_expr_inv(compilation_t *compilation, ast_t *expr);
+ast_t *reduce_expr_not(compilation_t *compilation, ast_t *expr);
+ast_t *reduce_expr_ident(compilation_t *compilation, lexeme_t *literal);
+ast_t *reduce_expr_int(compilation_t *compilation, lexeme_t *literal);
+ast_t *reduce_expr_float(compilation_t *compilation, lexeme_t *literal);
+ast_t *reduce_expr_bool(compilation_t *compilation, lexeme_t *literal);
+ast_t *reduce_expr_call(compilation_t *compilation, lexeme_t *literal, list_t *arguments);
 
 /********\
 * Lexeme *
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "data_layout.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "profile.h"
+#include "structs.h"
+
+// Without a profile, an access in a loop counts as this many per level
+#define DATA_LAYOUT_LOOP_WEIGHT 10
+
+// Loops nested deeper than this count as this deep
+#define DATA_LAYOUT_MAX_DEPTH 4
+
+/*
+ * Returns the size of a line with the given globals, placed by decreasing
+ * alignment (which leaves no padding between them, as every size is a
+ * multiple of the alignment of its type)
+ */
+uint64_t data_layout_line_size(iloc_global_t *globals, uint64_t *members, uint64_t count) {
+    uint64_t size = 0;
+    for (uint64_t alignment = DATA_LAYOUT_LINE; alignment > 0; alignment /= 2) {
+        for (uint64_t m = 0; m < count; m++) {
+            if (globals[members[m]].alignment == alignment) {
+                size += globals[members[m]].size;
+            }
+        }
+    }
+    return size;
+}
+
+// Only the pairs of the hottest globals of each function add to their
+// affinity, which bounds the work (and the pairs kept) for each function
+#define DATA_LAYOUT_MAX_SHARED 64
+
+// The affinity of each pair of globals that were accessed in the same
+// functions, keyed by (a, b) with a < b (open addressing, 0 if empty)
+typedef struct {
+    uint64_t *keys;
+    double *values;
+    uint64_t length;
+    uint64_t capacity;
+} data_layout_pairs_t;
+
+// A global and its weight (in a function or in a line)
+typedef struct {
+    uint64_t global;
+    double weight;
+} data_layout_entry_t;
+
+uint64_t data_layout_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCD;
+    key ^= key >> 33;
+    return key;
+}
+
+void data_layout_pairs_init(data_layout_pairs_t *pairs, uint64_t capacity) {
+    pairs->keys = (uint64_t*) calloc(capacity, sizeof(uint64_t));
+    pairs->values = (double*) calloc(capacity, sizeof(double));
+    if (pairs->keys == NULL || pairs->values == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for data_layout_pairs_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    pairs->length = 0;
+    pairs->capacity = capacity;
+}
+
+/*
+ * Adds <weight> to the affinity of the pair with the key, growing the table
+ * once it is half full
+ */
+void data_layout_pairs_add(data_layout_pairs_t *pairs, uint64_t key, double weight) {
+    if (2 * (pairs->length + 1) > pairs->capacity) {
+        data_layout_pairs_t grown;
+        data_layout_pairs_init(&grown, 2 * pairs->capacity);
+        for (uint64_t i = 0; i < pairs->capacity; i++) {
+            if (pairs->keys[i] != 0) {
+                data_layout_pairs_add(&grown, pairs->keys[i], pairs->values[i]);
+            }
+        }
+        free(pairs->keys);
+        free(pairs->values);
+        *pairs = grown;
+    }
+    uint64_t i = data_layout_hash(key) & (pairs->capacity - 1);
+    while (pairs->keys[i] != 0 && pairs->keys[i] != key) {
+        i = (i + 1) & (pairs->capacity - 1);
+    }
+    if (pairs->keys[i] == 0) {
+        pairs->keys[i] = key;
+        pairs->length++;
+    }
+    pairs->values[i] += weight;
+}
+
+/*
+ * Orders entries by decreasing weight, then by increasing global
+ */
+int data_layout_compare(const void *a, const void *b) {
+    const data_layout_entry_t *x = (const data_layout_entry_t*) a;
+    const data_layout_entry_t *y = (const data_layout_entry_t*) b;
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    return x->global < y->global ? -1 : x->global > y->global;
+}
+
+/*
+ * Adds the accesses of the function to the frequency of each global, and the
+ * frequency both globals of each pair have in it to their affinity. <local>
+ * is zeroed scratch space for the weight of each global, and is left zeroed.
+ */
+void data_layout_count(iloc_module_t *module, iloc_function_t *function, double *frequency, data_layout_pairs_t *pairs, double *local) {
+    iloc_program_t *code = function->code;
+    iloc_cfg_t cfg = iloc_cfg_build(code);
+    uint64_t *depth = iloc_cfg_loop_depth(&cfg);
+    nlist_definition(data_layout_entry_t) accessed;
+    nlist_init(data_layout_entry_t, accessed);
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+        int64_t count = profile_block_count(function, &cfg, b);
+        double weight = 1;
+        if (count >= 0) {
+            weight = count;
+        } else {
+            for (uint64_t d = 0; d < depth[b] && d < DATA_LAYOUT_MAX_DEPTH; d++) {
+                weight *= DATA_LAYOUT_LOOP_WEIGHT;
+            }
+        }
+        for (uint64_t i = block->start; i < block->end; i++) {
+            int is_store;
+            int64_t offset = iloc_instruction_global(&code->instructions[i], &is_store);
+            iloc_global_t *global = offset >= 0 ? iloc_module_global_at(module, offset) : NULL;
+            if (global != NULL && weight > 0) {
+                uint64_t g = global - module->globals.items;
+                if (local[g] == 0) {
+                    data_layout_entry_t entry = { g, 0 };
+                    nlist_insert(data_layout_entry_t, accessed, entry);
+                }
+                local[g] += weight;
+            }
+        }
+    }
+    for (size_t e = 0; e < accessed.length; e++) {
+        data_layout_entry_t *entry = &nlist_get_unsafe(accessed, e);
+        entry->weight = local[entry->global];
+        frequency[entry->global] += entry->weight;
+        local[entry->global] = 0;
+    }
+    qsort(accessed.items, accessed.length, sizeof(data_layout_entry_t), data_layout_compare);
+    uint64_t shared = accessed.length < DATA_LAYOUT_MAX_SHARED ? accessed.length : DATA_LAYOUT_MAX_SHARED;
+    uint64_t n = module->globals.length;
+    for (uint64_t x = 0; x < shared; x++) {
+        for (uint64_t y = x+1; y < shared; y++) {
+            // Sorted by weight, so y is the less frequent of the two
+            uint64_t a = nlist_get_unsafe(accessed, x).global;
+            uint64_t b = nlist_get_unsafe(accessed, y).global;
+            uint64_t key = a < b ? a * n + b + 1 : b * n + a + 1;
+            data_layout_pairs_add(pairs, key, nlist_get_unsafe(accessed, y).weight);
+        }
+    }
+    nlist_free(accessed);
+    free(depth);
+    iloc_cfg_free(&cfg);
+}
+
+void data_layout_module(iloc_module_t *module) {
+    uint64_t n = module->globals.length;
+    if (n == 0) {
+        return;
+    }
+    double *frequency = (double*) calloc(n+1, sizeof(double));
+    double *local = (double*) calloc(n+1, sizeof(double));
+    double *shared = (double*) calloc(n+1, sizeof(double));
+    uint64_t *order = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    int *placed = (int*) calloc(n+1, sizeof(int));
+    uint64_t *degree = (uint64_t*) calloc(n+2, sizeof(uint64_t));
+    data_layout_entry_t *by_frequency = (data_layout_entry_t*) malloc((n+1) * sizeof(data_layout_entry_t));
+    if (frequency == NULL || local == NULL || shared == NULL || order == NULL || placed == NULL || degree == NULL || by_frequency == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for data_layout_module (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-8);
+        exit(EXIT_FAILURE);
+    }
+    data_layout_pairs_t pairs;
+    data_layout_pairs_init(&pairs, 64);
+    for (size_t f = 0; f < module->functions.length; f++) {
+        data_layout_count(module, nlist_get_unsafe(module->functions, f), frequency, &pairs, local);
+    }
+
+    // The neighbors of each global (the ones it has affinity with), as one
+    // array where those of <g> are [degree[g], degree[g+1])
+    for (uint64_t i = 0; i < pairs.capacity; i++) {
+        if (pairs.keys[i] != 0) {
+            degree[(pairs.keys[i] - 1) / n + 1]++;
+            degree[(pairs.keys[i] - 1) % n + 1]++;
+        }
+    }
+    for (uint64_t g = 0; g < n; g++) {
+        degree[g+1] += degree[g];
+    }
+    data_layout_entry_t *neighbors = (data_layout_entry_t*) malloc((2 * pairs.length + 1) * sizeof(data_layout_entry_t));
+    uint64_t *filled = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    if (neighbors == NULL || filled == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for data_layout_module (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < pairs.capacity; i++) {
+        if (pairs.keys[i] != 0) {
+            uint64_t a = (pairs.keys[i] - 1) / n;
+            uint64_t b = (pairs.keys[i] - 1) % n;
+            neighbors[degree[a] + filled[a]++] = (data_layout_entry_t) { b, pairs.values[i] };
+            neighbors[degree[b] + filled[b]++] = (data_layout_entry_t) { a, pairs.values[i] };
+        }
+    }
+
+    // The seeds of the lines are taken in this order
+    for (uint64_t g = 0; g < n; g++) {
+        by_frequency[g] = (data_layout_entry_t) { g, frequency[g] };
+    }
+    qsort(by_frequency, n, sizeof(data_layout_entry_t), data_layout_compare);
+
+    // Lines: the hottest global left, then whatever fits and is accessed the
+    // most along with the line (the hottest one on ties), among the globals
+    // that share a function with it
+    iloc_global_t *globals = module->globals.items;
+    uint64_t length = 0;
+    nlist_definition(uint64_t) candidates;
+    nlist_init(uint64_t, candidates);
+    for (uint64_t s = 0; s < n && by_frequency[s].weight > 0; s++) {
+        uint64_t seed = by_frequency[s].global;
+        if (placed[seed]) {
+            continue;
+        }
+        uint64_t line = length;
+        order[length++] = seed;
+        placed[seed] = 1;
+        while (1) {
+            // The affinity of each candidate with the line, which is small
+            // enough to sum again for each slot
+            candidates.length = 0;
+            for (uint64_t m = line; m < length; m++) {
+                for (uint64_t e = degree[order[m]]; e < degree[order[m]+1]; e++) {
+                    uint64_t g = neighbors[e].global;
+                    if (placed[g] || frequency[g] == 0) {
+                        continue;
+                    }
+                    if (shared[g] == 0) {
+                        nlist_insert(uint64_t, candidates, g);
+                    }
+                    shared[g] += neighbors[e].weight;
+                }
+            }
+            int64_t best = -1;
+            for (size_t c = 0; c < candidates.length; c++) {
+                uint64_t g = nlist_get_unsafe(candidates, c);
+                order[length] = g;
+                if (data_layout_line_size(globals, &order[line], length+1 - line) <= DATA_LAYOUT_LINE
+                        && (best < 0 || shared[g] > shared[best]
+                            || (shared[g] == shared[best] && (frequency[g] > frequency[best] || (frequency[g] == frequency[best] && (int64_t) g < best))))) {
+                    best = g;
+                }
+            }
+            for (size_t c = 0; c < candidates.length; c++) {
+                shared[nlist_get_unsafe(candidates, c)] = 0;
+            }
+            if (best < 0) {
+                break;
+            }
+            order[length++] = best;
+            placed[best] = 1;
+        }
+        // Decreasing alignment, so no padding is needed inside the line
+        for (uint64_t m = line + 1; m < length; m++) {
+            uint64_t member = order[m];
+            uint64_t k = m;
+            while (k > line && globals[order[k-1]].alignment < globals[member].alignment) {
+                order[k] = order[k-1];
+                k--;
+            }
+            order[k] = member;
+        }
+        globals[order[line]].alignment = DATA_LAYOUT_LINE;
+    }
+    for (uint64_t g = 0; g < n; g++) {
+        if (!placed[g]) {
+            order[length++] = g;
+        }
+    }
+
+    iloc_global_t *reordered = (iloc_global_t*) malloc((n+1) * sizeof(iloc_global_t));
+    if (reordered == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for iloc_global_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t g = 0; g < n; g++) {
+        reordered[g] = globals[order[g]];
+    }
+    memcpy(globals, reordered, n * sizeof(iloc_global_t));
+
+    free(reordered);
+    nlist_free(candidates);
+    free(filled);
+    free(neighbors);
+    free(pairs.keys);
+    free(pairs.values);
+    free(by_frequency);
+    free(degree);
+    free(placed);
+    free(order);
+    free(shared);
+    free(local);
+    free(frequency);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Bytes of a cache line, the unit the hot globals are packed into
+#define DATA_LAYOUT_LINE 64
+
+/*************\
+* Data Layout *
+\*************/
+/*
+ * This function reorders the global variables of the module (the order they
+ * take in .bss) by how often they are accessed, counting each access by the
+ * profile count of its block or, without one, by its loop depth.
+ *
+ * The globals that are accessed are packed into cache lines, each one started
+ * by the hottest global left and filled with the ones accessed the most in the
+ * same functions (counting the DATA_LAYOUT_MAX_SHARED hottest globals of each
+ * function), so a hot loop touches as few lines as possible. Each line is
+ * aligned to DATA_LAYOUT_LINE bytes, and the globals never accessed follow in
+ * their original order.
+ */
+void data_layout_module(iloc_module_t *module);
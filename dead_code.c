@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "dead_code.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+typedef nlist_definition(uint64_t) index_list_t;
+
+int64_t dead_code_function_index(iloc_module_t *module, uint64_t function_label) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        if (nlist_get_unsafe(module->functions, i)->function_label == function_label) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Marks every function reachable from <root> through calls and tail calls
+ */
+int *dead_code_reachable(iloc_module_t *module, uint64_t root) {
+    int *reachable = (int*) calloc(module->functions.length+1, sizeof(int));
+    if (reachable == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    index_list_t worklist;
+    nlist_init(uint64_t, worklist);
+    reachable[root] = 1;
+    nlist_insert(uint64_t, worklist, root);
+    while (worklist.length > 0) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, worklist.items[--worklist.length])->code;
+        for (uint64_t i = 0; i < code->length; i++) {
+            iloc_instruction_type_t type = code->instructions[i].instruction;
+            if (type != call && type != tailcall) {
+                continue;
+            }
+            int64_t callee = dead_code_function_index(module, code->instructions[i].r1);
+            if (callee >= 0 && !reachable[callee]) {
+                reachable[callee] = 1;
+                nlist_insert(uint64_t, worklist, callee);
+            }
+        }
+    }
+    nlist_free(worklist);
+    return reachable;
+}
+
+/*
+ * Removes the stores to the globals that are never read
+ */
+void dead_code_remove_stores(iloc_module_t *module, iloc_function_t *function, int *read) {
+    iloc_program_t *code = function->code;
+    iloc_program_t *new_program = iloc_program_new();
+    int removed = 0;
+    for (uint64_t i = 0; i < code->length; i++) {
+        int is_store;
+        int64_t offset = iloc_instruction_global(&code->instructions[i], &is_store);
+        if (offset >= 0 && is_store) {
+            iloc_global_t *global = iloc_module_global_at(module, offset);
+            if (global != NULL && !read[global - module->globals.items]) {
+                removed = 1;
+                continue;
+            }
+        }
+        iloc_program_push(new_program, code->instructions[i]);
+    }
+    if (removed) {
+        iloc_program_free(code);
+        function->code = new_program;
+    } else {
+        iloc_program_free(new_program);
+    }
+}
+
+void dead_code_module(iloc_module_t *module) {
+    int64_t root = -1;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f)->name, "main") == 0) {
+            root = f;
+        }
+    }
+    if (root < 0) {
+        return;
+    }
+
+    int *reachable = dead_code_reachable(module, root);
+    size_t kept = 0;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        if (reachable[f]) {
+            module->functions.items[kept++] = function;
+        } else {
+            iloc_function_free(function);
+        }
+    }
+    module->functions.length = kept;
+    free(reachable);
+
+    int *read = (int*) calloc(module->globals.length+1, sizeof(int));
+    if (read == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+        for (uint64_t i = 0; i < code->length; i++) {
+            int is_store;
+            int64_t offset = iloc_instruction_global(&code->instructions[i], &is_store);
+            iloc_global_t *global = offset >= 0 ? iloc_module_global_at(module, offset) : NULL;
+            if (global != NULL && !is_store) {
+                read[global - module->globals.items] = 1;
+            }
+        }
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        dead_code_remove_stores(module, nlist_get_unsafe(module->functions, f), read);
+    }
+
+    // The remaining globals keep their offsets, which only name them
+    kept = 0;
+    for (size_t g = 0; g < module->globals.length; g++) {
+        if (read[g]) {
+            module->globals.items[kept++] = nlist_get_unsafe(module->globals, g);
+        }
+    }
+    module->globals.length = kept;
+    free(read);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/**********************************\
+* Dead Function and Global Removal *
+\**********************************/
+/*
+ * This function removes the functions that cannot be reached from main
+ * through the call graph (such as callees whose every call was inlined or
+ * retargeted to a specialized clone), then the global variables that no
+ * remaining function reads. Stores to a global that is never read are
+ * deleted along with it.
+ *
+ * Modules without a main are left untouched, as every function may be used.
+ */
+void dead_code_module(iloc_module_t *module);
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "inline.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "profile.h"
+#include "structs.h"
+
+// Call sites nested deeper than this get no larger limit
+#define INLINE_MAX_HOTNESS 3
+
+// Callers stop growing once they reach this size
+#define INLINE_MAX_FUNCTION_SIZE 4096
+
+uint64_t inline_threshold = INLINE_DEFAULT_THRESHOLD;
+
+typedef nlist_definition(uint64_t) index_list_t;
+
+typedef struct {
+    iloc_module_t *module;
+    index_list_t *callees;   // Functions called by each function (by index in the module)
+    int64_t *index;          // Order in which Tarjan's algorithm visited each function
+    int64_t *lowlink;
+    int *on_stack;
+    uint64_t *component;     // Strongly connected component of each function
+    index_list_t stack;
+    index_list_t order;      // Functions in bottom-up order
+    int64_t next_index;
+    uint64_t components;
+} call_graph_t;
+
+int64_t inline_function_index(iloc_module_t *module, uint64_t function_label) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        if (nlist_get_unsafe(module->functions, i)->function_label == function_label) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Tarjan's algorithm: a component is complete once every function it calls
+ * has been visited, so the components come out callees first
+ */
+void call_graph_connect(call_graph_t *graph, uint64_t function) {
+    graph->index[function] = graph->next_index;
+    graph->lowlink[function] = graph->next_index;
+    graph->next_index++;
+    nlist_insert(uint64_t, graph->stack, function);
+    graph->on_stack[function] = 1;
+    for (size_t c = 0; c < graph->callees[function].length; c++) {
+        uint64_t callee = nlist_get_unsafe(graph->callees[function], c);
+        if (graph->index[callee] < 0) {
+            call_graph_connect(graph, callee);
+            if (graph->lowlink[callee] < graph->lowlink[function]) {
+                graph->lowlink[function] = graph->lowlink[callee];
+            }
+        } else if (graph->on_stack[callee] && graph->index[callee] < graph->lowlink[function]) {
+            graph->lowlink[function] = graph->index[callee];
+        }
+    }
+    if (graph->lowlink[function] != graph->index[function]) {
+        return;
+    }
+    uint64_t member;
+    do {
+        member = graph->stack.items[--graph->stack.length];
+        graph->on_stack[member] = 0;
+        graph->component[member] = graph->components;
+        nlist_insert(uint64_t, graph->order, member);
+    } while (member != function);
+    graph->components++;
+}
+
+call_graph_t call_graph_build(iloc_module_t *module) {
+    call_graph_t graph;
+    uint64_t n = module->functions.length;
+    graph.module = module;
+    graph.callees = (index_list_t*) malloc((n+1) * sizeof(index_list_t));
+    graph.index = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    graph.lowlink = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    graph.on_stack = (int*) calloc(n+1, sizeof(int));
+    graph.component = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    if (graph.callees == NULL || graph.index == NULL || graph.lowlink == NULL || graph.on_stack == NULL || graph.component == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for call_graph_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-6);
+        exit(EXIT_FAILURE);
+    }
+    nlist_init(uint64_t, graph.stack);
+    nlist_init(uint64_t, graph.order);
+    graph.next_index = 0;
+    graph.components = 0;
+    for (uint64_t f = 0; f < n; f++) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+        nlist_init(uint64_t, graph.callees[f]);
+        graph.index[f] = -1;
+        for (uint64_t i = 0; i < code->length; i++) {
+            if (code->instructions[i].instruction != call) {
+                continue;
+            }
+            int64_t callee = inline_function_index(module, code->instructions[i].r1);
+            if (callee >= 0) {
+                nlist_insert(uint64_t, graph.callees[f], callee);
+            }
+        }
+    }
+    for (uint64_t f = 0; f < n; f++) {
+        if (graph.index[f] < 0) {
+            call_graph_connect(&graph, f);
+        }
+    }
+    return graph;
+}
+
+void call_graph_free(call_graph_t *graph) {
+    for (uint64_t f = 0; f < graph->module->functions.length; f++) {
+        nlist_free(graph->callees[f]);
+    }
+    free(graph->callees);
+    free(graph->index);
+    free(graph->lowlink);
+    free(graph->on_stack);
+    free(graph->component);
+    nlist_free(graph->stack);
+    nlist_free(graph->order);
+}
+
+/*
+ * Amount of instructions the body of a function adds to its callers
+ */
+uint64_t inline_function_size(iloc_function_t *function) {
+    uint64_t size = 0;
+    for (uint64_t i = 0; i < function->code->length; i++) {
+        iloc_instruction_type_t type = function->code->instructions[i].instruction;
+        if (type != label && type != getparam && type != fgetparam) {
+            size++;
+        }
+    }
+    return size;
+}
+
+/*
+ * Stores the registers and labels mentioned by the instruction, which are the
+ * operands renamed when it is copied into another function
+ */
+uint64_t inline_operands(iloc_instruction_t *instruction, int64_t **operands) {
+    uint64_t count = iloc_instruction_uses(instruction, operands);
+    int64_t *def = iloc_instruction_def(instruction);
+    if (def != NULL) {
+        operands[count++] = def;
+    }
+    switch (instruction->instruction) {
+        case label:
+        case jump_i:
+            operands[count++] = &instruction->r1;
+            break;
+        case cbr:
+            operands[count++] = &instruction->r2;
+            operands[count++] = &instruction->r3;
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+/*
+ * Appends a copy of the callee to the caller, with fresh registers and labels:
+ * parameters are copied from the arguments and returns become a copy to the
+ * result of the call and a jump past the copy. The copied blocks get the
+ * counts of the callee scaled to the <count> of the call site (if known).
+ */
+void inline_call(iloc_program_t *program, iloc_function_t *caller, iloc_function_t *callee, iloc_instruction_t *arguments, iloc_instruction_t *call_instruction, int64_t count) {
+    iloc_program_t *code = callee->code;
+    int64_t *operands[5];
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (uint64_t i = 0; i < code->length; i++) {
+        uint64_t count = inline_operands(&code->instructions[i], operands);
+        for (uint64_t o = 0; o < count; o++) {
+            if (*operands[o] < min) min = *operands[o];
+            if (*operands[o] > max) max = *operands[o];
+        }
+    }
+    uint64_t range = min <= max ? (uint64_t) (max - min + 1) : 0;
+    int64_t *renamed = (int64_t*) malloc((range+1) * sizeof(int64_t));
+    if (renamed == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t r = 0; r < range; r++) {
+        renamed[r] = -1;
+    }
+
+    int64_t result = call_instruction->r3;
+    int is_float = iloc_is_float(result);
+    uint64_t label_done = iloc_next_id();
+    for (uint64_t i = 0; i < code->length; i++) {
+        iloc_instruction_t instruction = code->instructions[i];
+        uint64_t count = inline_operands(&instruction, operands);
+        for (uint64_t o = 0; o < count; o++) {
+            int64_t *id = &renamed[*operands[o] - min];
+            if (*id < 0) {
+                *id = iloc_is_float(*operands[o]) ? iloc_next_float_id() : iloc_next_id();
+            }
+            *operands[o] = *id;
+        }
+        switch (instruction.instruction) {
+            case getparam:
+                iloc_push(program, i2i, arguments[instruction.r1].r1, instruction.r2, 0);
+                break;
+            case fgetparam:
+                iloc_push(program, f2f, arguments[instruction.r1].r1, instruction.r2, 0);
+                break;
+            case ret:
+                iloc_push(program, is_float ? f2f : i2i, instruction.r1, result, 0);
+                iloc_push(program, jump_i, label_done, 0, 0);
+                break;
+            default:
+                iloc_program_push(program, instruction);
+                break;
+        }
+    }
+    iloc_push(program, label, label_done, 0, 0);
+    if (count >= 0 && callee->profiled) {
+        double scale = callee->entry_count > 0 ? (double) count / callee->entry_count : 0;
+        for (size_t c = 0; c < callee->block_counts.length; c++) {
+            iloc_block_count_t block_count = nlist_get_unsafe(callee->block_counts, c);
+            block_count.label = renamed[block_count.label - min];
+            block_count.count = (uint64_t) (block_count.count * scale);
+            nlist_insert(iloc_block_count_t, caller->block_counts, block_count);
+        }
+    }
+    if (count >= 0) {
+        iloc_block_count_t block_count = { label_done, count };
+        nlist_insert(iloc_block_count_t, caller->block_counts, block_count);
+    }
+    free(renamed);
+}
+
+/*
+ * Inlines the calls of a function whose callees are worth copying
+ */
+void inline_function(call_graph_t *graph, uint64_t caller_index) {
+    iloc_function_t *caller = nlist_get_unsafe(graph->module->functions, caller_index);
+    iloc_program_t *code = caller->code;
+    iloc_cfg_t cfg = iloc_cfg_build(code);
+    uint64_t *depth = iloc_cfg_loop_depth(&cfg);
+    iloc_program_t *new_program = iloc_program_new();
+    int inlined = 0;
+
+    for (uint64_t i = 0; i < code->length; i++) {
+        // The arguments are passed right before the call
+        uint64_t first = i;
+        while (i < code->length && (code->instructions[i].instruction == param || code->instructions[i].instruction == fparam)) {
+            i++;
+        }
+        if (i == code->length) {
+            for (uint64_t k = first; k < i; k++) {
+                iloc_program_push(new_program, code->instructions[k]);
+            }
+            break;
+        }
+        iloc_instruction_t *instruction = &code->instructions[i];
+        int64_t callee_index = instruction->instruction == call ? inline_function_index(graph->module, instruction->r1) : -1;
+        if (callee_index >= 0 && graph->component[callee_index] != graph->component[caller_index]
+                && new_program->length < INLINE_MAX_FUNCTION_SIZE) {
+            iloc_function_t *callee = nlist_get_unsafe(graph->module->functions, callee_index);
+            uint64_t arguments = i - first;
+            uint64_t hotness = depth[cfg.block_of[i]] < INLINE_MAX_HOTNESS ? depth[cfg.block_of[i]] : INLINE_MAX_HOTNESS;
+            uint64_t limit = arguments + 1 + inline_threshold * (1 + hotness);
+            // With a profile, the call site is as hot as the loop nest that
+            // would run it as often (a factor of 10 per level), and a call
+            // that never ran is only inlined if that takes no more code
+            int64_t count = profile_block_count(caller, &cfg, cfg.block_of[i]);
+            if (count == 0) {
+                limit = arguments + 1;
+            } else if (count > 0) {
+                hotness = 0;
+                for (uint64_t calls = caller->entry_count * 10; hotness < INLINE_MAX_HOTNESS && (uint64_t) count >= calls; calls *= 10) {
+                    hotness++;
+                }
+                limit = arguments + 1 + inline_threshold * (1 + hotness);
+            }
+            if (arguments == callee->parameters.length && inline_function_size(callee) <= limit) {
+                inline_call(new_program, caller, callee, &code->instructions[first], instruction, count);
+                inlined = 1;
+                continue;
+            }
+        }
+        for (uint64_t k = first; k <= i; k++) {
+            iloc_program_push(new_program, code->instructions[k]);
+        }
+    }
+
+    free(depth);
+    iloc_cfg_free(&cfg);
+    if (inlined) {
+        iloc_program_free(code);
+        caller->code = new_program;
+    } else {
+        iloc_program_free(new_program);
+    }
+}
+
+void inline_module(iloc_module_t *module) {
+    call_graph_t graph = call_graph_build(module);
+    for (size_t o = 0; o < graph.order.length; o++) {
+        inline_function(&graph, nlist_get_unsafe(graph.order, o));
+    }
+    call_graph_free(&graph);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Largest callee (in instructions, beyond the call overhead it removes) that
+// is inlined at a call site outside of loops
+#define INLINE_DEFAULT_THRESHOLD 24
+
+extern uint64_t inline_threshold;
+
+/**********\
+* Inlining *
+\**********/
+/*
+ * This function replaces calls by a copy of the body of the callee, visiting
+ * the call graph bottom-up (callees before callers, one strongly connected
+ * component at a time) so the inlined bodies already have their own calls
+ * inlined. Recursive calls are never inlined.
+ *
+ * A call is inlined if the callee has at most inline_threshold instructions
+ * more than the call sequence, a limit that grows with the loop depth of the
+ * call site (hot calls are worth more code). With a profile, the limit grows
+ * with how often the call ran instead, and calls that never ran are only
+ * inlined if that does not grow the caller.
+ */
+void inline_module(iloc_module_t *module);
@@ -0,0 +1,557 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "interp.h"
+#include "code_gen.h"
+#include "list.h"
+#include "profile.h"
+#include "structs.h"
+
+// Contents of a virtual register or of an argument
+typedef union {
+    int32_t i;
+    double f;
+} interp_value_t;
+
+typedef struct interp_function interp_function_t;
+
+/*
+ * Instruction decoded for dispatch: registers are indexes into the register
+ * file of the activation, labels are indexes into the code, and the bases of
+ * loadAI/storeAI are iloc_register_t
+ */
+typedef struct {
+    const void *handler;
+    int64_t r1;
+    int64_t r2;
+    int64_t r3;
+    interp_function_t *callee; // Only for call and tailcall
+} interp_instruction_t;
+
+struct interp_function {
+    iloc_function_t *source;
+    interp_instruction_t *code;
+    uint64_t register_count;
+    uint64_t argument_count; // Slots for the arguments of the calls it makes
+};
+
+// Activation record of a caller, restored by ret
+typedef struct {
+    interp_function_t *function;
+    interp_instruction_t *ip;  // The call
+    interp_value_t *arguments;
+    uint64_t frame;
+    uint64_t base;
+    uint64_t frame_pointer;
+} interp_activation_t;
+
+typedef struct {
+    iloc_module_t *module;
+    interp_function_t *functions;
+    uint8_t *memory;         // Globals from address 0, then the stack
+    uint64_t memory_size;
+    uint64_t stack_limit;    // The stack grows down from memory_size to here
+    interp_value_t *values;  // Register files and arguments of the activations
+    interp_activation_t *activations;
+    uint64_t depth;
+} interp_state_t;
+
+#define INTERP_STACK_SIZE (1 << 20)
+#define INTERP_VALUE_COUNT (1 << 22)
+#define INTERP_MAX_DEPTH (1 << 20)
+
+// Handlers of interp_execute, indexed by iloc_instruction_type_t
+static const void **interp_handlers = NULL;
+
+void interp_error(const char *message) {
+    fprintf(stderr, "ERRO: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * Returns the address after checking that <size> bytes from it are inside the
+ * memory
+ */
+static inline uint64_t interp_address(interp_state_t *state, int64_t address, uint64_t size) {
+    if (address < 0 || (uint64_t) address + size > state->memory_size) {
+        interp_error("Acesso fora da memoria do programa");
+    }
+    return address;
+}
+
+/*
+ * Runs <function> until it returns, with the calls it makes kept in
+ * state->activations instead of the C stack. Calling it without a function
+ * only publishes the handlers for decoding.
+ */
+interp_value_t interp_execute(interp_state_t *state, interp_function_t *function) {
+    static const void *handlers[] = {
+        [add] = &&do_add,
+        [sub] = &&do_sub,
+        [mult] = &&do_mult,
+        [_div] = &&do_div,
+        [rsub_i] = &&do_rsub_i,
+        [load_ai_r] = &&do_load_ai_r,
+        [load_i] = &&do_load_i,
+        [store_ai_r] = &&do_store_ai_r,
+        [i2i] = &&do_copy,
+        [cmp_lt] = &&do_cmp_lt,
+        [cmp_le] = &&do_cmp_le,
+        [cmp_eq] = &&do_cmp_eq,
+        [cmp_ge] = &&do_cmp_ge,
+        [cmp_gt] = &&do_cmp_gt,
+        [cmp_ne] = &&do_cmp_ne,
+        [cbr] = &&do_cbr,
+        [jump_i] = &&do_jump_i,
+        [jump] = &&do_unsupported,
+        [label] = &&do_next,
+        [push] = &&do_push,
+        [pop] = &&do_pop,
+        [mod] = &&do_mod,
+        [ret] = &&do_ret,
+        [getparam] = &&do_getparam,
+        [param] = &&do_param,
+        [call] = &&do_call,
+        [tailcall] = &&do_tailcall,
+        [load_ax] = &&do_load_ax,
+        [store_ax] = &&do_store_ax,
+        [fadd] = &&do_fadd,
+        [fsub] = &&do_fsub,
+        [fmult] = &&do_fmult,
+        [fdiv] = &&do_fdiv,
+        [fload_i] = &&do_fload_i,
+        [fload_ai_r] = &&do_fload_ai_r,
+        [fstore_ai_r] = &&do_fstore_ai_r,
+        [f2f] = &&do_copy,
+        [i2f] = &&do_i2f,
+        [f2i] = &&do_f2i,
+        [fcmp_lt] = &&do_fcmp_lt,
+        [fcmp_le] = &&do_fcmp_le,
+        [fcmp_eq] = &&do_fcmp_eq,
+        [fcmp_ge] = &&do_fcmp_ge,
+        [fcmp_gt] = &&do_fcmp_gt,
+        [fcmp_ne] = &&do_fcmp_ne,
+        [fgetparam] = &&do_getparam,
+        [fparam] = &&do_param,
+    };
+    interp_value_t result;
+    result.i = 0;
+    if (function == NULL) {
+        interp_handlers = handlers;
+        return result;
+    }
+
+    // A tail call moves its arguments to the start of the activation, so the
+    // callee reuses it
+    interp_value_t *arguments = NULL;
+    uint64_t frame_pointer = state->memory_size;
+    uint64_t frame = 0;
+    uint64_t base = 0;
+    interp_value_t *registers;
+    interp_value_t *outgoing;
+    int64_t stack_pointer;
+    interp_instruction_t *ip;
+    double *constants = state->module->constants.items;
+    uint8_t *memory = state->memory;
+
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ip++; goto *ip->handler; } while (0)
+#define R(field) registers[ip->field]
+#define BASE(field) (ip->field == rbss ? 0 : ip->field == rfp ? (int64_t) frame_pointer : stack_pointer)
+
+enter:
+    if (base + function->register_count + function->argument_count > INTERP_VALUE_COUNT) {
+        interp_error("Estouro da pilha de execucao");
+    }
+    registers = state->values + base;
+    outgoing = registers + function->register_count;
+    memset(registers, 0, function->register_count * sizeof(interp_value_t));
+    stack_pointer = (int64_t) frame_pointer - (int64_t) function->source->frame_size;
+    if (stack_pointer < (int64_t) state->stack_limit) {
+        interp_error("Estouro da pilha de execucao");
+    }
+    ip = function->code;
+    DISPATCH();
+
+do_add:
+    R(r3).i = (int32_t) ((uint32_t) R(r1).i + (uint32_t) R(r2).i);
+    NEXT();
+do_sub:
+    R(r3).i = (int32_t) ((uint32_t) R(r1).i - (uint32_t) R(r2).i);
+    NEXT();
+do_mult:
+    R(r3).i = (int32_t) ((uint32_t) R(r1).i * (uint32_t) R(r2).i);
+    NEXT();
+do_div:
+    if (R(r2).i == 0) {
+        interp_error("Divisao por zero");
+    } else if (R(r2).i == -1 && R(r1).i == INT32_MIN) {
+        interp_error("Estouro na divisao inteira");
+    }
+    R(r3).i = R(r1).i / R(r2).i;
+    NEXT();
+do_mod:
+    if (R(r2).i == 0) {
+        interp_error("Divisao por zero");
+    } else if (R(r2).i == -1 && R(r1).i == INT32_MIN) {
+        interp_error("Estouro na divisao inteira");
+    }
+    R(r3).i = R(r1).i % R(r2).i;
+    NEXT();
+do_rsub_i:
+    R(r3).i = (int32_t) ((uint32_t) ip->r2 - (uint32_t) R(r1).i);
+    NEXT();
+do_load_ai_r:
+    memcpy(&R(r3).i, memory + interp_address(state, BASE(r1) + ip->r2, sizeof(int32_t)), sizeof(int32_t));
+    NEXT();
+do_load_i:
+    R(r2).i = (int32_t) ip->r1;
+    NEXT();
+do_store_ai_r:
+    memcpy(memory + interp_address(state, BASE(r2) + ip->r3, sizeof(int32_t)), &R(r1).i, sizeof(int32_t));
+    NEXT();
+do_copy:
+    R(r2) = R(r1);
+    NEXT();
+do_cmp_lt:
+    R(r3).i = R(r1).i < R(r2).i;
+    NEXT();
+do_cmp_le:
+    R(r3).i = R(r1).i <= R(r2).i;
+    NEXT();
+do_cmp_eq:
+    R(r3).i = R(r1).i == R(r2).i;
+    NEXT();
+do_cmp_ge:
+    R(r3).i = R(r1).i >= R(r2).i;
+    NEXT();
+do_cmp_gt:
+    R(r3).i = R(r1).i > R(r2).i;
+    NEXT();
+do_cmp_ne:
+    R(r3).i = R(r1).i != R(r2).i;
+    NEXT();
+do_cbr:
+    ip = function->code + (R(r1).i ? ip->r2 : ip->r3);
+    DISPATCH();
+do_jump_i:
+    ip = function->code + ip->r1;
+    DISPATCH();
+do_next:
+    NEXT();
+do_push:
+    stack_pointer -= sizeof(interp_value_t);
+    if (stack_pointer < (int64_t) state->stack_limit) {
+        interp_error("Estouro da pilha de execucao");
+    }
+    memcpy(memory + stack_pointer, &R(r1), sizeof(interp_value_t));
+    NEXT();
+do_pop:
+    memcpy(&R(r1), memory + interp_address(state, stack_pointer, sizeof(interp_value_t)), sizeof(interp_value_t));
+    stack_pointer += sizeof(interp_value_t);
+    NEXT();
+do_ret:
+    result = R(r1);
+    if (state->depth == 0) {
+        return result;
+    }
+    {
+        interp_activation_t *caller = &state->activations[--state->depth];
+        function = caller->function;
+        arguments = caller->arguments;
+        frame = caller->frame;
+        base = caller->base;
+        frame_pointer = caller->frame_pointer;
+        registers = state->values + base;
+        outgoing = registers + function->register_count;
+        stack_pointer = (int64_t) frame_pointer - (int64_t) function->source->frame_size;
+        ip = caller->ip;
+    }
+    R(r3) = result;
+    NEXT();
+do_getparam:
+    R(r2) = arguments[ip->r1];
+    NEXT();
+do_param:
+    outgoing[ip->r2] = R(r1);
+    NEXT();
+do_call:
+    if (state->depth == INTERP_MAX_DEPTH) {
+        interp_error("Estouro da pilha de execucao");
+    }
+    {
+        interp_activation_t *caller = &state->activations[state->depth++];
+        caller->function = function;
+        caller->ip = ip;
+        caller->arguments = arguments;
+        caller->frame = frame;
+        caller->base = base;
+        caller->frame_pointer = frame_pointer;
+    }
+    arguments = outgoing;
+    frame = base = base + function->register_count + function->argument_count;
+    frame_pointer = stack_pointer;
+    function = ip->callee;
+    goto enter;
+do_tailcall:
+    memmove(state->values + frame, outgoing, ip->r2 * sizeof(interp_value_t));
+    arguments = state->values + frame;
+    base = frame + ip->r2;
+    function = ip->callee;
+    goto enter;
+do_load_ax:
+    memcpy(&R(r3).i, memory + interp_address(state, ip->r1 + R(r2).i, sizeof(int32_t)), sizeof(int32_t));
+    NEXT();
+do_store_ax:
+    memcpy(memory + interp_address(state, ip->r2 + R(r3).i, sizeof(int32_t)), &R(r1).i, sizeof(int32_t));
+    NEXT();
+do_fadd:
+    R(r3).f = R(r1).f + R(r2).f;
+    NEXT();
+do_fsub:
+    R(r3).f = R(r1).f - R(r2).f;
+    NEXT();
+do_fmult:
+    R(r3).f = R(r1).f * R(r2).f;
+    NEXT();
+do_fdiv:
+    R(r3).f = R(r1).f / R(r2).f;
+    NEXT();
+do_fload_i:
+    R(r2).f = constants[ip->r1];
+    NEXT();
+do_fload_ai_r:
+    memcpy(&R(r3).f, memory + interp_address(state, BASE(r1) + ip->r2, sizeof(double)), sizeof(double));
+    NEXT();
+do_fstore_ai_r:
+    memcpy(memory + interp_address(state, BASE(r2) + ip->r3, sizeof(double)), &R(r1).f, sizeof(double));
+    NEXT();
+do_i2f:
+    R(r2).f = (double) R(r1).i;
+    NEXT();
+do_f2i:
+    // Like cvttsd2si, values out of range (and NaN) become INT32_MIN
+    R(r2).i = R(r1).f > -2147483649.0 && R(r1).f < 2147483648.0 ? (int32_t) R(r1).f : INT32_MIN;
+    NEXT();
+do_fcmp_lt:
+    R(r3).i = R(r1).f < R(r2).f;
+    NEXT();
+do_fcmp_le:
+    R(r3).i = R(r1).f <= R(r2).f;
+    NEXT();
+do_fcmp_eq:
+    R(r3).i = R(r1).f == R(r2).f;
+    NEXT();
+do_fcmp_ge:
+    R(r3).i = R(r1).f >= R(r2).f;
+    NEXT();
+do_fcmp_gt:
+    R(r3).i = R(r1).f > R(r2).f;
+    NEXT();
+do_fcmp_ne:
+    R(r3).i = R(r1).f != R(r2).f;
+    NEXT();
+do_unsupported:
+    interp_error("Instrucao nao suportada pelo interpretador");
+    return result;
+
+#undef DISPATCH
+#undef NEXT
+#undef R
+#undef BASE
+}
+
+/*
+ * Decodes <decoded->source>: labels are removed, and the registers are
+ * renumbered densely from 0 using <dense> (indexed by id, all -1 on entry
+ * and on return)
+ */
+void interp_decode(interp_state_t *state, interp_function_t *decoded, int64_t *dense, int64_t *labels) {
+    iloc_program_t *code = decoded->source->code;
+    decoded->code = (interp_instruction_t*) malloc((code->length+1) * sizeof(interp_instruction_t));
+    if (decoded->code == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for interp_instruction_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t length = 0;
+    for (uint64_t i = 0; i < code->length; i++) {
+        if (code->instructions[i].instruction == label) {
+            labels[code->instructions[i].r1] = length;
+        } else {
+            length++;
+        }
+    }
+
+    nlist_definition(int64_t) assigned;
+    nlist_init(int64_t, assigned);
+    decoded->register_count = 0;
+    decoded->argument_count = 0;
+    length = 0;
+    for (uint64_t i = 0; i < code->length; i++) {
+        iloc_instruction_t instruction = code->instructions[i];
+        if (instruction.instruction == label) {
+            continue;
+        }
+        int64_t *operands[3];
+        uint64_t count = iloc_instruction_uses(&instruction, operands);
+        int64_t *def = iloc_instruction_def(&instruction);
+        if (def != NULL) {
+            operands[count++] = def;
+        }
+        for (uint64_t o = 0; o < count; o++) {
+            if (dense[*operands[o]] < 0) {
+                dense[*operands[o]] = decoded->register_count++;
+                nlist_insert(int64_t, assigned, *operands[o]);
+            }
+            *operands[o] = dense[*operands[o]];
+        }
+
+        interp_instruction_t *target = &decoded->code[length++];
+        target->handler = interp_handlers[instruction.instruction];
+        target->r1 = instruction.r1;
+        target->r2 = instruction.r2;
+        target->r3 = instruction.r3;
+        target->callee = NULL;
+        switch (instruction.instruction) {
+            case cbr:
+                target->r2 = labels[instruction.r2];
+                target->r3 = labels[instruction.r3];
+                break;
+            case jump_i:
+                target->r1 = labels[instruction.r1];
+                break;
+            case load_ai_r:
+            case fload_ai_r:
+                target->r1 = id_to_reg(instruction.r1);
+                break;
+            case store_ai_r:
+            case fstore_ai_r:
+                target->r2 = id_to_reg(instruction.r2);
+                break;
+            case param:
+            case fparam:
+                if ((uint64_t) instruction.r2 + 1 > decoded->argument_count) {
+                    decoded->argument_count = instruction.r2 + 1;
+                }
+                break;
+            case call:
+            case tailcall:
+                for (size_t f = 0; f < state->module->functions.length; f++) {
+                    if (nlist_get_unsafe(state->module->functions, f)->function_label == (uint64_t) instruction.r1) {
+                        target->callee = &state->functions[f];
+                    }
+                }
+                if (target->callee == NULL) {
+                    fprintf(stderr, "ERROR: Call to undefined function L%ld\n", instruction.r1);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    // Falling off the end is never generated, but labels may point past it
+    decoded->code[length].handler = interp_handlers[jump];
+    decoded->code[length].callee = NULL;
+
+    for (size_t a = 0; a < assigned.length; a++) {
+        dense[assigned.items[a]] = -1;
+    }
+    nlist_free(assigned);
+}
+
+int interp_run_module(iloc_module_t *module) {
+    int64_t entry = -1;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f)->name, "main") == 0) {
+            entry = f;
+        }
+    }
+    if (entry < 0) {
+        fprintf(stderr, "ERRO: O programa nao define a funcao main\n");
+        return 1;
+    }
+    interp_execute(NULL, NULL);
+
+    // Registers and labels share the id space
+    uint64_t id_count = 1;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+        for (uint64_t i = 0; i < code->length; i++) {
+            iloc_instruction_t *instruction = &code->instructions[i];
+            int64_t *operands[3];
+            uint64_t count = iloc_instruction_uses(instruction, operands);
+            int64_t *def = iloc_instruction_def(instruction);
+            if (def != NULL) {
+                operands[count++] = def;
+            }
+            for (uint64_t o = 0; o < count; o++) {
+                if ((uint64_t) *operands[o] + 1 > id_count) {
+                    id_count = *operands[o] + 1;
+                }
+            }
+            if (instruction->instruction == label && (uint64_t) instruction->r1 + 1 > id_count) {
+                id_count = instruction->r1 + 1;
+            }
+        }
+    }
+    int64_t *dense = (int64_t*) malloc(id_count * sizeof(int64_t));
+    int64_t *labels = (int64_t*) calloc(id_count, sizeof(int64_t));
+    if (dense == NULL || labels == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t id = 0; id < id_count; id++) {
+        dense[id] = -1;
+    }
+
+    interp_state_t state;
+    state.module = module;
+    state.functions = (interp_function_t*) malloc((module->functions.length+1) * sizeof(interp_function_t));
+    if (state.functions == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for interp_function_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        state.functions[f].source = nlist_get_unsafe(module->functions, f);
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        interp_decode(&state, &state.functions[f], dense, labels);
+    }
+    free(labels);
+    free(dense);
+
+    uint64_t bss_size = 0;
+    for (size_t g = 0; g < module->globals.length; g++) {
+        iloc_global_t *global = &nlist_get_unsafe(module->globals, g);
+        if (global->offset + global->size > bss_size) {
+            bss_size = global->offset + global->size;
+        }
+    }
+    state.stack_limit = (bss_size + 7) / 8 * 8;
+    state.memory_size = state.stack_limit + INTERP_STACK_SIZE;
+    state.memory = (uint8_t*) calloc(state.memory_size, sizeof(uint8_t));
+    state.values = (interp_value_t*) malloc(INTERP_VALUE_COUNT * sizeof(interp_value_t));
+    state.activations = (interp_activation_t*) malloc(INTERP_MAX_DEPTH * sizeof(interp_activation_t));
+    if (state.memory == NULL || state.values == NULL || state.activations == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the interpreter (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    state.depth = 0;
+
+    interp_value_t result = interp_execute(&state, &state.functions[entry]);
+    iloc_global_t *counters = profile_counters(module);
+    if (counters != NULL) {
+        profile_write(module, state.memory + counters->offset);
+    }
+
+    for (size_t f = 0; f < module->functions.length; f++) {
+        free(state.functions[f].code);
+    }
+    free(state.functions);
+    free(state.activations);
+    free(state.memory);
+    free(state.values);
+    return result.i;
+}
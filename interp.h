@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/******************\
+* ILOC Interpreter *
+\******************/
+/*
+ * This function executes the module from its main function and returns the
+ * result, without register allocation or native code. Virtual registers live
+ * in a register file per activation, and the globals, addressed from rbss,
+ * share a byte-addressed memory with the activation records (rfp and rsp).
+ *
+ * Integer operations wrap around at 32 bits like the generated code; errors
+ * that would trap natively (division by zero, stack overflow, accesses
+ * outside the memory) are reported and stop the program. An instrumented
+ * module writes its profile once main returns.
+ */
+int interp_run_module(iloc_module_t *module);
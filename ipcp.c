@@ -0,0 +1,688 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "ipcp.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+/*
+ * Registers of a function that hold a known integer: the ones defined only
+ * once, by a loadI (or by an instruction folded into one)
+ */
+typedef struct {
+    iloc_numbering_t numbering;
+    uint64_t *definitions;
+    int *known;
+    int64_t *value;
+} ipcp_constants_t;
+
+typedef struct {
+    iloc_function_t *caller;
+    uint64_t call;          // Index of the call in the code of the caller
+    uint64_t callee;        // Index of the callee in the module
+    int *known;             // Whether each argument is a constant
+    int64_t *value;
+} ipcp_site_t;
+
+ipcp_constants_t ipcp_constants_build(iloc_program_t *program) {
+    ipcp_constants_t constants;
+    constants.numbering = iloc_numbering_build(program);
+    uint64_t n = constants.numbering.length;
+    constants.definitions = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    constants.known = (int*) calloc(n+1, sizeof(int));
+    constants.value = (int64_t*) calloc(n+1, sizeof(int64_t));
+    if (constants.definitions == NULL || constants.known == NULL || constants.value == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for ipcp_constants_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t *instruction = &program->instructions[i];
+        int64_t *def = iloc_instruction_def(instruction);
+        if (def == NULL) {
+            continue;
+        }
+        int64_t d = iloc_numbering_get(&constants.numbering, *def);
+        constants.definitions[d]++;
+        if (instruction->instruction == load_i) {
+            constants.known[d] = 1;
+            constants.value[d] = instruction->r1;
+        }
+    }
+    for (uint64_t v = 0; v < n; v++) {
+        if (constants.definitions[v] != 1) {
+            constants.known[v] = 0;
+        }
+    }
+    return constants;
+}
+
+void ipcp_constants_free(ipcp_constants_t *constants) {
+    iloc_numbering_free(&constants->numbering);
+    free(constants->definitions);
+    free(constants->known);
+    free(constants->value);
+}
+
+#define constant_known(constants, reg) ((constants)->known[iloc_numbering_get(&(constants)->numbering, reg)])
+#define constant_value(constants, reg) ((constants)->value[iloc_numbering_get(&(constants)->numbering, reg)])
+
+/*
+ * Evaluates an integer operation with the wrap-around of the 32-bit machine
+ * registers. Returns false if it cannot be folded (division by zero).
+ */
+int ipcp_evaluate(iloc_instruction_type_t type, int64_t a, int64_t b, int64_t *result) {
+    int32_t x = (int32_t) a;
+    int32_t y = (int32_t) b;
+    switch (type) {
+        case add:    *result = (int32_t) ((uint32_t) x + (uint32_t) y); return 1;
+        case sub:    *result = (int32_t) ((uint32_t) x - (uint32_t) y); return 1;
+        case mult:   *result = (int32_t) ((uint32_t) x * (uint32_t) y); return 1;
+        case cmp_lt: *result = x < y;  return 1;
+        case cmp_le: *result = x <= y; return 1;
+        case cmp_eq: *result = x == y; return 1;
+        case cmp_ge: *result = x >= y; return 1;
+        case cmp_gt: *result = x > y;  return 1;
+        case cmp_ne: *result = x != y; return 1;
+        case _div:
+        case mod:
+            if (y == 0 || (x == INT32_MIN && y == -1)) {
+                return 0;
+            }
+            *result = type == _div ? x / y : x % y;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Returns true if the instruction only writes its result, so it may be
+ * removed once that result is not read (divisions are kept, as they trap)
+ */
+int ipcp_is_pure(iloc_instruction_type_t type) {
+    switch (type) {
+        case add:
+        case sub:
+        case mult:
+        case rsub_i:
+        case load_ai_r:
+        case load_ax:
+        case load_i:
+        case i2i:
+        case cmp_lt:
+        case cmp_le:
+        case cmp_eq:
+        case cmp_ge:
+        case cmp_gt:
+        case cmp_ne:
+        case fadd:
+        case fsub:
+        case fmult:
+        case fdiv:
+        case fload_i:
+        case fload_ai_r:
+        case f2f:
+        case i2f:
+        case f2i:
+        case fcmp_lt:
+        case fcmp_le:
+        case fcmp_eq:
+        case fcmp_ge:
+        case fcmp_gt:
+        case fcmp_ne:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Removes the blocks that the folded branches no longer reach, then the pure
+ * instructions whose result is never read (which frees their operands too)
+ */
+void ipcp_sweep(iloc_function_t *function) {
+    iloc_program_t *program = function->code;
+    if (program->length == 0) {
+        return;
+    }
+    iloc_cfg_t cfg = iloc_cfg_build(program);
+    uint64_t block_count = cfg.blocks.length;
+    int *reachable = (int*) calloc(block_count+1, sizeof(int));
+    uint64_t *stack = (uint64_t*) malloc((block_count+1) * sizeof(uint64_t));
+    int *keep = (int*) malloc((program->length+1) * sizeof(int));
+    if (reachable == NULL || stack == NULL || keep == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for ipcp_sweep (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t top = 0;
+    reachable[0] = 1;
+    stack[top++] = 0;
+    while (top > 0) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, stack[--top]);
+        // The targets of an indirect jump are unknown
+        if (program->instructions[block->end-1].instruction == jump) {
+            for (uint64_t b = 0; b < block_count; b++) {
+                reachable[b] = 1;
+            }
+            break;
+        }
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t successor = nlist_get_unsafe(block->successors, s);
+            if (!reachable[successor]) {
+                reachable[successor] = 1;
+                stack[top++] = successor;
+            }
+        }
+    }
+    for (uint64_t i = 0; i < program->length; i++) {
+        keep[i] = reachable[cfg.block_of[i]];
+    }
+    free(reachable);
+    free(stack);
+    iloc_cfg_free(&cfg);
+
+    iloc_numbering_t numbering = iloc_numbering_build(program);
+    uint64_t *reads = (uint64_t*) calloc(numbering.length+1, sizeof(uint64_t));
+    if (reads == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    int64_t *uses[3];
+    for (uint64_t i = 0; i < program->length; i++) {
+        uint64_t use_count = keep[i] ? iloc_instruction_uses(&program->instructions[i], uses) : 0;
+        for (uint64_t u = 0; u < use_count; u++) {
+            reads[iloc_numbering_get(&numbering, *uses[u])]++;
+        }
+    }
+    // Removing an instruction may leave the definitions of its operands unread
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t i = program->length; i-- > 0;) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            int64_t *def = iloc_instruction_def(instruction);
+            if (!keep[i] || def == NULL || !ipcp_is_pure(instruction->instruction)
+                    || reads[iloc_numbering_get(&numbering, *def)] > 0) {
+                continue;
+            }
+            keep[i] = 0;
+            uint64_t use_count = iloc_instruction_uses(instruction, uses);
+            for (uint64_t u = 0; u < use_count; u++) {
+                reads[iloc_numbering_get(&numbering, *uses[u])]--;
+            }
+            changed = 1;
+        }
+    }
+    free(reads);
+    iloc_numbering_free(&numbering);
+
+    iloc_program_t *new_program = iloc_program_new();
+    for (uint64_t i = 0; i < program->length; i++) {
+        if (keep[i]) {
+            iloc_program_push(new_program, program->instructions[i]);
+        }
+    }
+    free(keep);
+    iloc_program_free(program);
+    function->code = new_program;
+}
+
+void ipcp_fold_constants(iloc_function_t *function) {
+    iloc_program_t *program = function->code;
+    ipcp_constants_t constants = ipcp_constants_build(program);
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t i = 0; i < program->length; i++) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            int64_t result;
+            int folded = 0;
+            switch (instruction->instruction) {
+                case add:
+                case sub:
+                case mult:
+                case _div:
+                case mod:
+                case cmp_lt:
+                case cmp_le:
+                case cmp_eq:
+                case cmp_ge:
+                case cmp_gt:
+                case cmp_ne:
+                    folded = constant_known(&constants, instruction->r1) && constant_known(&constants, instruction->r2)
+                        && ipcp_evaluate(instruction->instruction, constant_value(&constants, instruction->r1),
+                            constant_value(&constants, instruction->r2), &result);
+                    if (folded) {
+                        instruction->r2 = instruction->r3;
+                    }
+                    break;
+                case rsub_i:
+                    folded = constant_known(&constants, instruction->r1)
+                        && ipcp_evaluate(sub, instruction->r2, constant_value(&constants, instruction->r1), &result);
+                    if (folded) {
+                        instruction->r2 = instruction->r3;
+                    }
+                    break;
+                case i2i:
+                    folded = constant_known(&constants, instruction->r1);
+                    if (folded) {
+                        result = constant_value(&constants, instruction->r1);
+                    }
+                    break;
+                case cbr:
+                    if (constant_known(&constants, instruction->r1)) {
+                        instruction->r1 = constant_value(&constants, instruction->r1) ? instruction->r2 : instruction->r3;
+                        instruction->instruction = jump_i;
+                        instruction->r2 = 0;
+                        instruction->r3 = 0;
+                        changed = 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (!folded) {
+                continue;
+            }
+            // The result is now in r2, like the one of a loadI
+            instruction->instruction = load_i;
+            instruction->r1 = result;
+            instruction->r3 = 0;
+            int64_t d = iloc_numbering_get(&constants.numbering, instruction->r2);
+            if (constants.definitions[d] == 1) {
+                constants.known[d] = 1;
+                constants.value[d] = result;
+            }
+            changed = 1;
+        }
+    }
+    ipcp_constants_free(&constants);
+    ipcp_sweep(function);
+}
+
+int64_t ipcp_function_index(iloc_module_t *module, uint64_t function_label) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        if (nlist_get_unsafe(module->functions, i)->function_label == function_label) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Makes the parameters whose <known> flag is set hold their constant: the
+ * getparam writes to an unused register and a loadI defines the parameter.
+ * Returns the amount of instructions inserted (all before the body).
+ */
+uint64_t ipcp_bind_parameters(iloc_function_t *function, int *known, int64_t *value) {
+    iloc_program_t *code = function->code;
+    iloc_program_t *new_program = iloc_program_new();
+    uint64_t i = 0;
+    while (i < code->length && (code->instructions[i].instruction == getparam || code->instructions[i].instruction == fgetparam)) {
+        iloc_instruction_t instruction = code->instructions[i++];
+        if (instruction.instruction == getparam && known[instruction.r1]) {
+            instruction.r2 = iloc_next_id();
+        }
+        iloc_program_push(new_program, instruction);
+    }
+    uint64_t inserted = 0;
+    for (uint64_t p = 0; p < function->parameters.length; p++) {
+        if (known[p]) {
+            iloc_push(new_program, load_i, value[p], nlist_get_unsafe(function->parameters, p), 0);
+            inserted++;
+        }
+    }
+    for (; i < code->length; i++) {
+        iloc_program_push(new_program, code->instructions[i]);
+    }
+    iloc_program_free(code);
+    function->code = new_program;
+    return inserted;
+}
+
+/*
+ * Copies the function under a new name and label, with fresh labels (they
+ * are global in the assembly) but the same registers
+ */
+iloc_function_t *ipcp_clone(iloc_function_t *function, uint64_t clone_number) {
+    char *name = (char*) malloc(strlen(function->name) + 32);
+    if (name == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for char* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    sprintf(name, "%s.constprop.%lu", function->name, clone_number);
+    iloc_function_t *clone = iloc_function_new(name, function->type, iloc_next_id());
+    free(name);
+    for (size_t p = 0; p < function->parameters.length; p++) {
+        nlist_insert(uint64_t, clone->parameters, nlist_get_unsafe(function->parameters, p));
+    }
+
+    iloc_program_t *code = function->code;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (uint64_t i = 0; i < code->length; i++) {
+        if (code->instructions[i].instruction == label) {
+            if (code->instructions[i].r1 < min) min = code->instructions[i].r1;
+            if (code->instructions[i].r1 > max) max = code->instructions[i].r1;
+        }
+    }
+    uint64_t range = min <= max ? (uint64_t) (max - min + 1) : 0;
+    int64_t *renamed = (int64_t*) malloc((range+1) * sizeof(int64_t));
+    if (renamed == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < code->length; i++) {
+        if (code->instructions[i].instruction == label) {
+            renamed[code->instructions[i].r1 - min] = iloc_next_id();
+        }
+    }
+    for (uint64_t i = 0; i < code->length; i++) {
+        iloc_instruction_t instruction = code->instructions[i];
+        switch (instruction.instruction) {
+            case label:
+            case jump_i:
+                instruction.r1 = renamed[instruction.r1 - min];
+                break;
+            case cbr:
+                instruction.r2 = renamed[instruction.r2 - min];
+                instruction.r3 = renamed[instruction.r3 - min];
+                break;
+            default:
+                break;
+        }
+        iloc_program_push(clone->code, instruction);
+    }
+    // The clone keeps the shape of the profile of the original
+    clone->profiled = function->profiled;
+    clone->entry_count = function->entry_count;
+    for (size_t c = 0; c < function->block_counts.length; c++) {
+        iloc_block_count_t block_count = nlist_get_unsafe(function->block_counts, c);
+        block_count.label = renamed[block_count.label - min];
+        nlist_insert(iloc_block_count_t, clone->block_counts, block_count);
+    }
+    free(renamed);
+    return clone;
+}
+
+int ipcp_same_signature(ipcp_site_t *a, ipcp_site_t *b, uint64_t count) {
+    for (uint64_t p = 0; p < count; p++) {
+        if (a->known[p] != b->known[p] || (a->known[p] && a->value[p] != b->value[p])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void ipcp_module(iloc_module_t *module) {
+    uint64_t n = module->functions.length;
+    uint64_t module_size = 0;
+    nlist_definition(ipcp_site_t) sites;
+    nlist_init(ipcp_site_t, sites);
+
+    // Call sites, with the arguments that are constants in the caller
+    for (uint64_t f = 0; f < n; f++) {
+        iloc_function_t *caller = nlist_get_unsafe(module->functions, f);
+        iloc_program_t *code = caller->code;
+        module_size += code->length;
+        ipcp_constants_t constants = ipcp_constants_build(code);
+        for (uint64_t i = 0; i < code->length; i++) {
+            if (code->instructions[i].instruction != call) {
+                continue;
+            }
+            int64_t callee = ipcp_function_index(module, code->instructions[i].r1);
+            if (callee < 0) {
+                continue;
+            }
+            uint64_t count = nlist_get_unsafe(module->functions, callee)->parameters.length;
+            ipcp_site_t site;
+            site.caller = caller;
+            site.call = i;
+            site.callee = callee;
+            site.known = (int*) calloc(count+1, sizeof(int));
+            site.value = (int64_t*) calloc(count+1, sizeof(int64_t));
+            if (site.known == NULL || site.value == NULL) {
+                fprintf(stderr, "ERROR: Failed to allocate memory for ipcp_site_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+                exit(EXIT_FAILURE);
+            }
+            // The arguments are passed right before the call
+            for (uint64_t k = i; k-- > 0 && code->instructions[k].instruction != call;) {
+                iloc_instruction_t *argument = &code->instructions[k];
+                if (argument->instruction != param && argument->instruction != fparam) {
+                    break;
+                }
+                if (argument->instruction == param && (uint64_t) argument->r2 < count && constant_known(&constants, argument->r1)) {
+                    site.known[argument->r2] = 1;
+                    site.value[argument->r2] = constant_value(&constants, argument->r1);
+                }
+            }
+            nlist_insert(ipcp_site_t, sites, site);
+        }
+        ipcp_constants_free(&constants);
+    }
+
+    int *changed = (int*) calloc(n+1, sizeof(int));
+    if (changed == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t budget = module_size * IPCP_GROWTH_PERCENT / 100;
+    uint64_t clone_number = 0;
+    for (uint64_t f = 0; f < n; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        uint64_t count = function->parameters.length;
+        if (count == 0) {
+            continue;
+        }
+
+        // Parameters that receive the same constant at every call
+        int agreed[count+1];
+        int64_t agreed_value[count+1];
+        uint64_t site_count = 0;
+        int any_agreed = 0;
+        for (uint64_t p = 0; p < count; p++) {
+            agreed[p] = 1;
+            agreed_value[p] = 0;
+        }
+        for (size_t s = 0; s < sites.length; s++) {
+            ipcp_site_t *site = &nlist_get_unsafe(sites, s);
+            if (site->callee != f) {
+                continue;
+            }
+            for (uint64_t p = 0; p < count; p++) {
+                if (!site->known[p] || (site_count > 0 && agreed_value[p] != site->value[p])) {
+                    agreed[p] = 0;
+                }
+                agreed_value[p] = site->value[p];
+            }
+            site_count++;
+        }
+        for (uint64_t p = 0; p < count; p++) {
+            agreed[p] = agreed[p] && site_count > 0;
+            any_agreed |= agreed[p];
+        }
+        if (any_agreed) {
+            uint64_t inserted = ipcp_bind_parameters(function, agreed, agreed_value);
+            changed[f] = 1;
+            for (size_t s = 0; s < sites.length; s++) {
+                ipcp_site_t *site = &nlist_get_unsafe(sites, s);
+                if (site->caller == function) {
+                    site->call += inserted;
+                }
+                // The propagated constants no longer distinguish the call sites
+                for (uint64_t p = 0; p < count && site->callee == f; p++) {
+                    site->known[p] &= !agreed[p];
+                }
+            }
+        }
+
+        // A copy for each other signature of constants, while the budget lasts
+        uint64_t size = function->code->length;
+        uint64_t clones = 0;
+        for (size_t s = 0; s < sites.length && size <= IPCP_MAX_CLONE_SIZE; s++) {
+            ipcp_site_t *site = &nlist_get_unsafe(sites, s);
+            int any_known = 0;
+            for (uint64_t p = 0; p < count; p++) {
+                any_known |= site->callee == f && site->known[p];
+            }
+            if (!any_known || clones == IPCP_MAX_CLONES || size > budget) {
+                continue;
+            }
+            iloc_function_t *clone = ipcp_clone(function, clone_number++);
+            ipcp_bind_parameters(clone, site->known, site->value);
+            ipcp_fold_constants(clone);
+            nlist_insert(iloc_function_t*, module->functions, clone);
+            budget -= size;
+            clones++;
+            // Every call with the same signature goes to the copy
+            for (size_t t = sites.length; t-- > s;) {
+                ipcp_site_t *other = &nlist_get_unsafe(sites, t);
+                if (other->callee == f && ipcp_same_signature(site, other, count)) {
+                    other->caller->code->instructions[other->call].r1 = clone->function_label;
+                    if (t != s) {
+                        other->callee = n;
+                    }
+                }
+            }
+            site->callee = n;
+        }
+    }
+
+    for (uint64_t f = 0; f < n; f++) {
+        if (changed[f]) {
+            ipcp_fold_constants(nlist_get_unsafe(module->functions, f));
+        }
+    }
+    for (size_t s = 0; s < sites.length; s++) {
+        free(nlist_get_unsafe(sites, s).known);
+        free(nlist_get_unsafe(sites, s).value);
+    }
+    nlist_free(sites);
+    free(changed);
+}
+
+/*
+ * Finds the value that a single store in the entry of main gives to each
+ * global: the store must come before any call, branch or read of the global,
+ * so every read in the program happens after it
+ */
+void ipcp_global_initializers(iloc_module_t *module, uint64_t *stores, int *known, int64_t *value) {
+    iloc_function_t *main_function = NULL;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f)->name, "main") == 0) {
+            main_function = nlist_get_unsafe(module->functions, f);
+        }
+    }
+    if (main_function == NULL) {
+        return;
+    }
+    iloc_program_t *code = main_function->code;
+    int *read = (int*) calloc(module->globals.length+1, sizeof(int));
+    if (read == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < code->length; i++) {
+        iloc_instruction_t *instruction = &code->instructions[i];
+        iloc_instruction_type_t type = instruction->instruction;
+        if (type == call || type == tailcall || type == jump || type == jump_i || type == cbr || type == ret) {
+            break;
+        }
+        int is_store;
+        int64_t offset = iloc_instruction_global(instruction, &is_store);
+        iloc_global_t *global = offset >= 0 ? iloc_module_global_at(module, offset) : NULL;
+        if (global == NULL) {
+            continue;
+        }
+        uint64_t g = global - module->globals.items;
+        if (!is_store) {
+            read[g] = 1;
+            continue;
+        }
+        if (stores[g] != 1 || read[g]) {
+            continue;
+        }
+        // The entry is straight-line code, so the last definition reaches the store
+        iloc_instruction_type_t constant = type == fstore_ai_r ? fload_i : load_i;
+        for (uint64_t k = i; k-- > 0;) {
+            int64_t *def = iloc_instruction_def(&code->instructions[k]);
+            if (def != NULL && *def == instruction->r1) {
+                if (code->instructions[k].instruction == constant) {
+                    known[g] = 1;
+                    value[g] = code->instructions[k].r1;
+                }
+                break;
+            }
+        }
+    }
+    free(read);
+}
+
+void ipcp_globals(iloc_module_t *module) {
+    uint64_t n = module->globals.length;
+    uint64_t *stores = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    int *indexed = (int*) calloc(n+1, sizeof(int));
+    int *known = (int*) calloc(n+1, sizeof(int));
+    int64_t *value = (int64_t*) calloc(n+1, sizeof(int64_t));
+    if (stores == NULL || indexed == NULL || known == NULL || value == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for ipcp_globals (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-5);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+        for (uint64_t i = 0; i < code->length; i++) {
+            iloc_instruction_t *instruction = &code->instructions[i];
+            int is_store;
+            int64_t offset = iloc_instruction_global(instruction, &is_store);
+            iloc_global_t *global = offset >= 0 ? iloc_module_global_at(module, offset) : NULL;
+            if (global == NULL) {
+                continue;
+            }
+            uint64_t g = global - module->globals.items;
+            if (instruction->instruction == load_ax || instruction->instruction == store_ax || (uint64_t) offset != global->offset) {
+                indexed[g] = 1;
+            } else if (is_store) {
+                stores[g]++;
+            }
+        }
+    }
+    // Globals that are never written keep the zero of .bss
+    for (uint64_t g = 0; g < n; g++) {
+        known[g] = stores[g] == 0;
+    }
+    ipcp_global_initializers(module, stores, known, value);
+
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+        for (uint64_t i = 0; i < code->length; i++) {
+            iloc_instruction_t *instruction = &code->instructions[i];
+            int is_store;
+            int64_t offset = iloc_instruction_global(instruction, &is_store);
+            iloc_global_t *global = offset >= 0 && !is_store ? iloc_module_global_at(module, offset) : NULL;
+            if (global == NULL) {
+                continue;
+            }
+            uint64_t g = global - module->globals.items;
+            if (!known[g] || indexed[g]) {
+                continue;
+            }
+            int64_t result = instruction->r3;
+            if (instruction->instruction == fload_ai_r) {
+                instruction->instruction = fload_i;
+                instruction->r1 = stores[g] == 0 ? (int64_t) iloc_module_constant(module, 0.0) : value[g];
+            } else {
+                instruction->instruction = load_i;
+                instruction->r1 = value[g];
+            }
+            instruction->r2 = result;
+            instruction->r3 = 0;
+        }
+    }
+    free(stores);
+    free(indexed);
+    free(known);
+    free(value);
+}
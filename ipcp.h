@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Most specialized copies of a single function
+#define IPCP_MAX_CLONES 4
+
+// Largest function (in instructions) that may be specialized
+#define IPCP_MAX_CLONE_SIZE 256
+
+// Specialized copies may add at most this percentage to the size of the module
+#define IPCP_GROWTH_PERCENT 50
+
+/**************************************\
+* Interprocedural Constant Propagation *
+\**************************************/
+/*
+ * This function finds the integer arguments that are constants at the call
+ * sites of each function. A parameter that receives the same constant at
+ * every call is replaced by it inside the function, and the call sites that
+ * pass other constants get a specialized copy of the function (one per
+ * signature of constants, within a budget of code growth). The functions
+ * that changed are then folded with ipcp_fold_constants.
+ */
+void ipcp_module(iloc_module_t *module);
+
+/*
+ * This function replaces the reads of the global variables whose value is
+ * known at compile time by that constant: the ones never written (which hold
+ * the zero of .bss) and the ones written only once, with a constant, at the
+ * start of main before any call or read. The stores left behind are removed
+ * with the global by dead_code_module.
+ */
+void ipcp_globals(iloc_module_t *module);
+
+/*
+ * This function evaluates the integer instructions whose operands are
+ * constants (registers defined only by a loadI) and turns conditional
+ * branches on constants into jumps. The blocks those jumps no longer reach,
+ * and the instructions whose result is no longer read, are then removed.
+ */
+void ipcp_fold_constants(iloc_function_t *function);
@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "isel.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+#define REG isel_register
+#define IMM isel_immediate
+#define MEM isel_memory
+#define SCALED isel_scaled
+
+typedef struct {
+    iloc_instruction_type_t type;
+    uint8_t r1;   // Kinds accepted for r1 and r2
+    uint8_t r2;
+    uint8_t cost; // Instructions emitted
+} isel_pattern_t;
+
+/*
+ * Forms of each instruction that the lowering can emit. Commutative
+ * instructions also match with the operands swapped, so only the forms with
+ * the leaf in r2 are listed for them.
+ */
+static const isel_pattern_t patterns[] = {
+    { add,         REG,             REG | IMM,       1 }, // addl, or leal (r1,r2) / c(r1)
+    { add,         REG,             MEM,             1 },
+    { add,         REG,             SCALED,          1 }, // leal (r1,x,s)
+    { sub,         REG,             REG | IMM | MEM, 1 },
+    { sub,         IMM | MEM,       REG,             2 },
+    { mult,        REG,             REG | IMM | MEM, 1 },
+    { _div,        REG | IMM | MEM, REG | MEM,       4 },
+    { mod,         REG | IMM | MEM, REG | MEM,       4 },
+    { cmp_lt,      REG,             REG | IMM | MEM, 3 },
+    { cmp_lt,      IMM | MEM,       REG,             3 },
+    { cmp_lt,      MEM,             IMM,             3 },
+    { cmp_le,      REG,             REG | IMM | MEM, 3 },
+    { cmp_le,      IMM | MEM,       REG,             3 },
+    { cmp_le,      MEM,             IMM,             3 },
+    { cmp_eq,      REG,             REG | IMM | MEM, 3 },
+    { cmp_eq,      IMM | MEM,       REG,             3 },
+    { cmp_eq,      MEM,             IMM,             3 },
+    { cmp_ge,      REG,             REG | IMM | MEM, 3 },
+    { cmp_ge,      IMM | MEM,       REG,             3 },
+    { cmp_ge,      MEM,             IMM,             3 },
+    { cmp_gt,      REG,             REG | IMM | MEM, 3 },
+    { cmp_gt,      IMM | MEM,       REG,             3 },
+    { cmp_gt,      MEM,             IMM,             3 },
+    { cmp_ne,      REG,             REG | IMM | MEM, 3 },
+    { cmp_ne,      IMM | MEM,       REG,             3 },
+    { cmp_ne,      MEM,             IMM,             3 },
+    { store_ai_r,  REG | IMM,       0,               1 },
+    { store_ax,    REG | IMM,       0,               2 },
+    { i2i,         REG | IMM | MEM, 0,               1 },
+    { ret,         REG | IMM | MEM, 0,               1 },
+    { fadd,        REG,             REG | MEM,       1 },
+    { fsub,        REG,             REG | MEM,       1 },
+    { fsub,        MEM,             REG,             2 },
+    { fmult,       REG,             REG | MEM,       1 },
+    { fdiv,        REG,             REG | MEM,       1 },
+    { fdiv,        MEM,             REG,             2 },
+    { f2f,         REG | MEM,       0,               1 },
+    { i2f,         REG | MEM,       0,               1 },
+    { fcmp_lt,     REG | MEM,       REG,             4 }, // ucomisd r1, r2
+    { fcmp_le,     REG | MEM,       REG,             4 },
+    { fcmp_gt,     REG,             REG | MEM,       4 }, // ucomisd r2, r1
+    { fcmp_ge,     REG,             REG | MEM,       4 },
+    { fcmp_eq,     REG,             REG | MEM,       6 },
+    { fcmp_ne,     REG,             REG | MEM,       6 },
+};
+
+#define PATTERN_COUNT (sizeof(patterns) / sizeof(patterns[0]))
+
+// Instructions a leaf costs when it is computed into its register instead
+#define LEAF_COST 1
+
+int isel_commutative(iloc_instruction_type_t type) {
+    return type == add || type == mult || type == fadd || type == fmult;
+}
+
+// Whether r2 is an operand too
+int isel_binary(iloc_instruction_type_t type) {
+    for (uint64_t p = 0; p < PATTERN_COUNT; p++) {
+        if (patterns[p].type == type && patterns[p].r2 != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Returns the cost of the cheapest pattern that reads r1 and r2 in the given
+ * forms, or -1 if there is none
+ */
+int64_t isel_cost(iloc_instruction_type_t type, uint8_t r1, uint8_t r2) {
+    int64_t best = -1;
+    for (uint64_t p = 0; p < PATTERN_COUNT; p++) {
+        const isel_pattern_t *pattern = &patterns[p];
+        if (pattern->type != type) {
+            continue;
+        }
+        int matches = (pattern->r1 & r1) && (pattern->r2 == 0 || (pattern->r2 & r2));
+        if (!matches && isel_commutative(type)) {
+            matches = (pattern->r1 & r2) && (pattern->r2 & r1);
+        }
+        if (matches && (best < 0 || pattern->cost < best)) {
+            best = pattern->cost;
+        }
+    }
+    return best;
+}
+
+/*
+ * Returns the physical registers the instruction reads or, with <defs>,
+ * writes (the operands of param/getparam only when they are in registers)
+ */
+uint64_t isel_registers(iloc_instruction_t *instruction, int defs) {
+    iloc_instruction_t copy = *instruction;
+    int64_t *operands[3];
+    uint64_t count = 0;
+    switch (instruction->instruction) {
+        case getparam:
+        case fgetparam:
+        case param:
+        case fparam:
+            if (instruction->r3 != iloc_operand_register) {
+                return 0;
+            }
+            break;
+        default:
+            break;
+    }
+    if (defs) {
+        int64_t *def = iloc_instruction_def(&copy);
+        if (def != NULL) {
+            operands[count++] = def;
+        }
+    } else {
+        count = iloc_instruction_uses(&copy, operands);
+    }
+    uint64_t mask = 0;
+    for (uint64_t o = 0; o < count; o++) {
+        if (*operands[o] >= 0 && *operands[o] < 64) {
+            mask |= UINT64_C(1) << *operands[o];
+        }
+    }
+    return mask;
+}
+
+/*
+ * Returns the registers live at the end of each block
+ */
+uint64_t *isel_live_out(iloc_function_t *function, iloc_cfg_t *cfg) {
+    uint64_t blocks = cfg->blocks.length;
+    uint64_t *live_in = (uint64_t*) calloc(blocks+1, sizeof(uint64_t));
+    uint64_t *live_out = (uint64_t*) calloc(blocks+1, sizeof(uint64_t));
+    if (live_in == NULL || live_out == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t b = blocks; b-- > 0;) {
+            iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+            uint64_t live = 0;
+            for (size_t s = 0; s < block->successors.length; s++) {
+                live |= live_in[nlist_get_unsafe(block->successors, s)];
+            }
+            live_out[b] = live;
+            for (uint64_t i = block->end; i-- > block->start;) {
+                iloc_instruction_t *instruction = &function->code->instructions[i];
+                live = (live & ~isel_registers(instruction, 1)) | isel_registers(instruction, 0);
+            }
+            if (live != live_in[b]) {
+                live_in[b] = live;
+                changed = 1;
+            }
+        }
+    }
+    free(live_in);
+    return live_out;
+}
+
+int isel_is_compare(iloc_instruction_type_t type) {
+    return type == cmp_lt || type == cmp_le || type == cmp_eq || type == cmp_ge || type == cmp_gt || type == cmp_ne;
+}
+
+int isel_writes_memory(iloc_instruction_type_t type) {
+    return type == store_ai_r || type == fstore_ai_r || type == store_ax || type == call || type == tailcall || type == push;
+}
+
+/*
+ * Block-local state of the selection, as of the instruction being selected
+ */
+typedef struct {
+    iloc_instruction_t *code;
+    isel_choice_t *choices;
+    int64_t last_def[64];
+    int64_t last_use[64];
+    int64_t last_memory_write;
+} isel_block_state_t;
+
+/*
+ * Returns the form in which instruction <j> can read <reg> without the
+ * instruction that computes it (0 if that one must stay), storing that
+ * instruction in <leaf>. <live_after> are the registers live after <j>.
+ */
+uint8_t isel_leaf(isel_block_state_t *state, uint64_t j, int64_t reg, uint64_t live_after, int64_t *leaf) {
+    iloc_instruction_t *user = &state->code[j];
+    if (reg < 0 || reg >= 64) {
+        return 0;
+    }
+    int64_t i = state->last_def[reg];
+    if (i < 0 || state->last_use[reg] > i || state->choices[i].folded) {
+        return 0;
+    }
+    // Read exactly once, here, and dead afterwards
+    iloc_instruction_t copy = *user;
+    int64_t *uses[3];
+    uint64_t count = iloc_instruction_uses(&copy, uses);
+    uint64_t reads = 0;
+    for (uint64_t u = 0; u < count; u++) {
+        reads += *uses[u] == reg;
+    }
+    if (reads != 1 || ((live_after >> reg) & 1 && !((isel_registers(user, 1) >> reg) & 1))) {
+        return 0;
+    }
+    *leaf = i;
+    iloc_instruction_t *definition = &state->code[i];
+    switch (definition->instruction) {
+        case load_i:
+            return IMM;
+        case fload_i:
+            return MEM;
+        case load_ai_r:
+        case fload_ai_r:
+            return state->last_memory_write < i ? MEM : 0;
+        case mult:
+            {
+                // The index must still hold the same value at the user
+                isel_choice_t *choice = &state->choices[i];
+                for (int p = 0; p < 2; p++) {
+                    int64_t index = p == 0 ? definition->r2 : definition->r1;
+                    if (choice->kinds[p] != IMM || choice->kinds[1-p] != REG || index < 0 || index >= 64) {
+                        continue;
+                    }
+                    int64_t scale = state->code[choice->leaves[p]].r1;
+                    if ((scale == 1 || scale == 2 || scale == 4 || scale == 8) && state->last_def[index] < i) {
+                        return SCALED;
+                    }
+                }
+                return 0;
+            }
+        default:
+            return 0;
+    }
+}
+
+isel_choice_t *isel_select(iloc_function_t *function) {
+    uint64_t n = function->code->length;
+    isel_choice_t *choices = (isel_choice_t*) malloc((n+1) * sizeof(isel_choice_t));
+    if (choices == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for isel_choice_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < n; i++) {
+        choices[i].folded = 0;
+        choices[i].fused = 0;
+        choices[i].kinds[0] = REG;
+        choices[i].kinds[1] = REG;
+        choices[i].leaves[0] = -1;
+        choices[i].leaves[1] = -1;
+    }
+    if (optimization_level < 1) {
+        return choices;
+    }
+
+    iloc_cfg_t cfg = iloc_cfg_build(function->code);
+    uint64_t *live_out = isel_live_out(function, &cfg);
+    uint64_t *live_after = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    if (live_after == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    isel_block_state_t state;
+    state.code = function->code->instructions;
+    state.choices = choices;
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+        uint64_t live = live_out[b];
+        for (uint64_t i = block->end; i-- > block->start;) {
+            live_after[i] = live;
+            live = (live & ~isel_registers(&state.code[i], 1)) | isel_registers(&state.code[i], 0);
+        }
+
+        for (uint64_t r = 0; r < 64; r++) {
+            state.last_def[r] = -1;
+            state.last_use[r] = -1;
+        }
+        state.last_memory_write = -1;
+        for (uint64_t j = block->start; j < block->end; j++) {
+            iloc_instruction_t *instruction = &state.code[j];
+            if (isel_cost(instruction->instruction, REG, REG) >= 0) {
+                // Each operand is read from its register or folded, whichever
+                // makes the tree cheaper (ties keep the register)
+                uint8_t kinds[2] = { 0, 0 };
+                int64_t leaves[2] = { -1, -1 };
+                kinds[0] = isel_leaf(&state, j, instruction->r1, live_after[j], &leaves[0]);
+                if (isel_binary(instruction->instruction)) {
+                    kinds[1] = isel_leaf(&state, j, instruction->r2, live_after[j], &leaves[1]);
+                }
+                int64_t best = -1;
+                uint8_t best_kinds[2] = { REG, REG };
+                for (int f0 = 0; f0 < 2; f0++) {
+                    for (int f1 = 0; f1 < 2; f1++) {
+                        uint8_t k0 = f0 ? kinds[0] : REG;
+                        uint8_t k1 = f1 ? kinds[1] : REG;
+                        if (k0 == 0 || k1 == 0) {
+                            continue;
+                        }
+                        int64_t cost = isel_cost(instruction->instruction, k0, k1);
+                        if (cost < 0) {
+                            continue;
+                        }
+                        cost += (kinds[0] != 0 && !f0 ? LEAF_COST : 0) + (kinds[1] != 0 && !f1 ? LEAF_COST : 0);
+                        if (best < 0 || cost < best) {
+                            best = cost;
+                            best_kinds[0] = k0;
+                            best_kinds[1] = k1;
+                        }
+                    }
+                }
+                for (int p = 0; p < 2; p++) {
+                    if (best_kinds[p] != REG) {
+                        choices[j].kinds[p] = best_kinds[p];
+                        choices[j].leaves[p] = leaves[p];
+                        choices[leaves[p]].folded = 1;
+                    }
+                }
+            }
+
+            uint64_t uses = isel_registers(instruction, 0);
+            uint64_t defs = isel_registers(instruction, 1);
+            if (instruction->instruction == call || instruction->instruction == tailcall) {
+                // Which clobbers the caller-saved registers
+                defs = ~UINT64_C(0);
+            }
+            for (uint64_t r = 0; r < 64; r++) {
+                if ((uses >> r) & 1) {
+                    state.last_use[r] = j;
+                }
+                if ((defs >> r) & 1) {
+                    state.last_def[r] = j;
+                }
+            }
+            if (isel_writes_memory(instruction->instruction)) {
+                state.last_memory_write = j;
+            }
+        }
+
+        // The cbr that ends the block, and the comparison before it
+        uint64_t j = block->end - 1;
+        iloc_instruction_t *branch = &state.code[j];
+        if (j > block->start && branch->instruction == cbr && isel_is_compare(state.code[j-1].instruction)
+                && state.code[j-1].r3 == branch->r1 && branch->r1 >= 0 && branch->r1 < 64 && !((live_after[j] >> branch->r1) & 1)) {
+            choices[j-1].fused = 1;
+        }
+    }
+    free(live_after);
+    free(live_out);
+    iloc_cfg_free(&cfg);
+    return choices;
+}
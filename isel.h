@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/***********************\
+* Instruction Selection *
+\***********************/
+// Forms in which an x86 instruction can read an operand
+typedef enum {
+    isel_register  = 1,
+    isel_immediate = 2, // The constant of a loadI
+    isel_memory    = 4, // The address of a loadAI, floadAI or floadI
+    isel_scaled    = 8, // A register times 1, 2, 4 or 8 (a mult), as an index
+} isel_kind_t;
+
+typedef struct {
+    int folded;           // Emitted as an operand of a later instruction instead
+    int fused;            // A comparison read only by the cbr after it, which branches on its flags
+    isel_kind_t kinds[2]; // How r1 and r2 are read
+    int64_t leaves[2];    // Instruction that computes r1 or r2, when not a register
+} isel_choice_t;
+
+/*
+ * This function selects the x86 form of each instruction of a function after
+ * register allocation, returning one choice per instruction.
+ *
+ * Within a basic block, a loadI, a load or a multiplication by a power of two
+ * whose result is read only once (and is dead afterwards) is a leaf of the
+ * expression tree of its user, which may read it directly as an immediate,
+ * a memory operand or a scaled index. Each instruction takes the cheapest
+ * pattern of a table of the operand forms x86 accepts, counting the leaves
+ * that would still need their own instruction. An integer comparison whose
+ * result is only read by the cbr right after it is fused with it, so the
+ * branch tests the flags instead of a boolean. Below -O1 every operand stays
+ * in a register.
+ */
+isel_choice_t *isel_select(iloc_function_t *function);
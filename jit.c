@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "code_gen.h"
+#include "list.h"
+#include "object.h"
+#include "structs.h"
+#include "x86.h"
+
+#define align_to(value, alignment) (((value) + (alignment) - 1) / (alignment) * (alignment))
+
+int jit_run_module(x86_module_t *module) {
+    iloc_module_t *source = module->source;
+    int64_t entry = -1;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f).name, "main") == 0) {
+            entry = f;
+        }
+    }
+    if (entry < 0) {
+        fprintf(stderr, "ERRO: O programa nao define a funcao main\n");
+        return 1;
+    }
+
+    object_code_t code[code_section_count];
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        nlist_init(uint8_t, code[c].bytes);
+        nlist_init(object_relocation_t, code[c].relocations);
+    }
+    uint64_t *function_offsets = (uint64_t*) malloc((module->functions.length+1) * sizeof(uint64_t));
+    uint64_t *global_offsets = (uint64_t*) malloc((source->globals.length+1) * sizeof(uint64_t));
+    if (function_offsets == NULL || global_offsets == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    object_encode_module(code, module, function_offsets);
+    uint64_t bss_size = object_layout_globals(source, global_offsets);
+
+    // Code, constants and globals share one mapping, so every RIP-relative
+    // displacement fits in 32 bits, with each part in its own pages (the cold
+    // code follows the rest of the code)
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t sections[code_section_count];
+    sections[code_text] = 0;
+    sections[code_unlikely] = align_to(code[code_text].bytes.length, 16);
+    uint64_t rodata = align_to(sections[code_unlikely] + code[code_unlikely].bytes.length, page);
+    uint64_t bss = rodata + align_to(source->constants.length * sizeof(double) + source->data.length, page);
+    uint64_t size = bss + align_to(bss_size, page);
+    if (size == 0) {
+        size = page;
+    }
+    uint8_t *base = (uint8_t*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Failed to map memory for the JIT (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        memcpy(base + sections[c], code[c].bytes.items, code[c].bytes.length);
+    }
+    memcpy(base + rodata, source->constants.items, source->constants.length * sizeof(double));
+    memcpy(base + rodata + source->constants.length * sizeof(double), source->data.items, source->data.length);
+
+    object_symbol_t *symbols = object_symbols(module, global_offsets, function_offsets);
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        for (size_t r = 0; r < code[c].relocations.length; r++) {
+            object_relocation_t *relocation = &nlist_get_unsafe(code[c].relocations, r);
+            int64_t target = -1;
+            if (relocation->kind == relocation_constant) {
+                target = rodata;
+            } else if (relocation->kind == relocation_code) {
+                target = sections[relocation->section];
+            } else {
+                object_symbol_t *symbol = object_find_symbol(module, symbols, relocation);
+                if (symbol != NULL) {
+                    target = (symbol->kind == relocation_symbol ? bss : 0) + symbol->offset;
+                }
+            }
+            if (target < 0) {
+                fprintf(stderr, "ERROR: Undefined symbol \"%s\"\n", relocation->symbol);
+                exit(EXIT_FAILURE);
+            }
+            int64_t offset = sections[c] + relocation->offset;
+            int32_t displacement = (int32_t) (target + relocation->addend - offset);
+            memcpy(base + offset, &displacement, sizeof(int32_t));
+        }
+    }
+    free(symbols);
+
+    // W^X: the code stops being writable before it runs
+    if (mprotect(base, rodata, PROT_READ | PROT_EXEC) != 0 || mprotect(base + rodata, bss - rodata, PROT_READ) != 0) {
+        fprintf(stderr, "ERROR: Failed to protect the JIT code (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-1);
+        exit(EXIT_FAILURE);
+    }
+    int (*main_function)(void) = (int (*)(void)) (base + function_offsets[entry]);
+    int result = main_function();
+    for (size_t f = 0; f < module->functions.length && module->fini != NULL; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f).name, module->fini) == 0) {
+            void (*fini_function)(void) = (void (*)(void)) (base + function_offsets[f]);
+            fini_function();
+        }
+    }
+
+    munmap(base, size);
+    free(global_offsets);
+    free(function_offsets);
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        nlist_free(code[c].bytes);
+        nlist_free(code[c].relocations);
+    }
+    return result;
+}
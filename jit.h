@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+#include "x86.h"
+
+/***************\
+* JIT Execution *
+\***************/
+/*
+ * This function encodes the module into memory of the running process, with
+ * the globals in a block allocated next to the code, calls its main function
+ * (and then the function run at exit, if any) and returns the result, so a
+ * program runs without being assembled and linked.
+ */
+int jit_run_module(x86_module_t *module);
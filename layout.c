@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "layout.h"
+#include "list.h"
+#include "profile.h"
+#include "structs.h"
+#include "x86.h"
+
+// Probability of staying in the loop at a branch inside it
+#define LOOP_PROBABILITY 0.9
+
+// Probability of a branch to a block that returns, when the other one does not
+#define RETURN_PROBABILITY 0.1
+
+// Iterations assumed for each loop when estimating the block frequencies
+#define LOOP_ITERATIONS 10
+
+// Bytes the loop heads are aligned to (.p2align 4), padding them with at most
+// LAYOUT_ALIGN_MAX_SKIP bytes
+#define LAYOUT_ALIGN_LOG2 4
+#define LAYOUT_ALIGN_MAX_SKIP 10
+
+typedef struct {
+    uint64_t start;    // First instruction: the label of the block, except for the entry
+    uint64_t end;
+    int falls_through; // Continues into the next block without a jump
+    int returns;
+    int64_t loop_end;  // For the head of a loop, its last block (-1 otherwise)
+    double frequency;  // Estimated executions per call
+    int cold;
+    nlist_definition(uint64_t) successors;
+    nlist_definition(double) probabilities;
+    nlist_definition(int) unlikely; // Whether each successor is reached by an unlikely branch
+} layout_block_t;
+
+typedef struct {
+    uint64_t from;
+    uint64_t to;
+    double weight;
+} layout_edge_t;
+
+int layout_edge_compare(const void *a, const void *b) {
+    const layout_edge_t *x = (const layout_edge_t*) a;
+    const layout_edge_t *y = (const layout_edge_t*) b;
+    if (x->weight != y->weight) {
+        return x->weight > y->weight ? -1 : 1;
+    }
+    if (x->from != y->from) {
+        return x->from < y->from ? -1 : 1;
+    }
+    return x->to < y->to ? -1 : x->to > y->to;
+}
+
+/*
+ * Splits the program at its labels, linking each block to the targets of its
+ * jumps and to the next block when it falls through
+ */
+layout_block_t *layout_blocks(x86_program_t *program, uint64_t *count) {
+    layout_block_t *blocks = (layout_block_t*) malloc((program->length+1) * sizeof(layout_block_t));
+    if (blocks == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for layout_block_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t n = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (uint64_t i = 0; i < program->length; i++) {
+        x86_instruction_t *instruction = &program->items[i];
+        if (i == 0 || instruction->opcode == x86_label) {
+            if (n > 0) {
+                blocks[n-1].end = i;
+            }
+            blocks[n].start = i;
+            blocks[n].loop_end = -1;
+            blocks[n].cold = 0;
+            nlist_init(uint64_t, blocks[n].successors);
+            nlist_init(double, blocks[n].probabilities);
+            nlist_init(int, blocks[n].unlikely);
+            n++;
+        }
+        if (instruction->opcode == x86_label) {
+            if (instruction->src.value < min) min = instruction->src.value;
+            if (instruction->src.value > max) max = instruction->src.value;
+        }
+    }
+    if (n > 0) {
+        blocks[n-1].end = program->length;
+    }
+    uint64_t range = min <= max ? (uint64_t) (max - min + 1) : 0;
+    uint64_t *block_of_label = (uint64_t*) malloc((range+1) * sizeof(uint64_t));
+    if (block_of_label == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < n; b++) {
+        if (program->items[blocks[b].start].opcode == x86_label) {
+            block_of_label[program->items[blocks[b].start].src.value - min] = b;
+        }
+    }
+
+    for (uint64_t b = 0; b < n; b++) {
+        layout_block_t *block = &blocks[b];
+        x86_opcode_t last = x86_nop;
+        for (uint64_t i = block->start; i < block->end; i++) {
+            x86_instruction_t *instruction = &program->items[i];
+            if (instruction->opcode == x86_jmp || instruction->opcode == x86_jcc) {
+                nlist_insert(uint64_t, block->successors, block_of_label[instruction->src.value - min]);
+            }
+            if (instruction->opcode != x86_nop && instruction->opcode != x86_label) {
+                last = instruction->opcode;
+            }
+            // What follows the terminator never runs, so the block drops it
+            if (last == x86_jmp || last == x86_ret || last == x86_tailcall) {
+                block->end = i+1;
+            }
+        }
+        block->returns = last == x86_ret || last == x86_tailcall;
+        block->falls_through = last != x86_jmp && last != x86_ret && last != x86_tailcall && b+1 < n;
+        if (block->falls_through) {
+            nlist_insert(uint64_t, block->successors, b+1);
+        }
+        // Every back edge encloses the blocks between its target and its source
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t target = nlist_get_unsafe(block->successors, s);
+            if (target <= b && blocks[target].loop_end < (int64_t) b) {
+                blocks[target].loop_end = b;
+            }
+        }
+    }
+    free(block_of_label);
+    *count = n;
+    return blocks;
+}
+
+/*
+ * Estimates the probability of each edge and the frequency of each block,
+ * marking as cold the blocks only reached through unlikely branches. The
+ * blocks with a count from the profile (<counts> is -1 for the others) are
+ * cold if they never ran, and their counts decide the branches to them.
+ */
+void layout_estimate(layout_block_t *blocks, uint64_t n, int64_t *counts) {
+    for (uint64_t b = 0; b < n; b++) {
+        layout_block_t *block = &blocks[b];
+        uint64_t count = block->successors.length;
+        // Innermost loop containing the block
+        int64_t head = -1;
+        for (uint64_t h = 0; h <= b; h++) {
+            if (blocks[h].loop_end >= (int64_t) b) {
+                head = h;
+            }
+        }
+        for (size_t s = 0; s < count; s++) {
+            uint64_t target = nlist_get_unsafe(block->successors, s);
+            double probability = 1.0 / count;
+            int unlikely = 0;
+            uint64_t other = count == 2 ? nlist_get_unsafe(block->successors, 1-s) : target;
+            if (count == 2 && counts[target] >= 0 && counts[other] >= 0 && counts[target] + counts[other] > 0) {
+                probability = (double) counts[target] / (counts[target] + counts[other]);
+            } else if (count == 2) {
+                // A block that returns never gets back to the head, even when
+                // it is placed between the head and the back edge
+                int inside = head >= 0 && target >= (uint64_t) head && (int64_t) target <= blocks[head].loop_end && !blocks[target].returns;
+                int other_inside = head >= 0 && other >= (uint64_t) head && (int64_t) other <= blocks[head].loop_end && !blocks[other].returns;
+                if (inside != other_inside) {
+                    probability = inside ? LOOP_PROBABILITY : 1 - LOOP_PROBABILITY;
+                } else if (blocks[target].returns != blocks[other].returns) {
+                    probability = blocks[target].returns ? RETURN_PROBABILITY : 1 - RETURN_PROBABILITY;
+                    unlikely = blocks[target].returns;
+                }
+            }
+            nlist_insert(double, block->probabilities, probability);
+            nlist_insert(int, block->unlikely, unlikely);
+        }
+    }
+
+    // Forward edges carry the frequency down the blocks, and each loop head
+    // runs once per iteration
+    double *incoming = (double*) calloc(n+1, sizeof(double));
+    int *likely = (int*) calloc(n+1, sizeof(int));
+    int *reached = (int*) calloc(n+1, sizeof(int));
+    if (incoming == NULL || likely == NULL || reached == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for layout_estimate (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    incoming[0] = counts[0] >= 0 ? counts[0] : 1;
+    likely[0] = 1;
+    reached[0] = 1;
+    for (uint64_t b = 0; b < n; b++) {
+        layout_block_t *block = &blocks[b];
+        if (counts[b] >= 0) {
+            block->frequency = counts[b];
+            block->cold = b > 0 && counts[b] == 0;
+        } else {
+            block->frequency = incoming[b] * (block->loop_end >= 0 ? LOOP_ITERATIONS : 1);
+            block->cold = reached[b] && !likely[b];
+        }
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t target = nlist_get_unsafe(block->successors, s);
+            if (target > b) {
+                incoming[target] += block->frequency * nlist_get_unsafe(block->probabilities, s);
+                reached[target] = 1;
+                likely[target] |= !block->cold && !nlist_get_unsafe(block->unlikely, s);
+            }
+        }
+    }
+    free(reached);
+    free(likely);
+    free(incoming);
+}
+
+/*
+ * Returns the blocks in their new order, storing in <cold_start> the position
+ * of the first cold block
+ */
+uint64_t *layout_order(layout_block_t *blocks, uint64_t n, uint64_t *cold_start) {
+    uint64_t edge_count = 0;
+    for (uint64_t b = 0; b < n; b++) {
+        edge_count += blocks[b].successors.length;
+    }
+    layout_edge_t *edges = (layout_edge_t*) malloc((edge_count+1) * sizeof(layout_edge_t));
+    int64_t *next = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    int64_t *previous = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    uint64_t *head = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    double *connection = (double*) calloc(n+1, sizeof(double));
+    int *placed = (int*) calloc(n+1, sizeof(int));
+    uint64_t *order = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    if (edges == NULL || next == NULL || previous == NULL || head == NULL || connection == NULL || placed == NULL || order == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for layout_order (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-8);
+        exit(EXIT_FAILURE);
+    }
+    edge_count = 0;
+    for (uint64_t b = 0; b < n; b++) {
+        for (size_t s = 0; s < blocks[b].successors.length; s++) {
+            layout_edge_t edge = { b, nlist_get_unsafe(blocks[b].successors, s), blocks[b].frequency * nlist_get_unsafe(blocks[b].probabilities, s) };
+            edges[edge_count++] = edge;
+        }
+        next[b] = -1;
+        previous[b] = -1;
+        head[b] = b;
+    }
+    qsort(edges, edge_count, sizeof(layout_edge_t), layout_edge_compare);
+
+    // Chains: an edge joins the chain ending at its source to the one
+    // starting at its target (never the entry, and never across temperatures)
+    for (uint64_t e = 0; e < edge_count; e++) {
+        uint64_t from = edges[e].from;
+        uint64_t to = edges[e].to;
+        if (next[from] >= 0 || previous[to] >= 0 || to == 0 || head[from] == to || blocks[from].cold != blocks[to].cold) {
+            continue;
+        }
+        next[from] = to;
+        previous[to] = from;
+        for (int64_t b = to; b >= 0; b = next[b]) {
+            head[b] = head[from];
+        }
+    }
+
+    // Hot chains go after the one that jumps to them the most (the entry
+    // first), and the cold ones at the end in their original order
+    uint64_t length = 0;
+    for (int cold = 0; cold < 2; cold++) {
+        if (cold) {
+            *cold_start = length;
+        }
+        while (1) {
+            int64_t best = -1;
+            for (uint64_t b = 0; b < n; b++) {
+                if (head[b] != b || placed[b] || blocks[b].cold != cold) {
+                    continue;
+                }
+                if (best < 0 || connection[b] > connection[best]) {
+                    best = b;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            placed[best] = 1;
+            for (int64_t b = best; b >= 0; b = next[b]) {
+                order[length++] = b;
+                for (size_t s = 0; s < blocks[b].successors.length; s++) {
+                    uint64_t target = nlist_get_unsafe(blocks[b].successors, s);
+                    connection[head[target]] += blocks[b].frequency * nlist_get_unsafe(blocks[b].probabilities, s);
+                }
+            }
+        }
+    }
+    free(placed);
+    free(connection);
+    free(head);
+    free(previous);
+    free(next);
+    free(edges);
+    return order;
+}
+
+void layout_program(x86_program_t *program, iloc_function_t *function) {
+    uint64_t n;
+    layout_block_t *blocks = layout_blocks(program, &n);
+    // A profile where the function never ran says nothing about its blocks
+    int64_t *counts = (int64_t*) malloc((n+1) * sizeof(int64_t));
+    if (counts == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < n; b++) {
+        x86_instruction_t *first = &program->items[blocks[b].start];
+        if (!function->profiled || function->entry_count == 0) {
+            counts[b] = -1;
+        } else if (b == 0) {
+            counts[b] = function->entry_count;
+        } else {
+            counts[b] = first->opcode == x86_label ? profile_label_count(function, first->src.value) : -1;
+        }
+    }
+    layout_estimate(blocks, n, counts);
+    uint64_t cold_start;
+    uint64_t *order = layout_order(blocks, n, &cold_start);
+
+    x86_program_t result;
+    nlist_init(x86_instruction_t, result);
+    for (uint64_t k = 0; k < n; k++) {
+        layout_block_t *block = &blocks[order[k]];
+        if (k == cold_start) {
+            x86_instruction_t cold = { x86_cold, x86_cond_e, x86_operand_none(), x86_operand_none() };
+            nlist_insert(x86_instruction_t, result, cold);
+        }
+        // The padding would run on every iteration if a block of the loop
+        // laid out before the head fell into it (its jump to the head becomes
+        // useless there, and the peephole optimizer removes it)
+        int64_t previous = k > 0 && k != cold_start ? (int64_t) order[k-1] : -1;
+        x86_instruction_t *previous_last = previous >= 0 ? &program->items[blocks[previous].end-1] : NULL;
+        int falls_in = previous >= (int64_t) order[k] && previous <= block->loop_end
+            && previous_last->opcode == x86_jmp && previous_last->src.value == program->items[block->start].src.value;
+        if (block->loop_end >= 0 && !block->cold && !falls_in) {
+            x86_instruction_t align = { x86_align, x86_cond_e, x86_operand_immediate(LAYOUT_ALIGN_LOG2), x86_operand_immediate(LAYOUT_ALIGN_MAX_SKIP) };
+            nlist_insert(x86_instruction_t, result, align);
+        }
+        for (uint64_t i = block->start; i < block->end; i++) {
+            nlist_insert(x86_instruction_t, result, program->items[i]);
+        }
+        int64_t following = k+1 < n && k+1 != cold_start ? (int64_t) order[k+1] : -1;
+        if (block->falls_through && following != (int64_t) order[k]+1) {
+            x86_instruction_t jump = { x86_jmp, x86_cond_e, program->items[blocks[order[k]+1].start].src, x86_operand_none() };
+            nlist_insert(x86_instruction_t, result, jump);
+        }
+    }
+    nlist_free(*program);
+    *program = result;
+
+    for (uint64_t b = 0; b < n; b++) {
+        nlist_free(blocks[b].successors);
+        nlist_free(blocks[b].probabilities);
+        nlist_free(blocks[b].unlikely);
+    }
+    free(counts);
+    free(order);
+    free(blocks);
+}
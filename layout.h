@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/*************\
+* Code Layout *
+\*************/
+/*
+ * This function reorders the basic blocks of the program so the likely
+ * successor of each block follows it, chaining the blocks along the heaviest
+ * edges first (Pettis-Hansen) and placing each chain after the one that jumps
+ * to it the most. Jumps are added where a block no longer falls through to
+ * its successor; the peephole optimizer removes the ones that become useless.
+ *
+ * The edges are weighed by the block counts of the profile of <function> (the
+ * source of the program), if any, and otherwise by static heuristics:
+ * branches stay in the loop that contains them, and a branch to a block that
+ * returns is unlikely when the other one does not return. Blocks that never
+ * ran, or without a profile the ones only reached through unlikely branches
+ * (early returns), are cold and move to .text.unlikely, and the heads of the
+ * other loops are aligned to 16 bytes.
+ */
+void layout_program(x86_program_t *program, iloc_function_t *function);
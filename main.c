@@ -11,19 +11,33 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <string.h>
 #include "code_gen.h"
+#include "data_layout.h"
+#include "dead_code.h"
 #include "list.h"
 #include "structs.h"
 #include "print.h"
-
-extern int yyparse(void);
-extern int yylex_destroy(void);
+#include "inline.h"
+#include "interp.h"
+#include "ipcp.h"
+#include "jit.h"
+#include "layout.h"
+#include "memoize.h"
+#include "object.h"
+#include "peephole.h"
+#include "profile.h"
+#include "reg_alloc.h"
+#include "sched.h"
+#include "shrink_wrap.h"
+#include "tail_call.h"
+#include "tasks.h"
+#include "x86.h"
 
 char *program_name;
 
-void *arvore = NULL;
-
-void temp() {
+void temp(compilation_t *compilation) {
     // TODO: data segment (from semantics' scope)
     // .align 4
     // .type	<varname>, @object
@@ -32,29 +46,167 @@ void temp() {
     // .zero	4
 
     // TODO: register allocation
-    ast_t *tree = ((ast_t*) arvore);
+    ast_t *tree = compilation->tree;
+}
+
+// What the functions of a module share while they are compiled in parallel
+typedef struct {
+    compilation_t *compilation;
+    iloc_module_t *iloc_module;
+    x86_function_t *lowered; // Indexed like the functions of the module
+} compile_state_t;
+
+/*
+ * Optimizes, allocates the registers of and lowers the function at <index>,
+ * which touches nothing the other functions use
+ */
+void compile_function(void *context, uint64_t index) {
+    compile_state_t *state = (compile_state_t*) context;
+    iloc_function_t *function = nlist_get_unsafe(state->iloc_module->functions, index);
+    iloc_namespace_t namespace;
+    iloc_namespace_enter(&namespace, state->compilation);
+    if (optimization_level >= 2 && schedule_mode == schedule_pre) {
+        sched_function(function);
+    }
+    if (optimization_level >= 1) {
+        shrink_wrap_split(function);
+    }
+    if (optimization_level >= 2) {
+        reg_alloc_graph_coloring(function);
+    } else {
+        reg_alloc_linear_scan(function);
+    }
+    x86_function_t *x86_function = &state->lowered[index];
+    x86_function->name = function->name;
+    x86_function->code = x86_lower_function(state->iloc_module, function);
+    if (optimization_level >= 1) {
+        layout_program(&x86_function->code, function);
+        peephole_optimize(&x86_function->code);
+    }
+    if (optimization_level >= 2 && schedule_mode == schedule_post) {
+        sched_program(&x86_function->code);
+    }
+    iloc_namespace_leave(&namespace);
 }
 
 int main (int argc, char **argv) {
     program_name = argv[0];
-    int ret = yyparse(); 
-    // fprintf(stderr, "Reached main with code %d (arvore = %p)\n", ret, arvore);
-    yylex_destroy();
+    int peephole_stats = 0;
+    int memoize = 0;
+    int emit_object = 0;
+    int run = 0;
+    int interpret = 0;
+    char *profile_generate = NULL;
+    char *profile_use = NULL;
+    uint64_t jobs = tasks_default_jobs();
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'O' && argv[i][2] >= '0' && argv[i][2] <= '3' && argv[i][3] == '\0') {
+            optimization_level = argv[i][2] - '0';
+        } else if (strcmp(argv[i], "--peephole-stats") == 0) {
+            peephole_stats = 1;
+        } else if (strcmp(argv[i], "--memoize") == 0) {
+            memoize = 1;
+        } else if (strncmp(argv[i], "--inline-threshold=", 19) == 0 && argv[i][19] >= '0' && argv[i][19] <= '9') {
+            inline_threshold = strtoull(&argv[i][19], NULL, 10);
+        } else if (strcmp(argv[i], "--emit=asm") == 0) {
+            emit_object = 0;
+        } else if (strcmp(argv[i], "--emit=obj") == 0) {
+            emit_object = 1;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run = 1;
+        } else if (strcmp(argv[i], "--interpret") == 0) {
+            interpret = 1;
+        } else if (strcmp(argv[i], "--profile-generate") == 0) {
+            profile_generate = PROFILE_DEFAULT_FILE;
+        } else if (strncmp(argv[i], "--profile-generate=", 19) == 0 && argv[i][19] != '\0') {
+            profile_generate = &argv[i][19];
+        } else if (strncmp(argv[i], "--profile-use=", 14) == 0 && argv[i][14] != '\0') {
+            profile_use = &argv[i][14];
+        } else if (strcmp(argv[i], "--schedule=none") == 0) {
+            schedule_mode = schedule_none;
+        } else if (strcmp(argv[i], "--schedule=pre") == 0) {
+            schedule_mode = schedule_pre;
+        } else if (strcmp(argv[i], "--schedule=post") == 0) {
+            schedule_mode = schedule_post;
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0 && argv[i][7] >= '1' && argv[i][7] <= '9') {
+            jobs = strtoull(&argv[i][7], NULL, 10);
+        } else {
+            fprintf(stderr, "ERRO: Opcao desconhecida \"%s\"\n", argv[i]);
+            fprintf(stderr, "Uso: %s [-O0 | -O1 | -O2 | -O3] [--peephole-stats] [--inline-threshold=N] [--memoize] [--profile-generate[=arquivo] | --profile-use=arquivo] [--schedule=none | --schedule=pre | --schedule=post] [--jobs=N] [--emit=asm | --emit=obj | --run | --interpret] < entrada > saida.s\n", program_name);
+            return 1;
+        }
+    }
+    compilation_t *compilation = compilation_new();
+    int ret = compilation_parse(compilation, stdin);
+    // fprintf(stderr, "Reached main with code %d (arvore = %p)\n", ret, compilation->tree);
     if (ret != 0) {
         return ret;
     }
 
-    ast_t *program = (ast_t*) arvore;
+    ast_t *program = compilation->tree;
     if (program != NULL) {
+        iloc_module_t *iloc_module = compilation->module;
         // ast_program_export(program);
         // ast_program_free(program);
-        for (size_t i = 0; i < program->_program.length; i++) {
-            // fprintf(stdout, "%lu ", i);
-            fprintf(stdout, "%s", program->_program.items[i]);
+        if (memoize) {
+            memoize_module(iloc_module);
+        }
+        if (profile_use != NULL) {
+            profile_load(iloc_module, profile_use);
+        }
+        if (profile_generate != NULL) {
+            profile_instrument(iloc_module, profile_generate);
+        }
+        if (optimization_level >= 2) {
+            ipcp_globals(iloc_module);
+            ipcp_module(iloc_module);
+            inline_module(iloc_module);
+            // Inlining exposes the constant arguments to the callers
+            for (size_t i = 0; i < iloc_module->functions.length; i++) {
+                ipcp_fold_constants(nlist_get_unsafe(iloc_module->functions, i));
+            }
+        }
+        if (optimization_level >= 1) {
+            tail_call_module(iloc_module);
+            dead_code_module(iloc_module);
+            data_layout_module(iloc_module);
+        }
+        if (interpret) {
+            ret = interp_run_module(iloc_module);
+            iloc_module_free(iloc_module);
+            return ret;
+        }
+        // The functions are compiled in parallel, and put together in the
+        // order of the source, so the output does not depend on the jobs
+        uint64_t count = iloc_module->functions.length;
+        compile_state_t state = { compilation, iloc_module, (x86_function_t*) malloc((count+1) * sizeof(x86_function_t)) };
+        if (state.lowered == NULL) {
+            fprintf(stderr, "ERROR: Failed to allocate memory for x86_function_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+            exit(EXIT_FAILURE);
+        }
+        tasks_run(count, jobs, compile_function, &state);
+        x86_module_t *x86_module = x86_module_new(iloc_module);
+        for (size_t i = 0; i < count; i++) {
+            nlist_insert(x86_function_t, x86_module->functions, state.lowered[i]);
+        }
+        free(state.lowered);
+        if (optimization_level >= 1 && peephole_stats) {
+            peephole_report(stderr);
+        }
+        if (profile_generate != NULL) {
+            profile_emit_dumper(x86_module);
+        }
+        if (run) {
+            ret = jit_run_module(x86_module);
+        } else if (emit_object) {
+            object_write_module(stdout, x86_module);
+        } else {
+            x86_module_to_string(stdout, x86_module);
         }
-        // print_ast(stderr, program);
+        iloc_module_free(iloc_module);
+        // print_ast(stderr, compilation, program);
     }
 
-    return 0;
+    return ret;
 }
 
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "memoize.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+/*
+ * Returns true if the function may be pure by itself, ignoring its calls
+ */
+int memoize_is_candidate(iloc_function_t *function) {
+    if (function->type == type_float || function->parameters.length == 0) {
+        return 0;
+    }
+    iloc_program_t *code = function->code;
+    for (uint64_t i = 0; i < code->length; i++) {
+        switch (code->instructions[i].instruction) {
+            case load_ai_r:
+            case store_ai_r:
+            case fload_ai_r:
+            case fstore_ai_r:
+            case load_ax:
+            case store_ax:
+            case fgetparam:
+                return 0;
+            default:
+                break;
+        }
+    }
+    return 1;
+}
+
+int memoize_is_recursive(iloc_function_t *function) {
+    for (uint64_t i = 0; i < function->code->length; i++) {
+        iloc_instruction_t *instruction = &function->code->instructions[i];
+        if (instruction->instruction == call && instruction->r1 == (int64_t) function->function_label) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Pushes <value> = <register> * <constant> and returns the value
+ */
+uint64_t memoize_multiply(iloc_program_t *program, uint64_t reg, int64_t constant) {
+    uint64_t factor = iloc_next_id();
+    uint64_t product = iloc_next_id();
+    iloc_push(program, load_i, constant, factor, 0);
+    iloc_push(program, mult, reg, factor, product);
+    return product;
+}
+
+void memoize_function(iloc_module_t *module, iloc_function_t *function) {
+    // Each entry holds a valid flag, the arguments and the result
+    uint64_t count = function->parameters.length;
+    uint64_t stride = 4 * (count + 2);
+    char *name = (char*) malloc(strlen(function->name) + 6);
+    if (name == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for char* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    sprintf(name, "%s.memo", function->name);
+    uint64_t table = iloc_module_add_global(module, name, type_int, MEMOIZE_ENTRIES * stride);
+    // Only the function uses its table, so it must not clash with other objects
+    iloc_module_find_global(module, table)->local = 1;
+    uint64_t result_field = table + 4 * (count + 1);
+
+    iloc_program_t *code = function->code;
+    iloc_program_t *new_program = iloc_program_new();
+    uint64_t i = 0;
+    while (i < code->length && code->instructions[i].instruction == getparam) {
+        iloc_program_push(new_program, code->instructions[i++]);
+    }
+
+    // The parameters are variables, so the key is copied before the body runs
+    uint64_t keys[count+1];
+    uint64_t hash = 0;
+    for (uint64_t p = 0; p < count; p++) {
+        keys[p] = iloc_next_id();
+        iloc_push(new_program, i2i, nlist_get_unsafe(function->parameters, p), keys[p], 0);
+        if (p == 0) {
+            hash = keys[p];
+        } else {
+            uint64_t sum = iloc_next_id();
+            iloc_push(new_program, add, memoize_multiply(new_program, hash, 31), keys[p], sum);
+            hash = sum;
+        }
+    }
+    // slot = ((hash % entries) + entries) % entries, which is never negative
+    uint64_t entries = iloc_next_id();
+    uint64_t remainder = iloc_next_id();
+    uint64_t shifted = iloc_next_id();
+    uint64_t slot = iloc_next_id();
+    iloc_push(new_program, load_i, MEMOIZE_ENTRIES, entries, 0);
+    iloc_push(new_program, mod, hash, entries, remainder);
+    iloc_push(new_program, add, remainder, entries, shifted);
+    iloc_push(new_program, mod, shifted, entries, slot);
+    uint64_t entry = memoize_multiply(new_program, slot, stride);
+
+    // Lookup
+    uint64_t label_check = iloc_next_id();
+    uint64_t label_miss = iloc_next_id();
+    uint64_t valid = iloc_next_id();
+    iloc_push(new_program, load_ax, table, entry, valid);
+    iloc_push(new_program, cbr, valid, label_check, label_miss);
+    iloc_push(new_program, label, label_check, 0, 0);
+    for (uint64_t p = 0; p < count; p++) {
+        uint64_t stored = iloc_next_id();
+        uint64_t equal = iloc_next_id();
+        uint64_t label_next = iloc_next_id();
+        iloc_push(new_program, load_ax, table + 4 * (p + 1), entry, stored);
+        iloc_push(new_program, cmp_eq, stored, keys[p], equal);
+        iloc_push(new_program, cbr, equal, label_next, label_miss);
+        iloc_push(new_program, label, label_next, 0, 0);
+    }
+    uint64_t cached = iloc_next_id();
+    iloc_push(new_program, load_ax, result_field, entry, cached);
+    iloc_push(new_program, ret, cached, 0, 0);
+    iloc_push(new_program, label, label_miss, 0, 0);
+
+    // Body, filling the entry before every return
+    for (; i < code->length; i++) {
+        iloc_instruction_t *instruction = &code->instructions[i];
+        if (instruction->instruction == ret) {
+            uint64_t one = iloc_next_id();
+            iloc_push(new_program, load_i, 1, one, 0);
+            iloc_push(new_program, store_ax, one, table, entry);
+            for (uint64_t p = 0; p < count; p++) {
+                iloc_push(new_program, store_ax, keys[p], table + 4 * (p + 1), entry);
+            }
+            iloc_push(new_program, store_ax, instruction->r1, result_field, entry);
+        }
+        iloc_program_push(new_program, *instruction);
+    }
+
+    iloc_program_free(code);
+    function->code = new_program;
+}
+
+void memoize_module(iloc_module_t *module) {
+    uint64_t n = module->functions.length;
+    int *pure = (int*) malloc((n+1) * sizeof(int));
+    if (pure == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t f = 0; f < n; f++) {
+        pure[f] = memoize_is_candidate(nlist_get_unsafe(module->functions, f));
+    }
+
+    // A function that calls an impure function is impure, until nothing changes
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (uint64_t f = 0; f < n; f++) {
+            iloc_program_t *code = nlist_get_unsafe(module->functions, f)->code;
+            for (uint64_t i = 0; i < code->length && pure[f]; i++) {
+                if (code->instructions[i].instruction != call) {
+                    continue;
+                }
+                int callee_pure = 0;
+                for (uint64_t g = 0; g < n; g++) {
+                    if ((int64_t) nlist_get_unsafe(module->functions, g)->function_label == code->instructions[i].r1) {
+                        callee_pure = pure[g];
+                        break;
+                    }
+                }
+                if (!callee_pure) {
+                    pure[f] = 0;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    for (uint64_t f = 0; f < n; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        if (pure[f] && memoize_is_recursive(function)) {
+            memoize_function(module, function);
+        }
+    }
+    free(pure);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Entries of the direct-mapped cache of each memoized function
+#define MEMOIZE_ENTRIES 4096
+
+/*************\
+* Memoization *
+\*************/
+/*
+ * This function caches the results of the pure recursive functions of the
+ * module. A function is pure if it takes and returns only integers and
+ * booleans, never touches a global variable and only calls pure functions.
+ *
+ * Each memoized function gets a direct-mapped table in .bss, indexed by a
+ * hash of its arguments, that is consulted right after the parameters are
+ * read and filled before every return.
+ */
+void memoize_module(iloc_module_t *module);
@@ -0,0 +1,947 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <elf.h>
+#include "object.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+#include "x86.h"
+
+/*
+ * Machine code of a single instruction: jumps to labels are encoded later,
+ * once their form is known
+ */
+typedef struct {
+    uint8_t bytes[16];
+    uint64_t length;
+    object_relocation_kind_t relocation;
+    uint64_t relocation_offset; // Position of the 32-bit field in the instruction
+    x86_operand_t *target;      // Operand that names the relocated symbol
+} object_encoding_t;
+
+static const uint8_t condition_codes[] = {
+    [x86_cond_e] = 0x4,
+    [x86_cond_ne] = 0x5,
+    [x86_cond_l] = 0xC,
+    [x86_cond_le] = 0xE,
+    [x86_cond_g] = 0xF,
+    [x86_cond_ge] = 0xD,
+    [x86_cond_b] = 0x2,
+    [x86_cond_be] = 0x6,
+    [x86_cond_a] = 0x7,
+    [x86_cond_ae] = 0x3,
+    [x86_cond_p] = 0xA,
+    [x86_cond_np] = 0xB,
+};
+
+#define fits_int8(value) ((value) >= -128 && (value) <= 127)
+
+// Number of a register in the encoding (xmm registers are numbered from 0)
+#define hardware_number(reg) ((reg) & 15)
+
+/**********\
+ * Encoding *
+ \**********/
+void object_byte(object_encoding_t *encoding, uint8_t byte) {
+    encoding->bytes[encoding->length++] = byte;
+}
+
+void object_int32(object_encoding_t *encoding, int64_t value) {
+    for (uint64_t i = 0; i < 4; i++) {
+        object_byte(encoding, (uint8_t) ((uint64_t) value >> (8 * i)));
+    }
+}
+
+// Operands of object_modrm that name byte registers
+#define BYTE_REG 1
+#define BYTE_RM 2
+
+/*
+ * Encodes [prefix] [REX] opcode ModRM [SIB] [displacement], with <reg> in the
+ * reg field and <rm> as the register or memory operand. <byte_registers> marks
+ * the operands that need a REX prefix to name spl, bpl, sil or dil instead of
+ * the high byte registers.
+ */
+void object_modrm(object_encoding_t *encoding, uint8_t prefix, int rex_w, const uint8_t *opcode, uint64_t opcode_length, uint64_t reg, x86_operand_t *rm, int byte_registers) {
+    uint8_t rex = 0x40 | (rex_w ? 0x8 : 0) | ((reg & 8) ? 0x4 : 0);
+    int need_rex = rex_w || (reg & 8) || ((byte_registers & BYTE_REG) && reg >= 4 && reg < 8);
+    switch (rm->type) {
+        case operand_register:
+            rex |= (hardware_number(rm->reg) & 8) ? 0x1 : 0;
+            need_rex |= (hardware_number(rm->reg) & 8) || ((byte_registers & BYTE_RM) && hardware_number(rm->reg) >= 4 && hardware_number(rm->reg) < 8);
+            break;
+        case operand_memory:
+            rex |= (rm->reg & 8) ? 0x1 : 0;
+            need_rex |= rm->reg & 8;
+            break;
+        case operand_indexed:
+            rex |= ((rm->reg & 8) ? 0x1 : 0) | ((rm->index & 8) ? 0x2 : 0);
+            need_rex |= (rm->reg & 8) || (rm->index & 8);
+            break;
+        default:
+            break;
+    }
+    if (prefix != 0) {
+        object_byte(encoding, prefix);
+    }
+    if (need_rex) {
+        object_byte(encoding, rex);
+    }
+    for (uint64_t i = 0; i < opcode_length; i++) {
+        object_byte(encoding, opcode[i]);
+    }
+    reg &= 7;
+    switch (rm->type) {
+        case operand_register:
+            object_byte(encoding, 0xC0 | (reg << 3) | (hardware_number(rm->reg) & 7));
+            break;
+        case operand_memory:
+        case operand_indexed:
+            {
+                uint64_t base = rm->reg & 7;
+                uint8_t mod = rm->value == 0 && base != 5 ? 0x00 : fits_int8(rm->value) ? 0x40 : 0x80;
+                if (rm->type == operand_indexed) {
+                    object_byte(encoding, mod | (reg << 3) | 4);
+                    uint8_t scale = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+                    object_byte(encoding, (scale << 6) | ((rm->index & 7) << 3) | base);
+                } else if (base == 4) {
+                    object_byte(encoding, mod | (reg << 3) | 4);
+                    object_byte(encoding, 0x24);
+                } else {
+                    object_byte(encoding, mod | (reg << 3) | base);
+                }
+                if (mod == 0x40) {
+                    object_byte(encoding, (uint8_t) rm->value);
+                } else if (mod == 0x80) {
+                    object_int32(encoding, rm->value);
+                }
+            }
+            break;
+        case operand_symbol:
+        case operand_constant:
+        case operand_data:
+            object_byte(encoding, (reg << 3) | 5);
+            encoding->relocation = rm->type == operand_symbol ? relocation_symbol : relocation_constant;
+            encoding->relocation_offset = encoding->length;
+            encoding->target = rm;
+            object_int32(encoding, 0);
+            break;
+        default:
+            fprintf(stderr, "ERROR: Invalid operand for ModRM (type = %d)\n", rm->type);
+            exit(EXIT_FAILURE);
+    }
+}
+
+#define opcode1(a) ((const uint8_t[]) { a }), 1
+#define opcode2(a, b) ((const uint8_t[]) { a, b }), 2
+
+/*
+ * Arithmetic of the 0x00-0x3F group (add, or, and, sub, xor, cmp): <group> is
+ * the /digit of the immediate form
+ */
+void object_arithmetic(object_encoding_t *encoding, uint8_t group, int rex_w, x86_instruction_t *instruction) {
+    x86_operand_t *src = &instruction->src;
+    x86_operand_t *dst = &instruction->dst;
+    if (src->type == operand_immediate) {
+        if (fits_int8(src->value)) {
+            object_modrm(encoding, 0, rex_w, opcode1(0x83), group, dst, 0);
+            object_byte(encoding, (uint8_t) src->value);
+        } else if (dst->type == operand_register && dst->reg == x86_rax) {
+            if (rex_w) {
+                object_byte(encoding, 0x48);
+            }
+            object_byte(encoding, group * 8 + 5);
+            object_int32(encoding, src->value);
+        } else {
+            object_modrm(encoding, 0, rex_w, opcode1(0x81), group, dst, 0);
+            object_int32(encoding, src->value);
+        }
+    } else if (src->type == operand_register) {
+        object_modrm(encoding, 0, rex_w, opcode1(group * 8 + 1), hardware_number(src->reg), dst, 0);
+    } else {
+        object_modrm(encoding, 0, rex_w, opcode1(group * 8 + 3), hardware_number(dst->reg), src, 0);
+    }
+}
+
+/*
+ * Moves between registers and memory (movl and movq)
+ */
+void object_move(object_encoding_t *encoding, int rex_w, x86_instruction_t *instruction) {
+    x86_operand_t *src = &instruction->src;
+    x86_operand_t *dst = &instruction->dst;
+    if (src->type == operand_immediate && dst->type == operand_register) {
+        uint64_t reg = hardware_number(dst->reg);
+        if (rex_w && (src->value < INT32_MIN || src->value > INT32_MAX)) {
+            object_byte(encoding, 0x48 | ((reg & 8) ? 0x1 : 0));
+            object_byte(encoding, 0xB8 + (reg & 7));
+            object_int32(encoding, src->value);
+            object_int32(encoding, src->value >> 32);
+        } else if (rex_w) {
+            object_modrm(encoding, 0, 1, opcode1(0xC7), 0, dst, 0);
+            object_int32(encoding, src->value);
+        } else {
+            if (reg & 8) {
+                object_byte(encoding, 0x41);
+            }
+            object_byte(encoding, 0xB8 + (reg & 7));
+            object_int32(encoding, src->value);
+        }
+    } else if (src->type == operand_immediate) {
+        object_modrm(encoding, 0, rex_w, opcode1(0xC7), 0, dst, 0);
+        object_int32(encoding, src->value);
+    } else if (src->type == operand_register) {
+        object_modrm(encoding, 0, rex_w, opcode1(0x89), hardware_number(src->reg), dst, 0);
+    } else {
+        object_modrm(encoding, 0, rex_w, opcode1(0x8B), hardware_number(dst->reg), src, 0);
+    }
+}
+
+/*
+ * Scalar double instructions (F2/66 0F xx /r), with the destination in the
+ * reg field
+ */
+void object_sse(object_encoding_t *encoding, uint8_t prefix, uint8_t opcode, x86_instruction_t *instruction) {
+    object_modrm(encoding, prefix, 0, opcode2(0x0F, opcode), hardware_number(instruction->dst.reg), &instruction->src, 0);
+}
+
+/*
+ * Encodes every instruction except jumps to labels (and labels themselves,
+ * which take no space)
+ */
+void object_encode(object_encoding_t *encoding, x86_instruction_t *instruction) {
+    x86_operand_t *src = &instruction->src;
+    x86_operand_t *dst = &instruction->dst;
+    encoding->length = 0;
+    encoding->relocation = relocation_none;
+    switch (instruction->opcode) {
+        case x86_label:
+        case x86_nop:
+        case x86_align:
+        case x86_cold:
+            break;
+        case x86_movl:
+            object_move(encoding, 0, instruction);
+            break;
+        case x86_movq:
+            object_move(encoding, 1, instruction);
+            break;
+        case x86_leaq:
+        case x86_leal:
+            object_modrm(encoding, 0, instruction->opcode == x86_leaq, opcode1(0x8D), hardware_number(dst->reg), src, 0);
+            break;
+        case x86_movzbl:
+            object_modrm(encoding, 0, 0, opcode2(0x0F, 0xB6), hardware_number(dst->reg), src, BYTE_RM);
+            break;
+        case x86_addl:
+            object_arithmetic(encoding, 0, 0, instruction);
+            break;
+        case x86_subl:
+            object_arithmetic(encoding, 5, 0, instruction);
+            break;
+        case x86_xorl:
+            object_arithmetic(encoding, 6, 0, instruction);
+            break;
+        case x86_cmpl:
+            object_arithmetic(encoding, 7, 0, instruction);
+            break;
+        case x86_addq:
+            object_arithmetic(encoding, 0, 1, instruction);
+            break;
+        case x86_subq:
+            object_arithmetic(encoding, 5, 1, instruction);
+            break;
+        case x86_andb:
+        case x86_orb:
+            object_modrm(encoding, 0, 0, opcode1(instruction->opcode == x86_andb ? 0x20 : 0x08), hardware_number(src->reg), dst, BYTE_REG | BYTE_RM);
+            break;
+        case x86_testl:
+            if (src->type == operand_immediate) {
+                object_modrm(encoding, 0, 0, opcode1(0xF7), 0, dst, 0);
+                object_int32(encoding, src->value);
+            } else {
+                object_modrm(encoding, 0, 0, opcode1(0x85), hardware_number(src->reg), dst, 0);
+            }
+            break;
+        case x86_imull:
+            if (src->type == operand_immediate) {
+                object_modrm(encoding, 0, 0, opcode1(fits_int8(src->value) ? 0x6B : 0x69), hardware_number(dst->reg), dst, 0);
+                if (fits_int8(src->value)) {
+                    object_byte(encoding, (uint8_t) src->value);
+                } else {
+                    object_int32(encoding, src->value);
+                }
+            } else {
+                object_modrm(encoding, 0, 0, opcode2(0x0F, 0xAF), hardware_number(dst->reg), src, 0);
+            }
+            break;
+        case x86_negl:
+            object_modrm(encoding, 0, 0, opcode1(0xF7), 3, src, 0);
+            break;
+        case x86_idivl:
+            object_modrm(encoding, 0, 0, opcode1(0xF7), 7, src, 0);
+            break;
+        case x86_cltd:
+            object_byte(encoding, 0x99);
+            break;
+        case x86_setcc:
+            object_modrm(encoding, 0, 0, opcode2(0x0F, 0x90 + condition_codes[instruction->condition]), 0, src, BYTE_RM);
+            break;
+        case x86_pushq:
+            if (src->type == operand_register) {
+                if (hardware_number(src->reg) & 8) {
+                    object_byte(encoding, 0x41);
+                }
+                object_byte(encoding, 0x50 + (hardware_number(src->reg) & 7));
+            } else if (src->type == operand_immediate && fits_int8(src->value)) {
+                object_byte(encoding, 0x6A);
+                object_byte(encoding, (uint8_t) src->value);
+            } else if (src->type == operand_immediate) {
+                object_byte(encoding, 0x68);
+                object_int32(encoding, src->value);
+            } else {
+                object_modrm(encoding, 0, 0, opcode1(0xFF), 6, src, 0);
+            }
+            break;
+        case x86_popq:
+            if (hardware_number(src->reg) & 8) {
+                object_byte(encoding, 0x41);
+            }
+            object_byte(encoding, 0x58 + (hardware_number(src->reg) & 7));
+            break;
+        case x86_leave:
+            object_byte(encoding, 0xC9);
+            break;
+        case x86_ret:
+            object_byte(encoding, 0xC3);
+            break;
+        case x86_call:
+        case x86_tailcall:
+            object_byte(encoding, instruction->opcode == x86_call ? 0xE8 : 0xE9);
+            encoding->relocation = relocation_function;
+            encoding->relocation_offset = encoding->length;
+            encoding->target = src;
+            object_int32(encoding, 0);
+            break;
+        case x86_endbr64:
+            object_byte(encoding, 0xF3);
+            object_byte(encoding, 0x0F);
+            object_byte(encoding, 0x1E);
+            object_byte(encoding, 0xFA);
+            break;
+        case x86_movsd:
+            if (dst->type == operand_register) {
+                object_sse(encoding, 0xF2, 0x10, instruction);
+            } else {
+                object_modrm(encoding, 0xF2, 0, opcode2(0x0F, 0x11), hardware_number(src->reg), dst, 0);
+            }
+            break;
+        case x86_movapd:
+            object_sse(encoding, 0x66, 0x28, instruction);
+            break;
+        case x86_addsd:
+            object_sse(encoding, 0xF2, 0x58, instruction);
+            break;
+        case x86_mulsd:
+            object_sse(encoding, 0xF2, 0x59, instruction);
+            break;
+        case x86_subsd:
+            object_sse(encoding, 0xF2, 0x5C, instruction);
+            break;
+        case x86_divsd:
+            object_sse(encoding, 0xF2, 0x5E, instruction);
+            break;
+        case x86_ucomisd:
+            object_sse(encoding, 0x66, 0x2E, instruction);
+            break;
+        case x86_cvtsi2sdl:
+            object_sse(encoding, 0xF2, 0x2A, instruction);
+            break;
+        case x86_cvttsd2si:
+            object_sse(encoding, 0xF2, 0x2C, instruction);
+            break;
+        case x86_syscall:
+            object_byte(encoding, 0x0F);
+            object_byte(encoding, 0x05);
+            break;
+        case x86_jmp:
+        case x86_jcc:
+            fprintf(stderr, "ERROR: Jumps to labels are encoded with their targets\n");
+            exit(EXIT_FAILURE);
+    }
+}
+
+#define is_jump(instruction) ((instruction)->opcode == x86_jmp || (instruction)->opcode == x86_jcc)
+
+uint64_t object_jump_length(x86_instruction_t *instruction, int is_long) {
+    if (!is_long) {
+        return 2;
+    }
+    return instruction->opcode == x86_jcc ? 6 : 5;
+}
+
+int64_t object_function_index(x86_module_t *module, char *name) {
+    for (size_t f = 0; f < module->functions.length; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f).name, name) == 0) {
+            return f;
+        }
+    }
+    return -1;
+}
+
+// Multi-byte nops the assembler pads the code with, by length
+static const uint8_t nop_patterns[][11] = {
+    { 0 },
+    { 0x90 },
+    { 0x66, 0x90 },
+    { 0x0F, 0x1F, 0x00 },
+    { 0x0F, 0x1F, 0x40, 0x00 },
+    { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+    { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    { 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+};
+
+#define NOP_MAX_LENGTH (sizeof(nop_patterns) / sizeof(nop_patterns[0]) - 1)
+
+// Padding of a .p2align at <offset>
+uint64_t object_padding(x86_instruction_t *instruction, uint64_t offset) {
+    uint64_t alignment = UINT64_C(1) << instruction->src.value;
+    uint64_t padding = (alignment - offset % alignment) % alignment;
+    return padding > (uint64_t) instruction->dst.value || padding > NOP_MAX_LENGTH ? 0 : padding;
+}
+
+/*
+ * Jumps to labels of the same section and tail calls from .text to functions
+ * of the module are relaxed like the assembler does: each one starts short and
+ * grows until all displacements fit, which terminates because growing a jump
+ * only moves the others apart (and alignment padding only absorbs that).
+ * Jumps between .text and .text.unlikely are always long and relocated.
+ */
+void object_encode_module(object_code_t *code, x86_module_t *module, uint64_t *function_offsets) {
+    uint64_t n = 0;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        n += nlist_get_unsafe(module->functions, f).code.length;
+    }
+    x86_instruction_t **instructions = (x86_instruction_t**) malloc((n+1) * sizeof(x86_instruction_t*));
+    object_encoding_t *encodings = (object_encoding_t*) malloc((n+1) * sizeof(object_encoding_t));
+    uint64_t *offsets = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    uint64_t *targets = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    uint64_t *starts = (uint64_t*) malloc((module->functions.length+1) * sizeof(uint64_t));
+    int *is_long = (int*) calloc(n+1, sizeof(int));
+    object_code_section_t *sections = (object_code_section_t*) malloc((n+1) * sizeof(object_code_section_t));
+    if (instructions == NULL || encodings == NULL || offsets == NULL || targets == NULL || starts == NULL || is_long == NULL || sections == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the encoder (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-8);
+        exit(EXIT_FAILURE);
+    }
+
+    // Labels are unique in the module, so they index an array by their range
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    uint64_t i = 0;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        x86_program_t *program = &nlist_get_unsafe(module->functions, f).code;
+        starts[f] = i;
+        object_code_section_t section = code_text;
+        for (uint64_t j = 0; j < program->length; j++, i++) {
+            x86_instruction_t *instruction = &program->items[j];
+            instructions[i] = instruction;
+            if (instruction->opcode == x86_cold) {
+                section = code_unlikely;
+            }
+            sections[i] = section;
+            if (instruction->opcode == x86_label || is_jump(instruction)) {
+                if (instruction->src.value < min) min = instruction->src.value;
+                if (instruction->src.value > max) max = instruction->src.value;
+            }
+        }
+    }
+    starts[module->functions.length] = n;
+    uint64_t range = min <= max ? (uint64_t) (max - min + 1) : 0;
+    uint64_t *label_index = (uint64_t*) malloc((range+1) * sizeof(uint64_t));
+    if (label_index == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+        if (instructions[i]->opcode == x86_label) {
+            label_index[instructions[i]->src.value - min] = i;
+        }
+    }
+
+    // Instructions with a target in their own section are relaxed, the
+    // others are final
+    int *is_relaxed = (int*) calloc(n+1, sizeof(int));
+    if (is_relaxed == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+        x86_instruction_t *instruction = instructions[i];
+        int64_t callee = instruction->opcode == x86_tailcall ? object_function_index(module, instruction->src.symbol) : -1;
+        if (is_jump(instruction)) {
+            targets[i] = label_index[instruction->src.value - min];
+            is_relaxed[i] = sections[targets[i]] == sections[i];
+            is_long[i] = !is_relaxed[i];
+        } else if (callee >= 0 && sections[i] == code_text) {
+            is_relaxed[i] = 1;
+            targets[i] = starts[callee];
+        } else if (instruction->opcode != x86_align) {
+            object_encode(&encodings[i], instruction);
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        uint64_t offset[code_section_count] = { 0, 0 };
+        for (i = 0; i < n; i++) {
+            x86_instruction_t *instruction = instructions[i];
+            offsets[i] = offset[sections[i]];
+            if (instruction->opcode == x86_align) {
+                offset[sections[i]] += object_padding(instruction, offsets[i]);
+            } else if (is_jump(instruction) || is_relaxed[i]) {
+                offset[sections[i]] += object_jump_length(instruction, is_long[i]);
+            } else {
+                offset[sections[i]] += encodings[i].length;
+            }
+        }
+        offsets[n] = offset[code_text];
+        for (i = 0; i < n; i++) {
+            if (!is_relaxed[i] || is_long[i]) {
+                continue;
+            }
+            int64_t displacement = (int64_t) offsets[targets[i]] - (int64_t) (offsets[i] + 2);
+            if (!fits_int8(displacement)) {
+                is_long[i] = 1;
+                changed = 1;
+            }
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        x86_instruction_t *instruction = instructions[i];
+        object_encoding_t *encoding = &encodings[i];
+        if (instruction->opcode == x86_align) {
+            encoding->length = 0;
+            uint64_t padding = object_padding(instruction, offsets[i]);
+            for (uint64_t b = 0; b < padding; b++) {
+                object_byte(encoding, nop_patterns[padding][b]);
+            }
+        } else if (is_jump(instruction) || is_relaxed[i]) {
+            uint64_t length = object_jump_length(instruction, is_long[i]);
+            int64_t displacement = (int64_t) offsets[targets[i]] - (int64_t) (offsets[i] + length);
+            uint8_t condition = condition_codes[instruction->condition];
+            if (!is_relaxed[i]) {
+                // The other section is placed by the linker
+                object_relocation_t relocation;
+                relocation.offset = offsets[i] + length - 4;
+                relocation.kind = relocation_code;
+                relocation.symbol = NULL;
+                relocation.section = sections[targets[i]];
+                relocation.addend = (int64_t) offsets[targets[i]] - 4;
+                nlist_insert(object_relocation_t, code[sections[i]].relocations, relocation);
+                displacement = 0;
+            }
+            encoding->length = 0;
+            if (!is_long[i]) {
+                object_byte(encoding, instruction->opcode == x86_jcc ? 0x70 + condition : 0xEB);
+                object_byte(encoding, (uint8_t) displacement);
+            } else if (instruction->opcode == x86_jcc) {
+                object_byte(encoding, 0x0F);
+                object_byte(encoding, 0x80 + condition);
+                object_int32(encoding, displacement);
+            } else {
+                object_byte(encoding, 0xE9);
+                object_int32(encoding, displacement);
+            }
+        } else if (encoding->relocation != relocation_none) {
+            object_relocation_t relocation;
+            relocation.offset = offsets[i] + encoding->relocation_offset;
+            relocation.kind = encoding->relocation;
+            relocation.symbol = encoding->target->symbol;
+            relocation.section = code_text;
+            // The field is relative to the end of the instruction
+            relocation.addend = -(int64_t) (encoding->length - encoding->relocation_offset);
+            if (encoding->target->type == operand_constant) {
+                relocation.addend += 8 * encoding->target->value;
+            } else if (encoding->target->type == operand_data) {
+                relocation.addend += 8 * module->source->constants.length + encoding->target->value;
+            }
+            nlist_insert(object_relocation_t, code[sections[i]].relocations, relocation);
+        }
+        for (uint64_t b = 0; b < encoding->length; b++) {
+            nlist_insert(uint8_t, code[sections[i]].bytes, encoding->bytes[b]);
+        }
+    }
+    for (size_t f = 0; f <= module->functions.length; f++) {
+        function_offsets[f] = offsets[starts[f]];
+    }
+
+    free(sections);
+    free(is_relaxed);
+    free(label_index);
+    free(is_long);
+    free(starts);
+    free(targets);
+    free(offsets);
+    free(encodings);
+    free(instructions);
+}
+
+/*********\
+ * Writing *
+ \*********/
+void object_append(byte_list_t *buffer, const void *data, uint64_t size) {
+    for (uint64_t i = 0; i < size; i++) {
+        nlist_insert(uint8_t, *buffer, ((const uint8_t*) data)[i]);
+    }
+}
+
+void object_align(byte_list_t *buffer, uint64_t alignment) {
+    while (buffer->length % alignment != 0) {
+        nlist_insert(uint8_t, *buffer, 0);
+    }
+}
+
+uint32_t object_string(byte_list_t *strings, const char *string) {
+    uint32_t offset = strings->length;
+    object_append(strings, string, strlen(string) + 1);
+    return offset;
+}
+
+uint64_t object_layout_globals(iloc_module_t *module, uint64_t *offsets) {
+    uint64_t size = 0;
+    for (size_t g = 0; g < module->globals.length; g++) {
+        iloc_global_t *global = &nlist_get_unsafe(module->globals, g);
+        uint64_t alignment = global->alignment;
+        size = (size + alignment - 1) / alignment * alignment;
+        offsets[g] = size;
+        size += global->size;
+    }
+    return size;
+}
+
+/*
+ * Orders the symbols by kind and name (and by index, so the first of two
+ * with the same name is the one found)
+ */
+int object_symbol_compare(const void *a, const void *b) {
+    const object_symbol_t *x = (const object_symbol_t*) a;
+    const object_symbol_t *y = (const object_symbol_t*) b;
+    if (x->kind != y->kind) {
+        return x->kind < y->kind ? -1 : 1;
+    }
+    int order = strcmp(x->name, y->name);
+    if (order != 0) {
+        return order;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+object_symbol_t *object_symbols(x86_module_t *module, uint64_t *global_offsets, uint64_t *function_offsets) {
+    iloc_module_t *source = module->source;
+    uint64_t count = source->globals.length + module->functions.length;
+    object_symbol_t *symbols = (object_symbol_t*) malloc((count+1) * sizeof(object_symbol_t));
+    if (symbols == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for object_symbol_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t s = 0;
+    for (size_t g = 0; g < source->globals.length; g++) {
+        object_symbol_t symbol = { nlist_get_unsafe(source->globals, g).name, relocation_symbol, g, global_offsets[g] };
+        symbols[s++] = symbol;
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        object_symbol_t symbol = { nlist_get_unsafe(module->functions, f).name, relocation_function, f, function_offsets[f] };
+        symbols[s++] = symbol;
+    }
+    qsort(symbols, count, sizeof(object_symbol_t), object_symbol_compare);
+    return symbols;
+}
+
+object_symbol_t *object_find_symbol(x86_module_t *module, object_symbol_t *symbols, object_relocation_t *relocation) {
+    uint64_t low = 0;
+    uint64_t high = module->source->globals.length + module->functions.length;
+    object_symbol_t key = { relocation->symbol, relocation->kind, 0, 0 };
+    // The first symbol not before the key
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (object_symbol_compare(&symbols[middle], &key) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == module->source->globals.length + module->functions.length
+            || symbols[low].kind != relocation->kind || strcmp(symbols[low].name, relocation->symbol) != 0) {
+        return NULL;
+    }
+    return &symbols[low];
+}
+
+// Section indexes of the object
+enum {
+    section_null,
+    section_text,
+    section_rela_text,
+    section_unlikely,
+    section_rela_unlikely,
+    section_bss,
+    section_rodata,
+    section_fini_array,
+    section_rela_fini_array,
+    section_note,
+    section_symtab,
+    section_strtab,
+    section_shstrtab,
+    section_count,
+};
+
+// Local symbols: the null symbol and one for each section with contents
+#define ELF_LOCAL_SYMBOLS 5
+
+void object_write_module(FILE *file, x86_module_t *module) {
+    iloc_module_t *source = module->source;
+    byte_list_t rela[code_section_count], rodata, fini_array, rela_fini_array, symtab, strtab, shstrtab, output;
+    object_code_t code[code_section_count];
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        nlist_init(uint8_t, code[c].bytes);
+        nlist_init(object_relocation_t, code[c].relocations);
+        nlist_init(uint8_t, rela[c]);
+    }
+    nlist_init(uint8_t, rodata);
+    nlist_init(uint8_t, fini_array);
+    nlist_init(uint8_t, rela_fini_array);
+    nlist_init(uint8_t, symtab);
+    nlist_init(uint8_t, strtab);
+    nlist_init(uint8_t, shstrtab);
+    nlist_init(uint8_t, output);
+
+    // .text and .text.unlikely
+    uint64_t *function_offsets = (uint64_t*) malloc((module->functions.length+1) * sizeof(uint64_t));
+    if (function_offsets == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    object_encode_module(code, module, function_offsets);
+
+    // .rodata
+    for (size_t c = 0; c < source->constants.length; c++) {
+        object_append(&rodata, &nlist_get_unsafe(source->constants, c), sizeof(double));
+    }
+    object_append(&rodata, source->data.items, source->data.length);
+
+    // Symbols: locals first, then the globals of .bss and the functions
+    Elf64_Sym symbol;
+    object_string(&strtab, "");
+    memset(&symbol, 0, sizeof(Elf64_Sym));
+    object_append(&symtab, &symbol, sizeof(Elf64_Sym));
+    uint16_t local_sections[] = { section_text, section_unlikely, section_bss, section_rodata };
+    for (uint64_t s = 0; s < ELF_LOCAL_SYMBOLS - 1; s++) {
+        memset(&symbol, 0, sizeof(Elf64_Sym));
+        symbol.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        symbol.st_shndx = local_sections[s];
+        object_append(&symtab, &symbol, sizeof(Elf64_Sym));
+    }
+    uint64_t *global_offsets = (uint64_t*) malloc((source->globals.length+1) * sizeof(uint64_t));
+    if (global_offsets == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t bss_size = object_layout_globals(source, global_offsets);
+    uint64_t bss_alignment = 1;
+    for (size_t g = 0; g < source->globals.length; g++) {
+        if (nlist_get_unsafe(source->globals, g).alignment > bss_alignment) {
+            bss_alignment = nlist_get_unsafe(source->globals, g).alignment;
+        }
+    }
+    // The globals local to the module go with the other locals, before the
+    // exported ones
+    uint64_t *global_symbols = (uint64_t*) malloc((source->globals.length+1) * sizeof(uint64_t));
+    if (global_symbols == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t local_symbols = ELF_LOCAL_SYMBOLS;
+    for (int exported = 0; exported <= 1; exported++) {
+        for (size_t g = 0; g < source->globals.length; g++) {
+            iloc_global_t *global = &nlist_get_unsafe(source->globals, g);
+            if (global->local == exported) {
+                continue;
+            }
+            global_symbols[g] = symtab.length / sizeof(Elf64_Sym);
+            local_symbols += !exported;
+            memset(&symbol, 0, sizeof(Elf64_Sym));
+            symbol.st_name = object_string(&strtab, global->name);
+            symbol.st_info = ELF64_ST_INFO(exported ? STB_GLOBAL : STB_LOCAL, STT_OBJECT);
+            symbol.st_shndx = section_bss;
+            symbol.st_value = global_offsets[g];
+            symbol.st_size = global->size;
+            object_append(&symtab, &symbol, sizeof(Elf64_Sym));
+        }
+    }
+    for (size_t f = 0; f < module->functions.length; f++) {
+        memset(&symbol, 0, sizeof(Elf64_Sym));
+        symbol.st_name = object_string(&strtab, nlist_get_unsafe(module->functions, f).name);
+        symbol.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        symbol.st_shndx = section_text;
+        symbol.st_value = function_offsets[f];
+        symbol.st_size = function_offsets[f+1] - function_offsets[f];
+        object_append(&symtab, &symbol, sizeof(Elf64_Sym));
+    }
+
+    // .rela.text and .rela.text.unlikely
+    object_symbol_t *symbols = object_symbols(module, global_offsets, function_offsets);
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        for (size_t r = 0; r < code[c].relocations.length; r++) {
+            object_relocation_t *relocation = &nlist_get_unsafe(code[c].relocations, r);
+            uint64_t symbol_index = 0;
+            if (relocation->kind == relocation_constant) {
+                symbol_index = 4;
+            } else if (relocation->kind == relocation_code) {
+                symbol_index = 1 + relocation->section;
+            } else {
+                object_symbol_t *symbol = object_find_symbol(module, symbols, relocation);
+                if (symbol != NULL && symbol->kind == relocation_function) {
+                    symbol_index = ELF_LOCAL_SYMBOLS + source->globals.length + symbol->index;
+                } else if (symbol != NULL) {
+                    symbol_index = global_symbols[symbol->index];
+                    // Like the assembler, through the symbol of .bss for the local ones
+                    if (nlist_get_unsafe(source->globals, symbol->index).local) {
+                        symbol_index = 3;
+                        relocation->addend += symbol->offset;
+                    }
+                }
+            }
+            if (symbol_index == 0) {
+                fprintf(stderr, "ERROR: Undefined symbol \"%s\"\n", relocation->symbol);
+                exit(EXIT_FAILURE);
+            }
+            Elf64_Rela rela_entry;
+            rela_entry.r_offset = relocation->offset;
+            rela_entry.r_info = ELF64_R_INFO(symbol_index, relocation->kind == relocation_function ? R_X86_64_PLT32 : R_X86_64_PC32);
+            rela_entry.r_addend = relocation->addend;
+            object_append(&rela[c], &rela_entry, sizeof(Elf64_Rela));
+        }
+    }
+    free(symbols);
+
+    // .fini_array, with the address of the function run at exit
+    for (size_t f = 0; f < module->functions.length && module->fini != NULL; f++) {
+        if (strcmp(nlist_get_unsafe(module->functions, f).name, module->fini) == 0) {
+            uint64_t address = 0;
+            object_append(&fini_array, &address, sizeof(uint64_t));
+            Elf64_Rela rela_entry;
+            rela_entry.r_offset = 0;
+            rela_entry.r_info = ELF64_R_INFO(ELF_LOCAL_SYMBOLS + source->globals.length + f, R_X86_64_64);
+            rela_entry.r_addend = 0;
+            object_append(&rela_fini_array, &rela_entry, sizeof(Elf64_Rela));
+        }
+    }
+
+    // Section names
+    const char *names[section_count] = {
+        "", ".text", ".rela.text", ".text.unlikely", ".rela.text.unlikely", ".bss", ".rodata", ".fini_array", ".rela.fini_array", ".note.GNU-stack", ".symtab", ".strtab", ".shstrtab",
+    };
+    uint32_t name_offsets[section_count];
+    for (uint64_t s = 0; s < section_count; s++) {
+        name_offsets[s] = object_string(&shstrtab, names[s]);
+    }
+
+    // Layout: header, the contents of each section and the section headers
+    Elf64_Shdr headers[section_count];
+    memset(headers, 0, sizeof(headers));
+    byte_list_t *contents[section_count] = {
+        NULL, &code[code_text].bytes, &rela[code_text], &code[code_unlikely].bytes, &rela[code_unlikely], NULL, &rodata, &fini_array, &rela_fini_array, NULL, &symtab, &strtab, &shstrtab,
+    };
+    uint64_t alignments[section_count] = { 0, 16, 8, 1, 8, bss_alignment, 8, 8, 8, 1, 8, 1, 1 };
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(Elf64_Ehdr));
+    object_append(&output, &header, sizeof(Elf64_Ehdr));
+    for (uint64_t s = 1; s < section_count; s++) {
+        headers[s].sh_name = name_offsets[s];
+        headers[s].sh_addralign = alignments[s];
+        if (contents[s] != NULL) {
+            object_align(&output, alignments[s]);
+            headers[s].sh_offset = output.length;
+            headers[s].sh_size = contents[s]->length;
+            object_append(&output, contents[s]->items, contents[s]->length);
+        } else {
+            headers[s].sh_offset = output.length;
+        }
+    }
+    headers[section_text].sh_type = SHT_PROGBITS;
+    headers[section_text].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    headers[section_rela_text].sh_type = SHT_RELA;
+    headers[section_rela_text].sh_flags = SHF_INFO_LINK;
+    headers[section_rela_text].sh_link = section_symtab;
+    headers[section_rela_text].sh_info = section_text;
+    headers[section_rela_text].sh_entsize = sizeof(Elf64_Rela);
+    headers[section_unlikely].sh_type = SHT_PROGBITS;
+    headers[section_unlikely].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    headers[section_rela_unlikely].sh_type = SHT_RELA;
+    headers[section_rela_unlikely].sh_flags = SHF_INFO_LINK;
+    headers[section_rela_unlikely].sh_link = section_symtab;
+    headers[section_rela_unlikely].sh_info = section_unlikely;
+    headers[section_rela_unlikely].sh_entsize = sizeof(Elf64_Rela);
+    headers[section_bss].sh_type = SHT_NOBITS;
+    headers[section_bss].sh_flags = SHF_ALLOC | SHF_WRITE;
+    headers[section_bss].sh_size = bss_size;
+    headers[section_rodata].sh_type = SHT_PROGBITS;
+    headers[section_rodata].sh_flags = SHF_ALLOC;
+    headers[section_fini_array].sh_type = SHT_FINI_ARRAY;
+    headers[section_fini_array].sh_flags = SHF_ALLOC | SHF_WRITE;
+    headers[section_fini_array].sh_entsize = sizeof(uint64_t);
+    headers[section_rela_fini_array].sh_type = SHT_RELA;
+    headers[section_rela_fini_array].sh_flags = SHF_INFO_LINK;
+    headers[section_rela_fini_array].sh_link = section_symtab;
+    headers[section_rela_fini_array].sh_info = section_fini_array;
+    headers[section_rela_fini_array].sh_entsize = sizeof(Elf64_Rela);
+    headers[section_note].sh_type = SHT_PROGBITS;
+    headers[section_symtab].sh_type = SHT_SYMTAB;
+    headers[section_symtab].sh_link = section_strtab;
+    headers[section_symtab].sh_info = local_symbols;
+    headers[section_symtab].sh_entsize = sizeof(Elf64_Sym);
+    headers[section_strtab].sh_type = SHT_STRTAB;
+    headers[section_shstrtab].sh_type = SHT_STRTAB;
+    object_align(&output, 8);
+    uint64_t section_headers = output.length;
+    object_append(&output, headers, sizeof(headers));
+
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = section_headers;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = section_count;
+    header.e_shstrndx = section_shstrtab;
+    memcpy(output.items, &header, sizeof(Elf64_Ehdr));
+
+    fwrite(output.items, 1, output.length, file);
+
+    free(global_symbols);
+    free(global_offsets);
+    free(function_offsets);
+    for (uint64_t c = 0; c < code_section_count; c++) {
+        nlist_free(code[c].bytes);
+        nlist_free(code[c].relocations);
+        nlist_free(rela[c]);
+    }
+    nlist_free(rodata);
+    nlist_free(fini_array);
+    nlist_free(rela_fini_array);
+    nlist_free(symtab);
+    nlist_free(strtab);
+    nlist_free(shstrtab);
+    nlist_free(output);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+#include "x86.h"
+
+/*********************\
+* ELF Object Emission *
+\*********************/
+typedef nlist_definition(uint8_t) byte_list_t;
+
+typedef enum {
+    relocation_none,
+    relocation_symbol,    // Global variable (R_X86_64_PC32)
+    relocation_constant,  // Float or other data in .rodata (R_X86_64_PC32 on the section)
+    relocation_function,  // Call or tail call (R_X86_64_PLT32)
+    relocation_code,      // Jump to the other code section (R_X86_64_PC32 on the section)
+} object_relocation_kind_t;
+
+// Sections of code: the functions, and the cold blocks moved out of them
+typedef enum {
+    code_text,
+    code_unlikely,
+    code_section_count,
+} object_code_section_t;
+
+// A 32-bit field of the code to patch with the address of <symbol> (or of
+// the code <section>) plus <addend>, relative to the field
+typedef struct {
+    uint64_t offset;
+    object_relocation_kind_t kind;
+    char *symbol;
+    object_code_section_t section;
+    int64_t addend;
+} object_relocation_t;
+
+typedef nlist_definition(object_relocation_t) relocation_list_t;
+
+// A global variable (of kind relocation_symbol) or a function (of kind
+// relocation_function), and where it is in .bss or .text
+typedef struct {
+    char *name;
+    object_relocation_kind_t kind;
+    uint64_t index; // In the globals or the functions of the module
+    uint64_t offset;
+} object_symbol_t;
+
+typedef struct {
+    byte_list_t bytes;
+    relocation_list_t relocations;
+} object_code_t;
+
+/*
+ * This function encodes every function of the module into <code> (one entry
+ * per code section, initialized by the caller), storing in <function_offsets>
+ * (one entry per function and one for the end) where each function starts in
+ * .text. The references that can only be resolved once the code is placed
+ * are appended to the relocations of each section; jumps inside a section are
+ * resolved in place.
+ */
+void object_encode_module(object_code_t *code, x86_module_t *module, uint64_t *function_offsets);
+
+/*
+ * This function stores the offset of each global variable in .bss into
+ * <offsets>, in the order of the module and aligned to their alignment, and
+ * returns the size of .bss
+ */
+uint64_t object_layout_globals(iloc_module_t *module, uint64_t *offsets);
+
+/*
+ * This function returns the symbols of the module (its globals, then its
+ * functions), with the offsets given by object_layout_globals and
+ * object_encode_module, sorted for object_find_symbol. The caller frees it.
+ */
+object_symbol_t *object_symbols(x86_module_t *module, uint64_t *global_offsets, uint64_t *function_offsets);
+
+/*
+ * This function returns the symbol a relocation of kind relocation_symbol or
+ * relocation_function refers to (NULL if the module does not define it)
+ */
+object_symbol_t *object_find_symbol(x86_module_t *module, object_symbol_t *symbols, object_relocation_t *relocation);
+
+/*
+ * This function encodes the module into machine code and writes it as a
+ * relocatable ELF64 object (the same one as assembling the output of
+ * x86_module_to_string), so no external assembler is needed.
+ *
+ * The object has the sections .text, .text.unlikely (the cold blocks), .bss,
+ * .rodata, .fini_array (the function run at exit, if any) and
+ * .note.GNU-stack, a global symbol for each function and global variable, and
+ * relocations for the RIP-relative accesses to globals and constants and the
+ * jumps between the code sections (R_X86_64_PC32), the calls (R_X86_64_PLT32)
+ * and the address in .fini_array (R_X86_64_64). Jumps to labels of the same section are resolved in
+ * place, using the short form whenever the target is within reach.
+ */
+void object_write_module(FILE *file, x86_module_t *module);
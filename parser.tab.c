@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -66,22 +66,6 @@
 
 
 
-/* First part of user prologue.  */
-#line 19 "parser.y"
-
-#include <stdio.h>
-// #include <stdlib.h>
-// #include <string.h>
-#include "code_gen.h"
-
-int yylex(void);
-void yyerror (char const *mensagem);
-
-extern int get_line_number(void);
-extern void *arvore;
-
-
-#line 85 "parser.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -174,6 +158,21 @@ typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
+/* Unqualified %code blocks.  */
+#line 25 "parser.y"
+
+#include <stdio.h>
+// #include <stdlib.h>
+// #include <string.h>
+#include "code_gen.h"
+
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+void yyerror (yyscan_t scanner, compilation_t *compilation, char const *mensagem);
+
+extern int get_line_number(yyscan_t scanner);
+
+
+#line 176 "parser.tab.c"
 
 #ifdef short
 # undef short
@@ -556,13 +555,13 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    86,    86,    88,    92,    96,   100,   104,   106,   110,
-     112,   114,   116,   120,   122,   124,   126,   134,   136,   140,
-     144,   146,   148,   150,   152,   154,   156,   158,   160,   164,
-     166,   168,   170,   172,   174,   176,   178,   180,   182,   184,
-     186,   188,   190,   192,   194,   196,   198,   200,   202,   204,
-     206,   208,   212,   214,   216,   218,   220,   222,   224,   228,
-     229,   230
+       0,    95,    95,    97,   101,   105,   109,   113,   115,   119,
+     121,   123,   125,   129,   131,   133,   135,   143,   145,   149,
+     153,   155,   157,   159,   161,   163,   165,   167,   169,   173,
+     175,   177,   179,   181,   183,   185,   187,   189,   191,   193,
+     195,   197,   199,   201,   203,   205,   207,   209,   211,   213,
+     215,   217,   221,   223,   225,   227,   229,   231,   233,   237,
+     238,   239
 };
 #endif
 
@@ -774,7 +773,7 @@ enum { YYENOMEM = -2 };
       }                                                           \
     else                                                          \
       {                                                           \
-        yyerror (YY_("syntax error: cannot back up")); \
+        yyerror (scanner, compilation, YY_("syntax error: cannot back up")); \
         YYERROR;                                                  \
       }                                                           \
   while (0)
@@ -807,7 +806,7 @@ do {                                                                      \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Kind, Value); \
+                  Kind, Value, scanner, compilation); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
@@ -819,10 +818,12 @@ do {                                                                      \
 
 static void
 yy_symbol_value_print (FILE *yyo,
-                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, yyscan_t scanner, compilation_t *compilation)
 {
   FILE *yyoutput = yyo;
   YY_USE (yyoutput);
+  YY_USE (scanner);
+  YY_USE (compilation);
   if (!yyvaluep)
     return;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
@@ -837,12 +838,12 @@ yy_symbol_value_print (FILE *yyo,
 
 static void
 yy_symbol_print (FILE *yyo,
-                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, yyscan_t scanner, compilation_t *compilation)
 {
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  yy_symbol_value_print (yyo, yykind, yyvaluep, scanner, compilation);
   YYFPRINTF (yyo, ")");
 }
 
@@ -876,7 +877,7 @@ do {                                                            \
 
 static void
 yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
-                 int yyrule)
+                 int yyrule, yyscan_t scanner, compilation_t *compilation)
 {
   int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
@@ -889,7 +890,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
                        YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
-                       &yyvsp[(yyi + 1) - (yynrhs)]);
+                       &yyvsp[(yyi + 1) - (yynrhs)], scanner, compilation);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -897,7 +898,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule); \
+    yy_reduce_print (yyssp, yyvsp, Rule, scanner, compilation); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
@@ -1205,9 +1206,11 @@ yysyntax_error (YYPTRDIFF_T *yymsg_alloc, char **yymsg,
 
 static void
 yydestruct (const char *yymsg,
-            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, yyscan_t scanner, compilation_t *compilation)
 {
   YY_USE (yyvaluep);
+  YY_USE (scanner);
+  YY_USE (compilation);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
@@ -1218,13 +1221,6 @@ yydestruct (const char *yymsg,
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -1234,8 +1230,21 @@ int yynerrs;
 `----------*/
 
 int
-yyparse (void)
+yyparse (yyscan_t scanner, compilation_t *compilation)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -1391,7 +1400,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval, scanner);
     }
 
   if (yychar <= YYEOF)
@@ -1479,367 +1488,367 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* push_scope: %empty  */
-#line 87 "parser.y"
-    { reduce_push_scope(); }
-#line 1485 "parser.tab.c"
+#line 96 "parser.y"
+    { reduce_push_scope(compilation); }
+#line 1494 "parser.tab.c"
     break;
 
   case 3: /* pop_scope: %empty  */
-#line 89 "parser.y"
-    { reduce_pop_scope(); }
-#line 1491 "parser.tab.c"
+#line 98 "parser.y"
+    { reduce_pop_scope(compilation); }
+#line 1500 "parser.tab.c"
     break;
 
   case 4: /* program: push_scope global_list pop_scope  */
-#line 93 "parser.y"
-    { (yyval.ast_t) = reduce_program((yyvsp[-1].ast_t)); arvore = (yyval.ast_t); }
-#line 1497 "parser.tab.c"
+#line 102 "parser.y"
+    { (yyval.ast_t) = reduce_program(compilation, (yyvsp[-1].ast_t)); compilation->tree = (yyval.ast_t); }
+#line 1506 "parser.tab.c"
     break;
 
   case 5: /* global_list: %empty  */
-#line 97 "parser.y"
-    { (yyval.ast_t) = reduce_global_list_empty(); }
-#line 1503 "parser.tab.c"
+#line 106 "parser.y"
+    { (yyval.ast_t) = reduce_global_list_empty(compilation); }
+#line 1512 "parser.tab.c"
     break;
 
   case 6: /* global_list: global_list type comma_separated_identifiers_1 ';'  */
-#line 101 "parser.y"
-    { (yyval.ast_t) = reduce_global_list_variable((yyvsp[-3].ast_t), (yyvsp[-2].type_t), (yyvsp[-1].list_t)); }
-#line 1509 "parser.tab.c"
+#line 110 "parser.y"
+    { (yyval.ast_t) = reduce_global_list_variable(compilation, (yyvsp[-3].ast_t), (yyvsp[-2].type_t), (yyvsp[-1].list_t)); }
+#line 1518 "parser.tab.c"
     break;
 
   case 7: /* global_list: global_list function_header '{' command_list '}'  */
-#line 105 "parser.y"
-    { (yyval.ast_t) = reduce_global_list_function((yyvsp[-4].ast_t), (yyvsp[-3].ast_t), (yyvsp[-1].ast_t)); }
-#line 1515 "parser.tab.c"
+#line 114 "parser.y"
+    { (yyval.ast_t) = reduce_global_list_function(compilation, (yyvsp[-4].ast_t), (yyvsp[-3].ast_t), (yyvsp[-1].ast_t)); }
+#line 1524 "parser.tab.c"
     break;
 
   case 8: /* function_header: '(' comma_separated_variables_0 ')' TK_OC_GE type '!' TK_IDENTIFICADOR  */
-#line 107 "parser.y"
-    { (yyval.ast_t) = reduce_function_header((yyvsp[-5].list_t), (yyvsp[-2].type_t), (yyvsp[0].lexeme_t)); }
-#line 1521 "parser.tab.c"
+#line 116 "parser.y"
+    { (yyval.ast_t) = reduce_function_header(compilation, (yyvsp[-5].list_t), (yyvsp[-2].type_t), (yyvsp[0].lexeme_t)); }
+#line 1530 "parser.tab.c"
     break;
 
   case 9: /* comma_separated_variables_0: %empty  */
-#line 111 "parser.y"
+#line 120 "parser.y"
     { (yyval.list_t) = empty_list(); }
-#line 1527 "parser.tab.c"
+#line 1536 "parser.tab.c"
     break;
 
   case 10: /* comma_separated_variables_0: comma_separated_variables_1  */
-#line 113 "parser.y"
+#line 122 "parser.y"
     { (yyval.list_t) = (yyvsp[0].list_t); }
-#line 1533 "parser.tab.c"
+#line 1542 "parser.tab.c"
     break;
 
   case 11: /* comma_separated_variables_1: variable  */
-#line 115 "parser.y"
+#line 124 "parser.y"
     { (yyval.list_t) = empty_list(); list_push((yyval.list_t), (yyvsp[0].ast_t)); }
-#line 1539 "parser.tab.c"
+#line 1548 "parser.tab.c"
     break;
 
   case 12: /* comma_separated_variables_1: comma_separated_variables_1 ',' variable  */
-#line 117 "parser.y"
+#line 126 "parser.y"
     { (yyval.list_t) = (yyvsp[-2].list_t); list_push((yyval.list_t), (yyvsp[0].ast_t)); }
-#line 1545 "parser.tab.c"
+#line 1554 "parser.tab.c"
     break;
 
   case 13: /* comma_separated_expressions_0: %empty  */
-#line 121 "parser.y"
+#line 130 "parser.y"
     { (yyval.list_t) = empty_list(); }
-#line 1551 "parser.tab.c"
+#line 1560 "parser.tab.c"
     break;
 
   case 14: /* comma_separated_expressions_0: comma_separated_expressions_1  */
-#line 123 "parser.y"
+#line 132 "parser.y"
     { (yyval.list_t) = (yyvsp[0].list_t); }
-#line 1557 "parser.tab.c"
+#line 1566 "parser.tab.c"
     break;
 
   case 15: /* comma_separated_expressions_1: expression  */
-#line 125 "parser.y"
+#line 134 "parser.y"
     { (yyval.list_t) = empty_list(); list_push((yyval.list_t), (yyvsp[0].ast_t)); }
-#line 1563 "parser.tab.c"
+#line 1572 "parser.tab.c"
     break;
 
   case 16: /* comma_separated_expressions_1: comma_separated_expressions_1 ',' expression  */
-#line 127 "parser.y"
+#line 136 "parser.y"
     { (yyval.list_t) = (yyvsp[-2].list_t); list_push((yyval.list_t), (yyvsp[0].ast_t)); }
-#line 1569 "parser.tab.c"
+#line 1578 "parser.tab.c"
     break;
 
   case 17: /* comma_separated_identifiers_1: TK_IDENTIFICADOR  */
-#line 135 "parser.y"
+#line 144 "parser.y"
     { (yyval.list_t) = empty_list(); list_push((yyval.list_t), (yyvsp[0].lexeme_t)); }
-#line 1575 "parser.tab.c"
+#line 1584 "parser.tab.c"
     break;
 
   case 18: /* comma_separated_identifiers_1: comma_separated_identifiers_1 ',' TK_IDENTIFICADOR  */
-#line 137 "parser.y"
+#line 146 "parser.y"
     { (yyval.list_t) = (yyvsp[-2].list_t); list_push((yyval.list_t), (yyvsp[0].lexeme_t)); }
-#line 1581 "parser.tab.c"
+#line 1590 "parser.tab.c"
     break;
 
   case 19: /* variable: type TK_IDENTIFICADOR  */
-#line 141 "parser.y"
-    { (yyval.ast_t) = reduce_variable((yyvsp[-1].type_t), (yyvsp[0].lexeme_t)); }
-#line 1587 "parser.tab.c"
+#line 150 "parser.y"
+    { (yyval.ast_t) = reduce_variable(compilation, (yyvsp[-1].type_t), (yyvsp[0].lexeme_t)); }
+#line 1596 "parser.tab.c"
     break;
 
   case 20: /* command_list: %empty  */
-#line 145 "parser.y"
-    { (yyval.ast_t) = reduce_command_empty(); }
-#line 1593 "parser.tab.c"
+#line 154 "parser.y"
+    { (yyval.ast_t) = reduce_command_empty(compilation); }
+#line 1602 "parser.tab.c"
     break;
 
   case 21: /* command_list: command_list type comma_separated_identifiers_1 ';'  */
-#line 147 "parser.y"
-    { (yyval.ast_t) = reduce_command_variable((yyvsp[-3].ast_t), (yyvsp[-2].type_t), (yyvsp[-1].list_t)); }
-#line 1599 "parser.tab.c"
+#line 156 "parser.y"
+    { (yyval.ast_t) = reduce_command_variable(compilation, (yyvsp[-3].ast_t), (yyvsp[-2].type_t), (yyvsp[-1].list_t)); }
+#line 1608 "parser.tab.c"
     break;
 
   case 22: /* command_list: command_list TK_IDENTIFICADOR '=' expression ';'  */
-#line 149 "parser.y"
-    { (yyval.ast_t) = reduce_command_assignment((yyvsp[-4].ast_t), (yyvsp[-3].lexeme_t), (yyvsp[-1].ast_t)); }
-#line 1605 "parser.tab.c"
+#line 158 "parser.y"
+    { (yyval.ast_t) = reduce_command_assignment(compilation, (yyvsp[-4].ast_t), (yyvsp[-3].lexeme_t), (yyvsp[-1].ast_t)); }
+#line 1614 "parser.tab.c"
     break;
 
   case 23: /* command_list: command_list TK_IDENTIFICADOR '(' comma_separated_expressions_0 ')' ';'  */
-#line 151 "parser.y"
-    { (yyval.ast_t) = reduce_command_call((yyvsp[-5].ast_t), (yyvsp[-4].lexeme_t), (yyvsp[-2].list_t)); }
-#line 1611 "parser.tab.c"
+#line 160 "parser.y"
+    { (yyval.ast_t) = reduce_command_call(compilation, (yyvsp[-5].ast_t), (yyvsp[-4].lexeme_t), (yyvsp[-2].list_t)); }
+#line 1620 "parser.tab.c"
     break;
 
   case 24: /* command_list: command_list TK_PR_RETURN expression ';'  */
-#line 153 "parser.y"
-    { (yyval.ast_t) = reduce_command_return((yyvsp[-3].ast_t), (yyvsp[-1].ast_t)); }
-#line 1617 "parser.tab.c"
+#line 162 "parser.y"
+    { (yyval.ast_t) = reduce_command_return(compilation, (yyvsp[-3].ast_t), (yyvsp[-1].ast_t)); }
+#line 1626 "parser.tab.c"
     break;
 
   case 25: /* command_list: command_list TK_PR_IF '(' expression ')' '{' command_list '}' TK_PR_ELSE '{' command_list '}' ';'  */
-#line 155 "parser.y"
-    { (yyval.ast_t) = reduce_command_if_else((yyvsp[-12].ast_t), (yyvsp[-9].ast_t), (yyvsp[-6].ast_t), (yyvsp[-2].ast_t)); }
-#line 1623 "parser.tab.c"
+#line 164 "parser.y"
+    { (yyval.ast_t) = reduce_command_if_else(compilation, (yyvsp[-12].ast_t), (yyvsp[-9].ast_t), (yyvsp[-6].ast_t), (yyvsp[-2].ast_t)); }
+#line 1632 "parser.tab.c"
     break;
 
   case 26: /* command_list: command_list TK_PR_IF '(' expression ')' '{' command_list '}' ';'  */
-#line 157 "parser.y"
-    { (yyval.ast_t) = reduce_command_if((yyvsp[-8].ast_t), (yyvsp[-5].ast_t), (yyvsp[-2].ast_t)); }
-#line 1629 "parser.tab.c"
+#line 166 "parser.y"
+    { (yyval.ast_t) = reduce_command_if(compilation, (yyvsp[-8].ast_t), (yyvsp[-5].ast_t), (yyvsp[-2].ast_t)); }
+#line 1638 "parser.tab.c"
     break;
 
   case 27: /* command_list: command_list TK_PR_WHILE '(' expression ')' '{' command_list '}' ';'  */
-#line 159 "parser.y"
-    { (yyval.ast_t) = reduce_command_while((yyvsp[-8].ast_t), (yyvsp[-5].ast_t), (yyvsp[-2].ast_t)); }
-#line 1635 "parser.tab.c"
+#line 168 "parser.y"
+    { (yyval.ast_t) = reduce_command_while(compilation, (yyvsp[-8].ast_t), (yyvsp[-5].ast_t), (yyvsp[-2].ast_t)); }
+#line 1644 "parser.tab.c"
     break;
 
   case 28: /* command_list: command_list push_scope '{' command_list '}' pop_scope ';'  */
-#line 161 "parser.y"
-    { (yyval.ast_t) = reduce_command_block((yyvsp[-6].ast_t), (yyvsp[-3].ast_t)); }
-#line 1641 "parser.tab.c"
+#line 170 "parser.y"
+    { (yyval.ast_t) = reduce_command_block(compilation, (yyvsp[-6].ast_t), (yyvsp[-3].ast_t)); }
+#line 1650 "parser.tab.c"
     break;
 
   case 29: /* expression: expr_7  */
-#line 165 "parser.y"
+#line 174 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1647 "parser.tab.c"
+#line 1656 "parser.tab.c"
     break;
 
   case 30: /* expr_7: expr_6  */
-#line 167 "parser.y"
+#line 176 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1653 "parser.tab.c"
+#line 1662 "parser.tab.c"
     break;
 
   case 31: /* expr_7: expr_7 TK_OC_OR expr_6  */
-#line 169 "parser.y"
-    { (yyval.ast_t) = reduce_expr_or((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1659 "parser.tab.c"
+#line 178 "parser.y"
+    { (yyval.ast_t) = reduce_expr_or(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1668 "parser.tab.c"
     break;
 
   case 32: /* expr_6: expr_5  */
-#line 171 "parser.y"
+#line 180 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1665 "parser.tab.c"
+#line 1674 "parser.tab.c"
     break;
 
   case 33: /* expr_6: expr_6 TK_OC_AND expr_5  */
-#line 173 "parser.y"
-    { (yyval.ast_t) = reduce_expr_and((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1671 "parser.tab.c"
+#line 182 "parser.y"
+    { (yyval.ast_t) = reduce_expr_and(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1680 "parser.tab.c"
     break;
 
   case 34: /* expr_5: expr_4  */
-#line 175 "parser.y"
+#line 184 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1677 "parser.tab.c"
+#line 1686 "parser.tab.c"
     break;
 
   case 35: /* expr_5: expr_5 TK_OC_EQ expr_4  */
-#line 177 "parser.y"
-    { (yyval.ast_t) = reduce_expr_eq((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1683 "parser.tab.c"
+#line 186 "parser.y"
+    { (yyval.ast_t) = reduce_expr_eq(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1692 "parser.tab.c"
     break;
 
   case 36: /* expr_5: expr_5 TK_OC_NE expr_4  */
-#line 179 "parser.y"
-    { (yyval.ast_t) = reduce_expr_ne((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1689 "parser.tab.c"
+#line 188 "parser.y"
+    { (yyval.ast_t) = reduce_expr_ne(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1698 "parser.tab.c"
     break;
 
   case 37: /* expr_4: expr_3  */
-#line 181 "parser.y"
+#line 190 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1695 "parser.tab.c"
+#line 1704 "parser.tab.c"
     break;
 
   case 38: /* expr_4: expr_4 '<' expr_3  */
-#line 183 "parser.y"
-    { (yyval.ast_t) = reduce_expr_lt((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1701 "parser.tab.c"
+#line 192 "parser.y"
+    { (yyval.ast_t) = reduce_expr_lt(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1710 "parser.tab.c"
     break;
 
   case 39: /* expr_4: expr_4 '>' expr_3  */
-#line 185 "parser.y"
-    { (yyval.ast_t) = reduce_expr_gt((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1707 "parser.tab.c"
+#line 194 "parser.y"
+    { (yyval.ast_t) = reduce_expr_gt(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1716 "parser.tab.c"
     break;
 
   case 40: /* expr_4: expr_4 TK_OC_LE expr_3  */
-#line 187 "parser.y"
-    { (yyval.ast_t) = reduce_expr_le((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1713 "parser.tab.c"
+#line 196 "parser.y"
+    { (yyval.ast_t) = reduce_expr_le(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1722 "parser.tab.c"
     break;
 
   case 41: /* expr_4: expr_4 TK_OC_GE expr_3  */
-#line 189 "parser.y"
-    { (yyval.ast_t) = reduce_expr_ge((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1719 "parser.tab.c"
+#line 198 "parser.y"
+    { (yyval.ast_t) = reduce_expr_ge(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1728 "parser.tab.c"
     break;
 
   case 42: /* expr_3: expr_2  */
-#line 191 "parser.y"
+#line 200 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1725 "parser.tab.c"
+#line 1734 "parser.tab.c"
     break;
 
   case 43: /* expr_3: expr_3 '+' expr_2  */
-#line 193 "parser.y"
-    { (yyval.ast_t) = reduce_expr_add((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1731 "parser.tab.c"
+#line 202 "parser.y"
+    { (yyval.ast_t) = reduce_expr_add(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1740 "parser.tab.c"
     break;
 
   case 44: /* expr_3: expr_3 '-' expr_2  */
-#line 195 "parser.y"
-    { (yyval.ast_t) = reduce_expr_sub((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1737 "parser.tab.c"
+#line 204 "parser.y"
+    { (yyval.ast_t) = reduce_expr_sub(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1746 "parser.tab.c"
     break;
 
   case 45: /* expr_2: expr_1  */
-#line 197 "parser.y"
+#line 206 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1743 "parser.tab.c"
+#line 1752 "parser.tab.c"
     break;
 
   case 46: /* expr_2: expr_2 '*' expr_1  */
-#line 199 "parser.y"
-    { (yyval.ast_t) = reduce_expr_mul((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1749 "parser.tab.c"
+#line 208 "parser.y"
+    { (yyval.ast_t) = reduce_expr_mul(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1758 "parser.tab.c"
     break;
 
   case 47: /* expr_2: expr_2 '/' expr_1  */
-#line 201 "parser.y"
-    { (yyval.ast_t) = reduce_expr_div((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1755 "parser.tab.c"
+#line 210 "parser.y"
+    { (yyval.ast_t) = reduce_expr_div(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1764 "parser.tab.c"
     break;
 
   case 48: /* expr_2: expr_2 '%' expr_1  */
-#line 203 "parser.y"
-    { (yyval.ast_t) = reduce_expr_mod((yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
-#line 1761 "parser.tab.c"
+#line 212 "parser.y"
+    { (yyval.ast_t) = reduce_expr_mod(compilation, (yyvsp[-2].ast_t), (yyvsp[0].ast_t)); }
+#line 1770 "parser.tab.c"
     break;
 
   case 49: /* expr_1: expr_v  */
-#line 205 "parser.y"
+#line 214 "parser.y"
     { (yyval.ast_t) = (yyvsp[0].ast_t); }
-#line 1767 "parser.tab.c"
+#line 1776 "parser.tab.c"
     break;
 
   case 50: /* expr_1: '-' expr_1  */
-#line 207 "parser.y"
-    { (yyval.ast_t) = reduce_expr_inv((yyvsp[0].ast_t)); }
-#line 1773 "parser.tab.c"
+#line 216 "parser.y"
+    { (yyval.ast_t) = reduce_expr_inv(compilation, (yyvsp[0].ast_t)); }
+#line 1782 "parser.tab.c"
     break;
 
   case 51: /* expr_1: '!' expr_1  */
-#line 209 "parser.y"
-    { (yyval.ast_t) = reduce_expr_not((yyvsp[0].ast_t)); }
-#line 1779 "parser.tab.c"
+#line 218 "parser.y"
+    { (yyval.ast_t) = reduce_expr_not(compilation, (yyvsp[0].ast_t)); }
+#line 1788 "parser.tab.c"
     break;
 
   case 52: /* expr_v: '(' expression ')'  */
-#line 213 "parser.y"
+#line 222 "parser.y"
     { (yyval.ast_t) = (yyvsp[-1].ast_t); }
-#line 1785 "parser.tab.c"
+#line 1794 "parser.tab.c"
     break;
 
   case 53: /* expr_v: TK_LIT_INT  */
-#line 215 "parser.y"
-    { (yyval.ast_t) = reduce_expr_int((yyvsp[0].lexeme_t)); }
-#line 1791 "parser.tab.c"
+#line 224 "parser.y"
+    { (yyval.ast_t) = reduce_expr_int(compilation, (yyvsp[0].lexeme_t)); }
+#line 1800 "parser.tab.c"
     break;
 
   case 54: /* expr_v: TK_LIT_FLOAT  */
-#line 217 "parser.y"
-    { (yyval.ast_t) = reduce_expr_float((yyvsp[0].lexeme_t)); }
-#line 1797 "parser.tab.c"
+#line 226 "parser.y"
+    { (yyval.ast_t) = reduce_expr_float(compilation, (yyvsp[0].lexeme_t)); }
+#line 1806 "parser.tab.c"
     break;
 
   case 55: /* expr_v: TK_LIT_TRUE  */
-#line 219 "parser.y"
-    { (yyval.ast_t) = reduce_expr_bool((yyvsp[0].lexeme_t)); }
-#line 1803 "parser.tab.c"
+#line 228 "parser.y"
+    { (yyval.ast_t) = reduce_expr_bool(compilation, (yyvsp[0].lexeme_t)); }
+#line 1812 "parser.tab.c"
     break;
 
   case 56: /* expr_v: TK_LIT_FALSE  */
-#line 221 "parser.y"
-    { (yyval.ast_t) = reduce_expr_bool((yyvsp[0].lexeme_t)); }
-#line 1809 "parser.tab.c"
+#line 230 "parser.y"
+    { (yyval.ast_t) = reduce_expr_bool(compilation, (yyvsp[0].lexeme_t)); }
+#line 1818 "parser.tab.c"
     break;
 
   case 57: /* expr_v: TK_IDENTIFICADOR  */
-#line 223 "parser.y"
-    { (yyval.ast_t) = reduce_expr_ident((yyvsp[0].lexeme_t)); }
-#line 1815 "parser.tab.c"
+#line 232 "parser.y"
+    { (yyval.ast_t) = reduce_expr_ident(compilation, (yyvsp[0].lexeme_t)); }
+#line 1824 "parser.tab.c"
     break;
 
   case 58: /* expr_v: TK_IDENTIFICADOR '(' comma_separated_expressions_0 ')'  */
-#line 225 "parser.y"
-    { (yyval.ast_t) = reduce_expr_call((yyvsp[-3].lexeme_t), (yyvsp[-1].list_t)); }
-#line 1821 "parser.tab.c"
+#line 234 "parser.y"
+    { (yyval.ast_t) = reduce_expr_call(compilation, (yyvsp[-3].lexeme_t), (yyvsp[-1].list_t)); }
+#line 1830 "parser.tab.c"
     break;
 
   case 59: /* type: TK_PR_INT  */
-#line 228 "parser.y"
+#line 237 "parser.y"
                 { (yyval.type_t) = type_int; }
-#line 1827 "parser.tab.c"
+#line 1836 "parser.tab.c"
     break;
 
   case 60: /* type: TK_PR_FLOAT  */
-#line 229 "parser.y"
+#line 238 "parser.y"
                   { (yyval.type_t) = type_float; }
-#line 1833 "parser.tab.c"
+#line 1842 "parser.tab.c"
     break;
 
   case 61: /* type: TK_PR_BOOL  */
-#line 230 "parser.y"
+#line 239 "parser.y"
                  { (yyval.type_t) = type_bool; }
-#line 1839 "parser.tab.c"
+#line 1848 "parser.tab.c"
     break;
 
 
-#line 1843 "parser.tab.c"
+#line 1852 "parser.tab.c"
 
       default: break;
     }
@@ -1913,7 +1922,7 @@ yyerrlab:
                 yysyntax_error_status = YYENOMEM;
               }
           }
-        yyerror (yymsgp);
+        yyerror (scanner, compilation, yymsgp);
         if (yysyntax_error_status == YYENOMEM)
           YYNOMEM;
       }
@@ -1933,7 +1942,7 @@ yyerrlab:
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval);
+                      yytoken, &yylval, scanner, compilation);
           yychar = YYEMPTY;
         }
     }
@@ -1989,7 +1998,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, scanner, compilation);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -2027,7 +2036,7 @@ yyabortlab:
 | yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
 `-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (YY_("memory exhausted"));
+  yyerror (scanner, compilation, YY_("memory exhausted"));
   yyresult = 2;
   goto yyreturnlab;
 
@@ -2042,7 +2051,7 @@ yyreturnlab:
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval);
+                  yytoken, &yylval, scanner, compilation);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -2051,7 +2060,7 @@ yyreturnlab:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, scanner, compilation);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
@@ -2063,12 +2072,13 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 232 "parser.y"
+#line 241 "parser.y"
 
 
-void yyerror (char const *mensagem) {
+void yyerror (yyscan_t scanner, compilation_t *compilation, char const *mensagem) {
+    (void) compilation;
     // A seguinte linha de código demontra como apresentar a coluna do erro, 
     // functionalidade que nao foi habilitada para seguir a especificacao com mais regor:
     // printf("Erro na linha %d, coluna %d: \n - %s\n", get_line_number(), get_col_number(), mensagem);
-    fprintf(stderr, "Erro na linha %d: \n - %s\n", get_line_number(), mensagem);
+    fprintf(stderr, "Erro na linha %d: \n - %s\n", get_line_number(scanner), mensagem);
 }
@@ -45,12 +45,17 @@
 extern int yydebug;
 #endif
 /* "%code requires" blocks.  */
-#line 13 "parser.y"
+#line 14 "parser.y"
  
 #include "list.h"
 #include "structs.h"
 
-#line 54 "parser.tab.h"
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+#line 59 "parser.tab.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -88,14 +93,14 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 35 "parser.y"
+#line 44 "parser.y"
 
     ast_t *ast_t;
     list_t *list_t;
     type_t type_t;
     lexeme_t *lexeme_t;
 
-#line 99 "parser.tab.h"
+#line 104 "parser.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -104,10 +109,9 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
-int yyparse (void);
+int yyparse (yyscan_t scanner, compilation_t *compilation);
 
 
 #endif /* !YY_YY_PARSER_TAB_H_INCLUDED  */
@@ -8,27 +8,36 @@
  */
 
 %define parse.error verbose
+%define api.pure full
 
 // Included in parser.tab.h
 %code requires { 
 #include "list.h"
 #include "structs.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
 }
 
 // Included in parser.tab.c
-%{
+%code {
 #include <stdio.h>
 // #include <stdlib.h>
 // #include <string.h>
 #include "code_gen.h"
 
-int yylex(void);
-void yyerror (char const *mensagem);
+int yylex(YYSTYPE *lvalp, yyscan_t scanner);
+void yyerror (yyscan_t scanner, compilation_t *compilation, char const *mensagem);
+
+extern int get_line_number(yyscan_t scanner);
 
-extern int get_line_number(void);
-extern void *arvore;
+}
 
-%}
+// The scanner and the compilation are passed along instead of kept in globals
+%param {yyscan_t scanner}
+%parse-param {compilation_t *compilation}
 
 %start program
 
@@ -84,27 +93,27 @@ extern void *arvore;
 %%
 /* Scope control */
 push_scope: %empty 
-    { reduce_push_scope(); };
+    { reduce_push_scope(compilation); };
 pop_scope: %empty 
-    { reduce_pop_scope(); };
+    { reduce_pop_scope(compilation); };
 
 /* Program */
 program: push_scope global_list pop_scope 
-    { $$ = reduce_program($2); arvore = $$; };
+    { $$ = reduce_program(compilation, $2); compilation->tree = $$; };
 
 /* Empty program */
 global_list: %empty 
-    { $$ = reduce_global_list_empty(); };
+    { $$ = reduce_global_list_empty(compilation); };
 
 /* Global variable */
 global_list: global_list type comma_separated_identifiers_1 ';' 
-    { $$ = reduce_global_list_variable($1, $2, $3); };
+    { $$ = reduce_global_list_variable(compilation, $1, $2, $3); };
 
 /* Global function */
 global_list: global_list function_header '{' command_list '}' 
-    { $$ = reduce_global_list_function($1, $2, $4); };
+    { $$ = reduce_global_list_function(compilation, $1, $2, $4); };
 function_header: '(' comma_separated_variables_0 ')' TK_OC_GE type '!' TK_IDENTIFICADOR 
-    { $$ = reduce_function_header($2, $5, $7); };
+    { $$ = reduce_function_header(compilation, $2, $5, $7); };
 
 /* Comma-separated variables */
 comma_separated_variables_0: %empty 
@@ -138,27 +147,27 @@ comma_separated_identifiers_1: comma_separated_identifiers_1 ',' TK_IDENTIFICADO
 
 /* Variable definition */
 variable: type TK_IDENTIFICADOR 
-    { $$ = reduce_variable($1, $2); };
+    { $$ = reduce_variable(compilation, $1, $2); };
 
 /* Commands */
 command_list: %empty 
-    { $$ = reduce_command_empty(); };
+    { $$ = reduce_command_empty(compilation); };
 command_list: command_list type comma_separated_identifiers_1 ';' 
-    { $$ = reduce_command_variable($1, $2, $3); };
+    { $$ = reduce_command_variable(compilation, $1, $2, $3); };
 command_list: command_list TK_IDENTIFICADOR '=' expression ';' 
-    { $$ = reduce_command_assignment($1, $2, $4); };
+    { $$ = reduce_command_assignment(compilation, $1, $2, $4); };
 command_list: command_list TK_IDENTIFICADOR '(' comma_separated_expressions_0 ')' ';' 
-    { $$ = reduce_command_call($1, $2, $4); };
+    { $$ = reduce_command_call(compilation, $1, $2, $4); };
 command_list: command_list TK_PR_RETURN expression ';' 
-    { $$ = reduce_command_return($1, $3); };
+    { $$ = reduce_command_return(compilation, $1, $3); };
 command_list: command_list TK_PR_IF '(' expression ')' '{' command_list '}' TK_PR_ELSE '{' command_list '}' ';' 
-    { $$ = reduce_command_if_else($1, $4, $7, $11); };
+    { $$ = reduce_command_if_else(compilation, $1, $4, $7, $11); };
 command_list: command_list TK_PR_IF '(' expression ')' '{' command_list '}' ';' 
-    { $$ = reduce_command_if($1, $4, $7); };
+    { $$ = reduce_command_if(compilation, $1, $4, $7); };
 command_list: command_list TK_PR_WHILE '(' expression ')' '{' command_list '}' ';' 
-    { $$ = reduce_command_while($1, $4, $7); };
+    { $$ = reduce_command_while(compilation, $1, $4, $7); };
 command_list: command_list push_scope '{' command_list '}' pop_scope ';' 
-    { $$ = reduce_command_block($1, $4); };
+    { $$ = reduce_command_block(compilation, $1, $4); };
 
 /* Compound expressions */
 expression: expr_7 
@@ -166,63 +175,63 @@ expression: expr_7
 expr_7: expr_6 
     { $$ = $1; };
 expr_7: expr_7 TK_OC_OR expr_6 
-    { $$ = reduce_expr_or($1, $3); };
+    { $$ = reduce_expr_or(compilation, $1, $3); };
 expr_6: expr_5 
     { $$ = $1; };
 expr_6: expr_6 TK_OC_AND expr_5 
-    { $$ = reduce_expr_and($1, $3); };
+    { $$ = reduce_expr_and(compilation, $1, $3); };
 expr_5: expr_4 
     { $$ = $1; };
 expr_5: expr_5 TK_OC_EQ expr_4 
-    { $$ = reduce_expr_eq($1, $3); };
+    { $$ = reduce_expr_eq(compilation, $1, $3); };
 expr_5: expr_5 TK_OC_NE expr_4 
-    { $$ = reduce_expr_ne($1, $3); };
+    { $$ = reduce_expr_ne(compilation, $1, $3); };
 expr_4: expr_3 
     { $$ = $1; };
 expr_4: expr_4 '<' expr_3 
-    { $$ = reduce_expr_lt($1, $3); };
+    { $$ = reduce_expr_lt(compilation, $1, $3); };
 expr_4: expr_4 '>' expr_3 
-    { $$ = reduce_expr_gt($1, $3); };
+    { $$ = reduce_expr_gt(compilation, $1, $3); };
 expr_4: expr_4 TK_OC_LE expr_3 
-    { $$ = reduce_expr_le($1, $3); };
+    { $$ = reduce_expr_le(compilation, $1, $3); };
 expr_4: expr_4 TK_OC_GE expr_3 
-    { $$ = reduce_expr_ge($1, $3); };
+    { $$ = reduce_expr_ge(compilation, $1, $3); };
 expr_3: expr_2 
     { $$ = $1; };
 expr_3: expr_3 '+' expr_2 
-    { $$ = reduce_expr_add($1, $3); };
+    { $$ = reduce_expr_add(compilation, $1, $3); };
 expr_3: expr_3 '-' expr_2 
-    { $$ = reduce_expr_sub($1, $3); };
+    { $$ = reduce_expr_sub(compilation, $1, $3); };
 expr_2: expr_1 
     { $$ = $1; };
 expr_2: expr_2 '*' expr_1 
-    { $$ = reduce_expr_mul($1, $3); };
+    { $$ = reduce_expr_mul(compilation, $1, $3); };
 expr_2: expr_2 '/' expr_1 
-    { $$ = reduce_expr_div($1, $3); };
+    { $$ = reduce_expr_div(compilation, $1, $3); };
 expr_2: expr_2 '%' expr_1 
-    { $$ = reduce_expr_mod($1, $3); };
+    { $$ = reduce_expr_mod(compilation, $1, $3); };
 expr_1: expr_v 
     { $$ = $1; };
 expr_1: '-' expr_1 
-    { $$ = reduce_expr_inv($2); };
+    { $$ = reduce_expr_inv(compilation, $2); };
 expr_1: '!' expr_1 
-    { $$ = reduce_expr_not($2); };
+    { $$ = reduce_expr_not(compilation, $2); };
 
 /* Value expressions */
 expr_v: '(' expression ')' 
     { $$ = $2; };
 expr_v: TK_LIT_INT 
-    { $$ = reduce_expr_int($1); };
+    { $$ = reduce_expr_int(compilation, $1); };
 expr_v: TK_LIT_FLOAT 
-    { $$ = reduce_expr_float($1); };
+    { $$ = reduce_expr_float(compilation, $1); };
 expr_v: TK_LIT_TRUE 
-    { $$ = reduce_expr_bool($1); };
+    { $$ = reduce_expr_bool(compilation, $1); };
 expr_v: TK_LIT_FALSE 
-    { $$ = reduce_expr_bool($1); };
+    { $$ = reduce_expr_bool(compilation, $1); };
 expr_v: TK_IDENTIFICADOR 
-    { $$ = reduce_expr_ident($1); };
+    { $$ = reduce_expr_ident(compilation, $1); };
 expr_v: TK_IDENTIFICADOR '(' comma_separated_expressions_0 ')' 
-    { $$ = reduce_expr_call($1, $3); };
+    { $$ = reduce_expr_call(compilation, $1, $3); };
 
 /* Types */
 type: TK_PR_INT { $$ = type_int; };
@@ -231,9 +240,10 @@ type: TK_PR_BOOL { $$ = type_bool; };
 
 %%
 
-void yyerror (char const *mensagem) {
+void yyerror (yyscan_t scanner, compilation_t *compilation, char const *mensagem) {
+    (void) compilation;
     // A seguinte linha de código demontra como apresentar a coluna do erro, 
     // functionalidade que nao foi habilitada para seguir a especificacao com mais regor:
     // printf("Erro na linha %d, coluna %d: \n - %s\n", get_line_number(), get_col_number(), mensagem);
-    fprintf(stderr, "Erro na linha %d: \n - %s\n", get_line_number(), mensagem);
+    fprintf(stderr, "Erro na linha %d: \n - %s\n", get_line_number(scanner), mensagem);
 }
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "peephole.h"
+#include "list.h"
+#include "structs.h"
+
+typedef struct {
+    x86_program_t *program;
+    int64_t label_min;
+    uint64_t label_range;
+    int64_t *label_position;  // Index of each label in the program (or -1)
+    uint64_t *label_uses;     // Amount of jumps to each label
+} peephole_state_t;
+
+typedef struct {
+    const char *name;
+    uint64_t window;
+    int (*apply)(peephole_state_t *state, uint64_t index);
+    uint64_t hits;
+} peephole_rule_t;
+
+#define AT(index) (&state->program->items[(index)])
+
+int operand_equals(x86_operand_t *a, x86_operand_t *b) {
+    if (a->type != b->type) {
+        return 0;
+    }
+    switch (a->type) {
+        case operand_none:
+            return 1;
+        case operand_register:
+            return a->reg == b->reg;
+        case operand_memory:
+            return a->reg == b->reg && a->value == b->value;
+        case operand_indexed:
+            return a->reg == b->reg && a->index == b->index && a->scale == b->scale && a->value == b->value;
+        case operand_symbol:
+        case operand_function:
+            return strcmp(a->symbol, b->symbol) == 0;
+        default:
+            return a->value == b->value;
+    }
+}
+
+x86_condition_t condition_negate(x86_condition_t condition) {
+    switch (condition) {
+        case x86_cond_e:  return x86_cond_ne;
+        case x86_cond_ne: return x86_cond_e;
+        case x86_cond_l:  return x86_cond_ge;
+        case x86_cond_le: return x86_cond_g;
+        case x86_cond_g:  return x86_cond_le;
+        case x86_cond_ge: return x86_cond_l;
+        case x86_cond_b:  return x86_cond_ae;
+        case x86_cond_be: return x86_cond_a;
+        case x86_cond_a:  return x86_cond_be;
+        case x86_cond_ae: return x86_cond_b;
+        case x86_cond_p:  return x86_cond_np;
+        case x86_cond_np: return x86_cond_p;
+        default:          return x86_cond_l;
+    }
+}
+
+/*
+ * Returns the position of the first real instruction at or after <index>,
+ * skipping labels and removed instructions
+ */
+uint64_t skip_labels(peephole_state_t *state, uint64_t index) {
+    while (index < state->program->length && (AT(index)->opcode == x86_label || AT(index)->opcode == x86_nop)) {
+        index++;
+    }
+    return index;
+}
+
+int64_t *label_position(peephole_state_t *state, int64_t label) {
+    return &state->label_position[label - state->label_min];
+}
+
+uint64_t *label_uses(peephole_state_t *state, int64_t label) {
+    return &state->label_uses[label - state->label_min];
+}
+
+/*
+ * Returns true if the flags may be read before the next instruction that
+ * writes them (conservatively true at labels and jumps)
+ */
+int flags_live_after(peephole_state_t *state, uint64_t index) {
+    for (uint64_t i = index+1; i < state->program->length; i++) {
+        switch (AT(i)->opcode) {
+            case x86_nop:
+            case x86_align:
+            case x86_movl:
+            case x86_movq:
+            case x86_leaq:
+            case x86_leal:
+            case x86_movzbl:
+            case x86_cltd:
+            case x86_pushq:
+            case x86_popq:
+            case x86_movsd:
+            case x86_movapd:
+            case x86_addsd:
+            case x86_subsd:
+            case x86_mulsd:
+            case x86_divsd:
+            case x86_cvtsi2sdl:
+            case x86_cvttsd2si:
+                continue;
+            case x86_addl:
+            case x86_subl:
+            case x86_imull:
+            case x86_negl:
+            case x86_idivl:
+            case x86_cmpl:
+            case x86_testl:
+            case x86_xorl:
+            case x86_andb:
+            case x86_orb:
+            case x86_ucomisd:
+            case x86_subq:
+            case x86_addq:
+            case x86_ret:
+            case x86_call:
+            case x86_tailcall:
+                return 0;
+            default:
+                return 1;
+        }
+    }
+    return 0;
+}
+
+void remove_instruction(peephole_state_t *state, uint64_t index) {
+    x86_instruction_t *instruction = AT(index);
+    if (instruction->opcode == x86_jmp || instruction->opcode == x86_jcc) {
+        (*label_uses(state, instruction->src.value))--;
+    }
+    instruction->opcode = x86_nop;
+}
+
+void retarget(peephole_state_t *state, x86_instruction_t *jump, int64_t target) {
+    (*label_uses(state, jump->src.value))--;
+    jump->src.value = target;
+    (*label_uses(state, target))++;
+}
+
+/*******\
+ * Rules *
+ \*******/
+// movl %r, %r
+int rule_self_move(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *move = AT(i);
+    if (move->opcode != x86_movl || move->src.type != operand_register || !operand_equals(&move->src, &move->dst)) {
+        return 0;
+    }
+    remove_instruction(state, i);
+    return 1;
+}
+
+// movl $0, %r => xorl %r, %r
+int rule_zero_idiom(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *move = AT(i);
+    if (move->opcode != x86_movl || move->src.type != operand_immediate || move->src.value != 0
+            || move->dst.type != operand_register || flags_live_after(state, i)) {
+        return 0;
+    }
+    move->opcode = x86_xorl;
+    move->src = move->dst;
+    return 1;
+}
+
+// movl %r, M; movl M, %s => movl %r, M; movl %r, %s
+int rule_store_reload(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *store = AT(i);
+    x86_instruction_t *load = AT(i+1);
+    if (store->opcode != x86_movl || load->opcode != x86_movl || store->src.type != operand_register
+            || (store->dst.type != operand_memory && store->dst.type != operand_symbol)
+            || !operand_equals(&store->dst, &load->src) || load->dst.type != operand_register) {
+        return 0;
+    }
+    if (load->dst.reg == store->src.reg) {
+        remove_instruction(state, i+1);
+    } else {
+        load->src = store->src;
+    }
+    return 1;
+}
+
+// jmp L; L: => L:
+int rule_jump_to_next(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *jump = AT(i);
+    if (jump->opcode != x86_jmp && jump->opcode != x86_jcc) {
+        return 0;
+    }
+    for (uint64_t next = i+1; next < state->program->length; next++) {
+        x86_instruction_t *instruction = AT(next);
+        if (instruction->opcode == x86_label && instruction->src.value == jump->src.value) {
+            remove_instruction(state, i);
+            return 1;
+        }
+        if (instruction->opcode != x86_label && instruction->opcode != x86_nop && instruction->opcode != x86_align) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+// jcc L1; jmp L2; L1: => jncc L2; L1:
+int rule_branch_over_jump(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *branch = AT(i);
+    x86_instruction_t *jump = AT(i+1);
+    x86_instruction_t *target = AT(i+2);
+    if (branch->opcode != x86_jcc || jump->opcode != x86_jmp || target->opcode != x86_label
+            || target->src.value != branch->src.value) {
+        return 0;
+    }
+    branch->condition = condition_negate(branch->condition);
+    retarget(state, branch, jump->src.value);
+    remove_instruction(state, i+1);
+    return 1;
+}
+
+// jmp L1 ... L1: jmp L2 => jmp L2 ... L1: jmp L2
+int rule_jump_chain(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *jump = AT(i);
+    if (jump->opcode != x86_jmp && jump->opcode != x86_jcc) {
+        return 0;
+    }
+    int64_t position = *label_position(state, jump->src.value);
+    if (position < 0) {
+        return 0;
+    }
+    uint64_t target = skip_labels(state, position);
+    if (target >= state->program->length || AT(target)->opcode != x86_jmp
+            || AT(target)->src.value == jump->src.value || target == i) {
+        return 0;
+    }
+    retarget(state, jump, AT(target)->src.value);
+    return 1;
+}
+
+// jmp L / ret; <code without labels> => jmp L / ret
+int rule_unreachable(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *jump = AT(i);
+    if (jump->opcode != x86_jmp && jump->opcode != x86_ret && jump->opcode != x86_tailcall) {
+        return 0;
+    }
+    int removed = 0;
+    for (uint64_t next = i+1; next < state->program->length && AT(next)->opcode != x86_label; next++) {
+        if (AT(next)->opcode == x86_cold) {
+            break;
+        }
+        if (AT(next)->opcode != x86_nop && AT(next)->opcode != x86_align) {
+            remove_instruction(state, next);
+            removed = 1;
+        }
+    }
+    return removed;
+}
+
+// L: (never jumped to) =>
+int rule_unused_label(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *label = AT(i);
+    if (label->opcode != x86_label || *label_uses(state, label->src.value) != 0) {
+        return 0;
+    }
+    remove_instruction(state, i);
+    return 1;
+}
+
+// setcc %al; movzbl %al, %r; testl %r, %r; jne L => setcc %al; movzbl %al, %r; jcc L
+int rule_compare_branch(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *set = AT(i);
+    x86_instruction_t *extend = AT(i+1);
+    x86_instruction_t *test = AT(i+2);
+    x86_instruction_t *branch = AT(i+3);
+    if (set->opcode != x86_setcc || extend->opcode != x86_movzbl || test->opcode != x86_testl
+            || branch->opcode != x86_jcc || (branch->condition != x86_cond_ne && branch->condition != x86_cond_e)
+            || !operand_equals(&set->src, &extend->src) || extend->dst.type != operand_register
+            || !operand_equals(&extend->dst, &test->src) || !operand_equals(&test->src, &test->dst)) {
+        return 0;
+    }
+    // setcc and movzbl keep the flags of the comparison
+    branch->condition = branch->condition == x86_cond_ne ? set->condition : condition_negate(set->condition);
+    remove_instruction(state, i+2);
+    return 1;
+}
+
+// op ..., %r; testl %r, %r; je/jne/sete/setne => op ..., %r; je/jne/sete/setne
+int rule_redundant_test(peephole_state_t *state, uint64_t i) {
+    x86_instruction_t *op = AT(i);
+    x86_instruction_t *test = AT(i+1);
+    x86_instruction_t *use = AT(i+2);
+    x86_operand_t *result;
+    switch (op->opcode) {
+        case x86_addl:
+        case x86_subl:
+        case x86_xorl:
+            result = &op->dst;
+            break;
+        case x86_negl:
+            result = &op->src;
+            break;
+        default:
+            return 0;
+    }
+    if (test->opcode != x86_testl || result->type != operand_register || !operand_equals(result, &test->src)
+            || !operand_equals(&test->src, &test->dst) || (use->opcode != x86_jcc && use->opcode != x86_setcc)
+            || (use->condition != x86_cond_e && use->condition != x86_cond_ne)) {
+        return 0;
+    }
+    remove_instruction(state, i+1);
+    return 1;
+}
+
+static peephole_rule_t rules[] = {
+    { "self-move",       1, rule_self_move,        0 },
+    { "store-reload",    2, rule_store_reload,     0 },
+    { "compare-branch",  4, rule_compare_branch,   0 },
+    { "redundant-test",  3, rule_redundant_test,   0 },
+    { "branch-over-jump", 3, rule_branch_over_jump, 0 },
+    { "jump-chain",      1, rule_jump_chain,       0 },
+    { "jump-to-next",    1, rule_jump_to_next,     0 },
+    { "unreachable",     1, rule_unreachable,      0 },
+    { "unused-label",    1, rule_unused_label,     0 },
+    { "zero-idiom",      1, rule_zero_idiom,       0 },
+};
+
+#define RULE_COUNT (sizeof(rules) / sizeof(rules[0]))
+
+/*
+ * Maps every label to its position and counts the jumps to it
+ */
+void peephole_index_labels(peephole_state_t *state) {
+    x86_program_t *program = state->program;
+    int64_t label_min = INT64_MAX;
+    int64_t label_max = INT64_MIN;
+    for (size_t i = 0; i < program->length; i++) {
+        x86_instruction_t *instruction = &program->items[i];
+        if (instruction->opcode == x86_label || instruction->opcode == x86_jmp || instruction->opcode == x86_jcc) {
+            if (instruction->src.value < label_min) label_min = instruction->src.value;
+            if (instruction->src.value > label_max) label_max = instruction->src.value;
+        }
+    }
+    state->label_min = label_min;
+    state->label_range = label_min <= label_max ? (uint64_t) (label_max - label_min + 1) : 0;
+    state->label_position = (int64_t*) malloc((state->label_range+1) * sizeof(int64_t));
+    state->label_uses = (uint64_t*) calloc(state->label_range+1, sizeof(uint64_t));
+    if (state->label_position == NULL || state->label_uses == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the label map (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t l = 0; l < state->label_range; l++) {
+        state->label_position[l] = -1;
+    }
+    for (size_t i = 0; i < program->length; i++) {
+        x86_instruction_t *instruction = &program->items[i];
+        if (instruction->opcode == x86_label) {
+            *label_position(state, instruction->src.value) = i;
+        } else if (instruction->opcode == x86_jmp || instruction->opcode == x86_jcc) {
+            (*label_uses(state, instruction->src.value))++;
+        }
+    }
+}
+
+void peephole_optimize(x86_program_t *program) {
+    peephole_state_t state;
+    state.program = program;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        peephole_index_labels(&state);
+        for (size_t i = 0; i < program->length; i++) {
+            for (uint64_t r = 0; r < RULE_COUNT && program->items[i].opcode != x86_nop; r++) {
+                if (i + rules[r].window <= program->length && rules[r].apply(&state, i)) {
+                    // Shared by the compilations running on other threads
+                    __atomic_fetch_add(&rules[r].hits, 1, __ATOMIC_RELAXED);
+                    changed = 1;
+                }
+            }
+        }
+        free(state.label_position);
+        free(state.label_uses);
+
+        // Drop the removed instructions
+        size_t kept = 0;
+        for (size_t i = 0; i < program->length; i++) {
+            if (program->items[i].opcode != x86_nop) {
+                program->items[kept++] = program->items[i];
+            }
+        }
+        program->length = kept;
+    }
+}
+
+void peephole_report(FILE *file) {
+    for (uint64_t r = 0; r < RULE_COUNT; r++) {
+        fprintf(file, "peephole: %-16s %lu\n", rules[r].name, rules[r].hits);
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/***********************\
+* Peephole Optimization *
+\***********************/
+/*
+ * This function slides a window over the program, rewriting the sequences
+ * matched by the rules of the peephole table, until no rule applies anymore
+ */
+void peephole_optimize(x86_program_t *program);
+
+/*
+ * This function writes how many times each rule was applied (over every
+ * program optimized so far)
+ */
+void peephole_report(FILE *file);
@@ -1,8 +1,6 @@
 #include <stdio.h>
 #include "structs.h"
 
-uint32_t lines[1024];
-
 void print_type(FILE *file, type_t type) {
     switch (type) {
         case type_undefined:
@@ -178,7 +176,7 @@ void print_ast_node(FILE *file, ast_t *ast) {
     fprintf(file, "\n");
 }
 
-void print_ast_inner(FILE *file, ast_t *ast, int left) {
+void print_ast_inner(FILE *file, uint32_t *lines, ast_t *ast, int left) {
     for (uint64_t i = 0; i < ast->length; i++) {
         for (int i = 0; i < left; i++) {
             if (lines[i] != 0) {
@@ -195,12 +193,12 @@ void print_ast_inner(FILE *file, ast_t *ast, int left) {
             lines[left] = 1;
         }
         print_ast_node(file, ast->children[i]);
-        print_ast_inner(file, ast->children[i], left+1);
+        print_ast_inner(file, lines, ast->children[i], left+1);
     }
 }
 
-void print_ast(FILE *file, ast_t *ast) {
+void print_ast(FILE *file, compilation_t *compilation, ast_t *ast) {
     print_ast_node(file, ast);
-    print_ast_inner(file, ast, 0);
+    print_ast_inner(file, compilation->print_lines, ast, 0);
 }
 
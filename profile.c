@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "profile.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+#include "x86.h"
+
+// FNV-1a, over the bytes of each value
+#define PROFILE_HASH_BASIS 0xCBF29CE484222325
+#define PROFILE_HASH_PRIME 0x100000001B3
+
+// Flags and mode of the profile for open (O_WRONLY | O_CREAT | O_TRUNC, 0644)
+#define PROFILE_OPEN_FLAGS 01101
+#define PROFILE_OPEN_MODE 0644
+
+// System call numbers
+#define SYS_OPEN 2
+#define SYS_WRITE 1
+#define SYS_CLOSE 3
+
+typedef nlist_definition(uint32_t) profile_words_t;
+
+uint64_t profile_mix(uint64_t hash, uint64_t value) {
+    for (uint64_t i = 0; i < 8; i++) {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= PROFILE_HASH_PRIME;
+    }
+    return hash;
+}
+
+uint64_t profile_hash(iloc_function_t *function) {
+    iloc_program_t *code = function->code;
+    iloc_cfg_t cfg = iloc_cfg_build(code);
+    uint64_t hash = PROFILE_HASH_BASIS;
+    for (char *c = function->name; *c != '\0'; c++) {
+        hash = profile_mix(hash, (uint8_t) *c);
+    }
+    hash = profile_mix(hash, cfg.blocks.length);
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+        hash = profile_mix(hash, block->end - block->start);
+        for (uint64_t i = block->start; i < block->end; i++) {
+            hash = profile_mix(hash, code->instructions[i].instruction);
+        }
+        hash = profile_mix(hash, block->successors.length);
+        for (size_t s = 0; s < block->successors.length; s++) {
+            hash = profile_mix(hash, nlist_get_unsafe(block->successors, s));
+        }
+    }
+    iloc_cfg_free(&cfg);
+    return hash;
+}
+
+/*
+ * Stores the bytes in the read-only data of the module (aligned to 8) and
+ * returns their offset
+ */
+uint64_t profile_data(iloc_module_t *module, const void *data, uint64_t size) {
+    while (module->data.length % 8 != 0) {
+        nlist_insert(uint8_t, module->data, 0);
+    }
+    uint64_t offset = module->data.length;
+    for (uint64_t i = 0; i < size; i++) {
+        nlist_insert(uint8_t, module->data, ((const uint8_t*) data)[i]);
+    }
+    return offset;
+}
+
+/*
+ * Pushes counter[index]++ (the counters are addressed like an array, since a
+ * loadAI from rbss only reaches the start of a global). Each counter is two
+ * ints, the low half first, and the high half adds the carry of the low one,
+ * so a count only wraps after 2^64 executions.
+ */
+void profile_increment(iloc_program_t *program, uint64_t counters, uint64_t index) {
+    uint64_t zero = iloc_next_id();
+    uint64_t low = iloc_next_id();
+    uint64_t one = iloc_next_id();
+    uint64_t low_sum = iloc_next_id();
+    uint64_t carry = iloc_next_id();
+    uint64_t high = iloc_next_id();
+    uint64_t high_sum = iloc_next_id();
+    iloc_push(program, load_i, 0, zero, 0);
+    iloc_push(program, load_ax, counters + 8 * index, zero, low);
+    iloc_push(program, load_i, 1, one, 0);
+    iloc_push(program, add, low, one, low_sum);
+    iloc_push(program, store_ax, low_sum, counters + 8 * index, zero);
+    iloc_push(program, cmp_eq, low_sum, zero, carry);
+    iloc_push(program, load_ax, counters + 8 * index + 4, zero, high);
+    iloc_push(program, add, high, carry, high_sum);
+    iloc_push(program, store_ax, high_sum, counters + 8 * index + 4, zero);
+}
+
+void profile_instrument(iloc_module_t *module, char *file) {
+    iloc_profile_t *profile = &module->profile;
+    profile->file = file;
+    profile->description.length = 0;
+    nlist_insert(uint32_t, profile->description, PROFILE_MAGIC);
+    nlist_insert(uint32_t, profile->description, PROFILE_VERSION);
+    nlist_insert(uint32_t, profile->description, module->functions.length);
+    profile->counter_count = 0;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        iloc_cfg_t cfg = iloc_cfg_build(function->code);
+        uint64_t hash = profile_hash(function);
+        nlist_insert(uint32_t, profile->description, (uint32_t) hash);
+        nlist_insert(uint32_t, profile->description, (uint32_t) (hash >> 32));
+        nlist_insert(uint32_t, profile->description, cfg.blocks.length);
+        profile->counter_count += cfg.blocks.length;
+        iloc_cfg_free(&cfg);
+    }
+    if (profile->counter_count == 0) {
+        return;
+    }
+    uint64_t counters = iloc_module_add_global(module, strdup(PROFILE_COUNTERS), type_int, 8 * profile->counter_count);
+
+    // Each block counts itself right after its label (or, in the entry block,
+    // after the parameters are read)
+    uint64_t index = 0;
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        iloc_program_t *code = function->code;
+        iloc_cfg_t cfg = iloc_cfg_build(code);
+        iloc_program_t *new_program = iloc_program_new();
+        for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+            iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+            uint64_t i = block->start;
+            while (i < block->end && (code->instructions[i].instruction == label
+                    || (b == 0 && (code->instructions[i].instruction == getparam || code->instructions[i].instruction == fgetparam)))) {
+                iloc_program_push(new_program, code->instructions[i++]);
+            }
+            profile_increment(new_program, counters, index++);
+            for (; i < block->end; i++) {
+                iloc_program_push(new_program, code->instructions[i]);
+            }
+        }
+        iloc_cfg_free(&cfg);
+        iloc_program_free(code);
+        function->code = new_program;
+    }
+
+    profile->file_data = profile_data(module, file, strlen(file) + 1);
+    profile->description_data = profile_data(module, profile->description.items, profile->description.length * sizeof(uint32_t));
+}
+
+void profile_emit_dumper(x86_module_t *module) {
+    iloc_profile_t *profile = &module->source->profile;
+    if (profile->counter_count == 0) {
+        return;
+    }
+    // The file descriptor stays in edi, which the system calls preserve
+    x86_program_t code;
+    nlist_init(x86_instruction_t, code);
+    uint64_t label_done = iloc_next_id();
+    x86_push(&code, x86_movl, x86_operand_immediate(SYS_OPEN), x86_operand_register(x86_rax));
+    x86_push(&code, x86_leaq, x86_operand_data(profile->file_data), x86_operand_register(x86_rdi));
+    x86_push(&code, x86_movl, x86_operand_immediate(PROFILE_OPEN_FLAGS), x86_operand_register(x86_rsi));
+    x86_push(&code, x86_movl, x86_operand_immediate(PROFILE_OPEN_MODE), x86_operand_register(x86_rdx));
+    x86_push(&code, x86_syscall, x86_operand_none(), x86_operand_none());
+    x86_push(&code, x86_testl, x86_operand_register(x86_rax), x86_operand_register(x86_rax));
+    x86_push_cc(&code, x86_jcc, x86_cond_l, x86_operand_label(label_done));
+    x86_push(&code, x86_movl, x86_operand_register(x86_rax), x86_operand_register(x86_rdi));
+    x86_push(&code, x86_movl, x86_operand_immediate(SYS_WRITE), x86_operand_register(x86_rax));
+    x86_push(&code, x86_leaq, x86_operand_data(profile->description_data), x86_operand_register(x86_rsi));
+    x86_push(&code, x86_movl, x86_operand_immediate(profile->description.length * sizeof(uint32_t)), x86_operand_register(x86_rdx));
+    x86_push(&code, x86_syscall, x86_operand_none(), x86_operand_none());
+    x86_push(&code, x86_movl, x86_operand_immediate(SYS_WRITE), x86_operand_register(x86_rax));
+    x86_push(&code, x86_leaq, x86_operand_symbol(PROFILE_COUNTERS), x86_operand_register(x86_rsi));
+    x86_push(&code, x86_movl, x86_operand_immediate(8 * profile->counter_count), x86_operand_register(x86_rdx));
+    x86_push(&code, x86_syscall, x86_operand_none(), x86_operand_none());
+    x86_push(&code, x86_movl, x86_operand_immediate(SYS_CLOSE), x86_operand_register(x86_rax));
+    x86_push(&code, x86_syscall, x86_operand_none(), x86_operand_none());
+    x86_push(&code, x86_label, x86_operand_label(label_done), x86_operand_none());
+    x86_push(&code, x86_ret, x86_operand_none(), x86_operand_none());
+
+    x86_function_t dumper;
+    dumper.name = PROFILE_DUMPER;
+    dumper.code = code;
+    nlist_insert(x86_function_t, module->functions, dumper);
+    module->fini = PROFILE_DUMPER;
+}
+
+iloc_global_t *profile_counters(iloc_module_t *module) {
+    if (module->profile.counter_count == 0) {
+        return NULL;
+    }
+    for (size_t g = 0; g < module->globals.length; g++) {
+        if (strcmp(nlist_get_unsafe(module->globals, g).name, PROFILE_COUNTERS) == 0) {
+            return &nlist_get_unsafe(module->globals, g);
+        }
+    }
+    return NULL;
+}
+
+void profile_write(iloc_module_t *module, uint8_t *counters) {
+    iloc_profile_t *profile = &module->profile;
+    FILE *file = fopen(profile->file, "wb");
+    if (file == NULL
+            || fwrite(profile->description.items, sizeof(uint32_t), profile->description.length, file) != profile->description.length
+            || fwrite(counters, sizeof(uint64_t), profile->counter_count, file) != profile->counter_count) {
+        fprintf(stderr, "ERRO: Nao foi possivel escrever o perfil \"%s\"\n", profile->file);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+}
+
+void profile_load(iloc_module_t *module, const char *file) {
+    FILE *input = fopen(file, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "ERRO: Nao foi possivel ler o perfil \"%s\"\n", file);
+        exit(EXIT_FAILURE);
+    }
+    profile_words_t words;
+    nlist_init(uint32_t, words);
+    uint32_t word;
+    while (fread(&word, sizeof(uint32_t), 1, input) == 1) {
+        nlist_insert(uint32_t, words, word);
+    }
+    fclose(input);
+
+    // The description, then the counters of each function in the same order
+    // (two words each, the low one first)
+    uint64_t functions = words.length >= 3 ? words.items[2] : 0;
+    int valid = words.length >= 3 && words.items[0] == PROFILE_MAGIC && words.items[1] == PROFILE_VERSION
+        && words.length >= 3 + 3 * functions;
+    uint64_t *first_counter = (uint64_t*) malloc((functions+1) * sizeof(uint64_t));
+    if (first_counter == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t counter = 3 + 3 * functions;
+    for (uint64_t r = 0; r < functions && valid; r++) {
+        first_counter[r] = counter;
+        counter += 2 * (uint64_t) words.items[3 + 3 * r + 2];
+    }
+    if (!valid || counter != words.length) {
+        fprintf(stderr, "ERRO: O perfil \"%s\" esta corrompido\n", file);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t f = 0; f < module->functions.length; f++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, f);
+        iloc_cfg_t cfg = iloc_cfg_build(function->code);
+        uint64_t hash = profile_hash(function);
+        int64_t record = -1;
+        for (uint64_t r = 0; r < functions && record < 0; r++) {
+            uint32_t *description = &words.items[3 + 3 * r];
+            if (description[0] == (uint32_t) hash && description[1] == (uint32_t) (hash >> 32) && description[2] == cfg.blocks.length) {
+                record = r;
+            }
+        }
+        if (record < 0) {
+            fprintf(stderr, "AVISO: O perfil \"%s\" nao corresponde a funcao %s (o codigo mudou), que sera otimizada sem ele\n", file, function->name);
+            iloc_cfg_free(&cfg);
+            continue;
+        }
+        uint32_t *counts = &words.items[first_counter[record]];
+        function->profiled = 1;
+        function->entry_count = cfg.blocks.length > 0 ? counts[0] | (uint64_t) counts[1] << 32 : 0;
+        for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+            iloc_instruction_t *first = &function->code->instructions[nlist_get_unsafe(cfg.blocks, b).start];
+            if (first->instruction == label) {
+                iloc_block_count_t block_count = { first->r1, counts[2 * b] | (uint64_t) counts[2 * b + 1] << 32 };
+                nlist_insert(iloc_block_count_t, function->block_counts, block_count);
+            }
+        }
+        iloc_cfg_free(&cfg);
+    }
+    free(first_counter);
+    nlist_free(words);
+}
+
+int64_t profile_label_count(iloc_function_t *function, uint64_t label) {
+    for (size_t c = 0; c < function->block_counts.length; c++) {
+        if (nlist_get_unsafe(function->block_counts, c).label == label) {
+            return nlist_get_unsafe(function->block_counts, c).count;
+        }
+    }
+    return -1;
+}
+
+int64_t profile_block_count(iloc_function_t *function, iloc_cfg_t *cfg, uint64_t block) {
+    if (!function->profiled) {
+        return -1;
+    }
+    if (block == 0) {
+        return function->entry_count;
+    }
+    iloc_instruction_t *first = &function->code->instructions[nlist_get_unsafe(cfg->blocks, block).start];
+    return first->instruction == label ? profile_label_count(function, first->r1) : -1;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+#include "x86.h"
+
+// Profile written by instrumented programs when no file is given
+#define PROFILE_DEFAULT_FILE "etapa6.profile"
+
+// Global with the counters of the instrumented program (a 64-bit count per
+// block, as two ints)
+#define PROFILE_COUNTERS "profile.counts"
+
+// Function of the instrumented program that writes the profile at exit
+#define PROFILE_DUMPER "profile.dump"
+
+// First words of a profile: "E6PF" and the version of the format
+#define PROFILE_MAGIC 0x46503645
+#define PROFILE_VERSION 2
+
+/********************\
+* Profile Generation *
+\********************/
+/*
+ * This function returns a hash of the control-flow graph of the function: its
+ * name, the opcodes of each block and the edges between the blocks, but not
+ * its registers or labels, so it only changes when the code does
+ */
+uint64_t profile_hash(iloc_function_t *function);
+
+/*
+ * This function makes every basic block of the module increment its own
+ * counter (in the global PROFILE_COUNTERS), and stores the name of the file
+ * and the description of the counters in the read-only data of the module
+ * (and where they are in module->profile).
+ *
+ * The profile is the description (PROFILE_MAGIC, PROFILE_VERSION, the amount
+ * of functions and the hash and amount of blocks of each one, as 32-bit words)
+ * followed by the 64-bit counters, in the order of the functions and their
+ * blocks.
+ */
+void profile_instrument(iloc_module_t *module, char *file);
+
+/*
+ * This function appends the dumper (which writes the profile with the open,
+ * write and close system calls) to an instrumented module and makes it run
+ * at exit
+ */
+void profile_emit_dumper(x86_module_t *module);
+
+/*
+ * This function returns the global with the counters of an instrumented
+ * module (NULL if the module is not instrumented)
+ */
+iloc_global_t *profile_counters(iloc_module_t *module);
+
+/*
+ * This function writes the profile from the counters of an instrumented
+ * module, for the interpreter (which runs no dumper)
+ */
+void profile_write(iloc_module_t *module, uint8_t *counters);
+
+/*****************\
+* Profile Reading *
+\*****************/
+/*
+ * This function reads the profile and attaches the block counts to each
+ * function whose hash is in it. A function that is not in it (because its code
+ * changed since the profile was generated) is reported and keeps the static
+ * estimates.
+ */
+void profile_load(iloc_module_t *module, const char *file);
+
+/*
+ * This function returns the count of the block that starts at the label (-1
+ * if unknown)
+ */
+int64_t profile_label_count(iloc_function_t *function, uint64_t label);
+
+/*
+ * This function returns the count of a block of the control-flow graph of
+ * the function (-1 if unknown)
+ */
+int64_t profile_block_count(iloc_function_t *function, iloc_cfg_t *cfg, uint64_t block);
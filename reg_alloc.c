@@ -0,0 +1,1071 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "reg_alloc.h"
+#include "bitset.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+// Caller-saved registers come first, so leaf functions save nothing
+static const x86_register_t allocatable_registers[] = {
+    x86_rcx, x86_rsi, x86_rdi, x86_r8, x86_r9,
+    x86_rbx, x86_r12, x86_r13, x86_r14, x86_r15,
+};
+
+#define ALLOCATABLE_COUNT (sizeof(allocatable_registers) / sizeof(allocatable_registers[0]))
+
+// xmm13 is the temporary of the lowering and xmm14/xmm15 reload spilled floats
+static const x86_register_t float_allocatable_registers[] = {
+    x86_xmm0, x86_xmm1, x86_xmm2, x86_xmm3, x86_xmm4, x86_xmm5, x86_xmm6,
+    x86_xmm7, x86_xmm8, x86_xmm9, x86_xmm10, x86_xmm11, x86_xmm12,
+};
+
+#define FLOAT_ALLOCATABLE_COUNT (sizeof(float_allocatable_registers) / sizeof(float_allocatable_registers[0]))
+
+// Amount of registers of the class of a virtual register
+#define class_count(is_float) ((is_float) ? FLOAT_ALLOCATABLE_COUNT : ALLOCATABLE_COUNT)
+
+static const x86_register_t argument_registers[REG_ALLOC_ARGUMENT_REGISTERS] = {
+    x86_rdi, x86_rsi, x86_rdx, x86_rcx, x86_r8, x86_r9,
+};
+
+typedef enum {
+    location_unassigned,
+    location_register,
+    location_stack,
+    location_constant,
+} reg_alloc_location_type_t;
+
+typedef struct {
+    reg_alloc_location_type_t type;
+    int64_t value; // x86_register_t, offset below rbp or the constant to rematerialize
+} reg_alloc_location_t;
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+} live_interval_t;
+
+x86_register_t reg_alloc_argument_register(uint64_t index) {
+    return argument_registers[index];
+}
+
+x86_register_t reg_alloc_float_argument_register(uint64_t index) {
+    return x86_xmm0 + index;
+}
+
+int reg_alloc_is_callee_saved(x86_register_t reg) {
+    switch (reg) {
+        case x86_rbx:
+        case x86_rbp:
+        case x86_r12:
+        case x86_r13:
+        case x86_r14:
+        case x86_r15:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Reserves a new slot of <size> bytes (aligned to its size) on the activation
+ * record of the function
+ */
+int64_t reg_alloc_stack_slot(iloc_function_t *function, uint64_t size) {
+    function->frame_size = (function->frame_size + size + size - 1) / size * size;
+    return function->frame_size;
+}
+
+/*
+ * Returns, for each dense register of the numbering, whether it holds a float
+ */
+int *reg_alloc_classes(iloc_numbering_t *numbering) {
+    int *is_float = (int*) malloc((numbering->length+1) * sizeof(int));
+    if (is_float == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t v = 0; v < numbering->length; v++) {
+        is_float[v] = iloc_is_float(numbering->sparse[v]);
+    }
+    return is_float;
+}
+
+#define interval_extend(interval, position) \
+    if ((position) < (interval).start) (interval).start = (position); \
+    if ((position) > (interval).end) (interval).end = (position);
+
+/*
+ * Suggests the ABI register of each parameter and argument as its location,
+ * so the moves around calls and at the entry are often removed (-1 if none)
+ */
+int64_t *reg_alloc_hints(iloc_program_t *program, iloc_numbering_t *numbering) {
+    int64_t *hints = (int64_t*) malloc((numbering->length+1) * sizeof(int64_t));
+    if (hints == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t v = 0; v < numbering->length; v++) {
+        hints[v] = -1;
+    }
+    // Integers and floats take the argument registers of their class in order
+    uint64_t parameters = 0, float_parameters = 0, arguments = 0, float_arguments = 0;
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t *instruction = &program->instructions[i];
+        switch (instruction->instruction) {
+            case getparam:
+                if (parameters < REG_ALLOC_ARGUMENT_REGISTERS) {
+                    hints[iloc_numbering_get(numbering, instruction->r2)] = argument_registers[parameters];
+                }
+                parameters++;
+                break;
+            case fgetparam:
+                if (float_parameters < REG_ALLOC_FLOAT_ARGUMENT_REGISTERS) {
+                    hints[iloc_numbering_get(numbering, instruction->r2)] = reg_alloc_float_argument_register(float_parameters);
+                }
+                float_parameters++;
+                break;
+            case param:
+            case fparam: {
+                int is_float = instruction->instruction == fparam;
+                uint64_t *index = is_float ? &float_arguments : &arguments;
+                int64_t v = iloc_numbering_get(numbering, instruction->r1);
+                if (hints[v] < 0 && *index < (is_float ? REG_ALLOC_FLOAT_ARGUMENT_REGISTERS : REG_ALLOC_ARGUMENT_REGISTERS)) {
+                    hints[v] = is_float ? reg_alloc_float_argument_register(*index) : argument_registers[*index];
+                }
+                (*index)++;
+                break;
+            }
+            case call:
+                arguments = 0;
+                float_arguments = 0;
+                break;
+            default:
+                break;
+        }
+    }
+    return hints;
+}
+
+/*
+ * Picks a free register of the class of a value, trying its hint first.
+ * Values that live across a call may only use the registers preserved by the
+ * callee (so floats never do). Returns -1 if there is none.
+ */
+int64_t reg_alloc_pick(int *free_registers, int64_t hint, int crosses_call, int is_float) {
+    if (hint >= 0 && free_registers[hint] && (!crosses_call || reg_alloc_is_callee_saved(hint))) {
+        return hint;
+    }
+    const x86_register_t *registers = is_float ? float_allocatable_registers : allocatable_registers;
+    for (uint64_t r = 0; r < class_count(is_float); r++) {
+        x86_register_t reg = registers[r];
+        if (free_registers[reg] && (!crosses_call || reg_alloc_is_callee_saved(reg))) {
+            return reg;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Builds the interval of each register from the liveness of the blocks and
+ * the instructions that mention it, in a single pass over the program
+ */
+live_interval_t *reg_alloc_build_intervals(iloc_program_t *program, iloc_cfg_t *cfg, iloc_numbering_t *numbering, iloc_liveness_t *liveness) {
+    live_interval_t *intervals = (live_interval_t*) malloc((numbering->length+1) * sizeof(live_interval_t));
+    if (intervals == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for live_interval_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t v = 0; v < numbering->length; v++) {
+        intervals[v].start = UINT64_MAX;
+        intervals[v].end = 0;
+    }
+    int64_t *uses[3];
+    for (uint64_t b = 0; b < cfg->blocks.length; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        bitset_iterate(&liveness->live_in[b * liveness->words], liveness->words, v) {
+            interval_extend(intervals[liveness->registers[v]], block->start);
+        }
+        bitset_iterate(&liveness->live_out[b * liveness->words], liveness->words, v) {
+            interval_extend(intervals[liveness->registers[v]], block->end-1);
+        }
+        for (uint64_t i = block->start; i < block->end; i++) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            uint64_t use_count = iloc_instruction_uses(instruction, uses);
+            int64_t *def = iloc_instruction_def(instruction);
+            if (def != NULL) {
+                uses[use_count++] = def;
+            }
+            for (uint64_t u = 0; u < use_count; u++) {
+                int64_t v = iloc_numbering_get(numbering, *uses[u]);
+                interval_extend(intervals[v], i);
+            }
+        }
+    }
+    return intervals;
+}
+
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t size;
+    uint64_t v;
+} reg_alloc_spill_t;
+
+typedef struct {
+    int64_t offset;
+    uint64_t size;
+    uint64_t end;  // End of the interval of the last register stored in the slot
+} reg_alloc_slot_t;
+
+int reg_alloc_spill_compare(const void *a, const void *b) {
+    const reg_alloc_spill_t *x = (const reg_alloc_spill_t*) a;
+    const reg_alloc_spill_t *y = (const reg_alloc_spill_t*) b;
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/*
+ * Gives a stack slot to every register spilled to the stack (whose offset is
+ * still -1). Registers whose intervals do not overlap share a slot, like the
+ * colors of an interval graph: the slots of a size are handed out in order
+ * of start, the larger ones first so the frame needs no padding.
+ */
+void reg_alloc_assign_slots(iloc_function_t *function, reg_alloc_location_t *locations, live_interval_t *intervals, int *is_float, uint64_t count) {
+    reg_alloc_spill_t *spills = (reg_alloc_spill_t*) malloc((count+1) * sizeof(reg_alloc_spill_t));
+    if (spills == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for reg_alloc_spill_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t spill_count = 0;
+    for (uint64_t v = 0; v < count; v++) {
+        if (locations[v].type == location_stack && locations[v].value < 0) {
+            spills[spill_count].start = intervals[v].start;
+            spills[spill_count].end = intervals[v].end;
+            spills[spill_count].size = is_float[v] ? 8 : 4;
+            spills[spill_count].v = v;
+            spill_count++;
+        }
+    }
+    qsort(spills, spill_count, sizeof(reg_alloc_spill_t), reg_alloc_spill_compare);
+
+    nlist_definition(reg_alloc_slot_t) slots;
+    nlist_init(reg_alloc_slot_t, slots);
+    for (uint64_t s = 0; s < spill_count; s++) {
+        reg_alloc_spill_t *spill = &spills[s];
+        reg_alloc_slot_t *slot = NULL;
+        for (size_t k = 0; k < slots.length; k++) {
+            if (slots.items[k].size == spill->size && slots.items[k].end < spill->start) {
+                slot = &slots.items[k];
+                break;
+            }
+        }
+        if (slot == NULL) {
+            reg_alloc_slot_t new_slot;
+            new_slot.offset = reg_alloc_stack_slot(function, spill->size);
+            new_slot.size = spill->size;
+            nlist_insert(reg_alloc_slot_t, slots, new_slot);
+            slot = &slots.items[slots.length-1];
+        }
+        slot->end = spill->end;
+        locations[spill->v].value = slot->offset;
+    }
+    nlist_free(slots);
+    free(spills);
+}
+
+/*
+ * Replaces every virtual register of the function by its location, loading
+ * spilled operands into the scratch registers before the instruction and
+ * storing spilled results after it. A rematerialized constant is not loaded
+ * again into a scratch register that still holds it.
+ */
+void reg_alloc_rewrite(iloc_function_t *function, iloc_numbering_t *numbering, reg_alloc_location_t *locations) {
+    iloc_program_t *program = function->code;
+    iloc_program_t *new_program = iloc_program_new();
+    int *is_float = reg_alloc_classes(numbering);
+    x86_register_t scratch[2][2] = {
+        { REG_ALLOC_SPILL_0, REG_ALLOC_SPILL_1 },
+        { REG_ALLOC_FLOAT_SPILL_0, REG_ALLOC_FLOAT_SPILL_1 },
+    };
+    int64_t *uses[2];
+    uint64_t *reads = (uint64_t*) calloc(numbering->length+1, sizeof(uint64_t));
+    if (reads == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < program->length; i++) {
+        uint64_t use_count = iloc_instruction_uses(&program->instructions[i], uses);
+        for (uint64_t u = 0; u < use_count; u++) {
+            reads[iloc_numbering_get(numbering, *uses[u])]++;
+        }
+    }
+    // The constant in each scratch register, until a label, a call or the
+    // moves of the arguments (which may go through them)
+    int holds[2][2] = { { 0, 0 }, { 0, 0 } };
+    int64_t held[2][2];
+
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t instruction = program->instructions[i];
+        if (instruction.instruction == label || instruction.instruction == call
+                || instruction.instruction == getparam || instruction.instruction == param
+                || instruction.instruction == fgetparam || instruction.instruction == fparam) {
+            memset(holds, 0, sizeof(holds));
+        }
+        int64_t *def = iloc_instruction_def(&instruction);
+        reg_alloc_location_t def_location;
+        def_location.type = location_unassigned;
+        def_location.value = 0;
+        int def_is_float = 0;
+        if (def != NULL) {
+            def_location = locations[iloc_numbering_get(numbering, *def)];
+            def_is_float = is_float[iloc_numbering_get(numbering, *def)];
+            // The only definition of a rematerialized constant is redone at
+            // each use, and a constant that is never read is not loaded
+            if (def_location.type == location_constant || ((instruction.instruction == load_i
+                    || instruction.instruction == fload_i) && reads[iloc_numbering_get(numbering, *def)] == 0)) {
+                continue;
+            }
+        }
+        // The moves of parameters and arguments read and write their locations directly
+        if (instruction.instruction == getparam || instruction.instruction == param
+                || instruction.instruction == fgetparam || instruction.instruction == fparam) {
+            int64_t *operand = instruction.instruction == getparam || instruction.instruction == fgetparam ? &instruction.r2 : &instruction.r1;
+            reg_alloc_location_t location = locations[iloc_numbering_get(numbering, *operand)];
+            instruction.r3 = location.type == location_stack ? iloc_operand_stack
+                : location.type == location_constant ? iloc_operand_constant
+                : iloc_operand_register;
+            *operand = location.value;
+            iloc_program_push(new_program, instruction);
+            continue;
+        }
+        uint64_t use_count = iloc_instruction_uses(&instruction, uses);
+        if (instruction.instruction == i2i || instruction.instruction == f2f) {
+            // Copies between coalesced registers vanish
+            reg_alloc_location_t src_location = locations[iloc_numbering_get(numbering, *uses[0])];
+            if (src_location.type == def_location.type && src_location.value == def_location.value) {
+                continue;
+            }
+        }
+        for (uint64_t u = 0; u < use_count; u++) {
+            uint64_t v = iloc_numbering_get(numbering, *uses[u]);
+            reg_alloc_location_t location = locations[v];
+            x86_register_t reg = scratch[is_float[v]][u];
+            if (location.type == location_stack) {
+                iloc_push(new_program, is_float[v] ? fload_ai_r : load_ai_r, reg_to_id(rfp), -location.value, reg);
+                holds[is_float[v]][u] = 0;
+                *uses[u] = reg;
+            } else if (location.type == location_constant) {
+                if (!holds[is_float[v]][u] || held[is_float[v]][u] != location.value) {
+                    iloc_push(new_program, is_float[v] ? fload_i : load_i, location.value, reg, 0);
+                    holds[is_float[v]][u] = 1;
+                    held[is_float[v]][u] = location.value;
+                }
+                *uses[u] = reg;
+            } else {
+                *uses[u] = location.value;
+            }
+        }
+        if (def != NULL) {
+            *def = def_location.type == location_stack ? scratch[def_is_float][0] : def_location.value;
+        }
+        iloc_program_push(new_program, instruction);
+        if (def_location.type == location_stack) {
+            iloc_push(new_program, def_is_float ? fstore_ai_r : store_ai_r, scratch[def_is_float][0], reg_to_id(rfp), -def_location.value);
+            holds[def_is_float][0] = 0;
+        }
+        if (iloc_is_terminator(&instruction)) {
+            memset(holds, 0, sizeof(holds));
+        }
+    }
+
+    for (uint64_t v = 0; v < numbering->length; v++) {
+        if (locations[v].type == location_register && reg_alloc_is_callee_saved(locations[v].value)) {
+            function->callee_saved |= UINT64_C(1) << locations[v].value;
+        }
+    }
+
+    free(reads);
+    free(is_float);
+    iloc_program_free(program);
+    function->code = new_program;
+}
+
+void reg_alloc_linear_scan(iloc_function_t *function) {
+    iloc_program_t *program = function->code;
+    iloc_numbering_t numbering = iloc_numbering_build(program);
+    iloc_cfg_t cfg = iloc_cfg_build(program);
+    iloc_liveness_t liveness = iloc_liveness_build(program, &cfg, &numbering);
+    live_interval_t *intervals = reg_alloc_build_intervals(program, &cfg, &numbering, &liveness);
+
+    // Sort the intervals by their start with a counting sort (starts are instruction indexes)
+    uint64_t *bucket = (uint64_t*) calloc(program->length+2, sizeof(uint64_t));
+    uint64_t *order = (uint64_t*) malloc((numbering.length+1) * sizeof(uint64_t));
+    reg_alloc_location_t *locations = (reg_alloc_location_t*) calloc(numbering.length+1, sizeof(reg_alloc_location_t));
+    if (bucket == NULL || order == NULL || locations == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for the register allocator (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t v = 0; v < numbering.length; v++) {
+        bucket[intervals[v].start+1]++;
+    }
+    for (uint64_t i = 0; i < program->length; i++) {
+        bucket[i+1] += bucket[i];
+    }
+    for (uint64_t v = 0; v < numbering.length; v++) {
+        order[bucket[intervals[v].start]++] = v;
+    }
+
+    // calls_before[i] = amount of calls before the instruction i
+    uint64_t *calls_before = (uint64_t*) calloc(program->length+1, sizeof(uint64_t));
+    if (calls_before == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < program->length; i++) {
+        calls_before[i+1] = calls_before[i] + (program->instructions[i].instruction == call);
+    }
+    int64_t *hints = reg_alloc_hints(program, &numbering);
+    int *is_float = reg_alloc_classes(&numbering);
+
+    // Active intervals of both classes, sorted by increasing end
+    uint64_t active[ALLOCATABLE_COUNT + FLOAT_ALLOCATABLE_COUNT];
+    uint64_t active_count = 0;
+    int free_registers[X86_REGISTER_COUNT] = {0};
+    for (uint64_t r = 0; r < ALLOCATABLE_COUNT; r++) {
+        free_registers[allocatable_registers[r]] = 1;
+    }
+    for (uint64_t r = 0; r < FLOAT_ALLOCATABLE_COUNT; r++) {
+        free_registers[float_allocatable_registers[r]] = 1;
+    }
+
+    for (uint64_t o = 0; o < numbering.length; o++) {
+        uint64_t v = order[o];
+        live_interval_t *current = &intervals[v];
+
+        // Expire the intervals that ended before this one starts
+        uint64_t expired = 0;
+        while (expired < active_count && intervals[active[expired]].end < current->start) {
+            free_registers[locations[active[expired]].value] = 1;
+            expired++;
+        }
+        memmove(active, &active[expired], (active_count - expired) * sizeof(uint64_t));
+        active_count -= expired;
+
+        // The registers of the caller are clobbered by calls strictly inside the interval
+        int crosses_call = current->start < current->end && calls_before[current->end] - calls_before[current->start+1] > 0;
+        int64_t reg = reg_alloc_pick(free_registers, hints[v], crosses_call, is_float[v]);
+        if (reg < 0) {
+            // Spill whichever usable interval of the same class ends last
+            int64_t last = -1;
+            for (uint64_t a = active_count; a-- > 0;) {
+                if (is_float[active[a]] != is_float[v]) {
+                    continue;
+                }
+                if (!crosses_call || reg_alloc_is_callee_saved(locations[active[a]].value)) {
+                    last = a;
+                    break;
+                }
+            }
+            if (last < 0 || intervals[active[last]].end <= current->end) {
+                locations[v].type = location_stack;
+                locations[v].value = -1;
+                continue;
+            }
+            uint64_t victim = active[last];
+            locations[v] = locations[victim];
+            locations[victim].type = location_stack;
+            locations[victim].value = -1;
+            memmove(&active[last], &active[last+1], (active_count - last - 1) * sizeof(uint64_t));
+            active_count--;
+        } else {
+            locations[v].type = location_register;
+            locations[v].value = reg;
+            free_registers[reg] = 0;
+        }
+
+        // Insert into the active list keeping it sorted
+        uint64_t position = active_count;
+        while (position > 0 && intervals[active[position-1]].end > current->end) {
+            active[position] = active[position-1];
+            position--;
+        }
+        active[position] = v;
+        active_count++;
+    }
+
+    reg_alloc_assign_slots(function, locations, intervals, is_float, numbering.length);
+    reg_alloc_rewrite(function, &numbering, locations);
+
+    free(is_float);
+    free(hints);
+    free(calls_before);
+    free(bucket);
+    free(order);
+    free(locations);
+    free(intervals);
+    iloc_liveness_free(&liveness);
+    iloc_cfg_free(&cfg);
+    iloc_numbering_free(&numbering);
+}
+
+// Functions with more registers than this fall back to linear scan, since the
+// interference bit matrix grows with the square of the amount of registers
+#define REG_ALLOC_GRAPH_MAX_NODES 16384
+
+// Each loop level multiplies the spill cost of an occurrence by this factor
+#define REG_ALLOC_LOOP_WEIGHT 10
+#define REG_ALLOC_MAX_LOOP_DEPTH 6
+
+typedef nlist_definition(uint64_t) index_list_t;
+
+typedef enum {
+    node_initial,
+    node_simplify,
+    node_freeze,
+    node_spill,
+    node_select,
+    node_coalesced,
+    node_colored,
+    node_spilled,
+} node_state_t;
+
+typedef enum {
+    move_worklist,
+    move_active,
+    move_coalesced,
+    move_constrained,
+    move_frozen,
+} move_state_t;
+
+typedef struct {
+    uint64_t src;
+    uint64_t dst;
+    move_state_t state;
+} graph_move_t;
+
+typedef struct {
+    uint64_t length;
+    uint64_t *matrix;          // Lower triangle of the adjacency bit matrix
+    index_list_t *adjacency;   // Neighbours of each node (never shrinks)
+    uint64_t *degree;
+    node_state_t *state;
+    uint64_t *alias;
+    index_list_t *move_list;   // Moves that mention each node
+    double *spill_cost;
+    int *rematerializable;
+    int64_t *constant;         // Value of the loadI that defines a rematerializable node
+    int *crosses_call;         // Whether the node is live across a call
+    int64_t *hint;
+    int64_t *color;
+    int *is_float;             // Class of the node (nodes of different classes never interfere)
+
+    nlist_definition(graph_move_t) moves;
+    index_list_t move_worklist;
+    index_list_t simplify_worklist;
+    index_list_t freeze_worklist;
+    index_list_t spill_worklist;
+    index_list_t select_stack;
+
+    uint64_t *mark;            // Scratch array for the conservative coalescing test
+    uint64_t mark_stamp;
+} interference_graph_t;
+
+#define graph_bit(u, v) ((u) > (v) ? (u) * ((u) - 1) / 2 + (v) : (v) * ((v) - 1) / 2 + (u))
+
+#define graph_interferes(graph, u, v) bitset_test((graph)->matrix, graph_bit(u, v))
+
+// Amount of colors available to the node
+#define graph_k(graph, node) class_count((graph)->is_float[node])
+
+void graph_add_edge(interference_graph_t *graph, uint64_t u, uint64_t v) {
+    if (u == v || graph->is_float[u] != graph->is_float[v] || graph_interferes(graph, u, v)) {
+        return;
+    }
+    bitset_set(graph->matrix, graph_bit(u, v));
+    nlist_insert(uint64_t, graph->adjacency[u], v);
+    nlist_insert(uint64_t, graph->adjacency[v], u);
+    graph->degree[u]++;
+    graph->degree[v]++;
+}
+
+uint64_t graph_get_alias(interference_graph_t *graph, uint64_t node) {
+    while (graph->state[node] == node_coalesced) {
+        node = graph->alias[node];
+    }
+    return node;
+}
+
+int graph_is_adjacent(interference_graph_t *graph, uint64_t node) {
+    return graph->state[node] != node_select && graph->state[node] != node_coalesced;
+}
+
+int graph_move_is_pending(interference_graph_t *graph, uint64_t move) {
+    move_state_t state = nlist_get_unsafe(graph->moves, move).state;
+    return state == move_active || state == move_worklist;
+}
+
+int graph_move_related(interference_graph_t *graph, uint64_t node) {
+    for (size_t m = 0; m < graph->move_list[node].length; m++) {
+        if (graph_move_is_pending(graph, nlist_get_unsafe(graph->move_list[node], m))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void graph_set_state(interference_graph_t *graph, uint64_t node, node_state_t state) {
+    graph->state[node] = state;
+    switch (state) {
+        case node_simplify:
+            nlist_insert(uint64_t, graph->simplify_worklist, node);
+            break;
+        case node_freeze:
+            nlist_insert(uint64_t, graph->freeze_worklist, node);
+            break;
+        case node_spill:
+            nlist_insert(uint64_t, graph->spill_worklist, node);
+            break;
+        case node_select:
+            nlist_insert(uint64_t, graph->select_stack, node);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Worklists are stacks with lazy deletion: an entry is only valid while the
+ * node is still in the state of the list
+ */
+int graph_pop(interference_graph_t *graph, index_list_t *worklist, node_state_t state, uint64_t *node) {
+    while (worklist->length > 0) {
+        *node = worklist->items[--worklist->length];
+        if (graph->state[*node] == state) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void graph_enable_moves(interference_graph_t *graph, uint64_t node) {
+    for (size_t m = 0; m < graph->move_list[node].length; m++) {
+        uint64_t move = nlist_get_unsafe(graph->move_list[node], m);
+        if (nlist_get_unsafe(graph->moves, move).state == move_active) {
+            nlist_get_unsafe(graph->moves, move).state = move_worklist;
+            nlist_insert(uint64_t, graph->move_worklist, move);
+        }
+    }
+}
+
+void graph_decrement_degree(interference_graph_t *graph, uint64_t node) {
+    uint64_t degree = graph->degree[node]--;
+    if (degree != graph_k(graph, node) || graph->state[node] != node_spill) {
+        return;
+    }
+    graph_enable_moves(graph, node);
+    for (size_t a = 0; a < graph->adjacency[node].length; a++) {
+        uint64_t neighbour = nlist_get_unsafe(graph->adjacency[node], a);
+        if (graph_is_adjacent(graph, neighbour)) {
+            graph_enable_moves(graph, neighbour);
+        }
+    }
+    graph_set_state(graph, node, graph_move_related(graph, node) ? node_freeze : node_simplify);
+}
+
+void graph_add_worklist(interference_graph_t *graph, uint64_t node) {
+    if (graph->state[node] == node_freeze && !graph_move_related(graph, node) && graph->degree[node] < graph_k(graph, node)) {
+        graph_set_state(graph, node, node_simplify);
+    }
+}
+
+/*
+ * Briggs' test: the merged node has fewer than K neighbours of significant
+ * degree, so it is still trivially colorable
+ */
+int graph_conservative(interference_graph_t *graph, uint64_t u, uint64_t v) {
+    uint64_t nodes[2] = { u, v };
+    uint64_t significant = 0;
+    graph->mark_stamp++;
+    for (uint64_t n = 0; n < 2; n++) {
+        for (size_t a = 0; a < graph->adjacency[nodes[n]].length; a++) {
+            uint64_t neighbour = nlist_get_unsafe(graph->adjacency[nodes[n]], a);
+            if (!graph_is_adjacent(graph, neighbour) || graph->mark[neighbour] == graph->mark_stamp) {
+                continue;
+            }
+            graph->mark[neighbour] = graph->mark_stamp;
+            if (graph->degree[neighbour] >= graph_k(graph, neighbour)) {
+                significant++;
+            }
+        }
+    }
+    return significant < graph_k(graph, u);
+}
+
+void graph_combine(interference_graph_t *graph, uint64_t u, uint64_t v) {
+    graph->state[v] = node_coalesced;
+    graph->alias[v] = u;
+    for (size_t m = 0; m < graph->move_list[v].length; m++) {
+        nlist_insert(uint64_t, graph->move_list[u], nlist_get_unsafe(graph->move_list[v], m));
+    }
+    graph_enable_moves(graph, v);
+    for (size_t a = 0; a < graph->adjacency[v].length; a++) {
+        uint64_t neighbour = nlist_get_unsafe(graph->adjacency[v], a);
+        if (graph_is_adjacent(graph, neighbour)) {
+            graph_add_edge(graph, neighbour, u);
+            graph_decrement_degree(graph, neighbour);
+        }
+    }
+    if (graph->degree[u] >= graph_k(graph, u) && graph->state[u] == node_freeze) {
+        graph_set_state(graph, u, node_spill);
+    }
+    // The merged node has more than one definition
+    graph->spill_cost[u] += graph->spill_cost[v];
+    graph->rematerializable[u] = 0;
+    graph->crosses_call[u] |= graph->crosses_call[v];
+    if (graph->hint[u] < 0) {
+        graph->hint[u] = graph->hint[v];
+    }
+}
+
+void graph_coalesce(interference_graph_t *graph, uint64_t move) {
+    graph_move_t *m = &nlist_get_unsafe(graph->moves, move);
+    uint64_t u = graph_get_alias(graph, m->dst);
+    uint64_t v = graph_get_alias(graph, m->src);
+    if (u == v) {
+        m->state = move_coalesced;
+        graph_add_worklist(graph, u);
+    } else if (graph_interferes(graph, u, v) || graph->crosses_call[u] != graph->crosses_call[v]) {
+        // Merging a value that lives across a call into one that does not
+        // would force a callee-saved register on both (and undo the splits
+        // made for shrink-wrapping)
+        m->state = move_constrained;
+        graph_add_worklist(graph, u);
+        graph_add_worklist(graph, v);
+    } else if (graph_conservative(graph, u, v)) {
+        m->state = move_coalesced;
+        graph_combine(graph, u, v);
+        graph_add_worklist(graph, u);
+    } else {
+        m->state = move_active;
+    }
+}
+
+void graph_freeze_moves(interference_graph_t *graph, uint64_t u) {
+    for (size_t m = 0; m < graph->move_list[u].length; m++) {
+        uint64_t move = nlist_get_unsafe(graph->move_list[u], m);
+        if (!graph_move_is_pending(graph, move)) {
+            continue;
+        }
+        graph_move_t *frozen = &nlist_get_unsafe(graph->moves, move);
+        uint64_t v = graph_get_alias(graph, frozen->src) == graph_get_alias(graph, u)
+            ? graph_get_alias(graph, frozen->dst)
+            : graph_get_alias(graph, frozen->src);
+        frozen->state = move_frozen;
+        if (graph->state[v] == node_freeze && !graph_move_related(graph, v) && graph->degree[v] < graph_k(graph, v)) {
+            graph_set_state(graph, v, node_simplify);
+        }
+    }
+}
+
+/*
+ * Picks the node with the lowest spill cost per interference as the
+ * potential spill, so that values used in loops are the last to go
+ */
+int graph_select_spill(interference_graph_t *graph) {
+    int64_t best = -1;
+    size_t kept = 0;
+    for (size_t i = 0; i < graph->spill_worklist.length; i++) {
+        uint64_t node = nlist_get_unsafe(graph->spill_worklist, i);
+        if (graph->state[node] != node_spill) {
+            continue;
+        }
+        nlist_get_unsafe(graph->spill_worklist, kept++) = node;
+        if (best < 0 || graph->spill_cost[node] / graph->degree[node] < graph->spill_cost[best] / graph->degree[best]) {
+            best = node;
+        }
+    }
+    graph->spill_worklist.length = kept;
+    if (best < 0) {
+        return 0;
+    }
+    graph_set_state(graph, best, node_simplify);
+    graph_freeze_moves(graph, best);
+    return 1;
+}
+
+void graph_build(interference_graph_t *graph, iloc_program_t *program, iloc_cfg_t *cfg, iloc_numbering_t *numbering, iloc_liveness_t *liveness) {
+    uint64_t n = numbering->length;
+    graph->length = n;
+    graph->matrix = bitset_new(n * (n + 1) / 2);
+    graph->adjacency = (index_list_t*) malloc((n+1) * sizeof(index_list_t));
+    graph->move_list = (index_list_t*) malloc((n+1) * sizeof(index_list_t));
+    graph->degree = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    graph->state = (node_state_t*) calloc(n+1, sizeof(node_state_t));
+    graph->alias = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    graph->spill_cost = (double*) calloc(n+1, sizeof(double));
+    graph->rematerializable = (int*) calloc(n+1, sizeof(int));
+    graph->constant = (int64_t*) calloc(n+1, sizeof(int64_t));
+    graph->crosses_call = (int*) calloc(n+1, sizeof(int));
+    graph->hint = reg_alloc_hints(program, numbering);
+    graph->is_float = reg_alloc_classes(numbering);
+    graph->color = (int64_t*) calloc(n+1, sizeof(int64_t));
+    graph->mark = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    if (graph->matrix == NULL || graph->adjacency == NULL || graph->move_list == NULL || graph->degree == NULL
+            || graph->state == NULL || graph->alias == NULL || graph->spill_cost == NULL || graph->rematerializable == NULL
+            || graph->constant == NULL || graph->crosses_call == NULL || graph->color == NULL || graph->mark == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for interference_graph_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-16);
+        exit(EXIT_FAILURE);
+    }
+    graph->mark_stamp = 0;
+    for (uint64_t v = 0; v < n; v++) {
+        nlist_init(uint64_t, graph->adjacency[v]);
+        nlist_init(uint64_t, graph->move_list[v]);
+    }
+    nlist_init(graph_move_t, graph->moves);
+    nlist_init(uint64_t, graph->move_worklist);
+    nlist_init(uint64_t, graph->simplify_worklist);
+    nlist_init(uint64_t, graph->freeze_worklist);
+    nlist_init(uint64_t, graph->spill_worklist);
+    nlist_init(uint64_t, graph->select_stack);
+
+    // Live set of the backward walk, as a sparse set over the dense numbering
+    uint64_t *live = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    uint64_t *live_position = (uint64_t*) malloc((n+1) * sizeof(uint64_t));
+    uint64_t *definitions = (uint64_t*) calloc(n+1, sizeof(uint64_t));
+    if (live == NULL || live_position == NULL || definitions == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for uint64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t live_count = 0;
+#define live_contains(v) (live_position[v] < live_count && live[live_position[v]] == (v))
+#define live_add(v) if (!live_contains(v)) { live_position[v] = live_count; live[live_count++] = (v); }
+#define live_remove(v) if (live_contains(v)) { uint64_t _last = live[--live_count]; live[live_position[v]] = _last; live_position[_last] = live_position[v]; }
+    for (uint64_t v = 0; v < n; v++) {
+        live_position[v] = UINT64_MAX;
+    }
+
+    uint64_t *depth = iloc_cfg_loop_depth(cfg);
+    int64_t *uses[2];
+    for (uint64_t b = cfg->blocks.length; b-- > 0;) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        double weight = 1;
+        for (uint64_t d = 0; d < depth[b] && d < REG_ALLOC_MAX_LOOP_DEPTH; d++) {
+            weight *= REG_ALLOC_LOOP_WEIGHT;
+        }
+
+        live_count = 0;
+        bitset_iterate(&liveness->live_out[b * liveness->words], liveness->words, v) {
+            live_add(liveness->registers[v]);
+        }
+        for (uint64_t i = block->end; i-- > block->start;) {
+            iloc_instruction_t *instruction = &program->instructions[i];
+            uint64_t use_count = iloc_instruction_uses(instruction, uses);
+            int64_t *def = iloc_instruction_def(instruction);
+            if (def != NULL) {
+                uint64_t d = iloc_numbering_get(numbering, *def);
+                if (instruction->instruction == i2i || instruction->instruction == f2f) {
+                    uint64_t src = iloc_numbering_get(numbering, *uses[0]);
+                    if (src != d) {
+                        // The copy does not make its source and destination interfere
+                        live_remove(src);
+                        graph_move_t move = { src, d, move_worklist };
+                        nlist_insert(uint64_t, graph->move_list[src], graph->moves.length);
+                        nlist_insert(uint64_t, graph->move_list[d], graph->moves.length);
+                        nlist_insert(uint64_t, graph->move_worklist, graph->moves.length);
+                        nlist_insert(graph_move_t, graph->moves, move);
+                    }
+                }
+                for (uint64_t l = 0; l < live_count; l++) {
+                    graph_add_edge(graph, live[l], d);
+                }
+                live_remove(d);
+                graph->spill_cost[d] += weight;
+                definitions[d]++;
+                if (instruction->instruction == load_i || instruction->instruction == fload_i) {
+                    graph->rematerializable[d] = 1;
+                    graph->constant[d] = instruction->r1;
+                }
+            }
+            if (instruction->instruction == call) {
+                for (uint64_t l = 0; l < live_count; l++) {
+                    graph->crosses_call[live[l]] = 1;
+                }
+            }
+            for (uint64_t u = 0; u < use_count; u++) {
+                uint64_t v = iloc_numbering_get(numbering, *uses[u]);
+                live_add(v);
+                graph->spill_cost[v] += weight;
+            }
+        }
+    }
+#undef live_contains
+#undef live_add
+#undef live_remove
+
+    // A constant defined once is reloaded with a loadI instead of going
+    // through the stack, which makes it cheaper to spill
+    for (uint64_t v = 0; v < n; v++) {
+        if (definitions[v] != 1) {
+            graph->rematerializable[v] = 0;
+        }
+        if (graph->rematerializable[v]) {
+            graph->spill_cost[v] /= 2;
+        }
+    }
+
+    free(depth);
+    free(live);
+    free(live_position);
+    free(definitions);
+}
+
+void graph_free(interference_graph_t *graph) {
+    for (uint64_t v = 0; v < graph->length; v++) {
+        nlist_free(graph->adjacency[v]);
+        nlist_free(graph->move_list[v]);
+    }
+    free(graph->matrix);
+    free(graph->adjacency);
+    free(graph->move_list);
+    free(graph->degree);
+    free(graph->state);
+    free(graph->alias);
+    free(graph->spill_cost);
+    free(graph->rematerializable);
+    free(graph->constant);
+    free(graph->crosses_call);
+    free(graph->hint);
+    free(graph->is_float);
+    free(graph->color);
+    free(graph->mark);
+    nlist_free(graph->moves);
+    nlist_free(graph->move_worklist);
+    nlist_free(graph->simplify_worklist);
+    nlist_free(graph->freeze_worklist);
+    nlist_free(graph->spill_worklist);
+    nlist_free(graph->select_stack);
+}
+
+void reg_alloc_graph_coloring(iloc_function_t *function) {
+    iloc_program_t *program = function->code;
+    iloc_numbering_t numbering = iloc_numbering_build(program);
+    if (numbering.length > REG_ALLOC_GRAPH_MAX_NODES) {
+        iloc_numbering_free(&numbering);
+        reg_alloc_linear_scan(function);
+        return;
+    }
+    iloc_cfg_t cfg = iloc_cfg_build(program);
+    iloc_liveness_t liveness = iloc_liveness_build(program, &cfg, &numbering);
+    interference_graph_t graph;
+    graph_build(&graph, program, &cfg, &numbering, &liveness);
+
+    for (uint64_t v = 0; v < graph.length; v++) {
+        if (graph.degree[v] >= graph_k(&graph, v)) {
+            graph_set_state(&graph, v, node_spill);
+        } else if (graph_move_related(&graph, v)) {
+            graph_set_state(&graph, v, node_freeze);
+        } else {
+            graph_set_state(&graph, v, node_simplify);
+        }
+    }
+
+    while (1) {
+        uint64_t node;
+        if (graph_pop(&graph, &graph.simplify_worklist, node_simplify, &node)) {
+            graph_set_state(&graph, node, node_select);
+            for (size_t a = 0; a < graph.adjacency[node].length; a++) {
+                uint64_t neighbour = nlist_get_unsafe(graph.adjacency[node], a);
+                if (graph_is_adjacent(&graph, neighbour)) {
+                    graph_decrement_degree(&graph, neighbour);
+                }
+            }
+        } else if (graph.move_worklist.length > 0) {
+            uint64_t move = graph.move_worklist.items[--graph.move_worklist.length];
+            if (nlist_get_unsafe(graph.moves, move).state == move_worklist) {
+                graph_coalesce(&graph, move);
+            }
+        } else if (graph_pop(&graph, &graph.freeze_worklist, node_freeze, &node)) {
+            graph_set_state(&graph, node, node_simplify);
+            graph_freeze_moves(&graph, node);
+        } else if (!graph_select_spill(&graph)) {
+            break;
+        }
+    }
+
+    // Assign colors in the reverse order of simplification
+    while (graph.select_stack.length > 0) {
+        uint64_t node = graph.select_stack.items[--graph.select_stack.length];
+        int free_registers[X86_REGISTER_COUNT] = {0};
+        for (uint64_t r = 0; r < ALLOCATABLE_COUNT; r++) {
+            free_registers[allocatable_registers[r]] = 1;
+        }
+        for (uint64_t r = 0; r < FLOAT_ALLOCATABLE_COUNT; r++) {
+            free_registers[float_allocatable_registers[r]] = 1;
+        }
+        for (size_t a = 0; a < graph.adjacency[node].length; a++) {
+            uint64_t neighbour = graph_get_alias(&graph, nlist_get_unsafe(graph.adjacency[node], a));
+            if (graph.state[neighbour] == node_colored) {
+                free_registers[graph.color[neighbour]] = 0;
+            }
+        }
+        int64_t reg = reg_alloc_pick(free_registers, graph.hint[node], graph.crosses_call[node], graph.is_float[node]);
+        if (reg < 0) {
+            graph.state[node] = node_spilled;
+        } else {
+            graph.state[node] = node_colored;
+            graph.color[node] = reg;
+        }
+    }
+
+    // Coalesced registers share the location of their representative
+    reg_alloc_location_t *locations = (reg_alloc_location_t*) calloc(numbering.length+1, sizeof(reg_alloc_location_t));
+    if (locations == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for reg_alloc_location_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t v = 0; v < graph.length; v++) {
+        if (graph.state[v] == node_colored) {
+            locations[v].type = location_register;
+            locations[v].value = graph.color[v];
+        } else if (graph.state[v] == node_spilled) {
+            if (graph.rematerializable[v]) {
+                locations[v].type = location_constant;
+                locations[v].value = graph.constant[v];
+            } else {
+                locations[v].type = location_stack;
+                locations[v].value = -1;
+            }
+        }
+    }
+    // A spilled representative lives as long as every register coalesced into it
+    live_interval_t *intervals = reg_alloc_build_intervals(program, &cfg, &numbering, &liveness);
+    for (uint64_t v = 0; v < graph.length; v++) {
+        if (graph.state[v] == node_coalesced && intervals[v].start <= intervals[v].end) {
+            uint64_t alias = graph_get_alias(&graph, v);
+            interval_extend(intervals[alias], intervals[v].start);
+            interval_extend(intervals[alias], intervals[v].end);
+        }
+    }
+    reg_alloc_assign_slots(function, locations, intervals, graph.is_float, graph.length);
+    free(intervals);
+    for (uint64_t v = 0; v < graph.length; v++) {
+        if (graph.state[v] == node_coalesced) {
+            locations[v] = locations[graph_get_alias(&graph, v)];
+        }
+    }
+
+    reg_alloc_rewrite(function, &numbering, locations);
+
+    free(locations);
+    graph_free(&graph);
+    iloc_liveness_free(&liveness);
+    iloc_cfg_free(&cfg);
+    iloc_numbering_free(&numbering);
+}
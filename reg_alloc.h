@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Scratch registers reserved to reload spilled operands (never allocated)
+#define REG_ALLOC_SPILL_0 x86_r10
+#define REG_ALLOC_SPILL_1 x86_r11
+
+// Scratch registers reserved to reload spilled floats (never allocated)
+#define REG_ALLOC_FLOAT_SPILL_0 x86_xmm14
+#define REG_ALLOC_FLOAT_SPILL_1 x86_xmm15
+
+// Integer and float arguments passed in registers by the System V ABI
+#define REG_ALLOC_ARGUMENT_REGISTERS 6
+#define REG_ALLOC_FLOAT_ARGUMENT_REGISTERS 8
+
+/*********************\
+* Register Allocation *
+\*********************/
+/*
+ * This function returns true if the System V ABI requires the callee to
+ * preserve the register
+ */
+int reg_alloc_is_callee_saved(x86_register_t reg);
+
+/*
+ * This function returns the register of the System V ABI for the integer
+ * argument <index> (which must be below REG_ALLOC_ARGUMENT_REGISTERS)
+ */
+x86_register_t reg_alloc_argument_register(uint64_t index);
+
+/*
+ * This function returns the register of the System V ABI for the float
+ * argument <index> (which must be below REG_ALLOC_FLOAT_ARGUMENT_REGISTERS)
+ */
+x86_register_t reg_alloc_float_argument_register(uint64_t index);
+
+/*
+ * This function assigns an x86 register or a stack slot to every virtual
+ * register of the function with linear scan, and rewrites its instructions to
+ * use the physical registers, reloading and storing the spilled ones around
+ * each instruction.
+ *
+ * It runs in O(n log n) on the size of the function, so it is the allocator
+ * for inputs where compile time matters more than the quality of the code.
+ */
+void reg_alloc_linear_scan(iloc_function_t *function);
+
+/*
+ * This function assigns locations like reg_alloc_linear_scan, but colors the
+ * interference graph of the function (iterated register coalescing). Copies
+ * whose registers do not interfere are removed, values in loops are the last
+ * to be spilled and spilled constants are rematerialized instead of stored.
+ *
+ * Functions too large for the interference matrix fall back to linear scan.
+ */
+void reg_alloc_graph_coloring(iloc_function_t *function);
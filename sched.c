@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "sched.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+schedule_mode_t schedule_mode = schedule_post;
+
+// Longest run of instructions scheduled together (the dependences are
+// computed between every pair)
+#define SCHED_WINDOW 128
+
+// Instructions issued per cycle
+#define SCHED_ISSUE_WIDTH 4
+
+// Latencies of a recent x86 core, in cycles
+#define LATENCY_SIMPLE 1
+#define LATENCY_MULTIPLY 3
+#define LATENCY_DIVIDE 26
+#define LATENCY_LOAD 4
+#define LATENCY_FLOAT_LOAD 5
+#define LATENCY_STORE_FORWARD 4 // From a store to a load of the same address
+#define LATENCY_FLOAT 4         // addsd, subsd and mulsd
+#define LATENCY_FLOAT_DIVIDE 14
+#define LATENCY_FLOAT_COMPARE 3
+#define LATENCY_INT_TO_FLOAT 4
+#define LATENCY_FLOAT_TO_INT 6
+
+// Cycles the divider (which is not pipelined) stays busy
+#define DIVIDER_DIVIDE 6
+#define DIVIDER_FLOAT_DIVIDE 4
+
+typedef struct {
+    uint64_t latency; // Cycles until the result can be read
+    uint64_t divider; // Cycles the divider stays busy (0 if not used)
+} sched_cost_t;
+
+/*
+ * Orders the <count> instructions of a region: <edges>[i*count+j] is the
+ * latency of the dependence of j on i (i < j), or -1 if there is none
+ */
+void sched_order(uint64_t count, sched_cost_t *costs, int64_t *edges, uint64_t *order) {
+    uint64_t *priority = (uint64_t*) malloc((count+1) * sizeof(uint64_t));
+    uint64_t *ready = (uint64_t*) calloc(count+1, sizeof(uint64_t));
+    uint64_t *waiting = (uint64_t*) calloc(count+1, sizeof(uint64_t));
+    int *done = (int*) calloc(count+1, sizeof(int));
+    if (priority == NULL || ready == NULL || waiting == NULL || done == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for sched_order (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-5);
+        exit(EXIT_FAILURE);
+    }
+
+    // Longest path of latencies from each instruction to the end of the region
+    for (uint64_t i = count; i-- > 0;) {
+        priority[i] = costs[i].latency;
+        for (uint64_t j = i+1; j < count; j++) {
+            int64_t latency = edges[i*count+j];
+            if (latency >= 0) {
+                waiting[j]++;
+                if (latency + priority[j] > priority[i]) {
+                    priority[i] = latency + priority[j];
+                }
+            }
+        }
+    }
+
+    uint64_t scheduled = 0;
+    uint64_t divider_free = 0;
+    for (uint64_t cycle = 0; scheduled < count; cycle++) {
+        for (uint64_t issued = 0; issued < SCHED_ISSUE_WIDTH; issued++) {
+            // The ready instruction on the longest path (the first one on ties)
+            int64_t best = -1;
+            for (uint64_t i = 0; i < count; i++) {
+                if (done[i] || waiting[i] != 0 || ready[i] > cycle || (costs[i].divider != 0 && divider_free > cycle)) {
+                    continue;
+                }
+                if (best < 0 || priority[i] > priority[best]) {
+                    best = i;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+            done[best] = 1;
+            order[scheduled++] = best;
+            if (costs[best].divider != 0) {
+                divider_free = cycle + costs[best].divider;
+            }
+            for (uint64_t j = best+1; j < count; j++) {
+                int64_t latency = edges[best*count+j];
+                if (latency >= 0) {
+                    waiting[j]--;
+                    if (cycle + latency > ready[j]) {
+                        ready[j] = cycle + latency;
+                    }
+                }
+            }
+        }
+    }
+    free(priority);
+    free(ready);
+    free(waiting);
+    free(done);
+}
+
+int64_t *sched_edges(uint64_t count) {
+    int64_t *edges = (int64_t*) malloc((count*count+1) * sizeof(int64_t));
+    if (edges == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int64_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    return edges;
+}
+
+int64_t sched_max(int64_t a, int64_t b) {
+    return a > b ? a : b;
+}
+
+ /******\
+ * ILOC *
+ \******/
+// Memory accessed by an ILOC instruction
+typedef struct {
+    int accesses;
+    int stores;
+    int indexed;    // An element of a global array (loadAX/storeAX)
+    int64_t base;   // Of a loadAI/storeAI
+    int64_t offset;
+    uint64_t size;
+} sched_access_t;
+
+typedef struct {
+    int64_t uses[3];
+    uint64_t use_count;
+    int64_t def;
+    sched_access_t access;
+    sched_cost_t cost;
+} sched_iloc_info_t;
+
+int sched_iloc_barrier(iloc_instruction_type_t type) {
+    switch (type) {
+        case label:
+        case cbr:
+        case jump_i:
+        case jump:
+        case ret:
+        case call:
+        case tailcall:
+        case param:
+        case fparam:
+        case getparam:
+        case fgetparam:
+        case push:
+        case pop:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+sched_cost_t sched_iloc_cost(iloc_instruction_type_t type) {
+    sched_cost_t cost = { LATENCY_SIMPLE, 0 };
+    switch (type) {
+        case mult:
+            cost.latency = LATENCY_MULTIPLY;
+            break;
+        case _div:
+        case mod:
+            cost.latency = LATENCY_DIVIDE;
+            cost.divider = DIVIDER_DIVIDE;
+            break;
+        case load_ai_r:
+        case load_ax:
+            cost.latency = LATENCY_LOAD;
+            break;
+        case fload_i:
+        case fload_ai_r:
+            cost.latency = LATENCY_FLOAT_LOAD;
+            break;
+        case store_ai_r:
+        case store_ax:
+        case fstore_ai_r:
+            cost.latency = LATENCY_STORE_FORWARD;
+            break;
+        case fadd:
+        case fsub:
+        case fmult:
+            cost.latency = LATENCY_FLOAT;
+            break;
+        case fdiv:
+            cost.latency = LATENCY_FLOAT_DIVIDE;
+            cost.divider = DIVIDER_FLOAT_DIVIDE;
+            break;
+        case fcmp_lt:
+        case fcmp_le:
+        case fcmp_eq:
+        case fcmp_ge:
+        case fcmp_gt:
+        case fcmp_ne:
+            cost.latency = LATENCY_FLOAT_COMPARE;
+            break;
+        case i2f:
+            cost.latency = LATENCY_INT_TO_FLOAT;
+            break;
+        case f2i:
+            cost.latency = LATENCY_FLOAT_TO_INT;
+            break;
+        default:
+            break;
+    }
+    return cost;
+}
+
+sched_access_t sched_iloc_access(iloc_instruction_t *instruction) {
+    sched_access_t access = { 0, 0, 0, 0, 0, 0 };
+    switch (instruction->instruction) {
+        case load_ai_r:
+        case fload_ai_r:
+            access.accesses = 1;
+            access.base = id_to_reg(instruction->r1);
+            access.offset = instruction->r2;
+            break;
+        case store_ai_r:
+        case fstore_ai_r:
+            access.accesses = 1;
+            access.stores = 1;
+            access.base = id_to_reg(instruction->r2);
+            access.offset = instruction->r3;
+            break;
+        case load_ax:
+        case store_ax:
+            access.accesses = 1;
+            access.stores = instruction->instruction == store_ax;
+            access.indexed = 1;
+            access.base = rbss;
+            break;
+        default:
+            break;
+    }
+    access.size = instruction->instruction == fload_ai_r || instruction->instruction == fstore_ai_r ? 8 : 4;
+    return access;
+}
+
+int sched_iloc_may_alias(sched_access_t *a, sched_access_t *b) {
+    if (a->base != b->base) {
+        // The frame and the data segment never overlap
+        return a->base != rbss && b->base != rbss;
+    }
+    if (a->indexed || b->indexed) {
+        return 1;
+    }
+    return a->offset < b->offset + (int64_t) b->size && b->offset < a->offset + (int64_t) a->size;
+}
+
+int64_t sched_iloc_edge(sched_iloc_info_t *a, sched_iloc_info_t *b) {
+    int64_t latency = -1;
+    for (uint64_t u = 0; u < b->use_count; u++) {
+        if (a->def >= 0 && b->uses[u] == a->def) {
+            latency = a->cost.latency;
+        }
+    }
+    for (uint64_t u = 0; u < a->use_count; u++) {
+        if (b->def >= 0 && a->uses[u] == b->def) {
+            latency = sched_max(latency, 0);
+        }
+    }
+    if (a->def >= 0 && a->def == b->def) {
+        latency = sched_max(latency, 0);
+    }
+    if (a->access.accesses && b->access.accesses && (a->access.stores || b->access.stores) && sched_iloc_may_alias(&a->access, &b->access)) {
+        latency = sched_max(latency, a->access.stores && !b->access.stores ? LATENCY_STORE_FORWARD : 0);
+    }
+    return latency;
+}
+
+void sched_iloc_region(iloc_instruction_t *code, uint64_t count) {
+    sched_iloc_info_t *info = (sched_iloc_info_t*) malloc((count+1) * sizeof(sched_iloc_info_t));
+    sched_cost_t *costs = (sched_cost_t*) malloc((count+1) * sizeof(sched_cost_t));
+    uint64_t *order = (uint64_t*) malloc((count+1) * sizeof(uint64_t));
+    iloc_instruction_t *copy = (iloc_instruction_t*) malloc((count+1) * sizeof(iloc_instruction_t));
+    if (info == NULL || costs == NULL || order == NULL || copy == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for sched_iloc_region (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-5);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        copy[i] = code[i];
+        iloc_instruction_t instruction = code[i];
+        int64_t *uses[3];
+        info[i].use_count = iloc_instruction_uses(&instruction, uses);
+        for (uint64_t u = 0; u < info[i].use_count; u++) {
+            info[i].uses[u] = *uses[u];
+        }
+        int64_t *def = iloc_instruction_def(&instruction);
+        info[i].def = def == NULL ? -1 : *def;
+        info[i].access = sched_iloc_access(&code[i]);
+        info[i].cost = sched_iloc_cost(code[i].instruction);
+        costs[i] = info[i].cost;
+    }
+    int64_t *edges = sched_edges(count);
+    for (uint64_t i = 0; i < count; i++) {
+        for (uint64_t j = i+1; j < count; j++) {
+            edges[i*count+j] = sched_iloc_edge(&info[i], &info[j]);
+        }
+    }
+    sched_order(count, costs, edges, order);
+    for (uint64_t i = 0; i < count; i++) {
+        code[i] = copy[order[i]];
+    }
+    free(edges);
+    free(copy);
+    free(order);
+    free(costs);
+    free(info);
+}
+
+void sched_function(iloc_function_t *function) {
+    iloc_instruction_t *code = function->code->instructions;
+    uint64_t length = function->code->length;
+    uint64_t start = 0;
+    for (uint64_t i = 0; i <= length; i++) {
+        if (i == length || sched_iloc_barrier(code[i].instruction) || i - start == SCHED_WINDOW) {
+            if (i - start > 1) {
+                sched_iloc_region(&code[start], i - start);
+            }
+            start = i == length || sched_iloc_barrier(code[i].instruction) ? i+1 : i;
+        }
+    }
+}
+
+ /*****\
+ * x86 *
+ \*****/
+// The flags, after the registers
+#define SCHED_FLAGS (UINT64_C(1) << X86_REGISTER_COUNT)
+
+#define bit(reg) (UINT64_C(1) << (reg))
+
+typedef struct {
+    uint64_t reads;        // Registers and flags
+    uint64_t writes;
+    uint64_t direct;       // Registers named as operands (not in addresses)
+    x86_operand_t *memory; // Operand in memory, if any
+    int loads;
+    int stores;
+    int barrier;
+    sched_cost_t cost;
+} sched_x86_info_t;
+
+int sched_is_memory(x86_operand_t *operand) {
+    return operand->type == operand_memory || operand->type == operand_indexed || operand->type == operand_symbol;
+}
+
+uint64_t sched_address_registers(x86_operand_t *operand) {
+    switch (operand->type) {
+        case operand_memory:
+            return bit(operand->reg);
+        case operand_indexed:
+            return bit(operand->reg) | bit(operand->index);
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Records an operand that the instruction reads and/or writes
+ */
+void sched_x86_operand(sched_x86_info_t *info, x86_operand_t *operand, int read, int write) {
+    if (operand->type == operand_register) {
+        info->direct |= bit(operand->reg);
+        info->reads |= read ? bit(operand->reg) : 0;
+        info->writes |= write ? bit(operand->reg) : 0;
+    } else if (sched_is_memory(operand)) {
+        info->reads |= sched_address_registers(operand);
+        info->memory = operand;
+        info->loads |= read;
+        info->stores |= write;
+    } else if (operand->type == operand_constant || operand->type == operand_data) {
+        info->loads = 1;
+    }
+}
+
+sched_x86_info_t sched_x86_info(x86_instruction_t *instruction) {
+    sched_x86_info_t info;
+    memset(&info, 0, sizeof(info));
+    x86_operand_t *src = &instruction->src;
+    x86_operand_t *dst = &instruction->dst;
+    uint64_t latency = LATENCY_SIMPLE;
+    int is_float = 0;
+    switch (instruction->opcode) {
+        case x86_movl:
+        case x86_movq:
+        case x86_movzbl:
+        case x86_movsd:
+        case x86_movapd:
+            is_float = instruction->opcode == x86_movsd || instruction->opcode == x86_movapd;
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 0, 1);
+            break;
+        case x86_leaq:
+        case x86_leal:
+            info.reads |= sched_address_registers(src);
+            sched_x86_operand(&info, dst, 0, 1);
+            break;
+        case x86_addl:
+        case x86_subl:
+        case x86_xorl:
+        case x86_andb:
+        case x86_orb:
+        case x86_addq:
+        case x86_subq:
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 1, 1);
+            info.writes |= SCHED_FLAGS;
+            break;
+        case x86_imull:
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 1, 1);
+            info.writes |= SCHED_FLAGS;
+            latency = LATENCY_MULTIPLY;
+            break;
+        case x86_addsd:
+        case x86_subsd:
+        case x86_mulsd:
+        case x86_divsd:
+            is_float = 1;
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 1, 1);
+            latency = instruction->opcode == x86_divsd ? LATENCY_FLOAT_DIVIDE : LATENCY_FLOAT;
+            info.cost.divider = instruction->opcode == x86_divsd ? DIVIDER_FLOAT_DIVIDE : 0;
+            break;
+        case x86_cmpl:
+        case x86_testl:
+        case x86_ucomisd:
+            is_float = instruction->opcode == x86_ucomisd;
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 1, 0);
+            info.writes |= SCHED_FLAGS;
+            latency = is_float ? LATENCY_FLOAT_COMPARE : LATENCY_SIMPLE;
+            break;
+        case x86_negl:
+            sched_x86_operand(&info, src, 1, 1);
+            info.writes |= SCHED_FLAGS;
+            break;
+        case x86_idivl:
+            sched_x86_operand(&info, src, 1, 0);
+            info.reads |= bit(x86_rax) | bit(x86_rdx);
+            info.writes |= bit(x86_rax) | bit(x86_rdx) | SCHED_FLAGS;
+            latency = LATENCY_DIVIDE;
+            info.cost.divider = DIVIDER_DIVIDE;
+            break;
+        case x86_cltd:
+            info.reads |= bit(x86_rax);
+            info.writes |= bit(x86_rdx);
+            break;
+        case x86_setcc:
+            // Only the low byte is written
+            sched_x86_operand(&info, src, 1, 1);
+            info.reads |= SCHED_FLAGS;
+            break;
+        case x86_cvtsi2sdl:
+            is_float = 1;
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 0, 1);
+            latency = LATENCY_INT_TO_FLOAT;
+            break;
+        case x86_cvttsd2si:
+            is_float = 1;
+            sched_x86_operand(&info, src, 1, 0);
+            sched_x86_operand(&info, dst, 0, 1);
+            latency = LATENCY_FLOAT_TO_INT;
+            break;
+        default:
+            // Labels, jumps, calls, returns and the stack manipulation
+            info.barrier = 1;
+            break;
+    }
+    if (info.direct & (bit(x86_rsp) | bit(x86_rbp))) {
+        info.barrier = 1;
+    }
+    if (info.loads) {
+        latency += is_float ? LATENCY_FLOAT_LOAD : LATENCY_LOAD;
+    }
+    info.cost.latency = info.stores ? LATENCY_STORE_FORWARD : latency;
+    return info;
+}
+
+int sched_x86_may_alias(x86_operand_t *a, x86_operand_t *b) {
+    int a_frame = a->type == operand_memory && (a->reg == x86_rbp || a->reg == x86_rsp);
+    int b_frame = b->type == operand_memory && (b->reg == x86_rbp || b->reg == x86_rsp);
+    if (a_frame && b_frame) {
+        return a->reg != b->reg || (a->value < b->value + 8 && b->value < a->value + 8);
+    }
+    if (a_frame || b_frame) {
+        return 0;
+    }
+    if (a->type == operand_symbol && b->type == operand_symbol) {
+        return strcmp(a->symbol, b->symbol) == 0;
+    }
+    return 1;
+}
+
+int64_t sched_x86_edge(sched_x86_info_t *a, sched_x86_info_t *b) {
+    int64_t latency = -1;
+    if (a->writes & b->reads) {
+        latency = a->cost.latency;
+    } else if ((a->reads & b->writes) || (a->writes & b->writes)) {
+        latency = 0;
+    }
+    if (a->memory != NULL && b->memory != NULL && (a->stores || b->stores) && sched_x86_may_alias(a->memory, b->memory)) {
+        latency = sched_max(latency, a->stores && b->loads ? LATENCY_STORE_FORWARD : 0);
+    }
+    return latency;
+}
+
+void sched_x86_region(x86_instruction_t *code, sched_x86_info_t *info, uint64_t count) {
+    sched_cost_t *costs = (sched_cost_t*) malloc((count+1) * sizeof(sched_cost_t));
+    uint64_t *order = (uint64_t*) malloc((count+1) * sizeof(uint64_t));
+    x86_instruction_t *copy = (x86_instruction_t*) malloc((count+1) * sizeof(x86_instruction_t));
+    if (costs == NULL || order == NULL || copy == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for sched_x86_region (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    int64_t *edges = sched_edges(count);
+    for (uint64_t i = 0; i < count; i++) {
+        copy[i] = code[i];
+        costs[i] = info[i].cost;
+        for (uint64_t j = i+1; j < count; j++) {
+            edges[i*count+j] = sched_x86_edge(&info[i], &info[j]);
+        }
+    }
+    sched_order(count, costs, edges, order);
+    for (uint64_t i = 0; i < count; i++) {
+        code[i] = copy[order[i]];
+    }
+    free(edges);
+    free(copy);
+    free(order);
+    free(costs);
+}
+
+void sched_program(x86_program_t *program) {
+    uint64_t length = program->length;
+    sched_x86_info_t *info = (sched_x86_info_t*) malloc((length+1) * sizeof(sched_x86_info_t));
+    if (info == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for sched_x86_info_t* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t i = 0; i < length; i++) {
+        info[i] = sched_x86_info(&program->items[i]);
+    }
+    uint64_t start = 0;
+    for (uint64_t i = 0; i <= length; i++) {
+        if (i == length || info[i].barrier || i - start == SCHED_WINDOW) {
+            if (i - start > 1) {
+                sched_x86_region(&program->items[start], &info[start], i - start);
+            }
+            start = i == length || info[i].barrier ? i+1 : i;
+        }
+    }
+    free(info);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+// Where the scheduler runs (at -O2)
+typedef enum {
+    schedule_none,
+    schedule_pre,  // On the ILOC, before register allocation
+    schedule_post, // On the x86, after register allocation and the peephole
+} schedule_mode_t;
+
+extern schedule_mode_t schedule_mode;
+
+/************************\
+* Instruction Scheduling *
+\************************/
+/*
+ * This function reorders the instructions of each basic block of the function
+ * (before register allocation) with the list scheduler.
+ *
+ * Labels, branches, calls and their parameters, push and pop stay where they
+ * are, and the instructions between them are reordered respecting the
+ * dependences through registers and memory. Accesses to different slots of
+ * the frame or to different globals are independent.
+ */
+void sched_function(iloc_function_t *function);
+
+/*
+ * This function reorders the x86 instructions of each basic block of the
+ * program with the list scheduler, which also keeps each instruction that
+ * writes the flags before the setcc and jcc that read them.
+ *
+ * Every cycle the scheduler issues up to four ready instructions, taking first
+ * the ones with the longest chain of latencies up to the end of the block, so
+ * the loads, multiplications and divisions start early and independent work
+ * fills their latency.
+ */
+void sched_program(x86_program_t *program);
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "shrink_wrap.h"
+#include "bitset.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "list.h"
+#include "structs.h"
+
+/*
+ * Returns the block that dominates every call of the function (moved out of
+ * loops), or 0 if that is the entry block or a return reachable from it is
+ * not dominated by it
+ */
+uint64_t shrink_wrap_block(iloc_program_t *program, iloc_cfg_t *cfg, int64_t *idom) {
+    uint64_t blocks = cfg->blocks.length;
+    int64_t save = -1;
+    for (uint64_t b = 0; b < blocks; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        int has_call = 0;
+        for (uint64_t i = block->start; i < block->end; i++) {
+            has_call |= program->instructions[i].instruction == call;
+        }
+        if (!has_call || idom[b] < 0) {
+            continue;
+        }
+        if (save < 0) {
+            save = b;
+            continue;
+        }
+        // Walks up from the deeper block until both meet
+        int64_t other = b;
+        while (save != other) {
+            if (iloc_cfg_dominates(idom, save, other)) {
+                other = save;
+            } else {
+                save = idom[save];
+            }
+        }
+    }
+    if (save <= 0) {
+        return 0;
+    }
+
+    uint64_t *loop_depth = iloc_cfg_loop_depth(cfg);
+    while (save > 0 && loop_depth[save] > 0) {
+        save = idom[save];
+    }
+    free(loop_depth);
+    if (save <= 0) {
+        return 0;
+    }
+
+    // Every return after the block must know the registers were saved
+    int *reachable = (int*) calloc(blocks+1, sizeof(int));
+    uint64_t *stack = (uint64_t*) malloc((blocks+1) * sizeof(uint64_t));
+    if (reachable == NULL || stack == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for shrink-wrapping (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t top = 0;
+    stack[top++] = save;
+    reachable[save] = 1;
+    while (top > 0) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, stack[--top]);
+        for (size_t s = 0; s < block->successors.length; s++) {
+            uint64_t successor = nlist_get_unsafe(block->successors, s);
+            if (!reachable[successor]) {
+                reachable[successor] = 1;
+                stack[top++] = successor;
+            }
+        }
+    }
+    for (uint64_t b = 0; b < blocks && save > 0; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        iloc_instruction_type_t type = program->instructions[block->end-1].instruction;
+        if ((type == ret || type == tailcall) && reachable[b] && !iloc_cfg_dominates(idom, save, b)) {
+            save = 0;
+        }
+    }
+    free(reachable);
+    free(stack);
+    return save;
+}
+
+void shrink_wrap_split(iloc_function_t *function) {
+    iloc_program_t *program = function->code;
+    iloc_cfg_t cfg = iloc_cfg_build(program);
+    int64_t *idom = iloc_cfg_dominators(&cfg);
+    uint64_t save = shrink_wrap_block(program, &cfg, idom);
+    if (save == 0) {
+        free(idom);
+        iloc_cfg_free(&cfg);
+        return;
+    }
+    iloc_numbering_t numbering = iloc_numbering_build(program);
+    iloc_liveness_t liveness = iloc_liveness_build(program, &cfg, &numbering);
+    int *dominated = (int*) calloc(cfg.blocks.length+1, sizeof(int));
+    int64_t *renamed = (int64_t*) malloc((numbering.length+1) * sizeof(int64_t));
+    if (dominated == NULL || renamed == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for shrink-wrapping (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < cfg.blocks.length; b++) {
+        dominated[b] = iloc_cfg_dominates(idom, save, b);
+    }
+    for (uint64_t v = 0; v < numbering.length; v++) {
+        renamed[v] = -1;
+    }
+
+    // A value can only be renamed if the copy never flows back into the
+    // blocks that still read the original
+    bitset_iterate(&liveness.live_in[save * liveness.words], liveness.words, t) {
+        uint64_t v = liveness.registers[t];
+        int safe = 1;
+        for (uint64_t b = 0; b < cfg.blocks.length && safe; b++) {
+            iloc_block_t *block = &nlist_get_unsafe(cfg.blocks, b);
+            for (size_t s = 0; s < block->successors.length && dominated[b]; s++) {
+                uint64_t successor = nlist_get_unsafe(block->successors, s);
+                if (!dominated[successor] && bitset_test(&liveness.live_in[successor * liveness.words], t)) {
+                    safe = 0;
+                }
+            }
+        }
+        if (safe) {
+            renamed[v] = -2;
+        }
+    }
+
+    iloc_program_t *new_program = iloc_program_new();
+    iloc_block_t *save_block = &nlist_get_unsafe(cfg.blocks, save);
+    int64_t *operands[3];
+    for (uint64_t i = 0; i < program->length; i++) {
+        iloc_instruction_t instruction = program->instructions[i];
+        if (i == save_block->start) {
+            if (instruction.instruction == label) {
+                iloc_program_push(new_program, instruction);
+            }
+            for (uint64_t v = 0; v < numbering.length; v++) {
+                if (renamed[v] != -2) {
+                    continue;
+                }
+                int64_t original = numbering.sparse[v];
+                int is_float = iloc_is_float(original);
+                renamed[v] = is_float ? iloc_next_float_id() : iloc_next_id();
+                iloc_push(new_program, is_float ? f2f : i2i, original, renamed[v], 0);
+            }
+            if (instruction.instruction == label) {
+                continue;
+            }
+        }
+        if (dominated[cfg.block_of[i]]) {
+            uint64_t count = iloc_instruction_uses(&instruction, operands);
+            int64_t *def = iloc_instruction_def(&instruction);
+            if (def != NULL) {
+                operands[count++] = def;
+            }
+            for (uint64_t o = 0; o < count; o++) {
+                int64_t v = iloc_numbering_get(&numbering, *operands[o]);
+                if (renamed[v] >= 0) {
+                    *operands[o] = renamed[v];
+                }
+            }
+        }
+        iloc_program_push(new_program, instruction);
+    }
+
+    free(dominated);
+    free(renamed);
+    iloc_liveness_free(&liveness);
+    iloc_numbering_free(&numbering);
+    free(idom);
+    iloc_cfg_free(&cfg);
+    iloc_program_free(program);
+    function->code = new_program;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/*****************\
+* Shrink-wrapping *
+\*****************/
+/*
+ * This function prepares a function for shrink-wrapping, before register
+ * allocation. The values live into the block that dominates every call
+ * (outside of loops) are copied to new registers at its start, which replace
+ * them in the blocks it dominates. The originals no longer live across calls,
+ * so the paths that skip the calls (like the base case of a recursion) need no
+ * callee-saved register, and the lowering saves those registers only once the
+ * calls may run.
+ */
+void shrink_wrap_split(iloc_function_t *function);
@@ -74,7 +74,9 @@ typedef struct {
     uint64_t column;
     uint64_t offset;
     uint64_t function_label;
+    uint64_t virtual_register;
     iloc_register_t base_register;
+    nlist_definition(type_t) parameter_types; // Only for functions
 } name_entry_t;
 
 typedef struct scope {
@@ -129,7 +131,7 @@ typedef enum {
     // cstore_ao,    // cstoreAO r1 => r2, r3    // caractere storeAO
     
     // Copy
-    // i2i,          // i2i r1 => r2             // r2 = r1 para inteiros
+    i2i,          // i2i r1 => r2             // r2 = r1 para inteiros
     // c2c,          // c2c r1 => r2             // r2 = r1 para caracteres
     // c2i,          // c2i r1 => r2             // converte um caractere para um inteiro
     // i2c,          // i2c r1 => r2             // converte um inteiro para caractere
@@ -151,9 +153,45 @@ typedef enum {
 
     // New instructions
     push,         // push r1
-    pop,         // push r1
+    pop,          // pop r1
+    mod,          // mod r1, r2 => r3         // r3 = r1 % r2
+    ret,          // ret r1                   // retorna r1 para o chamador
+    getparam,     // getparam c1 => r2        // r2 = parametro c1 da funcao
+    param,        // param r1, c2             // r1 e o argumento c2 da proxima chamada
+    call,         // call l1, c2 => r3        // chama a funcao l1 com c2 argumentos, r3 = retorno
+    tailcall,     // tailcall l1, c2          // chama a funcao l1 com c2 argumentos e retorna o seu retorno
+    load_ax,      // loadAX c1, r2 => r3      // r3 = Memoria(rbss + c1 + r2)
+    store_ax,     // storeAX r1 => c2, r3     // Memoria(rbss + c2 + r3) = r1
+
+    // Floating point (registers created with iloc_next_float_id)
+    fadd,         // fadd r1, r2 => r3        // r3 = r1 + r2
+    fsub,         // fsub r1, r2 => r3        // r3 = r1 - r2
+    fmult,        // fmult r1, r2 => r3       // r3 = r1 * r2
+    fdiv,         // fdiv r1, r2 => r3        // r3 = r1 / r2
+    fload_i,      // floadI c1 => r2          // r2 = constante c1 do modulo
+    fload_ai_r,   // floadAI reg(r1), c2 => r3// r3 = Memoria(reg(r1) + c2)
+    fstore_ai_r,  // fstoreAI r1 => reg(r2), c3 // Memoria(reg(r2) + c3) = r1
+    f2f,          // f2f r1 => r2             // r2 = r1 para floats
+    i2f,          // i2f r1 => r2             // converte um inteiro para float
+    f2i,          // f2i r1 => r2             // converte um float para inteiro (truncando)
+    fcmp_lt,      // fcmp_LT r1, r2 -> r3     // r3 = true se r1 < r2, senão r3 = false
+    fcmp_le,      // fcmp_LE r1, r2 -> r3     // r3 = true se r1 <= r2, senão r3 = false
+    fcmp_eq,      // fcmp_EQ r1, r2 -> r3     // r3 = true se r1 = r2, senão r3 = false
+    fcmp_ge,      // fcmp_GE r1, r2 -> r3     // r3 = true se r1 >= r2, senão r3 = false
+    fcmp_gt,      // fcmp_GT r1, r2 -> r3     // r3 = true se r1 > r2, senão r3 = false
+    fcmp_ne,      // fcmp_NE r1, r2 -> r3     // r3 = true se r1 != r2, senão r3 = false
+    fgetparam,    // fgetparam c1 => r2       // r2 = parametro c1 (float) da funcao
+    fparam,       // fparam r1, c2            // r1 e o argumento c2 (float) da proxima chamada
 } iloc_instruction_type_t;
 
+// Where the operand of a param (r1) or getparam (r2) is, stored in r3 by the
+// register allocator, since their moves are lowered together
+typedef enum {
+    iloc_operand_register,
+    iloc_operand_stack,    // The value is the offset below rfp
+    iloc_operand_constant,
+} iloc_operand_location_t;
+
 typedef struct {
     iloc_instruction_type_t instruction;
     int64_t r1;
@@ -164,8 +202,90 @@ typedef struct {
 typedef struct {
     iloc_instruction_t *instructions;
     uint64_t length;
+    uint64_t capacity;
 } iloc_program_t;
 
+typedef struct {
+    char *name;
+    type_t type;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t alignment; // Of its address in .bss (at least the size of its type)
+    int local;          // Only used inside the module, so its symbol is not exported
+} iloc_global_t;
+
+// Executions of the block that starts at <label>, read from a profile
+typedef struct {
+    uint64_t label;
+    uint64_t count;
+} iloc_block_count_t;
+
+typedef struct {
+    char *name;
+    type_t type;
+    uint64_t function_label;
+    nlist_definition(uint64_t) parameters;
+    iloc_program_t *code;
+    uint64_t frame_size;
+    uint64_t callee_saved; // Bitmask of x86_register_t saved by the prologue
+    int frameless;         // Leaf without a frame pointer (slots are addressed from rsp)
+    int shrink_wrapped;    // Callee-saved registers are pushed past the entry block
+    int registers_saved;   // Whether the code being lowered runs after those saves
+    int profiled;          // Whether the counts below were read from a profile
+    uint64_t entry_count;  // Calls of the function
+    nlist_definition(iloc_block_count_t) block_counts;
+} iloc_function_t;
+
+// Where profile_instrument put the profile of the module, for the dumper
+typedef struct {
+    char *file;                             // Written by the instrumented program
+    nlist_definition(uint32_t) description; // Written before the counters
+    uint64_t file_data;                     // Offsets of the file name and the description in the data
+    uint64_t description_data;
+    uint64_t counter_count;                 // 0 if the module is not instrumented
+} iloc_profile_t;
+
+typedef struct {
+    nlist_definition(iloc_global_t) globals;
+    nlist_definition(iloc_function_t*) functions;
+    nlist_definition(double) constants; // Float literals, loaded by floadI
+    nlist_definition(uint8_t) data;     // Other read-only bytes, for the code the compiler adds (like the profile dumper)
+    iloc_profile_t profile;
+} iloc_module_t;
+
+/********************\
+* Data-flow Analysis *
+\********************/
+typedef struct {
+    uint64_t start; // Index of the first instruction of the block
+    uint64_t end;   // Index one past the last instruction of the block
+    nlist_definition(uint64_t) successors;
+    nlist_definition(uint64_t) predecessors;
+} iloc_block_t;
+
+typedef struct {
+    nlist_definition(iloc_block_t) blocks;
+    uint64_t *block_of; // Maps each instruction index to its block
+} iloc_cfg_t;
+
+typedef struct {
+    int64_t base;     // Smallest virtual register id found in the program
+    uint64_t range;   // Amount of ids covered by <dense>
+    int64_t *dense;   // dense[id - base] = dense index (or -1)
+    int64_t *sparse;  // sparse[index] = virtual register id
+    uint64_t length;  // Amount of virtual registers
+} iloc_numbering_t;
+
+// Only registers read in a block other than the one defining them are tracked
+typedef struct {
+    uint64_t length;     // Amount of tracked registers
+    int64_t *index;      // index[dense] = tracked index (or -1 for block-local registers)
+    uint64_t *registers; // registers[index] = dense index
+    uint64_t words;      // Amount of uint64_t words per set
+    uint64_t *live_in;   // live_in[block * words ..]
+    uint64_t *live_out;  // live_out[block * words ..]
+} iloc_liveness_t;
+
 /********************\
 * Syntactic Analysis *
 \********************/
@@ -209,28 +329,177 @@ typedef struct ast {
     uint64_t capacity;
     lexeme_t *lexeme;
     type_t type;
-    nlist_definition(char*) _program;
+    iloc_program_t *code;
     uint64_t value;
+    uint64_t register_need; // Sethi-Ullman number of the expression
+    int has_call;           // Whether evaluating the expression calls a function
 } ast_t;
 
+/*************\
+* Compilation *
+\*************/
+// Everything a compilation changes while it runs, so that several of them can
+// run at once (each on its own thread)
+typedef struct {
+    // Where the last token and the next one begin
+    int line;
+    int col;
+    int line_next;
+    int col_next;
+
+    ast_t *tree;
+    scope_t *current_scope;
+    scope_t *global_scope;
+    char *current_function;
+
+    iloc_module_t *module;
+    uint64_t last_id;
+    uint8_t *float_registers; // float_registers[id] = 1 for registers created by iloc_next_float_id
+    uint64_t float_registers_capacity;
+
+    uint32_t print_lines[1024]; // Which levels of the tree print_ast is still drawing
+} compilation_t;
+
+// The ids handed out while a single function is compiled, once the module is
+// generated (see iloc_namespace_enter). They start where the ones of the
+// compilation stop, so they are unique inside the function but not across
+// functions, and do not depend on the order the functions are compiled in.
+typedef struct {
+    compilation_t *compilation; // Source of the ids below base
+    uint64_t base;
+    uint64_t last_id;
+    uint8_t *float_registers; // float_registers[id - base] = 1 for registers created by iloc_next_float_id
+    uint64_t float_registers_capacity;
+} iloc_namespace_t;
+
+/*********************\
+* x86 Code Generation *
+\*********************/
+// Ordered by their hardware encoding
 typedef enum {
-    ebx,
-    ecx,
-    edx,
+    x86_rax,
+    x86_rcx,
+    x86_rdx,
+    x86_rbx,
+    x86_rsp,
+    x86_rbp,
+    x86_rsi,
+    x86_rdi,
+    x86_r8,
+    x86_r9,
+    x86_r10,
+    x86_r11,
+    x86_r12,
+    x86_r13,
+    x86_r14,
+    x86_r15,
+    x86_xmm0,
+    x86_xmm1,
+    x86_xmm2,
+    x86_xmm3,
+    x86_xmm4,
+    x86_xmm5,
+    x86_xmm6,
+    x86_xmm7,
+    x86_xmm8,
+    x86_xmm9,
+    x86_xmm10,
+    x86_xmm11,
+    x86_xmm12,
+    x86_xmm13,
+    x86_xmm14,
+    x86_xmm15,
 } x86_register_t;
 
-uint64_t x86_to_int(x86_register_t reg);
+#define X86_REGISTER_COUNT 32
+
+typedef enum {
+    operand_none,
+    operand_register,  // %reg
+    operand_immediate, // $value
+    operand_memory,    // value(%reg)
+    operand_symbol,    // symbol(%rip)
+    operand_label,     // L<value>
+    operand_function,  // symbol
+    operand_constant,  // .LC<value>(%rip)
+    operand_data,      // .LD+<value>(%rip)
+    operand_indexed,   // value(%reg,%index)
+} x86_operand_type_t;
+
+typedef struct {
+    x86_operand_type_t type;
+    x86_register_t reg;
+    x86_register_t index; // Only for operand_indexed
+    uint64_t scale;       // Of the index (1, 2, 4 or 8)
+    int64_t value;
+    char *symbol;
+} x86_operand_t;
 
-x86_register_t int_to_x86(int reg);
+typedef enum {
+    x86_cond_e,
+    x86_cond_ne,
+    x86_cond_l,
+    x86_cond_le,
+    x86_cond_g,
+    x86_cond_ge,
+    x86_cond_b,   // Unsigned and floating point conditions
+    x86_cond_be,
+    x86_cond_a,
+    x86_cond_ae,
+    x86_cond_p,
+    x86_cond_np,
+} x86_condition_t;
 
-// [Ideia do algoritmo de alocacao de registradores]
-// passar por tudo
-// alocar ebx para r64
-// if (program->instructions[3].r1 == 64) {
-// program->instructions[3].r1 = x86_to_int(ebx);
-// }
-void allocated_registers(iloc_program_t *program);
+typedef enum {
+    x86_label,    // L<src>:
+    x86_movl,
+    x86_movq,
+    x86_leaq,
+    x86_leal,
+    x86_movzbl,
+    x86_addl,
+    x86_subl,
+    x86_imull,
+    x86_negl,
+    x86_cltd,
+    x86_idivl,
+    x86_cmpl,
+    x86_testl,
+    x86_xorl,
+    x86_setcc,
+    x86_jmp,
+    x86_jcc,
+    x86_pushq,
+    x86_popq,
+    x86_subq,
+    x86_addq,
+    x86_leave,
+    x86_ret,
+    x86_call,
+    x86_tailcall, // jmp to a function, after tearing down the frame
+    x86_endbr64,
+    x86_andb,
+    x86_orb,
+    x86_movsd,
+    x86_movapd,
+    x86_addsd,
+    x86_subsd,
+    x86_mulsd,
+    x86_divsd,
+    x86_ucomisd,
+    x86_cvtsi2sdl,
+    x86_cvttsd2si,
+    x86_syscall,
+    x86_nop,      // Removed by the peephole optimizer, never printed
+    x86_align,    // .p2align <src>,,<dst> (the padding is skipped if longer than <dst>)
+    x86_cold,     // The rest of the function goes to .text.unlikely
+} x86_opcode_t;
 
-// #define x86_reg_to_string(x) ((x == ebx) ? "ebx" : ((x == ecx) ? "ecx" : (x == edx) ? "edx" : "<registrador desconhecido>"))
-#define x86_reg_to_string(x) "ebx"
+typedef struct {
+    x86_opcode_t opcode;
+    x86_condition_t condition;
+    x86_operand_t src;
+    x86_operand_t dst;
+} x86_instruction_t;
 
+typedef nlist_definition(x86_instruction_t) x86_program_t;
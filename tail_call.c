@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "tail_call.h"
+#include "code_gen.h"
+#include "list.h"
+#include "reg_alloc.h"
+#include "structs.h"
+
+/*
+ * Returns true if every argument of the call goes in a register, so the
+ * callee does not read anything from the frame being torn down
+ */
+int tail_call_fits_registers(iloc_instruction_t *arguments, uint64_t count) {
+    uint64_t integers = 0, floats = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (arguments[i].instruction == fparam) {
+            floats++;
+        } else {
+            integers++;
+        }
+    }
+    return integers <= REG_ALLOC_ARGUMENT_REGISTERS && floats <= REG_ALLOC_FLOAT_ARGUMENT_REGISTERS;
+}
+
+void tail_call_function(iloc_function_t *function) {
+    iloc_program_t *code = function->code;
+    iloc_program_t *new_program = iloc_program_new();
+    uint64_t label_entry = iloc_next_id();
+    int rewritten = 0;
+    int entry_placed = 0;
+
+    for (uint64_t i = 0; i < code->length; i++) {
+        iloc_instruction_t *instruction = &code->instructions[i];
+        // The loop of a self-recursive function starts after the parameters are read
+        if (!entry_placed && instruction->instruction != getparam && instruction->instruction != fgetparam) {
+            iloc_push(new_program, label, label_entry, 0, 0);
+            entry_placed = 1;
+        }
+        if (instruction->instruction != param && instruction->instruction != fparam && instruction->instruction != call) {
+            iloc_program_push(new_program, *instruction);
+            continue;
+        }
+        uint64_t first = i;
+        while (code->instructions[i].instruction == param || code->instructions[i].instruction == fparam) {
+            i++;
+        }
+        iloc_instruction_t *call_instruction = &code->instructions[i];
+        iloc_instruction_t *arguments = &code->instructions[first];
+        uint64_t count = i - first;
+        int is_tail = i+1 < code->length
+            && code->instructions[i+1].instruction == ret
+            && code->instructions[i+1].r1 == call_instruction->r3;
+
+        if (is_tail && call_instruction->r1 == (int64_t) function->function_label && count == function->parameters.length) {
+            // The arguments may read the parameters, so they are copied to
+            // temporaries before any parameter is assigned
+            uint64_t temporaries[count+1];
+            for (uint64_t a = 0; a < count; a++) {
+                int is_float = arguments[a].instruction == fparam;
+                temporaries[a] = is_float ? iloc_next_float_id() : iloc_next_id();
+                iloc_push(new_program, is_float ? f2f : i2i, arguments[a].r1, temporaries[a], 0);
+            }
+            for (uint64_t a = 0; a < count; a++) {
+                int is_float = arguments[a].instruction == fparam;
+                iloc_push(new_program, is_float ? f2f : i2i, temporaries[a], nlist_get_unsafe(function->parameters, a), 0);
+            }
+            iloc_push(new_program, jump_i, label_entry, 0, 0);
+            rewritten = 1;
+            i++;
+        } else if (is_tail && tail_call_fits_registers(arguments, count)) {
+            for (uint64_t a = 0; a < count; a++) {
+                iloc_program_push(new_program, arguments[a]);
+            }
+            iloc_push(new_program, tailcall, call_instruction->r1, call_instruction->r2, 0);
+            rewritten = 1;
+            i++;
+        } else {
+            for (uint64_t k = first; k <= i; k++) {
+                iloc_program_push(new_program, code->instructions[k]);
+            }
+        }
+    }
+
+    if (rewritten) {
+        iloc_program_free(code);
+        function->code = new_program;
+    } else {
+        iloc_program_free(new_program);
+    }
+}
+
+void tail_call_module(iloc_module_t *module) {
+    for (size_t i = 0; i < module->functions.length; i++) {
+        tail_call_function(nlist_get_unsafe(module->functions, i));
+    }
+}
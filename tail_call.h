@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/************\
+* Tail Calls *
+\************/
+/*
+ * This function rewrites the calls whose result is returned right away
+ * (return f(...);). A function calling itself assigns the arguments to its
+ * parameters and jumps back to its entry, so the recursion runs in constant
+ * stack space. Calls to other functions become a tailcall, which tears the
+ * frame down and jumps to the callee, as long as every argument fits in the
+ * argument registers.
+ */
+void tail_call_module(iloc_module_t *module);
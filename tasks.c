@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "tasks.h"
+
+// The tasks a thread has left, [first, last). The thread runs them from the
+// first one on, and the others steal them from the last one back.
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t first;
+    uint64_t last;
+} tasks_queue_t;
+
+typedef struct {
+    tasks_queue_t *queues;
+    uint64_t jobs;
+    void (*run)(void *context, uint64_t task);
+    void *context;
+} tasks_pool_t;
+
+typedef struct {
+    tasks_pool_t *pool;
+    uint64_t index;
+} tasks_worker_t;
+
+uint64_t tasks_default_jobs() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (uint64_t) cores : TASKS_DEFAULT_JOBS;
+}
+
+/*
+ * Takes the next task of the queue, returning 0 if it is empty
+ */
+int tasks_pop(tasks_queue_t *queue, uint64_t *task) {
+    pthread_mutex_lock(&queue->lock);
+    int found = queue->first < queue->last;
+    if (found) {
+        *task = queue->first++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+/*
+ * Moves the last half of the tasks left in <victim> (rounded up) to <queue>,
+ * which is empty, returning 0 if there were none
+ */
+int tasks_steal(tasks_queue_t *queue, tasks_queue_t *victim) {
+    pthread_mutex_lock(&victim->lock);
+    uint64_t left = victim->last - victim->first;
+    uint64_t first = victim->last - (left+1) / 2;
+    uint64_t last = victim->last;
+    victim->last = first;
+    pthread_mutex_unlock(&victim->lock);
+    if (left == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->first = first;
+    queue->last = last;
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+void *tasks_work(void *argument) {
+    tasks_worker_t *worker = (tasks_worker_t*) argument;
+    tasks_pool_t *pool = worker->pool;
+    tasks_queue_t *queue = &pool->queues[worker->index];
+    while (1) {
+        uint64_t task;
+        while (tasks_pop(queue, &task)) {
+            pool->run(pool->context, task);
+        }
+        // The tasks never create others, so once every queue is seen empty
+        // there is nothing left to steal
+        int stolen = 0;
+        for (uint64_t j = 1; j < pool->jobs && !stolen; j++) {
+            stolen = tasks_steal(queue, &pool->queues[(worker->index + j) % pool->jobs]);
+        }
+        if (!stolen) {
+            return NULL;
+        }
+    }
+}
+
+void tasks_run(uint64_t count, uint64_t jobs, void (*run)(void *context, uint64_t task), void *context) {
+    if (jobs > count) {
+        jobs = count;
+    }
+    if (jobs <= 1) {
+        for (uint64_t task = 0; task < count; task++) {
+            run(context, task);
+        }
+        return;
+    }
+    tasks_queue_t *queues = (tasks_queue_t*) malloc(jobs * sizeof(tasks_queue_t));
+    tasks_worker_t *workers = (tasks_worker_t*) malloc(jobs * sizeof(tasks_worker_t));
+    pthread_t *threads = (pthread_t*) malloc(jobs * sizeof(pthread_t));
+    if (queues == NULL || workers == NULL || threads == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for tasks_run (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-4);
+        exit(EXIT_FAILURE);
+    }
+    tasks_pool_t pool = { queues, jobs, run, context };
+    for (uint64_t j = 0; j < jobs; j++) {
+        pthread_mutex_init(&queues[j].lock, NULL);
+        queues[j].first = count * j / jobs;
+        queues[j].last = count * (j+1) / jobs;
+        workers[j].pool = &pool;
+        workers[j].index = j;
+    }
+    // The calling thread is worker 0
+    for (uint64_t j = 1; j < jobs; j++) {
+        int error = pthread_create(&threads[j], NULL, tasks_work, &workers[j]);
+        if (error != 0) {
+            fprintf(stderr, "ERROR: Failed to create thread (errno = %d) [at file \"" __FILE__ "\", line %d]\n", error, __LINE__-2);
+            exit(EXIT_FAILURE);
+        }
+    }
+    tasks_work(&workers[0]);
+    for (uint64_t j = 1; j < jobs; j++) {
+        pthread_join(threads[j], NULL);
+    }
+    for (uint64_t j = 0; j < jobs; j++) {
+        pthread_mutex_destroy(&queues[j].lock);
+    }
+    free(threads);
+    free(workers);
+    free(queues);
+}
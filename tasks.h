@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+/*******\
+* Tasks *
+\*******/
+// Number of threads used when the machine does not tell how many cores it has
+#define TASKS_DEFAULT_JOBS 1
+
+/*
+ * This function returns the number of cores of the machine
+ */
+uint64_t tasks_default_jobs();
+
+/*
+ * This function calls run(context, task) for every task in [0, count), on
+ * <jobs> threads (the calling one among them), and returns once every call
+ * has. The tasks are split evenly between the threads, and a thread that runs
+ * out of them steals half of the ones another thread has left (from the end
+ * it is not working on), so the threads stay busy even when some tasks take
+ * much longer than the others. The calls must not depend on each other.
+ */
+void tasks_run(uint64_t count, uint64_t jobs, void (*run)(void *context, uint64_t task), void *context);
@@ -0,0 +1,1209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "x86.h"
+#include "cfg.h"
+#include "code_gen.h"
+#include "isel.h"
+#include "reg_alloc.h"
+#include "list.h"
+#include "structs.h"
+
+static const char *register_names_64[X86_REGISTER_COUNT] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+};
+
+static const char *register_names_32[X86_REGISTER_COUNT] = {
+    "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+    "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d",
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+};
+
+static const char *register_names_8[X86_REGISTER_COUNT] = {
+    "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+    "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b",
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+};
+
+static const char *condition_names[] = {
+    [x86_cond_e] = "e",
+    [x86_cond_ne] = "ne",
+    [x86_cond_l] = "l",
+    [x86_cond_le] = "le",
+    [x86_cond_g] = "g",
+    [x86_cond_ge] = "ge",
+    [x86_cond_b] = "b",
+    [x86_cond_be] = "be",
+    [x86_cond_a] = "a",
+    [x86_cond_ae] = "ae",
+    [x86_cond_p] = "p",
+    [x86_cond_np] = "np",
+};
+
+typedef struct {
+    const char *mnemonic;
+    uint64_t src_size;
+    uint64_t dst_size;
+} x86_opcode_info_t;
+
+static const x86_opcode_info_t opcode_info[] = {
+    [x86_label]   = { "",        0, 0 },
+    [x86_movl]    = { "movl",    4, 4 },
+    [x86_movq]    = { "movq",    8, 8 },
+    [x86_leaq]    = { "leaq",    8, 8 },
+    [x86_leal]    = { "leal",    8, 4 },
+    [x86_movzbl]  = { "movzbl",  1, 4 },
+    [x86_addl]    = { "addl",    4, 4 },
+    [x86_subl]    = { "subl",    4, 4 },
+    [x86_imull]   = { "imull",   4, 4 },
+    [x86_negl]    = { "negl",    4, 4 },
+    [x86_cltd]    = { "cltd",    0, 0 },
+    [x86_idivl]   = { "idivl",   4, 4 },
+    [x86_cmpl]    = { "cmpl",    4, 4 },
+    [x86_testl]   = { "testl",   4, 4 },
+    [x86_xorl]    = { "xorl",    4, 4 },
+    [x86_setcc]   = { "set",     1, 1 },
+    [x86_jmp]     = { "jmp",     0, 0 },
+    [x86_jcc]     = { "j",       0, 0 },
+    [x86_pushq]   = { "pushq",   8, 8 },
+    [x86_popq]    = { "popq",    8, 8 },
+    [x86_subq]    = { "subq",    8, 8 },
+    [x86_addq]    = { "addq",    8, 8 },
+    [x86_leave]   = { "leave",   0, 0 },
+    [x86_ret]     = { "ret",     0, 0 },
+    [x86_call]    = { "call",    0, 0 },
+    [x86_tailcall] = { "jmp",    0, 0 },
+    [x86_endbr64] = { "endbr64", 0, 0 },
+    [x86_andb]    = { "andb",    1, 1 },
+    [x86_orb]     = { "orb",     1, 1 },
+    [x86_movsd]   = { "movsd",   8, 8 },
+    [x86_movapd]  = { "movapd",  8, 8 },
+    [x86_addsd]   = { "addsd",   8, 8 },
+    [x86_subsd]   = { "subsd",   8, 8 },
+    [x86_mulsd]   = { "mulsd",   8, 8 },
+    [x86_divsd]   = { "divsd",   8, 8 },
+    [x86_ucomisd] = { "ucomisd", 8, 8 },
+    [x86_cvtsi2sdl] = { "cvtsi2sdl", 4, 8 },
+    [x86_cvttsd2si] = { "cvttsd2si", 8, 4 },
+    [x86_syscall] = { "syscall", 0, 0 },
+    [x86_nop]     = { "",        0, 0 },
+    [x86_align]   = { ".p2align", 0, 0 },
+    [x86_cold]    = { "",        0, 0 },
+};
+
+// Callee-saved registers, in the order they are pushed by the prologue
+static const x86_register_t callee_saved_registers[] = {
+    x86_rbx, x86_r12, x86_r13, x86_r14, x86_r15,
+};
+
+#define CALLEE_SAVED_COUNT (sizeof(callee_saved_registers) / sizeof(callee_saved_registers[0]))
+
+// Bytes below rsp that the System V ABI keeps from signal handlers
+#define X86_RED_ZONE 128
+
+/**********\
+ * Operands *
+ \**********/
+x86_operand_t x86_operand_none() {
+    x86_operand_t operand;
+    operand.type = operand_none;
+    operand.reg = x86_rax;
+    operand.index = x86_rax;
+    operand.scale = 1;
+    operand.value = 0;
+    operand.symbol = NULL;
+    return operand;
+}
+
+x86_operand_t x86_operand_register(x86_register_t reg) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_register;
+    operand.reg = reg;
+    return operand;
+}
+
+x86_operand_t x86_operand_immediate(int64_t value) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_immediate;
+    operand.value = value;
+    return operand;
+}
+
+x86_operand_t x86_operand_memory(x86_register_t base, int64_t displacement) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_memory;
+    operand.reg = base;
+    operand.value = displacement;
+    return operand;
+}
+
+x86_operand_t x86_operand_indexed(x86_register_t base, x86_register_t index, uint64_t scale, int64_t displacement) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_indexed;
+    operand.reg = base;
+    operand.index = index;
+    operand.scale = scale;
+    operand.value = displacement;
+    return operand;
+}
+
+x86_operand_t x86_operand_symbol(char *symbol) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_symbol;
+    operand.symbol = symbol;
+    return operand;
+}
+
+x86_operand_t x86_operand_label(uint64_t label) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_label;
+    operand.value = label;
+    return operand;
+}
+
+x86_operand_t x86_operand_function(char *symbol) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_function;
+    operand.symbol = symbol;
+    return operand;
+}
+
+x86_operand_t x86_operand_constant(uint64_t index) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_constant;
+    operand.value = index;
+    return operand;
+}
+
+x86_operand_t x86_operand_data(uint64_t offset) {
+    x86_operand_t operand = x86_operand_none();
+    operand.type = operand_data;
+    operand.value = offset;
+    return operand;
+}
+
+void x86_push(x86_program_t *program, x86_opcode_t opcode, x86_operand_t src, x86_operand_t dst) {
+    x86_instruction_t instruction;
+    instruction.opcode = opcode;
+    instruction.condition = x86_cond_e;
+    instruction.src = src;
+    instruction.dst = dst;
+    nlist_insert(x86_instruction_t, *program, instruction);
+}
+
+void x86_push_cc(x86_program_t *program, x86_opcode_t opcode, x86_condition_t condition, x86_operand_t operand) {
+    x86_instruction_t instruction;
+    instruction.opcode = opcode;
+    instruction.condition = condition;
+    instruction.src = operand;
+    instruction.dst = x86_operand_none();
+    nlist_insert(x86_instruction_t, *program, instruction);
+}
+
+/**********\
+ * Lowering *
+ \**********/
+#define REG(r) x86_operand_register((x86_register_t) (r))
+#define IMM(v) x86_operand_immediate(v)
+#define NONE x86_operand_none()
+
+// Temporary of the float lowering, like rax for the integers (never allocated)
+#define X86_FLOAT_TEMP x86_xmm13
+
+#define is_float_register(r) ((r) >= x86_xmm0)
+
+uint64_t x86_saved_count(iloc_function_t *function) {
+    uint64_t saved = 0;
+    for (uint64_t i = 0; i < CALLEE_SAVED_COUNT; i++) {
+        if (function->callee_saved & (UINT64_C(1) << callee_saved_registers[i])) {
+            saved++;
+        }
+    }
+    return saved;
+}
+
+/*
+ * Bytes the prologue subtracts from rsp: a frameless function only needs to
+ * when its slots do not fit in the red zone, and a function with a frame
+ * keeps rsp aligned to 16 bytes after the saves
+ */
+uint64_t x86_reserved_size(iloc_function_t *function) {
+    uint64_t saved = x86_saved_count(function);
+    if (function->frameless) {
+        return function->frame_size <= X86_RED_ZONE ? 0 : (function->frame_size + 15) / 16 * 16;
+    }
+    return (function->frame_size + saved * 8 + 15) / 16 * 16 - saved * 8;
+}
+
+/*
+ * Returns the memory operand at <offset> from the frame pointer: negative
+ * offsets are the slots of the function and the others its stack arguments
+ * (past the return address and the saved rbp). Frameless functions keep the
+ * slots below the callee-saved registers and address everything from rsp.
+ */
+x86_operand_t x86_lower_frame_slot(iloc_function_t *function, int64_t offset) {
+    if (!function->frameless) {
+        return x86_operand_memory(x86_rbp, offset);
+    }
+    int64_t reserved = x86_reserved_size(function);
+    if (offset < 0) {
+        return x86_operand_memory(x86_rsp, reserved + offset);
+    }
+    return x86_operand_memory(x86_rsp, reserved + 8 * x86_saved_count(function) + offset - 8);
+}
+
+/*
+ * Pushes the callee-saved registers used by the function (or pops them back,
+ * to restore them)
+ */
+void x86_lower_saves(x86_program_t *program, iloc_function_t *function, int restore) {
+    for (uint64_t k = 0; k < CALLEE_SAVED_COUNT; k++) {
+        uint64_t i = restore ? CALLEE_SAVED_COUNT - 1 - k : k;
+        if (function->callee_saved & (UINT64_C(1) << callee_saved_registers[i])) {
+            x86_push(program, restore ? x86_popq : x86_pushq, REG(callee_saved_registers[i]), NONE);
+        }
+    }
+}
+
+/*
+ * Returns true if the instruction (after register allocation) mentions one of
+ * the registers of the mask
+ */
+int x86_mentions_registers(iloc_instruction_t *instruction, uint64_t mask) {
+    switch (instruction->instruction) {
+        case getparam:
+        case fgetparam:
+            return instruction->r3 == iloc_operand_register && (mask & (UINT64_C(1) << instruction->r2));
+        case param:
+        case fparam:
+            return instruction->r3 == iloc_operand_register && (mask & (UINT64_C(1) << instruction->r1));
+        default:
+            break;
+    }
+    iloc_instruction_t copy = *instruction;
+    int64_t *operands[3];
+    uint64_t count = iloc_instruction_uses(&copy, operands);
+    int64_t *def = iloc_instruction_def(&copy);
+    if (def != NULL) {
+        operands[count++] = def;
+    }
+    for (uint64_t o = 0; o < count; o++) {
+        if (*operands[o] >= 0 && *operands[o] < 64 && (mask & (UINT64_C(1) << *operands[o]))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void x86_mark_reachable(iloc_cfg_t *cfg, uint64_t block, int *reachable) {
+    reachable[block] = 1;
+    iloc_block_t *b = &nlist_get_unsafe(cfg->blocks, block);
+    for (size_t s = 0; s < b->successors.length; s++) {
+        uint64_t successor = nlist_get_unsafe(b->successors, s);
+        if (!reachable[successor]) {
+            x86_mark_reachable(cfg, successor, reachable);
+        }
+    }
+}
+
+/*
+ * Shrink-wrapping: returns the block that saves the callee-saved registers,
+ * the nearest common dominator of the blocks that use them or call, out of any
+ * loop. Every exit reachable from it must be dominated by it, so each return
+ * knows whether it has to restore them. Returns 0 (the entry, where the
+ * prologue pushes them) if there is no better block.
+ */
+uint64_t x86_save_block(iloc_function_t *function, iloc_cfg_t *cfg, int64_t *idom) {
+    uint64_t blocks = cfg->blocks.length;
+    iloc_instruction_t *code = function->code->instructions;
+    uint64_t *dominator_depth = (uint64_t*) calloc(blocks+1, sizeof(uint64_t));
+    int *reachable = (int*) calloc(blocks+1, sizeof(int));
+    if (dominator_depth == NULL || reachable == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for shrink-wrapping (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-3);
+        exit(EXIT_FAILURE);
+    }
+    // Blocks come after their dominators in the layout except around back
+    // edges, so the depths are computed by walking up the tree
+    for (uint64_t b = 0; b < blocks; b++) {
+        for (int64_t d = b; idom[d] >= 0 && d != 0; d = idom[d]) {
+            dominator_depth[b]++;
+        }
+    }
+
+    int64_t save = -1;
+    for (uint64_t b = 0; b < blocks; b++) {
+        iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+        if (idom[b] < 0) {
+            continue;
+        }
+        // Calls need the pushes to keep rsp aligned
+        int uses = 0;
+        for (uint64_t i = block->start; i < block->end && !uses; i++) {
+            uses = code[i].instruction == call || x86_mentions_registers(&code[i], function->callee_saved);
+        }
+        if (!uses) {
+            continue;
+        }
+        if (save < 0) {
+            save = b;
+            continue;
+        }
+        int64_t other = b;
+        while (save != other) {
+            if (dominator_depth[save] > dominator_depth[other]) {
+                save = idom[save];
+            } else {
+                other = idom[other];
+            }
+        }
+    }
+
+    uint64_t *loop_depth = iloc_cfg_loop_depth(cfg);
+    while (save > 0 && loop_depth[save] > 0) {
+        save = idom[save];
+    }
+    if (save > 0) {
+        x86_mark_reachable(cfg, save, reachable);
+        for (uint64_t b = 0; b < blocks && save > 0; b++) {
+            iloc_block_t *block = &nlist_get_unsafe(cfg->blocks, b);
+            iloc_instruction_type_t type = code[block->end-1].instruction;
+            if ((type == ret || type == tailcall) && reachable[b] && !iloc_cfg_dominates(idom, save, b)) {
+                save = 0;
+            }
+        }
+    }
+    free(loop_depth);
+    free(reachable);
+    free(dominator_depth);
+    return save > 0 ? save : 0;
+}
+
+/*
+ * Returns the memory operand addressed by a loadAI/storeAI
+ */
+x86_operand_t x86_lower_address(iloc_module_t *module, iloc_function_t *function, int64_t base, int64_t offset) {
+    switch (id_to_reg(base)) {
+        case rfp:
+            return x86_lower_frame_slot(function, offset);
+        case rbss:
+            {
+                iloc_global_t *global = iloc_module_find_global(module, offset);
+                if (global == NULL) {
+                    fprintf(stderr, "ERROR: No global variable at rbss+%ld\n", offset);
+                    exit(EXIT_FAILURE);
+                }
+                return x86_operand_symbol(global->name);
+            }
+        default:
+            fprintf(stderr, "Register error #2\n");
+            exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Returns the memory operand addressed by a loadAX/storeAX, loading the
+ * address of the global into rax (a RIP-relative symbol cannot be indexed)
+ */
+x86_operand_t x86_lower_indexed(x86_program_t *program, iloc_module_t *module, int64_t offset, int64_t index) {
+    iloc_global_t *global = iloc_module_global_at(module, offset);
+    if (global == NULL) {
+        fprintf(stderr, "ERROR: No global variable at rbss+%ld\n", offset);
+        exit(EXIT_FAILURE);
+    }
+    x86_push(program, x86_leaq, x86_operand_symbol(global->name), REG(x86_rax));
+    return x86_operand_indexed(x86_rax, index, 1, offset - global->offset);
+}
+
+/*
+ * Emits a single move between any two operands of the same class (going
+ * through a scratch register when both are in memory)
+ */
+void x86_lower_move(x86_program_t *program, x86_operand_t src, x86_operand_t dst, int is_float) {
+    int src_memory = src.type == operand_memory || src.type == operand_symbol || src.type == operand_constant || src.type == operand_data;
+    int dst_memory = dst.type == operand_memory || dst.type == operand_symbol;
+    x86_opcode_t move = is_float ? x86_movsd : x86_movl;
+    x86_register_t scratch = is_float ? REG_ALLOC_FLOAT_SPILL_1 : REG_ALLOC_SPILL_1;
+    if (src_memory && dst_memory) {
+        x86_push(program, move, src, REG(scratch));
+        x86_push(program, move, REG(scratch), dst);
+    } else if (src.type != dst.type || src.reg != dst.reg || src.value != dst.value) {
+        x86_push(program, is_float && !src_memory && !dst_memory ? x86_movapd : move, src, dst);
+    }
+}
+
+/*
+ * Returns operand <p> (0 for r1, 1 for r2) of instruction <i> in the form
+ * picked by the instruction selection. A scaled index leaves the base of the
+ * address to the user.
+ */
+x86_operand_t x86_lower_selected(iloc_module_t *module, iloc_function_t *function, isel_choice_t *choices, uint64_t i, int p) {
+    iloc_instruction_t *code = function->code->instructions;
+    iloc_instruction_t *leaf = choices[i].leaves[p] < 0 ? NULL : &code[choices[i].leaves[p]];
+    switch (choices[i].kinds[p]) {
+        case isel_immediate:
+            return IMM(leaf->r1);
+        case isel_memory:
+            if (leaf->instruction == fload_i) {
+                return x86_operand_constant(leaf->r1);
+            }
+            return x86_lower_address(module, function, leaf->r1, leaf->r2);
+        case isel_scaled:
+            {
+                isel_choice_t *mult = &choices[choices[i].leaves[p]];
+                int scale = mult->kinds[0] == isel_immediate ? 0 : 1;
+                int64_t index = scale == 0 ? leaf->r2 : leaf->r1;
+                return x86_operand_indexed(x86_rax, (x86_register_t) index, code[mult->leaves[scale]].r1, 0);
+            }
+        default:
+            return REG(p == 0 ? code[i].r1 : code[i].r2);
+    }
+}
+
+#define is_register(operand, r) ((operand).type == operand_register && (operand).reg == (x86_register_t) (r))
+
+/*
+ * Lowers the three-address r3 = a <op> b into the two-address x86 form
+ */
+void x86_lower_binary(x86_program_t *program, x86_opcode_t opcode, int commutative, x86_operand_t a, x86_operand_t b, int64_t r3) {
+    int is_float = is_float_register(r3);
+    x86_register_t temp = is_float ? X86_FLOAT_TEMP : x86_rax;
+    if (commutative && a.type != operand_register) {
+        x86_operand_t swap = a;
+        a = b;
+        b = swap;
+    }
+    if (is_register(a, r3)) {
+        x86_push(program, opcode, b, REG(r3));
+    } else if (is_register(b, r3) && commutative) {
+        x86_push(program, opcode, a, REG(r3));
+    } else if (is_register(b, r3)) {
+        x86_lower_move(program, a, REG(temp), is_float);
+        x86_push(program, opcode, b, REG(temp));
+        x86_lower_move(program, REG(temp), REG(r3), is_float);
+    } else {
+        x86_lower_move(program, a, REG(r3), is_float);
+        x86_push(program, opcode, b, REG(r3));
+    }
+}
+
+/*
+ * Lowers an integer addition (or a subtraction of a constant) with leal when
+ * the result goes to a third register or the sum has a scaled index, and like
+ * any other binary operation otherwise
+ */
+void x86_lower_add(x86_program_t *program, x86_opcode_t opcode, x86_operand_t a, x86_operand_t b, int64_t r3) {
+    if (opcode == x86_addl && (a.type == operand_indexed || (a.type != operand_register && b.type == operand_register))) {
+        x86_operand_t swap = a;
+        a = b;
+        b = swap;
+    }
+    if (b.type == operand_indexed) {
+        b.reg = a.reg;
+        x86_push(program, x86_leal, b, REG(r3));
+        return;
+    }
+    if (optimization_level >= 1 && a.type == operand_register && !is_register(a, r3)) {
+        if (opcode == x86_addl && b.type == operand_register && !is_register(b, r3)) {
+            x86_push(program, x86_leal, x86_operand_indexed(a.reg, b.reg, 1, 0), REG(r3));
+            return;
+        }
+        if (b.type == operand_immediate && b.value != INT32_MIN) {
+            x86_push(program, x86_leal, x86_operand_memory(a.reg, opcode == x86_addl ? b.value : -b.value), REG(r3));
+            return;
+        }
+    }
+    x86_lower_binary(program, opcode, opcode == x86_addl, a, b, r3);
+}
+
+static x86_condition_t x86_swapped_condition(x86_condition_t condition) {
+    switch (condition) {
+        case x86_cond_l:
+            return x86_cond_g;
+        case x86_cond_le:
+            return x86_cond_ge;
+        case x86_cond_g:
+            return x86_cond_l;
+        case x86_cond_ge:
+            return x86_cond_le;
+        default:
+            return condition;
+    }
+}
+
+/*
+ * Returns the condition an integer comparison (cmp_*) tests
+ */
+x86_condition_t x86_compare_condition(iloc_instruction_type_t type) {
+    switch (type) {
+        case cmp_lt:
+            return x86_cond_l;
+        case cmp_le:
+            return x86_cond_le;
+        case cmp_ge:
+            return x86_cond_ge;
+        case cmp_gt:
+            return x86_cond_g;
+        case cmp_ne:
+            return x86_cond_ne;
+        case cmp_eq:
+        default:
+            return x86_cond_e;
+    }
+}
+
+/*
+ * Compares <a> with <b>, returning the condition of the flags that holds when
+ * <condition> does between them
+ */
+x86_condition_t x86_lower_cmpl(x86_program_t *program, x86_condition_t condition, x86_operand_t a, x86_operand_t b) {
+    if (a.type == operand_register || b.type == operand_immediate) {
+        x86_push(program, x86_cmpl, b, a);
+        return condition;
+    }
+    x86_push(program, x86_cmpl, a, b);
+    return x86_swapped_condition(condition);
+}
+
+void x86_lower_compare(x86_program_t *program, x86_condition_t condition, x86_operand_t a, x86_operand_t b, int64_t r3) {
+    condition = x86_lower_cmpl(program, condition, a, b);
+    x86_push_cc(program, x86_setcc, condition, REG(x86_rax));
+    x86_push(program, x86_movzbl, REG(x86_rax), REG(r3));
+}
+
+/*
+ * Compares two floats with ucomisd, which sets the flags like an unsigned
+ * comparison and raises PF when either is NaN. Only "above" conditions are
+ * false for NaN, so lt/le swap the operands and test for gt/ge, while eq and
+ * ne also look at PF.
+ */
+void x86_lower_float_compare(x86_program_t *program, iloc_instruction_type_t type, x86_operand_t a, x86_operand_t b, int64_t r3) {
+    switch (type) {
+        case fcmp_lt:
+        case fcmp_le:
+            x86_push(program, x86_ucomisd, a, b);
+            x86_push_cc(program, x86_setcc, type == fcmp_lt ? x86_cond_a : x86_cond_ae, REG(x86_rax));
+            break;
+        case fcmp_gt:
+        case fcmp_ge:
+            x86_push(program, x86_ucomisd, b, a);
+            x86_push_cc(program, x86_setcc, type == fcmp_gt ? x86_cond_a : x86_cond_ae, REG(x86_rax));
+            break;
+        default:
+            x86_push(program, x86_ucomisd, b, a);
+            x86_push_cc(program, x86_setcc, type == fcmp_eq ? x86_cond_e : x86_cond_ne, REG(x86_rax));
+            x86_push_cc(program, x86_setcc, type == fcmp_eq ? x86_cond_np : x86_cond_p, REG(x86_rdx));
+            x86_push(program, type == fcmp_eq ? x86_andb : x86_orb, REG(x86_rdx), REG(x86_rax));
+            break;
+    }
+    x86_push(program, x86_movzbl, REG(x86_rax), REG(r3));
+}
+
+/*
+ * Performs every move as if they happened at the same time: a move is only
+ * emitted once no other pending move reads its destination, and cycles are
+ * broken by copying one of the registers to rax (xmm13 for floats)
+ */
+void x86_lower_parallel_move(x86_program_t *program, x86_operand_t *sources, x86_operand_t *destinations, int *is_float, uint64_t count) {
+    int pending[count+1];
+    uint64_t remaining = count;
+    for (uint64_t m = 0; m < count; m++) {
+        pending[m] = 1;
+    }
+    while (remaining > 0) {
+        int progress = 0;
+        for (uint64_t m = 0; m < count; m++) {
+            if (!pending[m]) {
+                continue;
+            }
+            int blocked = 0;
+            if (destinations[m].type == operand_register) {
+                for (uint64_t k = 0; k < count && !blocked; k++) {
+                    blocked = k != m && pending[k] && sources[k].type == operand_register && sources[k].reg == destinations[m].reg;
+                }
+            }
+            if (!blocked) {
+                x86_lower_move(program, sources[m], destinations[m], is_float[m]);
+                pending[m] = 0;
+                remaining--;
+                progress = 1;
+            }
+        }
+        if (!progress) {
+            // Only cycles of registers are left
+            for (uint64_t m = 0; m < count; m++) {
+                if (pending[m]) {
+                    x86_register_t temp = is_float[m] ? X86_FLOAT_TEMP : x86_rax;
+                    x86_push(program, is_float[m] ? x86_movapd : x86_movl, destinations[m], REG(temp));
+                    for (uint64_t k = 0; k < count; k++) {
+                        if (pending[k] && sources[k].type == operand_register && sources[k].reg == destinations[m].reg) {
+                            sources[k] = REG(temp);
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Returns the operand of a param/getparam after register allocation
+ */
+x86_operand_t x86_lower_located(iloc_function_t *function, int64_t value, int64_t location, int is_float) {
+    switch (location) {
+        case iloc_operand_stack:
+            return x86_lower_frame_slot(function, -value);
+        case iloc_operand_constant:
+            return is_float ? x86_operand_constant(value) : IMM(value);
+        default:
+            return REG(value);
+    }
+}
+
+/*
+ * Returns where the ABI passes each argument: integers and floats take the
+ * registers of their class in order, and the rest go on the stack (the
+ * result is the register, or -1 - k for the k-th argument on the stack)
+ */
+void x86_lower_argument_locations(iloc_instruction_t *arguments, uint64_t count, int64_t *locations, int *is_float) {
+    uint64_t integers = 0, floats = 0, stack = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        is_float[i] = arguments[i].instruction == fgetparam || arguments[i].instruction == fparam;
+        if (is_float[i] && floats < REG_ALLOC_FLOAT_ARGUMENT_REGISTERS) {
+            locations[i] = reg_alloc_float_argument_register(floats++);
+        } else if (!is_float[i] && integers < REG_ALLOC_ARGUMENT_REGISTERS) {
+            locations[i] = reg_alloc_argument_register(integers++);
+        } else {
+            locations[i] = -1 - (int64_t) stack++;
+        }
+    }
+}
+
+/*
+ * Moves the incoming arguments (getparam) to the locations of the parameters
+ */
+void x86_lower_parameters(x86_program_t *program, iloc_function_t *function, iloc_instruction_t *parameters, uint64_t count) {
+    x86_operand_t sources[count+1];
+    x86_operand_t destinations[count+1];
+    int64_t locations[count+1];
+    int is_float[count+1];
+    x86_lower_argument_locations(parameters, count, locations, is_float);
+    for (uint64_t i = 0; i < count; i++) {
+        sources[i] = locations[i] >= 0
+            ? REG(locations[i])
+            : x86_lower_frame_slot(function, 16 + 8 * (-1 - locations[i]));
+        destinations[i] = x86_lower_located(function, parameters[i].r2, parameters[i].r3, is_float[i]);
+    }
+    // An unused parameter may share its register with a later one, whose
+    // value is the one that survives the getparam sequence
+    uint64_t kept = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        int overwritten = 0;
+        for (uint64_t k = i+1; k < count && destinations[i].type == operand_register; k++) {
+            if (destinations[k].type == operand_register && destinations[k].reg == destinations[i].reg) {
+                overwritten = 1;
+            }
+        }
+        if (!overwritten) {
+            sources[kept] = sources[i];
+            destinations[kept] = destinations[i];
+            is_float[kept] = is_float[i];
+            kept++;
+        }
+    }
+    x86_lower_parallel_move(program, sources, destinations, is_float, kept);
+}
+
+/*
+ * Restores the callee-saved registers and the frame of the caller
+ */
+void x86_lower_teardown(x86_program_t *program, iloc_function_t *function) {
+    uint64_t reserved = x86_reserved_size(function);
+    if (function->frameless && reserved != 0) {
+        x86_push(program, x86_addq, IMM(reserved), REG(x86_rsp));
+    }
+    if (!function->shrink_wrapped || function->registers_saved) {
+        x86_lower_saves(program, function, 1);
+    }
+    if (!function->frameless) {
+        x86_push(program, x86_leave, NONE, NONE);
+    }
+}
+
+void x86_lower_epilogue(x86_program_t *program, iloc_function_t *function) {
+    x86_lower_teardown(program, function);
+    x86_push(program, x86_ret, NONE, NONE);
+}
+
+/*
+ * Passes the arguments (param) and calls the function: the first ones go in
+ * registers, the others are pushed in reverse order, keeping rsp aligned to
+ * 16 bytes at the call. A tailcall (whose arguments are all in registers)
+ * tears the frame down and jumps to the callee instead.
+ */
+void x86_lower_call(x86_program_t *program, iloc_module_t *module, iloc_function_t *function, iloc_instruction_t *arguments, uint64_t count, iloc_instruction_t *instruction) {
+    iloc_function_t *callee = iloc_module_find_function(module, instruction->r1);
+    if (callee == NULL) {
+        fprintf(stderr, "ERROR: Call to an undefined function L%ld\n", instruction->r1);
+        exit(EXIT_FAILURE);
+    }
+    int64_t locations[count+1];
+    int is_float[count+1];
+    x86_lower_argument_locations(arguments, count, locations, is_float);
+    uint64_t stack_count = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        stack_count += locations[i] < 0;
+    }
+    uint64_t padding = stack_count % 2 == 1 ? 8 : 0;
+    if (padding != 0) {
+        x86_push(program, x86_subq, IMM(padding), REG(x86_rsp));
+    }
+    // Pushes only read their operands, so they go before the register moves
+    for (uint64_t i = count; i-- > 0;) {
+        if (locations[i] >= 0) {
+            continue;
+        }
+        x86_operand_t operand = x86_lower_located(function, arguments[i].r1, arguments[i].r3, is_float[i]);
+        if (is_float[i] && operand.type == operand_register) {
+            x86_push(program, x86_subq, IMM(8), REG(x86_rsp));
+            x86_push(program, x86_movsd, operand, x86_operand_memory(x86_rsp, 0));
+        } else {
+            x86_push(program, x86_pushq, operand, NONE);
+        }
+    }
+    uint64_t register_count = 0;
+    x86_operand_t sources[count+1];
+    x86_operand_t destinations[count+1];
+    int register_is_float[count+1];
+    for (uint64_t i = 0; i < count; i++) {
+        if (locations[i] < 0) {
+            continue;
+        }
+        sources[register_count] = x86_lower_located(function, arguments[i].r1, arguments[i].r3, is_float[i]);
+        destinations[register_count] = REG(locations[i]);
+        register_is_float[register_count] = is_float[i];
+        register_count++;
+    }
+    x86_lower_parallel_move(program, sources, destinations, register_is_float, register_count);
+    if (instruction->instruction == tailcall) {
+        x86_lower_teardown(program, function);
+        x86_push(program, x86_tailcall, x86_operand_function(callee->name), NONE);
+        return;
+    }
+    x86_push(program, x86_call, x86_operand_function(callee->name), NONE);
+    if (stack_count != 0) {
+        x86_push(program, x86_addq, IMM(stack_count * 8 + padding), REG(x86_rsp));
+    }
+    if (callee->type == type_float) {
+        x86_push(program, x86_movapd, REG(x86_xmm0), REG(instruction->r3));
+    } else {
+        x86_push(program, x86_movl, REG(x86_rax), REG(instruction->r3));
+    }
+}
+
+/*
+ * Lowers an instruction whose r1 and r2 are read as the operands <a> and <b>
+ */
+void x86_lower_instruction(x86_program_t *program, iloc_module_t *module, iloc_function_t *function, iloc_instruction_t *instruction, x86_operand_t a, x86_operand_t b) {
+    int64_t r1 = instruction->r1;
+    int64_t r2 = instruction->r2;
+    int64_t r3 = instruction->r3;
+    switch (instruction->instruction) {
+        case add:
+            x86_lower_add(program, x86_addl, a, b, r3);
+            break;
+        case sub:
+            x86_lower_add(program, x86_subl, a, b, r3);
+            break;
+        case mult:
+            x86_lower_binary(program, x86_imull, 1, a, b, r3);
+            break;
+        case _div:
+        case mod:
+            x86_lower_move(program, a, REG(x86_rax), 0);
+            x86_push(program, x86_cltd, NONE, NONE);
+            x86_push(program, x86_idivl, b, NONE);
+            x86_push(program, x86_movl, REG(instruction->instruction == mod ? x86_rdx : x86_rax), REG(r3));
+            break;
+        case rsub_i:
+            if (r2 == 0) {
+                if (r1 != r3) {
+                    x86_push(program, x86_movl, REG(r1), REG(r3));
+                }
+                x86_push(program, x86_negl, REG(r3), NONE);
+            } else {
+                x86_push(program, x86_movl, IMM(r2), REG(x86_rax));
+                x86_push(program, x86_subl, REG(r1), REG(x86_rax));
+                x86_push(program, x86_movl, REG(x86_rax), REG(r3));
+            }
+            break;
+        case load_ai_r:
+            x86_push(program, x86_movl, x86_lower_address(module, function, r1, r2), REG(r3));
+            break;
+        case load_i:
+            x86_push(program, x86_movl, IMM(r1), REG(r2));
+            break;
+        case store_ai_r:
+            x86_push(program, x86_movl, a, x86_lower_address(module, function, r2, r3));
+            break;
+        case load_ax:
+            x86_push(program, x86_movl, x86_lower_indexed(program, module, r1, r2), REG(r3));
+            break;
+        case store_ax:
+            x86_push(program, x86_movl, a, x86_lower_indexed(program, module, r2, r3));
+            break;
+        case i2i:
+            x86_lower_move(program, a, REG(r2), 0);
+            break;
+        case cmp_lt:
+        case cmp_le:
+        case cmp_eq:
+        case cmp_ge:
+        case cmp_gt:
+        case cmp_ne:
+            x86_lower_compare(program, x86_compare_condition(instruction->instruction), a, b, r3);
+            break;
+        case cbr:
+            x86_push(program, x86_testl, REG(r1), REG(r1));
+            x86_push_cc(program, x86_jcc, x86_cond_ne, x86_operand_label(r2));
+            x86_push(program, x86_jmp, x86_operand_label(r3), NONE);
+            break;
+        case jump_i:
+            x86_push(program, x86_jmp, x86_operand_label(r1), NONE);
+            break;
+        case label:
+            x86_push(program, x86_label, x86_operand_label(r1), NONE);
+            break;
+        case push:
+            x86_push(program, x86_pushq, REG(r1), NONE);
+            break;
+        case pop:
+            x86_push(program, x86_popq, REG(r1), NONE);
+            break;
+        case ret:
+            x86_lower_move(program, a, REG(is_float_register(r1) ? x86_xmm0 : x86_rax), is_float_register(r1));
+            x86_lower_epilogue(program, function);
+            break;
+        case fadd:
+            x86_lower_binary(program, x86_addsd, 1, a, b, r3);
+            break;
+        case fsub:
+            x86_lower_binary(program, x86_subsd, 0, a, b, r3);
+            break;
+        case fmult:
+            x86_lower_binary(program, x86_mulsd, 1, a, b, r3);
+            break;
+        case fdiv:
+            x86_lower_binary(program, x86_divsd, 0, a, b, r3);
+            break;
+        case fload_i:
+            x86_push(program, x86_movsd, x86_operand_constant(r1), REG(r2));
+            break;
+        case fload_ai_r:
+            x86_push(program, x86_movsd, x86_lower_address(module, function, r1, r2), REG(r3));
+            break;
+        case fstore_ai_r:
+            x86_push(program, x86_movsd, REG(r1), x86_lower_address(module, function, r2, r3));
+            break;
+        case f2f:
+            x86_lower_move(program, a, REG(r2), 1);
+            break;
+        case i2f:
+            x86_push(program, x86_cvtsi2sdl, a, REG(r2));
+            break;
+        case f2i:
+            x86_push(program, x86_cvttsd2si, REG(r1), REG(r2));
+            break;
+        case fcmp_lt:
+        case fcmp_le:
+        case fcmp_eq:
+        case fcmp_ge:
+        case fcmp_gt:
+        case fcmp_ne:
+            x86_lower_float_compare(program, instruction->instruction, a, b, r3);
+            break;
+        case jump:
+        default:
+            fprintf(stderr, "Instruction %d error #4\n", instruction->instruction);
+            exit(EXIT_FAILURE);
+            break;
+    }
+}
+
+x86_program_t x86_lower_function(iloc_module_t *module, iloc_function_t *function) {
+    x86_program_t program;
+    nlist_init(x86_instruction_t, program);
+
+    // Leaf functions need no frame pointer, since rsp does not move in their body
+    iloc_instruction_t *code = function->code->instructions;
+    function->frameless = optimization_level >= 1;
+    for (uint64_t i = 0; i < function->code->length; i++) {
+        iloc_instruction_type_t type = code[i].instruction;
+        if (type == call || type == tailcall || type == push || type == pop) {
+            function->frameless = 0;
+        }
+    }
+
+    // Functions with a frame may save the callee-saved registers later
+    iloc_cfg_t cfg = iloc_cfg_build(function->code);
+    int64_t *idom = iloc_cfg_dominators(&cfg);
+    uint64_t save_block = 0;
+    if (!function->frameless && function->callee_saved != 0 && optimization_level >= 1) {
+        save_block = x86_save_block(function, &cfg, idom);
+    }
+    function->shrink_wrapped = save_block != 0;
+    function->registers_saved = 0;
+
+    // Prologue
+    uint64_t reserved = x86_reserved_size(function);
+    x86_push(&program, x86_endbr64, NONE, NONE);
+    if (function->frameless) {
+        x86_lower_saves(&program, function, 0);
+        if (reserved != 0) {
+            x86_push(&program, x86_subq, IMM(reserved), REG(x86_rsp));
+        }
+    } else {
+        x86_push(&program, x86_pushq, REG(x86_rbp), NONE);
+        x86_push(&program, x86_movq, REG(x86_rsp), REG(x86_rbp));
+        if (reserved != 0) {
+            x86_push(&program, x86_subq, IMM(reserved), REG(x86_rsp));
+        }
+        // Shrink-wrapped functions push them once the save block is reached,
+        // which leaves rsp aligned for the calls that follow it
+        if (!function->shrink_wrapped) {
+            x86_lower_saves(&program, function, 0);
+        }
+    }
+
+    // Body
+    isel_choice_t *choices = isel_select(function);
+    int *saved_in = (int*) calloc(cfg.blocks.length+1, sizeof(int));
+    if (saved_in == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for int* (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    for (uint64_t b = 0; b < cfg.blocks.length && function->shrink_wrapped; b++) {
+        saved_in[b] = iloc_cfg_dominates(idom, save_block, b);
+    }
+    for (uint64_t i = 0; i < function->code->length; i++) {
+        function->registers_saved = saved_in[cfg.block_of[i]];
+        if (function->shrink_wrapped && i == nlist_get_unsafe(cfg.blocks, save_block).start) {
+            // The saves go after the label, since jumps to the block skip it otherwise
+            if (code[i].instruction == label) {
+                x86_lower_instruction(&program, module, function, &code[i], NONE, NONE);
+                x86_lower_saves(&program, function, 0);
+                continue;
+            }
+            x86_lower_saves(&program, function, 0);
+        }
+        if (code[i].instruction == getparam || code[i].instruction == fgetparam) {
+            uint64_t first = i;
+            while (i+1 < function->code->length && (code[i+1].instruction == getparam || code[i+1].instruction == fgetparam)) {
+                i++;
+            }
+            x86_lower_parameters(&program, function, &code[first], i - first + 1);
+        } else if (code[i].instruction == param || code[i].instruction == fparam || code[i].instruction == call || code[i].instruction == tailcall) {
+            uint64_t first = i;
+            while (code[i].instruction == param || code[i].instruction == fparam) {
+                i++;
+            }
+            x86_lower_call(&program, module, function, &code[first], i - first, &code[i]);
+        } else if (choices[i].fused) {
+            // The cbr after the comparison branches on its flags
+            x86_operand_t a = x86_lower_selected(module, function, choices, i, 0);
+            x86_operand_t b = x86_lower_selected(module, function, choices, i, 1);
+            x86_condition_t condition = x86_lower_cmpl(&program, x86_compare_condition(code[i].instruction), a, b);
+            i++;
+            x86_push_cc(&program, x86_jcc, condition, x86_operand_label(code[i].r2));
+            x86_push(&program, x86_jmp, x86_operand_label(code[i].r3), NONE);
+        } else if (!choices[i].folded) {
+            x86_operand_t a = x86_lower_selected(module, function, choices, i, 0);
+            x86_operand_t b = x86_lower_selected(module, function, choices, i, 1);
+            x86_lower_instruction(&program, module, function, &code[i], a, b);
+        }
+    }
+    free(choices);
+    free(saved_in);
+    free(idom);
+    iloc_cfg_free(&cfg);
+    return program;
+}
+
+x86_module_t *x86_module_new(iloc_module_t *module) {
+    x86_module_t *x86_module = (x86_module_t*) malloc(sizeof(x86_module_t));
+    if (x86_module == NULL) {
+        fprintf(stderr, "ERROR: Failed to allocate memory for x86_module_t (errno = %d) [at file \"" __FILE__ "\", line %d]\n", errno, __LINE__-2);
+        exit(EXIT_FAILURE);
+    }
+    x86_module->source = module;
+    nlist_init(x86_function_t, x86_module->functions);
+    x86_module->fini = NULL;
+    return x86_module;
+}
+
+x86_module_t *x86_module_lower(iloc_module_t *module) {
+    x86_module_t *x86_module = x86_module_new(module);
+    for (size_t i = 0; i < module->functions.length; i++) {
+        iloc_function_t *function = nlist_get_unsafe(module->functions, i);
+        x86_function_t x86_function;
+        x86_function.name = function->name;
+        x86_function.code = x86_lower_function(module, function);
+        nlist_insert(x86_function_t, x86_module->functions, x86_function);
+    }
+    return x86_module;
+}
+
+/**********\
+ * Printing *
+ \**********/
+const char *x86_register_to_string(x86_register_t reg, uint64_t size) {
+    switch (size) {
+        case 1:
+            return register_names_8[reg];
+        case 8:
+            return register_names_64[reg];
+        default:
+            return register_names_32[reg];
+    }
+}
+
+void x86_operand_to_string(FILE *file, x86_operand_t *operand, uint64_t size) {
+    switch (operand->type) {
+        case operand_none:
+            break;
+        case operand_register:
+            fprintf(file, "%%%s", x86_register_to_string(operand->reg, size));
+            break;
+        case operand_immediate:
+            fprintf(file, "$%ld", operand->value);
+            break;
+        case operand_memory:
+            fprintf(file, "%ld(%%%s)", operand->value, x86_register_to_string(operand->reg, 8));
+            break;
+        case operand_symbol:
+            fprintf(file, "%s(%%rip)", operand->symbol);
+            break;
+        case operand_label:
+            fprintf(file, "L%ld", operand->value);
+            break;
+        case operand_function:
+            fprintf(file, "%s", operand->symbol);
+            break;
+        case operand_constant:
+            fprintf(file, ".LC%ld(%%rip)", operand->value);
+            break;
+        case operand_data:
+            fprintf(file, ".LD+%ld(%%rip)", operand->value);
+            break;
+        case operand_indexed:
+            fprintf(file, "%ld(%%%s,%%%s", operand->value, x86_register_to_string(operand->reg, 8), x86_register_to_string(operand->index, 8));
+            if (operand->scale != 1) {
+                fprintf(file, ",%ld", operand->scale);
+            }
+            fprintf(file, ")");
+            break;
+    }
+}
+
+void x86_instruction_to_string(FILE *file, x86_instruction_t *instruction) {
+    const x86_opcode_info_t *info = &opcode_info[instruction->opcode];
+    switch (instruction->opcode) {
+        case x86_label:
+            fprintf(file, "L%ld:\n", instruction->src.value);
+            return;
+        case x86_nop:
+            return;
+        case x86_align:
+            fprintf(file, "%s %ld,,%ld\n", info->mnemonic, instruction->src.value, instruction->dst.value);
+            return;
+        case x86_cold:
+            fprintf(file, ".section .text.unlikely,\"ax\",@progbits\n");
+            return;
+        case x86_jcc:
+        case x86_setcc:
+            fprintf(file, "%s%s ", info->mnemonic, condition_names[instruction->condition]);
+            x86_operand_to_string(file, &instruction->src, info->src_size);
+            fprintf(file, "\n");
+            return;
+        default:
+            break;
+    }
+    fprintf(file, "%s", info->mnemonic);
+    if (instruction->src.type != operand_none) {
+        fprintf(file, " ");
+        x86_operand_to_string(file, &instruction->src, info->src_size);
+    }
+    if (instruction->dst.type != operand_none) {
+        fprintf(file, ", ");
+        x86_operand_to_string(file, &instruction->dst, info->dst_size);
+    }
+    fprintf(file, "\n");
+}
+
+void x86_program_to_string(FILE *file, x86_program_t *program) {
+    for (size_t i = 0; i < program->length; i++) {
+        x86_instruction_to_string(file, &program->items[i]);
+    }
+}
+
+void x86_module_to_string(FILE *file, x86_module_t *module) {
+    fprintf(file, ".text\n");
+    for (size_t i = 0; i < module->source->globals.length; i++) {
+        iloc_global_t *global = &nlist_get_unsafe(module->source->globals, i);
+        if (!global->local) {
+            fprintf(file, ".globl %s\n", global->name);
+        }
+        fprintf(file, ".bss\n");
+        fprintf(file, ".align %ld\n", global->alignment);
+        fprintf(file, ".type %s, @object\n", global->name);
+        fprintf(file, ".size %s, %ld\n", global->name, global->size);
+        fprintf(file, "%s:\n", global->name);
+        fprintf(file, ".zero %ld\n", global->size);
+    }
+    if (module->source->constants.length > 0 || module->source->data.length > 0) {
+        fprintf(file, ".section .rodata\n");
+        fprintf(file, ".align 8\n");
+        for (size_t i = 0; i < module->source->constants.length; i++) {
+            uint64_t bits;
+            memcpy(&bits, &nlist_get_unsafe(module->source->constants, i), sizeof(uint64_t));
+            fprintf(file, ".LC%ld:\n", i);
+            fprintf(file, ".quad %lu\n", bits);
+        }
+    }
+    // The other bytes follow the constants (which keep them aligned to 8)
+    if (module->source->data.length > 0) {
+        fprintf(file, ".LD:\n");
+        for (size_t i = 0; i < module->source->data.length; i++) {
+            fprintf(file, i % 16 == 0 ? ".byte %u" : ",%u", nlist_get_unsafe(module->source->data, i));
+            if (i % 16 == 15 || i + 1 == module->source->data.length) {
+                fprintf(file, "\n");
+            }
+        }
+    }
+    fprintf(file, ".text\n");
+    for (size_t i = 0; i < module->functions.length; i++) {
+        x86_function_t *function = &nlist_get_unsafe(module->functions, i);
+        fprintf(file, ".globl %s\n", function->name);
+        fprintf(file, ".type %s, @function\n", function->name);
+        fprintf(file, "%s:\n", function->name);
+        x86_program_to_string(file, &function->code);
+        for (size_t j = 0; j < function->code.length; j++) {
+            if (function->code.items[j].opcode == x86_cold) {
+                fprintf(file, ".text\n");
+                break;
+            }
+        }
+    }
+    if (module->fini != NULL) {
+        fprintf(file, ".section .fini_array,\"aw\"\n");
+        fprintf(file, ".align 8\n");
+        fprintf(file, ".quad %s\n", module->fini);
+    }
+    fprintf(file, ".section .note.GNU-stack,\"\",@progbits\n");
+}
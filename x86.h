@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "list.h"
+#include "structs.h"
+
+/*********************\
+* x86 Code Generation *
+\*********************/
+typedef struct {
+    char *name;
+    x86_program_t code;
+} x86_function_t;
+
+typedef struct {
+    iloc_module_t *source;
+    nlist_definition(x86_function_t) functions;
+    char *fini; // Function run at exit, after main returns (NULL if none)
+} x86_module_t;
+
+/*
+ * Operand constructors
+ */
+x86_operand_t x86_operand_register(x86_register_t reg);
+x86_operand_t x86_operand_immediate(int64_t value);
+x86_operand_t x86_operand_memory(x86_register_t base, int64_t displacement);
+x86_operand_t x86_operand_indexed(x86_register_t base, x86_register_t index, uint64_t scale, int64_t displacement);
+x86_operand_t x86_operand_symbol(char *symbol);
+x86_operand_t x86_operand_label(uint64_t label);
+x86_operand_t x86_operand_function(char *symbol);
+x86_operand_t x86_operand_constant(uint64_t index);
+x86_operand_t x86_operand_data(uint64_t offset);
+x86_operand_t x86_operand_none();
+
+/*
+ * This function inserts an instruction into the end of the program
+ */
+void x86_push(x86_program_t *program, x86_opcode_t opcode, x86_operand_t src, x86_operand_t dst);
+
+/*
+ * This function inserts a conditional instruction (jcc, setcc) into the end
+ * of the program
+ */
+void x86_push_cc(x86_program_t *program, x86_opcode_t opcode, x86_condition_t condition, x86_operand_t operand);
+
+/*
+ * This function translates a function whose instructions were already
+ * rewritten to physical registers by the register allocator
+ */
+x86_program_t x86_lower_function(iloc_module_t *module, iloc_function_t *function);
+
+/*
+ * This function creates a module with no functions yet, whose data comes from
+ * the module <module>
+ */
+x86_module_t *x86_module_new(iloc_module_t *module);
+
+/*
+ * This function translates every function of the module
+ */
+x86_module_t *x86_module_lower(iloc_module_t *module);
+
+/*
+ * This function returns the name of a register for an access of <size> bytes
+ */
+const char *x86_register_to_string(x86_register_t reg, uint64_t size);
+
+/*
+ * This function writes an instruction in GAS (AT&T) syntax
+ */
+void x86_instruction_to_string(FILE *file, x86_instruction_t *instruction);
+
+/*
+ * This function writes every instruction of the program
+ */
+void x86_program_to_string(FILE *file, x86_program_t *program);
+
+/*
+ * This function writes the whole assembly file of the module
+ */
+void x86_module_to_string(FILE *file, x86_module_t *module);